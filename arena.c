@@ -0,0 +1,107 @@
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// All allocations are aligned to this many bytes
+#define ARENA_ALIGNMENT 16
+
+// Add a chunk able to hold at least min_size bytes
+static ArenaChunk* arena_add_chunk(Arena *arena, size_t min_size) {
+    size_t size = arena->chunk_size;
+    if (min_size > size) size = min_size;
+
+    ArenaChunk *chunk = (ArenaChunk*)malloc(sizeof(ArenaChunk) + size);
+    if (!chunk) return NULL;
+
+    chunk->size = size;
+    chunk->used = 0;
+    arena->bytes_reserved += size;
+
+    // Oversized chunks go behind the current one so it keeps filling up
+    if (arena->chunks && size > arena->chunk_size) {
+        chunk->next = arena->chunks->next;
+        arena->chunks->next = chunk;
+    } else {
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    }
+
+    return chunk;
+}
+
+// Create an arena that grows in chunks of chunk_size bytes
+Arena* arena_create(size_t chunk_size) {
+    Arena *arena = (Arena*)malloc(sizeof(Arena));
+    if (!arena) return NULL;
+
+    arena->chunks = NULL;
+    arena->chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK_SIZE;
+    arena->bytes_used = 0;
+    arena->bytes_reserved = 0;
+
+    return arena;
+}
+
+// Free the arena and everything allocated from it
+void arena_destroy(Arena *arena) {
+    if (!arena) return;
+
+    ArenaChunk *chunk = arena->chunks;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    free(arena);
+}
+
+// Drop all allocations but keep the most recent chunk for reuse
+void arena_reset(Arena *arena) {
+    if (!arena || !arena->chunks) return;
+
+    ArenaChunk *chunk = arena->chunks->next;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        arena->bytes_reserved -= chunk->size;
+        free(chunk);
+        chunk = next;
+    }
+
+    arena->chunks->next = NULL;
+    arena->chunks->used = 0;
+    arena->bytes_used = 0;
+}
+
+// Allocate size bytes; the memory is not zeroed
+void* arena_alloc(Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+    ArenaChunk *chunk = arena->chunks;
+    if (!chunk || chunk->size - chunk->used < size) {
+        chunk = arena_add_chunk(arena, size);
+        if (!chunk) return NULL;
+    }
+
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    arena->bytes_used += size;
+
+    return ptr;
+}
+
+// Copy a byte range into the arena as a NUL-terminated string
+char* arena_strndup(Arena *arena, const char *str, size_t length) {
+    char *copy = (char*)arena_alloc(arena, length + 1);
+    if (!copy) return NULL;
+
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+// Copy a string into the arena
+char* arena_strdup(Arena *arena, const char *str) {
+    return arena_strndup(arena, str, strlen(str));
+}
@@ -0,0 +1,34 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "common.h"
+
+// Default chunk size for compilation arenas
+#define ARENA_DEFAULT_CHUNK_SIZE (1 << 20)
+
+// Arena chunk; allocations are carved out of data front to back
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t used;
+    size_t size;
+    _Alignas(16) char data[];
+} ArenaChunk;
+
+// Bump allocator: memory is only released all at once by arena_destroy
+// or arena_reset, and allocations never move
+typedef struct {
+    ArenaChunk *chunks;   // Most recent chunk first
+    size_t chunk_size;
+    size_t bytes_used;    // Bytes handed out (including alignment padding)
+    size_t bytes_reserved; // Bytes obtained from malloc for chunks
+} Arena;
+
+// Arena functions
+Arena* arena_create(size_t chunk_size);
+void arena_destroy(Arena *arena);
+void arena_reset(Arena *arena);
+void* arena_alloc(Arena *arena, size_t size);
+char* arena_strdup(Arena *arena, const char *str);
+char* arena_strndup(Arena *arena, const char *str, size_t length);
+
+#endif // ARENA_H
@@ -1,68 +1,201 @@
 #include "ast.h"
+#include "stats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Arena for nodes created on this thread (NULL: use malloc)
+static _Thread_local Arena *current_arena = NULL;
+
+// Direct node allocation on this thread to an arena (NULL restores malloc)
+void ast_set_arena(Arena *arena) {
+    current_arena = arena;
+}
+
+// Get the arena nodes are currently allocated from
+Arena* ast_get_arena(void) {
+    return current_arena;
+}
+
+// Allocate node memory from the current arena or the heap
+static void* ast_alloc(size_t size) {
+    return current_arena ? arena_alloc(current_arena, size) : stats_malloc(size);
+}
+
+// Copy a string into node memory
+static char* ast_strdup(const char *str) {
+    return current_arena ? arena_strdup(current_arena, str) : stats_strdup(str);
+}
+
 // Create a new AST node
 ASTNode* ast_create_node(NodeType type, const char *value) {
-    ASTNode *node = (ASTNode*)malloc(sizeof(ASTNode));
+    ASTNode *node = (ASTNode*)ast_alloc(sizeof(ASTNode));
     if (!node) return NULL;
     
     node->type = type;
-    node->value = value ? strdup(value) : NULL;
+    node->value = value ? ast_strdup(value) : NULL;
     node->children = NULL;
     node->num_children = 0;
     node->capacity = 0;
+    node->in_arena = current_arena != NULL;
+    node->symbol = -1;
     
     return node;
 }
 
-// Add a child node to a parent node
+// Add a child node to a parent node. Only the pointer is stored, so the
+// child stays where it is and references to it remain valid.
 void ast_add_child(ASTNode *parent, ASTNode *child) {
     if (!parent || !child) return;
     
     // Initialize or expand children array if needed
-    if (!parent->children) {
-        parent->capacity = 4;  // Initial capacity
-        parent->children = (ASTNode*)malloc(sizeof(ASTNode) * parent->capacity);
-        if (!parent->children) return;
-    } else if (parent->num_children >= parent->capacity) {
-        parent->capacity *= 2;
-        ASTNode *new_children = (ASTNode*)realloc(parent->children, 
-                                                 sizeof(ASTNode) * parent->capacity);
-        if (!new_children) return;
+    if (parent->num_children >= parent->capacity) {
+        int capacity = parent->capacity ? parent->capacity * 2 : 4;
+        ASTNode **new_children;
+        
+        if (parent->in_arena) {
+            // Arena arrays cannot grow in place; the old one is simply abandoned
+            new_children = (ASTNode**)arena_alloc(current_arena, sizeof(ASTNode*) * capacity);
+            if (!new_children) return;
+            if (parent->num_children > 0) {
+                memcpy(new_children, parent->children, sizeof(ASTNode*) * parent->num_children);
+            }
+        } else {
+            new_children = (ASTNode**)stats_realloc(parent->children, sizeof(ASTNode*) * capacity);
+            if (!new_children) return;
+        }
+        
         parent->children = new_children;
+        parent->capacity = capacity;
     }
     
     // Add the child
-    parent->children[parent->num_children++] = *child;
-    
-    // We've copied the child, so free the original pointer
-    // but not its contents (which are now owned by the parent)
-    free(child);
+    parent->children[parent->num_children++] = child;
 }
 
-// Free an AST node and all its children
-void ast_free_node(ASTNode *node) {
-    if (!node) return;
-    
-    // Free value
-    if (node->value) {
-        free(node->value);
+// Frames kept on the C stack before the walker moves to the heap
+#define AST_WALK_INLINE_DEPTH 64
+
+// Set up the frame for a node about to be entered
+static void init_frame(ASTWalkFrame *frame, ASTNode *node, ASTWalkFrame *parent, int index) {
+    frame->node = node;
+    frame->parent = parent;
+    frame->index = index;
+    frame->depth = parent ? parent->depth + 1 : 0;
+    frame->next = 0;
+    frame->order = NULL;
+    frame->order_count = 0;
+    frame->reverse = false;
+    memset(frame->slots, 0, sizeof(frame->slots));
+}
+
+// Run the enter callback; a skipped node has no children left to visit
+static void enter_frame(ASTWalkFrame *frame, const ASTVisitor *visitor, void *ctx) {
+    if (visitor->enter && visitor->enter(frame, ctx) == AST_WALK_SKIP) {
+        frame->order = NULL;
+        frame->next = frame->node->num_children;
     }
-    
-    // Free children
-    if (node->children) {
-        for (int i = 0; i < node->num_children; i++) {
-            ast_free_node(&node->children[i]);
+}
+
+// Walk the tree depth-first with an explicit stack of frames
+bool ast_walk(ASTNode *root, const ASTVisitor *visitor, void *ctx) {
+    if (!root) return true;
+    
+    ASTWalkFrame inline_frames[AST_WALK_INLINE_DEPTH];
+    ASTWalkFrame *frames = inline_frames;
+    int capacity = AST_WALK_INLINE_DEPTH;
+    int top = 0;
+    bool ok = true;
+    
+    init_frame(&frames[0], root, NULL, 0);
+    enter_frame(&frames[0], visitor, ctx);
+    
+    while (top >= 0) {
+        ASTWalkFrame *frame = &frames[top];
+        ASTNode *node = frame->node;
+        int count = frame->order ? frame->order_count : node->num_children;
+        
+        if (frame->next >= count) {
+            // All children done
+            if (visitor->leave) visitor->leave(frame, ctx);
+            top--;
+            continue;
+        }
+        
+        // Pick the next child
+        int position = frame->next++;
+        int index = frame->order ? frame->order[position]
+                  : frame->reverse ? count - 1 - position
+                  : position;
+        if (index >= node->num_children || !node->children[index]) {
+            continue;
         }
-        free(node->children);
+        
+        if (visitor->child) visitor->child(frame, index, ctx);
+        
+        // Grow the stack (moving off the C stack the first time)
+        if (top + 1 >= capacity) {
+            int new_capacity = capacity * 2;
+            ASTWalkFrame *new_frames;
+            
+            if (frames == inline_frames) {
+                new_frames = (ASTWalkFrame*)stats_malloc(sizeof(ASTWalkFrame) * new_capacity);
+                if (new_frames) memcpy(new_frames, frames, sizeof(ASTWalkFrame) * capacity);
+            } else {
+                new_frames = (ASTWalkFrame*)stats_realloc(frames, sizeof(ASTWalkFrame) * new_capacity);
+            }
+            
+            if (!new_frames) {
+                ok = false;
+                break;
+            }
+            
+            // Parents are always the frame below, so relink after moving
+            frames = new_frames;
+            capacity = new_capacity;
+            for (int i = 1; i <= top; i++) {
+                frames[i].parent = &frames[i - 1];
+            }
+            frame = &frames[top];
+        }
+        
+        ASTWalkFrame *child = &frames[++top];
+        init_frame(child, node->children[index], frame, index);
+        enter_frame(child, visitor, ctx);
     }
     
-    // Free the node itself
+    if (frames != inline_frames) {
+        free(frames);
+    }
+    return ok;
+}
+
+// Don't descend into arena nodes; nothing below them is freed here
+static ASTWalkAction free_enter(ASTWalkFrame *frame, void *ctx) {
+    (void)ctx;
+    return frame->node->in_arena ? AST_WALK_SKIP : AST_WALK_CHILDREN;
+}
+
+// Free a node once all its children are gone
+static void free_leave(ASTWalkFrame *frame, void *ctx) {
+    (void)ctx;
+    ASTNode *node = frame->node;
+    if (node->in_arena) return;
+    
+    free(node->value);
+    free(node->children);
     free(node);
 }
 
+// Free an AST node and all its children. Arena nodes are left alone;
+// they are released with their arena.
+void ast_free_node(ASTNode *node) {
+    if (!node || node->in_arena) return;
+    
+    static const ASTVisitor visitor = { free_enter, NULL, free_leave };
+    ast_walk(node, &visitor, NULL);
+}
+
 // Get string representation of node type
 static const char* get_node_type_str(NodeType type) {
     switch (type) {
@@ -85,162 +218,199 @@ static const char* get_node_type_str(NodeType type) {
     }
 }
 
-// Forward declaration of helper function
-static void print_ast(FILE *file, ASTNode *node, int depth);
+// Print a node on its own indented line
+static ASTWalkAction print_enter(ASTWalkFrame *frame, void *ctx) {
+    OutBuf *out = (OutBuf*)ctx;
+    ASTNode *node = frame->node;
+    
+    outbuf_indent(out, frame->depth);
+    outbuf_puts(out, get_node_type_str(node->type));
+    if (node->value) {
+        outbuf_puts(out, " (");
+        outbuf_puts(out, node->value);
+        outbuf_putc(out, ')');
+    }
+    outbuf_putc(out, '\n');
+    
+    return AST_WALK_CHILDREN;
+}
+
+// Write AST as indented text
+bool ast_write_text(ASTNode *root, OutBuf *out) {
+    static const ASTVisitor visitor = { print_enter, NULL, NULL };
+    return ast_walk(root, &visitor, out);
+}
 
 // Save AST to a text file
 bool ast_save_to_file(ASTNode *root, const char *filename) {
-    FILE *file = fopen(filename, "w");
-    if (!file) return false;
+    OutBuf *out = outbuf_open(filename);
+    if (!out) return false;
     
-    print_ast(file, root, 0);
-    
-    fclose(file);
-    return true;
+    bool ok = ast_write_text(root, out);
+    return outbuf_close(out) && ok;
 }
 
-// Helper function to print the AST recursively
-static void print_ast(FILE *file, ASTNode *node, int depth) {
-    if (!node) return;
-    
-    // Print indentation
-    for (int i = 0; i < depth; i++) {
-        fprintf(file, "  ");
-    }
+// State for DOT output
+typedef struct {
+    OutBuf *out;
+    int node_counter;
+} DotWalk;
+
+// Write a node and the edge from its parent; slots[0] holds the node ID
+static ASTWalkAction dot_enter(ASTWalkFrame *frame, void *ctx) {
+    DotWalk *walk = (DotWalk*)ctx;
+    OutBuf *out = walk->out;
+    ASTNode *node = frame->node;
+    int my_id = walk->node_counter++;
+    frame->slots[0] = my_id;
     
-    // Print node info
-    fprintf(file, "%s", get_node_type_str(node->type));
+    // Create node label
+    outbuf_puts(out, "  node");
+    outbuf_int(out, my_id);
+    outbuf_puts(out, " [label=\"");
+    outbuf_puts(out, get_node_type_str(node->type));
     if (node->value) {
-        fprintf(file, " (%s)", node->value);
+        outbuf_puts(out, "\\n");
+        outbuf_dot_string(out, node->value);
     }
-    fprintf(file, "\n");
+    outbuf_puts(out, "\"];\n");
     
-    // Print children
-    for (int i = 0; i < node->num_children; i++) {
-        print_ast(file, &node->children[i], depth + 1);
+    // Create edge from parent to this node
+    if (frame->parent) {
+        outbuf_puts(out, "  node");
+        outbuf_int(out, (long)frame->parent->slots[0]);
+        outbuf_puts(out, " -> node");
+        outbuf_int(out, my_id);
+        outbuf_puts(out, ";\n");
     }
+    
+    return AST_WALK_CHILDREN;
 }
 
-// Forward declaration of helper function
-static void generate_dot_nodes(FILE *file, ASTNode *node, int parent_id, int my_id, int *node_counter);
-
-// Save AST to DOT format for Graphviz
-bool ast_save_to_dot(ASTNode *root, const char *filename) {
-    FILE *file = fopen(filename, "w");
-    if (!file) return false;
-    
+// Write AST in DOT format for Graphviz
+bool ast_write_dot(ASTNode *root, OutBuf *out) {
     // Write DOT header
-    fprintf(file, "digraph AST {\n");
-    fprintf(file, "  node [shape=box, fontname=\"Arial\"];\n");
+    outbuf_puts(out, "digraph AST {\n");
+    outbuf_puts(out, "  node [shape=box, fontname=\"Arial\"];\n");
     
-    // Node counter for unique IDs
-    int node_counter = 0;
-    
-    // Start generating from root
-    generate_dot_nodes(file, root, -1, node_counter, &node_counter);
+    // Nodes are numbered in visiting order, starting at the root
+    static const ASTVisitor visitor = { dot_enter, NULL, NULL };
+    DotWalk walk = { out, 0 };
+    bool ok = ast_walk(root, &visitor, &walk);
     
     // Write DOT footer
-    fprintf(file, "}\n");
+    outbuf_puts(out, "}\n");
     
-    fclose(file);
-    return true;
+    return ok;
 }
 
-// Helper function to generate DOT nodes recursively
-static void generate_dot_nodes(FILE *file, ASTNode *node, int parent_id, int my_id, int *node_counter) {
-    if (!node) return;
-    
-    // Create node label
-    const char *type_str = get_node_type_str(node->type);
-    fprintf(file, "  node%d [label=\"%s", my_id, type_str);
-    if (node->value) {
-        fprintf(file, "\\n%s", node->value);
-    }
-    fprintf(file, "\"];\n");
-    
-    // Create edge from parent to this node
-    if (parent_id >= 0) {
-        fprintf(file, "  node%d -> node%d;\n", parent_id, my_id);
-    }
+// Save AST to DOT format for Graphviz
+bool ast_save_to_dot(ASTNode *root, const char *filename) {
+    OutBuf *out = outbuf_open(filename);
+    if (!out) return false;
     
-    // Process children
-    for (int i = 0; i < node->num_children; i++) {
-        generate_dot_nodes(file, &node->children[i], my_id, ++(*node_counter), node_counter);
-    }
+    bool ok = ast_write_dot(root, out);
+    return outbuf_close(out) && ok;
 }
 
-// Forward declaration of helper function
-static void write_node_json(FILE *file, ASTNode *node, int depth, bool is_last);
+// State for JSON output
+typedef struct {
+    OutBuf *out;
+    JsonStyle style;
+} JsonWalk;
 
-// Save AST to JSON format
-bool ast_save_to_json(ASTNode *root, const char *filename) {
-    FILE *file = fopen(filename, "w");
-    if (!file) return false;
-    
-    // Write the JSON file
-    fprintf(file, "{\n");
-    fprintf(file, "  \"ast\": ");
-    write_node_json(file, root, 1, true);
-    fprintf(file, "}\n");
-    
-    fclose(file);
-    return true;
+// JSON nesting: each node sits two levels below its parent
+static int json_depth(ASTWalkFrame *frame) {
+    return 1 + 2 * frame->depth;
 }
 
-// Helper function to write a node as JSON
-static void write_node_json(FILE *file, ASTNode *node, int depth, bool is_last) {
-    if (!node) return;
-    
-    // Indentation
-    for (int i = 0; i < depth; i++) {
-        fprintf(file, "  ");
+// Open a node object and its children array
+static ASTWalkAction json_enter(ASTWalkFrame *frame, void *ctx) {
+    JsonWalk *walk = (JsonWalk*)ctx;
+    OutBuf *out = walk->out;
+    ASTNode *node = frame->node;
+    
+    if (walk->style == JSON_COMPACT) {
+        outbuf_puts(out, "{\"type\":\"");
+        outbuf_puts(out, get_node_type_str(node->type));
+        outbuf_puts(out, "\",\"value\":");
+        if (node->value) {
+            outbuf_json_string(out, node->value);
+        } else {
+            outbuf_puts(out, "null");
+        }
+        outbuf_puts(out, ",\"children\":[");
+        return AST_WALK_CHILDREN;
     }
     
+    int depth = json_depth(frame);
+    
     // Start node object
-    fprintf(file, "{\n");
+    outbuf_indent(out, depth);
+    outbuf_puts(out, "{\n");
     
     // Node type
-    for (int i = 0; i < depth + 1; i++) {
-        fprintf(file, "  ");
-    }
-    fprintf(file, "\"type\": \"%s\",\n", get_node_type_str(node->type));
+    outbuf_indent(out, depth + 1);
+    outbuf_puts(out, "\"type\": \"");
+    outbuf_puts(out, get_node_type_str(node->type));
+    outbuf_puts(out, "\",\n");
     
     // Node value (if any)
-    for (int i = 0; i < depth + 1; i++) {
-        fprintf(file, "  ");
-    }
+    outbuf_indent(out, depth + 1);
+    outbuf_puts(out, "\"value\": ");
     if (node->value) {
-        fprintf(file, "\"value\": \"%s\",\n", node->value);
+        outbuf_json_string(out, node->value);
     } else {
-        fprintf(file, "\"value\": null,\n");
+        outbuf_puts(out, "null");
     }
+    outbuf_puts(out, ",\n");
     
     // Children array
-    for (int i = 0; i < depth + 1; i++) {
-        fprintf(file, "  ");
-    }
-    fprintf(file, "\"children\": [\n");
+    outbuf_indent(out, depth + 1);
+    outbuf_puts(out, "\"children\": [\n");
     
-    // Write each child
-    for (int i = 0; i < node->num_children; i++) {
-        write_node_json(file, &node->children[i], depth + 2, i == node->num_children - 1);
+    return AST_WALK_CHILDREN;
+}
+
+// Close the children array and the node object
+static void json_leave(ASTWalkFrame *frame, void *ctx) {
+    JsonWalk *walk = (JsonWalk*)ctx;
+    OutBuf *out = walk->out;
+    bool is_last = !frame->parent ||
+                   frame->index == frame->parent->node->num_children - 1;
+    
+    if (walk->style == JSON_COMPACT) {
+        outbuf_puts(out, is_last ? "]}" : "]},");
+        return;
     }
     
-    // Close children array
-    for (int i = 0; i < depth + 1; i++) {
-        fprintf(file, "  ");
-    }
-    fprintf(file, "]\n");
+    int depth = json_depth(frame);
     
-    // Close node object
-    for (int i = 0; i < depth; i++) {
-        fprintf(file, "  ");
-    }
-    if (is_last) {
-        fprintf(file, "}\n");
-    } else {
-        fprintf(file, "},\n");
-    }
+    outbuf_indent(out, depth + 1);
+    outbuf_puts(out, "]\n");
+    
+    outbuf_indent(out, depth);
+    outbuf_puts(out, is_last ? "}\n" : "},\n");
+}
+
+// Write AST as JSON
+bool ast_write_json(ASTNode *root, OutBuf *out, JsonStyle style) {
+    outbuf_puts(out, style == JSON_COMPACT ? "{\"ast\":" : "{\n  \"ast\": ");
+    static const ASTVisitor visitor = { json_enter, NULL, json_leave };
+    JsonWalk walk = { out, style };
+    bool ok = ast_walk(root, &visitor, &walk);
+    outbuf_puts(out, "}\n");
+    
+    return ok;
+}
+
+// Save AST to JSON format
+bool ast_save_to_json(ASTNode *root, const char *filename, JsonStyle style) {
+    OutBuf *out = outbuf_open(filename);
+    if (!out) return false;
+    
+    bool ok = ast_write_json(root, out, style);
+    return outbuf_close(out) && ok;
 }
 
 // Helper functions for creating specific node types
@@ -261,24 +431,44 @@ ASTNode* ast_create_block() {
 }
 
 ASTNode* ast_create_var_decl(const char *type, const char *name, ASTNode *init_expr) {
-    // Combine type and name for the value
-    char *value = (char*)malloc(strlen(type) + strlen(name) + 2);
-    if (!value) return NULL;
-    sprintf(value, "%s %s", type, name);
+    ASTNode *node = ast_create_node(NODE_VARIABLE_DECL, NULL);
+    if (!node) return NULL;
     
-    ASTNode *node = ast_create_node(NODE_VARIABLE_DECL, value);
-    free(value);
+    // Combine type and name for the value, written straight into node memory
+    node->value = (char*)ast_alloc(strlen(type) + strlen(name) + 2);
+    if (!node->value) return node;
+    sprintf(node->value, "%s %s", type, name);
     
     if (init_expr) ast_add_child(node, init_expr);
     return node;
 }
 
+// Variable name of a declaration, whose value reads "type name"
+const char* ast_decl_name(const ASTNode *node) {
+    const char *space = strrchr(node->value, ' ');
+    return space ? space + 1 : node->value;
+}
+
 ASTNode* ast_create_assignment(const char *name, ASTNode *expr) {
     ASTNode *node = ast_create_node(NODE_ASSIGNMENT, name);
     if (expr) ast_add_child(node, expr);
     return node;
 }
 
+// Desugar "name op= expr" into "name = name op expr"
+ASTNode* ast_create_compound_assignment(const char *name, const char *op, ASTNode *expr) {
+    char binary_op[8];
+    size_t length = strlen(op);
+    if (length < 2 || length > sizeof(binary_op) || op[length - 1] != '=') {
+        return NULL;
+    }
+    memcpy(binary_op, op, length - 1);
+    binary_op[length - 1] = '\0';
+    
+    ASTNode *target = ast_create_identifier(name);
+    return ast_create_assignment(name, ast_create_binary_op(binary_op, target, expr));
+}
+
 ASTNode* ast_create_binary_op(const char *op, ASTNode *left, ASTNode *right) {
     ASTNode *node = ast_create_node(NODE_BINARY_OP, op);
     if (left) ast_add_child(node, left);
@@ -307,12 +497,15 @@ ASTNode* ast_create_while(ASTNode *condition, ASTNode *body) {
     return node;
 }
 
+// Children are always init, condition, update and body in that order: an
+// omitted clause becomes an empty block, and an omitted condition the
+// constant 1, as in C
 ASTNode* ast_create_for(ASTNode *init, ASTNode *condition, ASTNode *update, ASTNode *body) {
     ASTNode *node = ast_create_node(NODE_FOR, NULL);
-    if (init) ast_add_child(node, init);
-    if (condition) ast_add_child(node, condition);
-    if (update) ast_add_child(node, update);
-    if (body) ast_add_child(node, body);
+    ast_add_child(node, init ? init : ast_create_block());
+    ast_add_child(node, condition ? condition : ast_create_number("1"));
+    ast_add_child(node, update ? update : ast_create_block());
+    ast_add_child(node, body ? body : ast_create_block());
     return node;
 }
 
@@ -2,6 +2,47 @@
 #define AST_H
 
 #include "common.h"
+#include "arena.h"
+#include "outbuf.h"
+#include <stdint.h>
+
+// Node allocation: while an arena is set, nodes, child arrays and node
+// strings are carved from it on the calling thread and released together
+// by arena_destroy(); ast_free_node() is then a no-op for them.
+void ast_set_arena(Arena *arena);
+Arena* ast_get_arena(void);
+
+// One node on the path from the root to the node being visited
+typedef struct ASTWalkFrame {
+    ASTNode *node;
+    struct ASTWalkFrame *parent; // NULL for the root
+    int index;              // Position of node among its parent's children
+    int depth;              // 0 for the root
+    int next;               // Visiting position of the next child
+    const int *order;       // Optional child visiting order, set in enter
+    int order_count;
+    bool reverse;           // Visit children last to first, set in enter
+    intptr_t slots[6];      // Scratch space for the callbacks
+} ASTWalkFrame;
+
+// What to do after entering a node
+typedef enum {
+    AST_WALK_CHILDREN,      // Visit the node's children
+    AST_WALK_SKIP           // Go straight to leave
+} ASTWalkAction;
+
+// Traversal callbacks, any of which may be NULL. enter runs before the
+// children, child before each child with that child's index, and leave
+// after the last child. Frames are only valid during a callback.
+typedef struct {
+    ASTWalkAction (*enter)(ASTWalkFrame *frame, void *ctx);
+    void (*child)(ASTWalkFrame *frame, int index, void *ctx);
+    void (*leave)(ASTWalkFrame *frame, void *ctx);
+} ASTVisitor;
+
+// Depth-first walk using an explicit stack, so tree depth is bounded by
+// heap memory only. Returns false if the stack could not be grown.
+bool ast_walk(ASTNode *root, const ASTVisitor *visitor, void *ctx);
 
 // AST node functions
 ASTNode* ast_create_node(NodeType type, const char *value);
@@ -9,7 +50,10 @@ void ast_add_child(ASTNode *parent, ASTNode *child);
 void ast_free_node(ASTNode *node);
 bool ast_save_to_file(ASTNode *root, const char *filename);
 bool ast_save_to_dot(ASTNode *root, const char *filename);
-bool ast_save_to_json(ASTNode *root, const char *filename);
+bool ast_save_to_json(ASTNode *root, const char *filename, JsonStyle style);
+bool ast_write_text(ASTNode *root, OutBuf *out);
+bool ast_write_dot(ASTNode *root, OutBuf *out);
+bool ast_write_json(ASTNode *root, OutBuf *out, JsonStyle style);
 
 // Helper functions for node creation
 ASTNode* ast_create_program();
@@ -17,6 +61,7 @@ ASTNode* ast_create_function(const char *name, ASTNode *params, ASTNode *body);
 ASTNode* ast_create_block();
 ASTNode* ast_create_var_decl(const char *type, const char *name, ASTNode *init_expr);
 ASTNode* ast_create_assignment(const char *name, ASTNode *expr);
+ASTNode* ast_create_compound_assignment(const char *name, const char *op, ASTNode *expr);
 ASTNode* ast_create_binary_op(const char *op, ASTNode *left, ASTNode *right);
 ASTNode* ast_create_unary_op(const char *op, ASTNode *expr);
 ASTNode* ast_create_if(ASTNode *condition, ASTNode *then_branch, ASTNode *else_branch);
@@ -27,5 +72,6 @@ ASTNode* ast_create_call(const char *name, ASTNode *args);
 ASTNode* ast_create_identifier(const char *name);
 ASTNode* ast_create_number(const char *value);
 ASTNode* ast_create_string(const char *value);
+const char* ast_decl_name(const ASTNode *node);
 
 #endif // AST_H
@@ -0,0 +1,355 @@
+#include "ast_flat.h"
+#include "ast.h"
+#include "strtab.h"
+#include "binfmt.h"
+#include "outbuf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Header at the start of every flat block; the arrays follow it in the
+// order types, value_ids, first_child, next_sibling, string_offsets and
+// finally the string bytes
+typedef struct {
+    int32_t num_nodes;
+    int32_t num_strings;
+    uint32_t string_bytes;
+    uint32_t reserved;
+} FlatHeader;
+
+// Traversal stack entry used while flattening
+typedef struct {
+    const ASTNode *node;
+    int32_t parent;
+} FlatFrame;
+
+// Size of a block holding the given number of nodes and strings
+static size_t block_size_for(int32_t num_nodes, int32_t num_strings, uint32_t string_bytes) {
+    return sizeof(FlatHeader) +
+           sizeof(int32_t) * 4 * (size_t)num_nodes +
+           sizeof(uint32_t) * (size_t)num_strings +
+           string_bytes;
+}
+
+// Point the array fields of a flat AST into its block
+static void bind_arrays(FlatAST *flat) {
+    char *p = (char*)flat->block + sizeof(FlatHeader);
+    size_t n = (size_t)flat->num_nodes;
+
+    flat->types = (int32_t*)p;           p += sizeof(int32_t) * n;
+    flat->value_ids = (int32_t*)p;       p += sizeof(int32_t) * n;
+    flat->first_child = (int32_t*)p;     p += sizeof(int32_t) * n;
+    flat->next_sibling = (int32_t*)p;    p += sizeof(int32_t) * n;
+    flat->string_offsets = (uint32_t*)p; p += sizeof(uint32_t) * (size_t)flat->num_strings;
+    flat->string_data = p;
+}
+
+// Push a frame, growing the stack as needed
+static bool push_frame(FlatFrame **stack, size_t *size, size_t *capacity,
+                       const ASTNode *node, int32_t parent) {
+    if (*size >= *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 64;
+        FlatFrame *new_stack = (FlatFrame*)realloc(*stack, sizeof(FlatFrame) * new_capacity);
+        if (!new_stack) return false;
+        *stack = new_stack;
+        *capacity = new_capacity;
+    }
+
+    (*stack)[*size].node = node;
+    (*stack)[*size].parent = parent;
+    (*size)++;
+    return true;
+}
+
+// Convert a node tree into the flat preorder encoding
+FlatAST* ast_flatten(const ASTNode *root) {
+    if (!root) return NULL;
+
+    StringTable *strings = strtab_create();
+    FlatFrame *stack = NULL;
+    size_t stack_size = 0;
+    size_t stack_capacity = 0;
+    int32_t *parents = NULL;
+    int32_t *last_child = NULL;
+    FlatAST *flat = NULL;
+
+    if (!strings) goto fail;
+
+    // Pass 1: count nodes and intern values (in preorder, so IDs are stable)
+    int32_t num_nodes = 0;
+    uint32_t string_bytes = 0;
+    if (!push_frame(&stack, &stack_size, &stack_capacity, root, FLAT_NONE)) goto fail;
+
+    while (stack_size > 0) {
+        const ASTNode *node = stack[--stack_size].node;
+        num_nodes++;
+
+        if (node->value) {
+            size_t count = strtab_count(strings);
+            int id = strtab_intern(strings, node->value, strlen(node->value));
+            if (id < 0) goto fail;
+            if ((size_t)id == count) {
+                string_bytes += (uint32_t)strtab_length(strings, id) + 1;
+            }
+        }
+
+        for (int i = node->num_children - 1; i >= 0; i--) {
+            if (!push_frame(&stack, &stack_size, &stack_capacity, node->children[i], FLAT_NONE)) goto fail;
+        }
+    }
+
+    // Allocate the block
+    flat = (FlatAST*)malloc(sizeof(FlatAST));
+    if (!flat) goto fail;
+
+    flat->num_nodes = num_nodes;
+    flat->num_strings = (int32_t)strtab_count(strings);
+    flat->string_bytes = string_bytes;
+    flat->block_size = block_size_for(flat->num_nodes, flat->num_strings, string_bytes);
+    flat->block = malloc(flat->block_size);
+    flat->owns_block = true;
+    flat->file = NULL;
+    if (!flat->block) goto fail;
+
+    FlatHeader *header = (FlatHeader*)flat->block;
+    header->num_nodes = flat->num_nodes;
+    header->num_strings = flat->num_strings;
+    header->string_bytes = string_bytes;
+    header->reserved = 0;
+    bind_arrays(flat);
+
+    // Pack the strings
+    uint32_t offset = 0;
+    for (int32_t i = 0; i < flat->num_strings; i++) {
+        size_t length = strtab_length(strings, i);
+        flat->string_offsets[i] = offset;
+        memcpy(flat->string_data + offset, strtab_get(strings, i), length + 1);
+        offset += (uint32_t)length + 1;
+    }
+
+    // Pass 2: assign preorder indices, recording each node's parent
+    parents = (int32_t*)malloc(sizeof(int32_t) * (size_t)num_nodes);
+    last_child = (int32_t*)malloc(sizeof(int32_t) * (size_t)num_nodes);
+    if (!parents || !last_child) goto fail;
+
+    int32_t index = 0;
+    push_frame(&stack, &stack_size, &stack_capacity, root, FLAT_NONE);
+
+    while (stack_size > 0) {
+        FlatFrame frame = stack[--stack_size];
+        const ASTNode *node = frame.node;
+
+        flat->types[index] = (int32_t)node->type;
+        flat->value_ids[index] = node->value
+            ? strtab_lookup(strings, node->value, strlen(node->value))
+            : FLAT_NONE;
+        flat->first_child[index] = FLAT_NONE;
+        flat->next_sibling[index] = FLAT_NONE;
+        parents[index] = frame.parent;
+        last_child[index] = FLAT_NONE;
+
+        for (int i = node->num_children - 1; i >= 0; i--) {
+            push_frame(&stack, &stack_size, &stack_capacity, node->children[i], index);
+        }
+        index++;
+    }
+
+    // Children of a parent appear in increasing preorder index, so one
+    // forward scan links first children and sibling chains
+    for (int32_t i = 1; i < num_nodes; i++) {
+        int32_t parent = parents[i];
+        if (last_child[parent] == FLAT_NONE) {
+            flat->first_child[parent] = i;
+        } else {
+            flat->next_sibling[last_child[parent]] = i;
+        }
+        last_child[parent] = i;
+    }
+
+    free(parents);
+    free(last_child);
+    free(stack);
+    strtab_free(strings);
+    return flat;
+
+fail:
+    free(parents);
+    free(last_child);
+    free(stack);
+    strtab_free(strings);
+    flat_ast_free(flat);
+    return NULL;
+}
+
+// Wrap an existing block (e.g. read from disk or mapped) as a flat AST.
+// With take_ownership the block is freed by flat_ast_free.
+FlatAST* flat_ast_from_block(void *block, size_t block_size, bool take_ownership) {
+    if (!block || block_size < sizeof(FlatHeader)) return NULL;
+
+    const FlatHeader *header = (const FlatHeader*)block;
+    if (header->num_nodes < 0 || header->num_strings < 0 ||
+        block_size < block_size_for(header->num_nodes, header->num_strings, header->string_bytes)) {
+        return NULL;
+    }
+
+    FlatAST *flat = (FlatAST*)malloc(sizeof(FlatAST));
+    if (!flat) return NULL;
+
+    flat->num_nodes = header->num_nodes;
+    flat->num_strings = header->num_strings;
+    flat->string_bytes = header->string_bytes;
+    flat->block = block;
+    flat->block_size = block_size;
+    flat->owns_block = take_ownership;
+    flat->file = NULL;
+    bind_arrays(flat);
+
+    return flat;
+}
+
+// Free a flat AST
+void flat_ast_free(FlatAST *flat) {
+    if (!flat) return;
+
+    if (flat->owns_block) {
+        free(flat->block);
+    }
+    if (flat->file) {
+        source_close(flat->file);
+        free(flat->file);
+    }
+    free(flat);
+}
+
+// Get the value of a node, or NULL if it has none
+const char* flat_ast_value(const FlatAST *flat, int32_t node) {
+    int32_t id = flat->value_ids[node];
+    if (id == FLAT_NONE || id >= flat->num_strings) return NULL;
+    return flat->string_data + flat->string_offsets[id];
+}
+
+// Rebuild a node tree (allocated like any other, e.g. from the current arena)
+ASTNode* ast_unflatten(const FlatAST *flat) {
+    if (!flat || flat->num_nodes == 0) return NULL;
+
+    ASTNode **nodes = (ASTNode**)malloc(sizeof(ASTNode*) * (size_t)flat->num_nodes);
+    if (!nodes) return NULL;
+
+    for (int32_t i = 0; i < flat->num_nodes; i++) {
+        nodes[i] = ast_create_node((NodeType)flat->types[i], flat_ast_value(flat, i));
+        if (!nodes[i]) {
+            ast_free_node(nodes[0]);
+            free(nodes);
+            return NULL;
+        }
+    }
+
+    // Linear scan: attach every node's children in sibling order
+    for (int32_t i = 0; i < flat->num_nodes; i++) {
+        for (int32_t c = flat->first_child[i]; c != FLAT_NONE; c = flat->next_sibling[c]) {
+            ast_add_child(nodes[i], nodes[c]);
+        }
+    }
+
+    ASTNode *root = nodes[0];
+    free(nodes);
+    return root;
+}
+
+// Check that every index in a flat AST stays in bounds. Children and
+// siblings must come later in preorder, which rules out cycles, and each
+// node but the root must be linked exactly once, which makes it a tree.
+static bool flat_ast_valid(const FlatAST *flat) {
+    int32_t n = flat->num_nodes;
+    bool ok = true;
+
+    char *linked = (char*)calloc((size_t)n + 1, 1);
+    if (!linked) return false;
+
+    for (int32_t i = 0; i < n && ok; i++) {
+        int32_t child = flat->first_child[i];
+        int32_t sibling = flat->next_sibling[i];
+
+        ok = flat->types[i] >= 0 && flat->types[i] <= NODE_STRING &&
+             flat->value_ids[i] >= FLAT_NONE && flat->value_ids[i] < flat->num_strings &&
+             (child == FLAT_NONE || (child == i + 1 && child < n && !linked[child])) &&
+             (sibling == FLAT_NONE || (sibling > i && sibling < n && !linked[sibling]));
+
+        if (ok && child != FLAT_NONE) linked[child] = 1;
+        if (ok && sibling != FLAT_NONE) linked[sibling] = 1;
+    }
+
+    for (int32_t i = 1; i < n && ok; i++) {
+        ok = linked[i];
+    }
+    free(linked);
+    if (!ok) return false;
+
+    for (int32_t i = 0; i < flat->num_strings; i++) {
+        if (flat->string_offsets[i] >= flat->string_bytes) return false;
+    }
+
+    return flat->string_bytes == 0 || flat->string_data[flat->string_bytes - 1] == '\0';
+}
+
+// Write a flat AST as a binary artifact: the header and then the block as is
+void flat_ast_write_bin(const FlatAST *flat, OutBuf *out) {
+    binfmt_write_header(out, BINFMT_AST_MAGIC, flat->block_size);
+    outbuf_write(out, (const char*)flat->block, flat->block_size);
+}
+
+// Save a flat AST to a binary artifact file
+bool flat_ast_save_bin(const FlatAST *flat, const char *filename) {
+    OutBuf *out = outbuf_open(filename);
+    if (!out) return false;
+
+    flat_ast_write_bin(flat, out);
+    return outbuf_close(out);
+}
+
+// Write a node tree as a binary artifact
+bool ast_write_bin(const ASTNode *root, OutBuf *out) {
+    FlatAST *flat = ast_flatten(root);
+    if (!flat) return false;
+
+    flat_ast_write_bin(flat, out);
+    flat_ast_free(flat);
+    return true;
+}
+
+// Save a node tree to a binary artifact file
+bool ast_save_bin(const ASTNode *root, const char *filename) {
+    FlatAST *flat = ast_flatten(root);
+    if (!flat) return false;
+
+    bool ok = flat_ast_save_bin(flat, filename);
+    flat_ast_free(flat);
+    return ok;
+}
+
+// Load a binary AST artifact. The file is mapped and the flat arrays
+// point straight into it until flat_ast_free.
+FlatAST* ast_load_bin(const char *filename) {
+    SourceBuffer *file = (SourceBuffer*)malloc(sizeof(SourceBuffer));
+    if (!file) return NULL;
+
+    if (!source_open(filename, file)) {
+        free(file);
+        return NULL;
+    }
+
+    size_t payload_size;
+    const char *payload = binfmt_payload(file->data, file->length, BINFMT_AST_MAGIC, &payload_size);
+    FlatAST *flat = payload ? flat_ast_from_block((void*)payload, payload_size, false) : NULL;
+
+    if (!flat || !flat_ast_valid(flat)) {
+        if (payload) fprintf(stderr, "Error: Corrupt AST file '%s'\n", filename);
+        flat_ast_free(flat);
+        source_close(file);
+        free(file);
+        return NULL;
+    }
+
+    flat->file = file;
+    return flat;
+}
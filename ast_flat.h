@@ -0,0 +1,46 @@
+#ifndef AST_FLAT_H
+#define AST_FLAT_H
+
+#include "common.h"
+#include "source.h"
+#include "outbuf.h"
+#include <stdint.h>
+
+// Marker for "no node" / "no value" in the flat arrays
+#define FLAT_NONE (-1)
+
+// Flat AST: nodes in preorder, stored as parallel arrays. Node 0 is the
+// root and a node's first child, when it has one, is always the next node.
+// All arrays and the string data live in one contiguous block, so a whole
+// tree can be copied, written or loaded with a single memcpy.
+typedef struct {
+    int32_t num_nodes;
+    int32_t num_strings;
+    uint32_t string_bytes;
+
+    int32_t *types;         // NodeType of each node
+    int32_t *value_ids;     // String ID of each node's value, or FLAT_NONE
+    int32_t *first_child;   // Index of the first child, or FLAT_NONE
+    int32_t *next_sibling;  // Index of the next sibling, or FLAT_NONE
+    uint32_t *string_offsets; // Offset of each string in string_data
+    char *string_data;      // NUL-terminated node values, deduplicated
+
+    void *block;            // The single allocation holding everything above
+    size_t block_size;
+    bool owns_block;        // flat_ast_free releases block
+    SourceBuffer *file;     // Mapped artifact holding block (ast_load_bin)
+} FlatAST;
+
+// Flat AST functions
+FlatAST* ast_flatten(const ASTNode *root);
+ASTNode* ast_unflatten(const FlatAST *flat);
+FlatAST* flat_ast_from_block(void *block, size_t block_size, bool take_ownership);
+void flat_ast_free(FlatAST *flat);
+const char* flat_ast_value(const FlatAST *flat, int32_t node);
+bool flat_ast_save_bin(const FlatAST *flat, const char *filename);
+bool ast_save_bin(const ASTNode *root, const char *filename);
+void flat_ast_write_bin(const FlatAST *flat, OutBuf *out);
+bool ast_write_bin(const ASTNode *root, OutBuf *out);
+FlatAST* ast_load_bin(const char *filename);
+
+#endif // AST_FLAT_H
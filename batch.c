@@ -0,0 +1,396 @@
+#include "batch.h"
+#include "driver.h"
+#include "arena.h"
+#include <errno.h>
+#include <glob.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// One input file and the directory its artifacts go to
+typedef struct {
+    char *input_file;
+    char *output_dir;
+    bool ok;
+} BatchFile;
+
+// A worker's share of the files: a range of indexes into the file list.
+// The owner takes files from the front and idle workers steal from the
+// back, so an owner keeps to list order and a thief is as far from it as
+// the range allows.
+typedef struct {
+    pthread_mutex_t lock;
+    size_t front;
+    size_t back;          // One past the last file
+} BatchQueue;
+
+typedef struct Batch Batch;
+
+// Worker thread state
+typedef struct {
+    Batch *batch;
+    int index;
+    pthread_t thread;
+    Arena *arena;         // Reused for every file the worker compiles
+} BatchWorker;
+
+struct Batch {
+    const CompilerConfig *config;
+    BatchFile *files;
+    size_t num_files;
+    BatchQueue *queues;   // One per worker
+    BatchWorker *workers;
+    int num_workers;
+    pthread_mutex_t output_lock;  // Keeps each file's messages together
+    ArtifactCache *cache; // Shared by every worker, or NULL
+};
+
+// Seconds on a monotonic clock
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Append a path to the file list
+static bool add_file(BatchFile **files, size_t *count, size_t *capacity, const char *path) {
+    if (*count >= *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 64;
+        BatchFile *new_files = (BatchFile*)realloc(*files, sizeof(BatchFile) * new_capacity);
+        if (!new_files) return false;
+        *files = new_files;
+        *capacity = new_capacity;
+    }
+
+    BatchFile *file = &(*files)[*count];
+    file->input_file = strdup(path);
+    file->output_dir = NULL;
+    file->ok = false;
+    if (!file->input_file) return false;
+
+    (*count)++;
+    return true;
+}
+
+// Read a list file: one path per line. Blank lines and lines starting
+// with '#' are skipped.
+static bool read_list(const char *filename, BatchFile **files, size_t *count, size_t *capacity) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "Error: Could not read file list '%s'\n", filename);
+        return false;
+    }
+
+    char *line = NULL;
+    size_t line_capacity = 0;
+    ssize_t length;
+    bool ok = true;
+
+    while (ok && (length = getline(&line, &line_capacity, file)) >= 0) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r' ||
+                              line[length - 1] == ' ' || line[length - 1] == '\t')) {
+            line[--length] = '\0';
+        }
+        if (length == 0 || line[0] == '#') continue;
+        ok = add_file(files, count, capacity, line);
+    }
+
+    if (!ok) fprintf(stderr, "Error: Memory allocation failed\n");
+    free(line);
+    fclose(file);
+    return ok;
+}
+
+// Expand a glob pattern; a directory stands for every .c file in it
+static bool expand_pattern(const char *pattern, BatchFile **files, size_t *count, size_t *capacity) {
+    struct stat st;
+    char *directory_pattern = NULL;
+
+    if (stat(pattern, &st) == 0 && S_ISDIR(st.st_mode)) {
+        directory_pattern = driver_output_path(pattern, "*.c");
+        if (!directory_pattern) {
+            fprintf(stderr, "Error: Memory allocation failed\n");
+            return false;
+        }
+        pattern = directory_pattern;
+    }
+
+    glob_t matches;
+    int status = glob(pattern, 0, NULL, &matches);
+    bool ok = status == 0;
+
+    if (status == GLOB_NOMATCH) {
+        fprintf(stderr, "Error: No input files match '%s'\n", pattern);
+    } else if (status != 0) {
+        fprintf(stderr, "Error: Could not expand '%s'\n", pattern);
+    }
+
+    for (size_t i = 0; ok && i < matches.gl_pathc; i++) {
+        ok = add_file(files, count, capacity, matches.gl_pathv[i]);
+        if (!ok) fprintf(stderr, "Error: Memory allocation failed\n");
+    }
+
+    if (status == 0 || status == GLOB_NOMATCH) globfree(&matches);
+    free(directory_pattern);
+    return ok;
+}
+
+// Create a directory unless it exists; *created, if given, tells if it
+// was made by this call
+static bool make_directory(const char *path, bool *created) {
+    bool made = mkdir(path, 0777) == 0;
+    if (created) *created = made;
+    if (made || errno == EEXIST) return true;
+    fprintf(stderr, "Error: Could not create directory '%s'\n", path);
+    return false;
+}
+
+// Name each file's output directory after the file, without its
+// extension. A name that is already taken gets "-2", "-3" and so on, in
+// list order, so every run lays the outputs out the same way. The
+// directories are created as their files are compiled.
+static bool assign_output_dirs(Batch *batch) {
+    const char *root = batch->config->output_dir;
+    if (!make_directory(root, NULL)) return false;
+
+    for (size_t i = 0; i < batch->num_files; i++) {
+        const char *path = batch->files[i].input_file;
+        const char *base = strrchr(path, '/');
+        base = base ? base + 1 : path;
+
+        size_t stem_length = strlen(base);
+        const char *dot = strrchr(base, '.');
+        if (dot && dot != base) stem_length = (size_t)(dot - base);
+
+        char name[256];
+        if (stem_length == 0 || stem_length > sizeof(name) - 16) {
+            fprintf(stderr, "Error: Cannot name an output directory for '%s'\n", path);
+            return false;
+        }
+        memcpy(name, base, stem_length);
+        name[stem_length] = '\0';
+
+        char *output_dir = NULL;
+        for (int copy = 1; !output_dir; copy++) {
+            if (copy > 1) snprintf(name + stem_length, sizeof(name) - stem_length, "-%d", copy);
+
+            char *candidate = driver_output_path(root, name);
+            if (!candidate) {
+                fprintf(stderr, "Error: Memory allocation failed\n");
+                return false;
+            }
+
+            bool taken = false;
+            for (size_t j = 0; j < i && !taken; j++) {
+                taken = strcmp(batch->files[j].output_dir, candidate) == 0;
+            }
+            if (taken) {
+                free(candidate);
+            } else {
+                output_dir = candidate;
+            }
+        }
+
+        batch->files[i].output_dir = output_dir;
+    }
+
+    return true;
+}
+
+// Take the next file from a worker's own queue
+static bool take_own(BatchQueue *queue, size_t *file) {
+    pthread_mutex_lock(&queue->lock);
+    bool found = queue->front < queue->back;
+    if (found) *file = queue->front++;
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+// Steal the last file from another worker's queue
+static bool steal(BatchQueue *queue, size_t *file) {
+    pthread_mutex_lock(&queue->lock);
+    bool found = queue->front < queue->back;
+    if (found) *file = --queue->back;
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+// Next file for a worker: its own first, then any other worker's. No work
+// is added once the batch starts, so when every queue is empty the
+// worker is done.
+static bool next_file(Batch *batch, int worker, size_t *file) {
+    if (take_own(&batch->queues[worker], file)) return true;
+
+    for (int i = 1; i < batch->num_workers; i++) {
+        if (steal(&batch->queues[(worker + i) % batch->num_workers], file)) return true;
+    }
+    return false;
+}
+
+// Compile one file. Its messages are collected and printed in one piece,
+// so the output of files compiled at the same time does not interleave.
+// A file that fails before writing anything, such as one that cannot be
+// read, leaves no empty output directory behind.
+static void compile_file(BatchWorker *worker, BatchFile *file) {
+    CompilerConfig config = *worker->batch->config;
+    config.input_file = file->input_file;
+    config.output_dir = file->output_dir;
+    config.inputs = NULL;
+    config.jobs = 1;      // Files are what runs in parallel
+
+    char *messages = NULL;
+    size_t messages_size = 0;
+    FILE *out = open_memstream(&messages, &messages_size);
+
+    DriverJob job;
+    driver_job_init(&job);
+    job.arena = worker->arena;
+    job.cache = worker->batch->cache;
+    if (out) job.out = out;
+
+    bool created = false;
+    file->ok = make_directory(file->output_dir, &created) && driver_compile(&config, &job);
+    if (!file->ok && created) rmdir(file->output_dir);
+
+    pthread_mutex_lock(&worker->batch->output_lock);
+    if (out) {
+        fclose(out);
+        fwrite(messages, 1, messages_size, stdout);
+    }
+    if (!file->ok) fprintf(stderr, "Error: Compiling '%s' failed\n", file->input_file);
+    pthread_mutex_unlock(&worker->batch->output_lock);
+
+    free(messages);
+}
+
+// Worker thread: compile files until none are left
+static void* run_worker(void *arg) {
+    BatchWorker *worker = (BatchWorker*)arg;
+    size_t file;
+
+    while (next_file(worker->batch, worker->index, &file)) {
+        compile_file(worker, &worker->batch->files[file]);
+    }
+    return NULL;
+}
+
+// Split the files into one contiguous range per worker
+static void fill_queues(Batch *batch) {
+    size_t start = 0;
+    for (int i = 0; i < batch->num_workers; i++) {
+        size_t share = batch->num_files / batch->num_workers +
+                       ((size_t)i < batch->num_files % batch->num_workers ? 1 : 0);
+        batch->queues[i].front = start;
+        batch->queues[i].back = start + share;
+        start += share;
+    }
+}
+
+// Free everything a batch holds
+static void free_batch(Batch *batch) {
+    for (size_t i = 0; i < batch->num_files; i++) {
+        free(batch->files[i].input_file);
+        free(batch->files[i].output_dir);
+    }
+    free(batch->files);
+
+    if (batch->workers) {
+        for (int i = 0; i < batch->num_workers; i++) {
+            arena_destroy(batch->workers[i].arena);
+            pthread_mutex_destroy(&batch->queues[i].lock);
+        }
+    }
+    free(batch->workers);
+    free(batch->queues);
+    cache_close(batch->cache);
+    pthread_mutex_destroy(&batch->output_lock);
+}
+
+// Compile every file named by config->inputs: "@file" reads the paths
+// from a list file, anything else is a glob pattern or a directory. The
+// files are compiled by config->jobs worker threads (0: one per CPU), and
+// each file's artifacts go to a directory of its own under
+// config->output_dir. Returns false if any file failed.
+bool batch_compile(const CompilerConfig *config) {
+    double start = now_seconds();
+    Batch batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.config = config;
+    pthread_mutex_init(&batch.output_lock, NULL);
+
+    size_t capacity = 0;
+    bool ok = config->inputs[0] == '@'
+        ? read_list(config->inputs + 1, &batch.files, &batch.num_files, &capacity)
+        : expand_pattern(config->inputs, &batch.files, &batch.num_files, &capacity);
+
+    if (ok && batch.num_files == 0) {
+        fprintf(stderr, "Error: No input files in '%s'\n", config->inputs);
+        ok = false;
+    }
+    if (ok) ok = assign_output_dirs(&batch);
+    if (ok && config->cache_dir) {
+        batch.cache = cache_open(config->cache_dir, config->cache_size);
+        ok = batch.cache != NULL;
+    }
+    if (!ok) {
+        free_batch(&batch);
+        return false;
+    }
+
+    long jobs = config->jobs > 0 ? config->jobs : sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs < 1) jobs = 1;
+    if ((size_t)jobs > batch.num_files) jobs = (long)batch.num_files;
+
+    batch.queues = (BatchQueue*)calloc((size_t)jobs, sizeof(BatchQueue));
+    batch.workers = (BatchWorker*)calloc((size_t)jobs, sizeof(BatchWorker));
+    if (!batch.queues || !batch.workers) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free_batch(&batch);
+        return false;
+    }
+
+    batch.num_workers = (int)jobs;
+    for (int i = 0; i < batch.num_workers; i++) {
+        pthread_mutex_init(&batch.queues[i].lock, NULL);
+        batch.workers[i].batch = &batch;
+        batch.workers[i].index = i;
+        batch.workers[i].arena = arena_create(ARENA_DEFAULT_CHUNK_SIZE);
+        if (!batch.workers[i].arena) ok = false;
+    }
+    if (!ok) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free_batch(&batch);
+        return false;
+    }
+    fill_queues(&batch);
+
+    // The calling thread is worker 0. A worker that cannot be started
+    // leaves its files to be stolen by the others.
+    for (int i = 1; i < batch.num_workers; i++) {
+        BatchWorker *worker = &batch.workers[i];
+        if (pthread_create(&worker->thread, NULL, run_worker, worker) != 0) {
+            worker->index = -1;
+        }
+    }
+    run_worker(&batch.workers[0]);
+    for (int i = 1; i < batch.num_workers; i++) {
+        if (batch.workers[i].index >= 0) pthread_join(batch.workers[i].thread, NULL);
+    }
+
+    size_t failed = 0;
+    for (size_t i = 0; i < batch.num_files; i++) {
+        if (!batch.files[i].ok) failed++;
+    }
+
+    printf("Compiled %zu file%s (%zu failed) in %.1f ms with %d worker%s\n",
+           batch.num_files, batch.num_files == 1 ? "" : "s", failed,
+           (now_seconds() - start) * 1e3, batch.num_workers, batch.num_workers == 1 ? "" : "s");
+    if (batch.cache && config->verbose) cache_print_stats(batch.cache, stdout);
+
+    free_batch(&batch);
+    return failed == 0;
+}
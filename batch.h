@@ -0,0 +1,12 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "common.h"
+
+// Most worker threads a batch may use
+#define BATCH_MAX_JOBS 256
+
+// Batch functions
+bool batch_compile(const CompilerConfig *config);
+
+#endif // BATCH_H
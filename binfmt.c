@@ -0,0 +1,53 @@
+#include "binfmt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Write an artifact header
+void binfmt_write_header(OutBuf *out, const char *magic, uint64_t payload_size) {
+    BinHeader header;
+    memset(&header, 0, sizeof(header));
+
+    memcpy(header.magic, magic, sizeof(header.magic));
+    header.version = BINFMT_VERSION;
+    header.byte_order = BINFMT_BYTE_ORDER;
+    header.payload_size = payload_size;
+
+    outbuf_write(out, (const char*)&header, sizeof(header));
+}
+
+// Check an artifact header and locate its payload. Returns NULL (with a
+// message on stderr) if the data is not a complete artifact of this type.
+const char* binfmt_payload(const char *data, size_t length, const char *magic, size_t *payload_size) {
+    BinHeader header;
+
+    if (length < sizeof(header)) {
+        fprintf(stderr, "Error: Binary artifact is truncated\n");
+        return NULL;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, magic, sizeof(header.magic)) != 0) {
+        fprintf(stderr, "Error: Not a %.4s binary artifact\n", magic);
+        return NULL;
+    }
+
+    if (header.byte_order != BINFMT_BYTE_ORDER) {
+        fprintf(stderr, "Error: Binary artifact was written with a different byte order\n");
+        return NULL;
+    }
+
+    if (header.version != BINFMT_VERSION) {
+        fprintf(stderr, "Error: Unsupported binary artifact version %u (expected %u)\n",
+                header.version, BINFMT_VERSION);
+        return NULL;
+    }
+
+    if (header.payload_size > length - sizeof(header)) {
+        fprintf(stderr, "Error: Binary artifact is truncated\n");
+        return NULL;
+    }
+
+    *payload_size = (size_t)header.payload_size;
+    return data + sizeof(header);
+}
@@ -0,0 +1,33 @@
+#ifndef BINFMT_H
+#define BINFMT_H
+
+#include "common.h"
+#include "outbuf.h"
+#include <stdint.h>
+
+// Binary artifact format version; bump on any layout change
+#define BINFMT_VERSION 1
+
+// Written natively; a reader on a different byte order sees it swapped
+#define BINFMT_BYTE_ORDER 0x01020304u
+
+// File type tags
+#define BINFMT_TOKENS_MAGIC "MCTK"
+#define BINFMT_AST_MAGIC    "MCAS"
+
+// Header at the start of every binary artifact. The payload follows it
+// directly and is payload_size bytes long. All offsets in the payload are
+// relative to its start, so a mapped file is used in place.
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t reserved;
+    uint64_t payload_size;
+} BinHeader;
+
+// Binary format functions
+void binfmt_write_header(OutBuf *out, const char *magic, uint64_t payload_size);
+const char* binfmt_payload(const char *data, size_t length, const char *magic, size_t *payload_size);
+
+#endif // BINFMT_H
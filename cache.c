@@ -0,0 +1,498 @@
+#include "cache.h"
+#include "driver.h"
+#include "source.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// MurmurHash3 constants
+#define MURMUR_C1 0x87c37b91114253d5ULL
+#define MURMUR_C2 0x4cf5ad432745937fULL
+
+// Rotate left by r bits, 0 < r < 64
+static uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// MurmurHash3 finalizer: every input bit affects every output bit
+static uint64_t fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+// 128-bit MurmurHash3 (x64 variant) of a byte range, 16 bytes at a time
+static void hash_bytes(const void *data, size_t length, uint64_t seed, uint64_t out[2]) {
+    const unsigned char *bytes = (const unsigned char*)data;
+    uint64_t h1 = seed;
+    uint64_t h2 = seed;
+    size_t blocks = length / 16;
+
+    for (size_t i = 0; i < blocks; i++) {
+        uint64_t k1, k2;
+        memcpy(&k1, bytes + i * 16, 8);
+        memcpy(&k2, bytes + i * 16 + 8, 8);
+
+        k1 *= MURMUR_C1;
+        k1 = rotl64(k1, 31);
+        k1 *= MURMUR_C2;
+        h1 ^= k1;
+        h1 = rotl64(h1, 27);
+        h1 += h2;
+        h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= MURMUR_C2;
+        k2 = rotl64(k2, 33);
+        k2 *= MURMUR_C1;
+        h2 ^= k2;
+        h2 = rotl64(h2, 31);
+        h2 += h1;
+        h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    // The last 0-15 bytes, zero-padded
+    size_t tail = length % 16;
+    if (tail > 0) {
+        unsigned char last[16] = { 0 };
+        memcpy(last, bytes + blocks * 16, tail);
+        uint64_t k1, k2;
+        memcpy(&k1, last, 8);
+        memcpy(&k2, last + 8, 8);
+
+        if (tail > 8) {
+            k2 *= MURMUR_C2;
+            k2 = rotl64(k2, 33);
+            k2 *= MURMUR_C1;
+            h2 ^= k2;
+        }
+        k1 *= MURMUR_C1;
+        k1 = rotl64(k1, 31);
+        k1 *= MURMUR_C2;
+        h1 ^= k1;
+    }
+
+    h1 ^= (uint64_t)length;
+    h2 ^= (uint64_t)length;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+    out[0] = h1;
+    out[1] = h2;
+}
+
+// Hash of the running compiler's executable, so a rebuilt compiler never
+// sees the artifacts of an older one. Without the executable, the time
+// this file was compiled stands in for it.
+static uint64_t compiler_hash[2];
+static pthread_once_t compiler_once = PTHREAD_ONCE_INIT;
+
+static void hash_compiler(void) {
+    SourceBuffer executable;
+    if (source_open("/proc/self/exe", &executable)) {
+        hash_bytes(executable.data, executable.length, CACHE_VERSION, compiler_hash);
+        source_close(&executable);
+    } else {
+        static const char build[] = __DATE__ " " __TIME__;
+        hash_bytes(build, sizeof(build) - 1, CACHE_VERSION, compiler_hash);
+    }
+}
+
+// The options that change what a compilation writes. Zeroed before it is
+// filled in, so the padding hashes the same every time.
+typedef struct {
+    uint32_t version;
+    uint32_t parser_type;
+    uint32_t format;
+    uint32_t compact_json;
+    uint64_t max_errors;
+    int32_t opt_level;
+    int32_t num_regs;
+    uint32_t outputs;
+    uint64_t compiler[2];
+    uint64_t source[2];
+} KeyFields;
+
+// Key of compiling source with config into the artifacts set in outputs,
+// one bit per artifact kind. The input's name, the output directory,
+// --jobs and --verbose leave the artifacts as they are.
+void cache_key(const CompilerConfig *config, uint32_t outputs, const char *source, size_t length,
+               CacheKey *key) {
+    pthread_once(&compiler_once, hash_compiler);
+
+    KeyFields fields;
+    memset(&fields, 0, sizeof(fields));
+    fields.version = CACHE_VERSION;
+    fields.parser_type = (uint32_t)config->parser_type;
+    fields.format = (uint32_t)config->format;
+    fields.compact_json = config->compact_json;
+    fields.max_errors = (uint64_t)config->max_errors;
+    fields.opt_level = config->opt_level;
+    fields.num_regs = config->num_regs;
+    fields.outputs = outputs;
+    fields.compiler[0] = compiler_hash[0];
+    fields.compiler[1] = compiler_hash[1];
+    hash_bytes(source, length, 0, fields.source);
+
+    hash_bytes(&fields, sizeof(fields), 0, key->hash);
+}
+
+// Name of a key's entry: its hash in hex
+void cache_key_name(const CacheKey *key, char name[CACHE_NAME_SIZE]) {
+    snprintf(name, CACHE_NAME_SIZE, "%016llx%016llx",
+             (unsigned long long)key->hash[0], (unsigned long long)key->hash[1]);
+}
+
+// Parse an entry's name back into its key
+static bool parse_key_name(const char *name, CacheKey *key) {
+    if (strlen(name) != CACHE_NAME_SIZE - 1) return false;
+
+    for (int half = 0; half < 2; half++) {
+        uint64_t value = 0;
+        for (int i = 0; i < 16; i++) {
+            char c = name[half * 16 + i];
+            int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+            if (digit < 0) return false;
+            value = value << 4 | (uint64_t)digit;
+        }
+        key->hash[half] = value;
+    }
+    return true;
+}
+
+// Order keys for the sorted entry list
+static int compare_keys(const CacheKey *a, const CacheKey *b) {
+    for (int i = 0; i < 2; i++) {
+        if (a->hash[i] != b->hash[i]) return a->hash[i] < b->hash[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+// Index of the entry with a key, or of where it would go
+static size_t find_entry(const ArtifactCache *cache, const CacheKey *key, bool *found) {
+    size_t low = 0;
+    size_t high = cache->num_entries;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        int order = compare_keys(&cache->entries[mid].key, key);
+        if (order == 0) {
+            *found = true;
+            return mid;
+        }
+        if (order < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    *found = false;
+    return low;
+}
+
+// Add an entry, or update the one with the same key
+static bool add_entry(ArtifactCache *cache, const CacheKey *key, uint64_t size, uint64_t last_used) {
+    bool found;
+    size_t index = find_entry(cache, key, &found);
+    if (found) {
+        CacheEntry *entry = &cache->entries[index];
+        cache->size = cache->size - entry->size + size;
+        entry->size = size;
+        if (last_used > entry->last_used) entry->last_used = last_used;
+        return true;
+    }
+
+    if (cache->num_entries >= cache->capacity) {
+        size_t capacity = cache->capacity ? cache->capacity * 2 : 64;
+        CacheEntry *entries = (CacheEntry*)realloc(cache->entries, capacity * sizeof(CacheEntry));
+        if (!entries) return false;
+        cache->entries = entries;
+        cache->capacity = capacity;
+    }
+
+    memmove(&cache->entries[index + 1], &cache->entries[index],
+            (cache->num_entries - index) * sizeof(CacheEntry));
+    cache->entries[index].key = *key;
+    cache->entries[index].size = size;
+    cache->entries[index].last_used = last_used;
+    cache->num_entries++;
+    cache->size += size;
+    return true;
+}
+
+// A use stamp later than every earlier one: the wall clock in
+// nanoseconds, so stamps from file times and from this run compare
+static uint64_t next_stamp(ArtifactCache *cache) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t now = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    cache->clock = now > cache->clock ? now : cache->clock + 1;
+    return cache->clock;
+}
+
+// Path of a file in an entry's directory, or of the directory itself
+static char* entry_path(const ArtifactCache *cache, const CacheKey *key, const char *file) {
+    char name[CACHE_NAME_SIZE];
+    cache_key_name(key, name);
+
+    char *dir = driver_output_path(cache->dir, name);
+    if (!dir || !file) return dir;
+
+    char *path = driver_output_path(dir, file);
+    free(dir);
+    return path;
+}
+
+// Bytes of the files in a directory
+static uint64_t directory_size(const char *path) {
+    DIR *dir = opendir(path);
+    if (!dir) return 0;
+
+    uint64_t size = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir))) {
+        struct stat st;
+        if (fstatat(dirfd(dir), ent->d_name, &st, 0) == 0 && S_ISREG(st.st_mode)) {
+            size += (uint64_t)st.st_size;
+        }
+    }
+    closedir(dir);
+    return size;
+}
+
+// Delete a directory and the files in it
+static void remove_directory(const char *path) {
+    DIR *dir = opendir(path);
+    if (dir) {
+        struct dirent *ent;
+        while ((ent = readdir(dir))) {
+            if (strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0) {
+                unlinkat(dirfd(dir), ent->d_name, 0);
+            }
+        }
+        closedir(dir);
+    }
+    rmdir(path);
+}
+
+// Copy a file, replacing the destination rather than writing into it
+static bool copy_file(const char *from, const char *to) {
+    int in = open(from, O_RDONLY);
+    if (in < 0) return false;
+
+    unlink(to);
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    bool ok = out >= 0;
+
+    char buffer[65536];
+    while (ok) {
+        ssize_t got = read(in, buffer, sizeof(buffer));
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            ok = got == 0;
+            break;
+        }
+        for (ssize_t done = 0; ok && done < got;) {
+            ssize_t put = write(out, buffer + done, (size_t)(got - done));
+            if (put < 0 && errno == EINTR) continue;
+            ok = put > 0;
+            if (ok) done += put;
+        }
+    }
+
+    if (out >= 0 && close(out) != 0) ok = false;
+    close(in);
+    if (!ok) unlink(to);
+    return ok;
+}
+
+// Hard-link a file, or copy it where links cannot be made (another file
+// system, say)
+static bool link_or_copy(const char *from, const char *to) {
+    unlink(to);
+    return link(from, to) == 0 || copy_file(from, to);
+}
+
+// Drop least recently used entries until the cache fits its bound. The
+// caller holds the lock.
+static void evict(ArtifactCache *cache) {
+    while (cache->size > cache->max_size && cache->num_entries > 0) {
+        size_t oldest = 0;
+        for (size_t i = 1; i < cache->num_entries; i++) {
+            if (cache->entries[i].last_used < cache->entries[oldest].last_used) oldest = i;
+        }
+
+        char *path = entry_path(cache, &cache->entries[oldest].key, NULL);
+        if (path) remove_directory(path);
+        free(path);
+
+        cache->size -= cache->entries[oldest].size;
+        memmove(&cache->entries[oldest], &cache->entries[oldest + 1],
+                (cache->num_entries - oldest - 1) * sizeof(CacheEntry));
+        cache->num_entries--;
+        cache->evictions++;
+    }
+}
+
+// Open the cache in a directory, creating the directory if needed, and
+// list the entries already in it. Their last use is when their
+// directory last changed.
+ArtifactCache* cache_open(const char *dir, uint64_t max_size) {
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Error: Could not create cache directory '%s'\n", dir);
+        return NULL;
+    }
+
+    DIR *listing = opendir(dir);
+    if (!listing) {
+        fprintf(stderr, "Error: Could not read cache directory '%s'\n", dir);
+        return NULL;
+    }
+
+    ArtifactCache *cache = (ArtifactCache*)calloc(1, sizeof(ArtifactCache));
+    if (!cache || !(cache->dir = strdup(dir))) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        free(cache);
+        closedir(listing);
+        return NULL;
+    }
+    cache->max_size = max_size;
+    pthread_mutex_init(&cache->lock, NULL);
+
+    bool ok = true;
+    struct dirent *ent;
+    while (ok && (ent = readdir(listing))) {
+        CacheKey key;
+        struct stat st;
+        if (!parse_key_name(ent->d_name, &key)) continue;
+        if (fstatat(dirfd(listing), ent->d_name, &st, 0) != 0 || !S_ISDIR(st.st_mode)) continue;
+
+        char *path = driver_output_path(dir, ent->d_name);
+        uint64_t last_used = (uint64_t)st.st_mtim.tv_sec * 1000000000ULL + (uint64_t)st.st_mtim.tv_nsec;
+        ok = path && add_entry(cache, &key, directory_size(path), last_used);
+        free(path);
+    }
+    closedir(listing);
+
+    if (!ok) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        cache_close(cache);
+        return NULL;
+    }
+
+    // A smaller bound than last time takes effect at once
+    evict(cache);
+    return cache;
+}
+
+// Free a cache; its entries stay on disk
+void cache_close(ArtifactCache *cache) {
+    if (!cache) return;
+
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->entries);
+    free(cache->dir);
+    free(cache);
+}
+
+// Put the files of a key's entry into output_dir. Returns false, and
+// counts a miss, if there is no entry or it lacks one of the files.
+bool cache_fetch(ArtifactCache *cache, const CacheKey *key, const char *const *files, int num_files,
+                 const char *output_dir) {
+    char *dir = entry_path(cache, key, NULL);
+    bool ok = dir != NULL;
+
+    for (int i = 0; ok && i < num_files; i++) {
+        char *from = driver_output_path(dir, files[i]);
+        char *to = driver_output_path(output_dir, files[i]);
+        ok = from && to && link_or_copy(from, to);
+        free(from);
+        free(to);
+    }
+
+    // The directory's time records the use for later runs
+    if (ok) utimensat(AT_FDCWD, dir, NULL, 0);
+
+    pthread_mutex_lock(&cache->lock);
+    if (ok) {
+        cache->hits++;
+        bool found;
+        size_t index = find_entry(cache, key, &found);
+        if (found) {
+            cache->entries[index].last_used = next_stamp(cache);
+        } else {
+            // Stored by another process since the cache was opened
+            add_entry(cache, key, directory_size(dir), next_stamp(cache));
+        }
+    } else {
+        cache->misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    free(dir);
+    return ok;
+}
+
+// Copy the files a compilation wrote to output_dir into a key's entry,
+// then evict what no longer fits. The entry is assembled under a
+// temporary name and renamed into place, so a reader never sees part of
+// one. Returns false if it could not be stored.
+bool cache_store(ArtifactCache *cache, const CacheKey *key, const char *const *files, int num_files,
+                 const char *output_dir) {
+    char *temp = driver_output_path(cache->dir, ".tmp-XXXXXX");
+    char *dir = entry_path(cache, key, NULL);
+    bool ok = temp && dir && mkdtemp(temp);
+    bool made = ok;
+
+    uint64_t size = 0;
+    for (int i = 0; ok && i < num_files; i++) {
+        char *from = driver_output_path(output_dir, files[i]);
+        char *to = driver_output_path(temp, files[i]);
+        struct stat st;
+        ok = from && to && copy_file(from, to) && stat(to, &st) == 0;
+        if (ok) size += (uint64_t)st.st_size;
+        free(from);
+        free(to);
+    }
+
+    // Another compilation may have stored the same entry first
+    if (ok && rename(temp, dir) != 0) {
+        ok = errno == EEXIST || errno == ENOTEMPTY;
+        remove_directory(temp);
+    } else if (!ok && made) {
+        remove_directory(temp);
+    }
+
+    if (ok) {
+        pthread_mutex_lock(&cache->lock);
+        ok = add_entry(cache, key, size, next_stamp(cache));
+        evict(cache);
+        pthread_mutex_unlock(&cache->lock);
+    }
+
+    free(temp);
+    free(dir);
+    return ok;
+}
+
+// Print the hit, miss and eviction counts and the cache's size
+void cache_print_stats(ArtifactCache *cache, FILE *out) {
+    pthread_mutex_lock(&cache->lock);
+    fprintf(out, "Cache: %zu hit%s, %zu miss%s, %zu eviction%s; %zu entr%s, %.1f of %.1f MB\n",
+            cache->hits, cache->hits == 1 ? "" : "s",
+            cache->misses, cache->misses == 1 ? "" : "es",
+            cache->evictions, cache->evictions == 1 ? "" : "s",
+            cache->num_entries, cache->num_entries == 1 ? "y" : "ies",
+            (double)cache->size / (1024.0 * 1024.0), (double)cache->max_size / (1024.0 * 1024.0));
+    pthread_mutex_unlock(&cache->lock);
+}
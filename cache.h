@@ -0,0 +1,59 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "common.h"
+#include <pthread.h>
+#include <stdint.h>
+
+// Cache layout version; bump when an entry's contents change meaning
+#define CACHE_VERSION 1
+
+// Default bound on the bytes a cache keeps, for --cache-size
+#define CACHE_DEFAULT_SIZE_MB 256
+
+// Bytes of a key's name, its hash in hex, including the terminator
+#define CACHE_NAME_SIZE 33
+
+// Key of one compilation: a 128-bit hash of its source, the options
+// that change its artifacts, and the compiler itself
+typedef struct {
+    uint64_t hash[2];
+} CacheKey;
+
+// One compilation's artifacts in the cache
+typedef struct {
+    CacheKey key;
+    uint64_t size;        // Bytes of its files
+    uint64_t last_used;   // Larger is more recent
+} CacheEntry;
+
+// Directory of artifacts from earlier compilations, one subdirectory per
+// key. Entries are evicted least recently used first once they take more
+// than max_size bytes. Several threads may use one cache at once.
+typedef struct {
+    char *dir;
+    uint64_t max_size;
+    CacheEntry *entries;
+    size_t num_entries;
+    size_t capacity;
+    uint64_t size;        // Bytes of all entries
+    uint64_t clock;       // Last use stamp handed out
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    pthread_mutex_t lock;
+} ArtifactCache;
+
+// Cache functions
+ArtifactCache* cache_open(const char *dir, uint64_t max_size);
+void cache_close(ArtifactCache *cache);
+void cache_key(const CompilerConfig *config, uint32_t outputs, const char *source, size_t length,
+               CacheKey *key);
+void cache_key_name(const CacheKey *key, char name[CACHE_NAME_SIZE]);
+bool cache_fetch(ArtifactCache *cache, const CacheKey *key, const char *const *files, int num_files,
+                 const char *output_dir);
+bool cache_store(ArtifactCache *cache, const CacheKey *key, const char *const *files, int num_files,
+                 const char *output_dir);
+void cache_print_stats(ArtifactCache *cache, FILE *out);
+
+#endif // CACHE_H
@@ -0,0 +1,399 @@
+#include "cfg.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Split a function body into blocks: a block starts at the first
+// instruction, at each label and after each jump or return. Fills in the
+// block bounds when blocks is not NULL; returns the number of blocks.
+static int split_blocks(const IRInsn *code, size_t first, size_t end, CFGBlock *blocks) {
+    int count = 0;
+    size_t start = first;
+    bool open = true;
+
+    for (size_t i = first; i < end; i++) {
+        if (code[i].op == IR_LABEL_DEF && open && (i > start || i == first)) {
+            if (blocks) {
+                blocks[count].start = start;
+                blocks[count].end = i;
+            }
+            count++;
+            start = i;
+        }
+        if (!open) {
+            start = i;
+            open = true;
+        }
+        if (ir_ends_block(code[i].op)) {
+            if (blocks) {
+                blocks[count].start = start;
+                blocks[count].end = i + 1;
+            }
+            count++;
+            open = false;
+        }
+    }
+
+    if (open) {
+        if (blocks) {
+            blocks[count].start = start;
+            blocks[count].end = end;
+        }
+        count++;
+    }
+    return count;
+}
+
+// Block a jump target label starts, or -1 if the label is not in the function
+int cfg_block_of_label(const CFG *cfg, IROperand label) {
+    long slot = (long)label.value - cfg->label_base;
+    if (label.kind != IR_LABEL || slot < 0 || slot >= cfg->num_label_slots) return -1;
+    return cfg->label_block[slot];
+}
+
+// Position of pred in a block's predecessor list, or -1
+int cfg_pred_index(const CFG *cfg, int block, int pred) {
+    const CFGBlock *b = &cfg->blocks[block];
+    for (int i = 0; i < b->num_preds; i++) {
+        if (cfg->preds[b->pred_start + i] == pred) return i;
+    }
+    return -1;
+}
+
+// Check if block a dominates block b; unreachable blocks dominate nothing
+bool cfg_dominates(const CFG *cfg, int a, int b) {
+    const CFGBlock *x = &cfg->blocks[a];
+    const CFGBlock *y = &cfg->blocks[b];
+    if (x->rpo < 0 || y->rpo < 0) return false;
+    return x->dom_pre <= y->dom_pre && y->dom_post <= x->dom_post;
+}
+
+// Map labels to blocks and link blocks to their successors
+static bool link_blocks(CFG *cfg) {
+    const IRInsn *code = cfg->ir->code;
+    int low = 0;
+    int high = -1;
+
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        CFGBlock *block = &cfg->blocks[b];
+        if (block->start == block->end || code[block->start].op != IR_LABEL_DEF) continue;
+
+        int label = (int)code[block->start].src1.value;
+        if (high < low) {
+            low = high = label;
+        } else {
+            if (label < low) low = label;
+            if (label > high) high = label;
+        }
+    }
+
+    cfg->label_base = low;
+    cfg->num_label_slots = high - low + 1;
+    cfg->label_block = (int*)malloc(sizeof(int) * (size_t)(cfg->num_label_slots + 1));
+    if (!cfg->label_block) return false;
+
+    for (int i = 0; i < cfg->num_label_slots; i++) cfg->label_block[i] = -1;
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        CFGBlock *block = &cfg->blocks[b];
+        if (block->start == block->end || code[block->start].op != IR_LABEL_DEF) continue;
+        cfg->label_block[code[block->start].src1.value - low] = b;
+    }
+
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        CFGBlock *block = &cfg->blocks[b];
+        int next = b + 1 < cfg->num_blocks ? b + 1 : -1;
+        const IRInsn *last = block->end > block->start ? &code[block->end - 1] : NULL;
+
+        block->num_succ = 0;
+        if (last && last->op == IR_JUMP) {
+            int target = cfg_block_of_label(cfg, last->src1);
+            if (target >= 0) block->succ[block->num_succ++] = target;
+        } else if (last && last->op == IR_JUMP_ZERO) {
+            int target = cfg_block_of_label(cfg, last->src2);
+            if (next >= 0) block->succ[block->num_succ++] = next;
+            if (target >= 0 && target != next) block->succ[block->num_succ++] = target;
+        } else if (!last || last->op != IR_RETURN) {
+            if (next >= 0) block->succ[block->num_succ++] = next;
+        }
+    }
+
+    return true;
+}
+
+// Gather every block's predecessors, in block order
+static bool find_preds(CFG *cfg) {
+    int num_edges = 0;
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        cfg->blocks[b].num_preds = 0;
+        num_edges += cfg->blocks[b].num_succ;
+    }
+
+    cfg->num_edges = num_edges;
+    cfg->preds = (int*)malloc(sizeof(int) * (size_t)(num_edges + 1));
+    if (!cfg->preds) return false;
+
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        for (int s = 0; s < cfg->blocks[b].num_succ; s++) {
+            cfg->blocks[cfg->blocks[b].succ[s]].num_preds++;
+        }
+    }
+
+    int offset = 0;
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        cfg->blocks[b].pred_start = offset;
+        offset += cfg->blocks[b].num_preds;
+        cfg->blocks[b].num_preds = 0;
+    }
+
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        for (int s = 0; s < cfg->blocks[b].num_succ; s++) {
+            CFGBlock *succ = &cfg->blocks[cfg->blocks[b].succ[s]];
+            cfg->preds[succ->pred_start + succ->num_preds++] = b;
+        }
+    }
+
+    return true;
+}
+
+// Number the blocks reachable from the entry in reverse postorder, using
+// an explicit stack of (block, next successor) pairs
+static bool number_blocks(CFG *cfg) {
+    int n = cfg->num_blocks;
+    int *stack = (int*)malloc(sizeof(int) * (size_t)n * 2);
+    cfg->order = (int*)malloc(sizeof(int) * (size_t)n);
+    if (!stack || !cfg->order) {
+        free(stack);
+        return false;
+    }
+
+    for (int b = 0; b < n; b++) cfg->blocks[b].rpo = -1;
+
+    // rpo doubles as the visited mark while the walk runs
+    int depth = 1;
+    int post = 0;
+    stack[0] = 0;
+    stack[1] = 0;
+    cfg->blocks[0].rpo = 0;
+
+    while (depth > 0) {
+        int b = stack[(depth - 1) * 2];
+        int *next = &stack[(depth - 1) * 2 + 1];
+        CFGBlock *block = &cfg->blocks[b];
+
+        if (*next < block->num_succ) {
+            int succ = block->succ[(*next)++];
+            if (cfg->blocks[succ].rpo < 0) {
+                cfg->blocks[succ].rpo = 0;
+                stack[depth * 2] = succ;
+                stack[depth * 2 + 1] = 0;
+                depth++;
+            }
+        } else {
+            cfg->order[post++] = b;
+            depth--;
+        }
+    }
+
+    // Postorder to reverse postorder
+    cfg->num_reachable = post;
+    for (int i = 0; i < post / 2; i++) {
+        int t = cfg->order[i];
+        cfg->order[i] = cfg->order[post - 1 - i];
+        cfg->order[post - 1 - i] = t;
+    }
+    for (int i = 0; i < post; i++) cfg->blocks[cfg->order[i]].rpo = i;
+
+    free(stack);
+    return true;
+}
+
+// Walk up the dominator tree from two blocks until they meet
+static int intersect(const CFG *cfg, int a, int b) {
+    while (a != b) {
+        while (cfg->blocks[a].rpo > cfg->blocks[b].rpo) a = cfg->blocks[a].idom;
+        while (cfg->blocks[b].rpo > cfg->blocks[a].rpo) b = cfg->blocks[b].idom;
+    }
+    return a;
+}
+
+// Immediate dominators by the iterative algorithm of Cooper, Harvey and
+// Kennedy: repeat over reverse postorder until nothing changes
+static void find_dominators(CFG *cfg) {
+    for (int b = 0; b < cfg->num_blocks; b++) cfg->blocks[b].idom = -1;
+    cfg->blocks[0].idom = 0;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (int i = 1; i < cfg->num_reachable; i++) {
+            int b = cfg->order[i];
+            CFGBlock *block = &cfg->blocks[b];
+            int idom = -1;
+
+            for (int p = 0; p < block->num_preds; p++) {
+                int pred = cfg->preds[block->pred_start + p];
+                if (cfg->blocks[pred].idom < 0) continue;
+                idom = idom < 0 ? pred : intersect(cfg, pred, idom);
+            }
+
+            if (idom != block->idom) {
+                block->idom = idom;
+                changed = true;
+            }
+        }
+    }
+}
+
+// Build the dominator tree's child lists (in reverse postorder) and number
+// it in preorder and postorder for constant-time dominance checks
+static bool build_dom_tree(CFG *cfg) {
+    int n = cfg->num_blocks;
+    cfg->dom_children = (int*)malloc(sizeof(int) * (size_t)n);
+    int *stack = (int*)malloc(sizeof(int) * (size_t)n * 2);
+    if (!cfg->dom_children || !stack) {
+        free(stack);
+        return false;
+    }
+
+    for (int b = 0; b < n; b++) cfg->blocks[b].num_dom_children = 0;
+    for (int i = 1; i < cfg->num_reachable; i++) {
+        cfg->blocks[cfg->blocks[cfg->order[i]].idom].num_dom_children++;
+    }
+
+    int offset = 0;
+    for (int b = 0; b < n; b++) {
+        cfg->blocks[b].dom_start = offset;
+        offset += cfg->blocks[b].num_dom_children;
+        cfg->blocks[b].num_dom_children = 0;
+    }
+
+    for (int i = 1; i < cfg->num_reachable; i++) {
+        CFGBlock *parent = &cfg->blocks[cfg->blocks[cfg->order[i]].idom];
+        cfg->dom_children[parent->dom_start + parent->num_dom_children++] = cfg->order[i];
+    }
+
+    int counter = 0;
+    int depth = 1;
+    stack[0] = 0;
+    stack[1] = 0;
+    cfg->blocks[0].dom_pre = counter++;
+
+    while (depth > 0) {
+        CFGBlock *block = &cfg->blocks[stack[(depth - 1) * 2]];
+        int *next = &stack[(depth - 1) * 2 + 1];
+
+        if (*next < block->num_dom_children) {
+            int child = cfg->dom_children[block->dom_start + (*next)++];
+            cfg->blocks[child].dom_pre = counter++;
+            stack[depth * 2] = child;
+            stack[depth * 2 + 1] = 0;
+            depth++;
+        } else {
+            block->dom_post = counter++;
+            depth--;
+        }
+    }
+
+    free(stack);
+    return true;
+}
+
+// Dominance frontiers: each join point is in the frontier of every block
+// from its predecessors up to (not including) its immediate dominator.
+// Runs twice, counting and then filling, with last_join to drop repeats.
+static bool find_frontiers(CFG *cfg) {
+    int n = cfg->num_blocks;
+    int *last_join = (int*)malloc(sizeof(int) * (size_t)n);
+    if (!last_join) return false;
+
+    for (int fill = 0; fill < 2; fill++) {
+        for (int b = 0; b < n; b++) {
+            last_join[b] = -1;
+            if (!fill) cfg->blocks[b].num_df = 0;
+        }
+
+        if (fill) {
+            int offset = 0;
+            for (int b = 0; b < n; b++) {
+                cfg->blocks[b].df_start = offset;
+                offset += cfg->blocks[b].num_df;
+                cfg->blocks[b].num_df = 0;
+            }
+
+            cfg->frontier = (int*)malloc(sizeof(int) * (size_t)(offset + 1));
+            if (!cfg->frontier) {
+                free(last_join);
+                return false;
+            }
+        }
+
+        for (int b = 0; b < n; b++) {
+            CFGBlock *block = &cfg->blocks[b];
+            if (block->rpo < 0 || block->num_preds < 2) continue;
+
+            for (int p = 0; p < block->num_preds; p++) {
+                int runner = cfg->preds[block->pred_start + p];
+                if (cfg->blocks[runner].rpo < 0) continue;
+
+                while (runner != block->idom && last_join[runner] != b) {
+                    CFGBlock *r = &cfg->blocks[runner];
+                    last_join[runner] = b;
+                    if (fill) cfg->frontier[r->df_start + r->num_df] = b;
+                    r->num_df++;
+                    runner = r->idom;
+                }
+            }
+        }
+    }
+
+    free(last_join);
+    return true;
+}
+
+// Build the control-flow graph, dominator tree and dominance frontiers of
+// the function whose IR_FUNCTION instruction is at func_start
+CFG* cfg_build(const IRProgram *ir, size_t func_start) {
+    CFG *cfg = (CFG*)calloc(1, sizeof(CFG));
+    if (!cfg) return NULL;
+
+    size_t end = func_start + 1;
+    while (end < ir->num_code && ir->code[end].op != IR_END_FUNCTION) end++;
+
+    cfg->ir = ir;
+    cfg->func_start = func_start;
+    cfg->func_end = end;
+    cfg->num_blocks = split_blocks(ir->code, func_start + 1, end, NULL);
+    cfg->blocks = (CFGBlock*)calloc((size_t)cfg->num_blocks, sizeof(CFGBlock));
+    if (!cfg->blocks) {
+        cfg_free(cfg);
+        return NULL;
+    }
+    split_blocks(ir->code, func_start + 1, end, cfg->blocks);
+
+    if (!link_blocks(cfg) || !find_preds(cfg) || !number_blocks(cfg)) {
+        cfg_free(cfg);
+        return NULL;
+    }
+
+    find_dominators(cfg);
+    if (!build_dom_tree(cfg) || !find_frontiers(cfg)) {
+        cfg_free(cfg);
+        return NULL;
+    }
+
+    return cfg;
+}
+
+// Free a control-flow graph
+void cfg_free(CFG *cfg) {
+    if (!cfg) return;
+
+    free(cfg->blocks);
+    free(cfg->preds);
+    free(cfg->order);
+    free(cfg->dom_children);
+    free(cfg->frontier);
+    free(cfg->label_block);
+    free(cfg);
+}
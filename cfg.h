@@ -0,0 +1,53 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include "common.h"
+#include "ir.h"
+
+// Basic block: the instructions [start, end) of the program's TAC
+typedef struct {
+    size_t start;
+    size_t end;
+    int succ[2];            // Fallthrough first, then the jump target
+    int num_succ;
+    int pred_start;         // Predecessors, in CFG.preds
+    int num_preds;
+    int rpo;                // Position in reverse postorder, -1 if unreachable
+    int idom;               // Immediate dominator, -1 if unreachable
+    int dom_start;          // Dominator tree children, in CFG.dom_children
+    int num_dom_children;
+    int dom_pre;            // Dominator tree preorder interval
+    int dom_post;
+    int df_start;           // Dominance frontier, in CFG.frontier
+    int num_df;
+} CFGBlock;
+
+// Control-flow graph of one function. Block 0 is the entry; it holds the
+// code before the first label and may be empty.
+typedef struct {
+    const IRProgram *ir;
+    size_t func_start;      // IR_FUNCTION instruction
+    size_t func_end;        // IR_END_FUNCTION instruction
+
+    CFGBlock *blocks;
+    int num_blocks;
+    int *preds;
+    int num_edges;
+    int *order;             // Reachable blocks in reverse postorder
+    int num_reachable;
+    int *dom_children;
+    int *frontier;
+
+    int label_base;         // Lowest label defined in the function
+    int num_label_slots;
+    int *label_block;       // Block of each label, by label - label_base
+} CFG;
+
+// CFG functions
+CFG* cfg_build(const IRProgram *ir, size_t func_start);
+void cfg_free(CFG *cfg);
+int cfg_block_of_label(const CFG *cfg, IROperand label);
+int cfg_pred_index(const CFG *cfg, int block, int pred);
+bool cfg_dominates(const CFG *cfg, int a, int b);
+
+#endif // CFG_H
@@ -1,19 +1,28 @@
 #include "codegen.h"
+#include "outbuf.h"
+#include "stats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 
 // Initialize the code generator
 CodeGenerator* codegen_init(ASTNode *ast) {
-    CodeGenerator *codegen = (CodeGenerator*)malloc(sizeof(CodeGenerator));
+    CodeGenerator *codegen = (CodeGenerator*)stats_malloc(sizeof(CodeGenerator));
     if (!codegen) return NULL;
     
     codegen->ast = ast;
-    codegen->tac_file = NULL;
-    codegen->stack_file = NULL;
-    codegen->target_file = NULL;
-    codegen->temp_var_count = 0;
-    codegen->label_count = 0;
+    codegen->ir = NULL;
+    codegen->symbols = NULL;
+    codegen->opt_level = 0;
+    memset(&codegen->opt_report, 0, sizeof(codegen->opt_report));
+    codegen->jobs = 1;
+    codegen->cache = NULL;
+    codegen->num_regs = 0;
+    memset(&codegen->reg_stats, 0, sizeof(codegen->reg_stats));
+    codegen->peephole = false;
+    memset(&codegen->target_peephole, 0, sizeof(codegen->target_peephole));
     
     return codegen;
 }
@@ -22,663 +31,1040 @@ CodeGenerator* codegen_init(ASTNode *ast) {
 void codegen_free(CodeGenerator *codegen) {
     if (!codegen) return;
     
-    if (codegen->tac_file) {
-        fclose(codegen->tac_file);
+    ir_free(codegen->ir);
+    free(codegen);
+}
+
+// How a node is being generated; kept in slots[0] of its walk frame
+typedef enum {
+    GEN_IGNORE,     // Not generated (e.g. parameter lists)
+    GEN_FUNCTION,   // Function declaration
+    GEN_STMT,       // Statement
+    GEN_EXPR,       // Expression producing a value
+    GEN_EXPR_STMT   // Expression whose value is discarded
+} GenMode;
+
+// Walk frame slots
+#define SLOT_MODE  0
+#define SLOT_BASE  1    // TAC value stack depth when the node was entered
+#define SLOT_LABEL 2    // First of up to three labels
+#define SLOT_ASSIGNED 2 // Other expressions: last child that assigns, see assigned_before_use
+#define SLOT_RESULT 4   // Result temp of "&&" and "||"
+#define SLOT_PHASE 5    // Last for loop phase written
+
+// For loops visit their body before the update expression
+static const int for_order[] = { 0, 1, 3, 2 };
+
+// Work out how a node is generated from its parent and position
+static GenMode gen_mode(ASTWalkFrame *frame) {
+    ASTWalkFrame *parent = frame->parent;
+    if (!parent) {
+        return frame->node->type == NODE_FUNCTION_DECL ? GEN_FUNCTION : GEN_STMT;
     }
     
-    if (codegen->stack_file) {
-        fclose(codegen->stack_file);
+    GenMode parent_mode = (GenMode)parent->slots[SLOT_MODE];
+    if (parent_mode == GEN_EXPR || parent_mode == GEN_EXPR_STMT) return GEN_EXPR;
+    if (parent_mode == GEN_IGNORE) return GEN_IGNORE;
+    
+    switch (parent->node->type) {
+        case NODE_PROGRAM:
+            return frame->node->type == NODE_FUNCTION_DECL ? GEN_FUNCTION : GEN_IGNORE;
+        case NODE_FUNCTION_DECL:
+            return frame->index == 1 ? GEN_STMT : GEN_IGNORE;
+        case NODE_BLOCK:
+            return GEN_STMT;
+        case NODE_IF:
+        case NODE_WHILE:
+            return frame->index == 0 ? GEN_EXPR : GEN_STMT;
+        case NODE_FOR:
+            // Init, condition, update, body (ast_create_for fills every slot)
+            return frame->index == 1 ? GEN_EXPR : GEN_STMT;
+        default:
+            return frame->index == 0 ? GEN_EXPR : GEN_IGNORE;
+    }
+}
+
+// Check if a node type can be generated as an expression
+static bool is_expr_node(ASTWalkFrame *frame) {
+    switch (frame->node->type) {
+        case NODE_NUMBER:
+        case NODE_STRING:
+        case NODE_IDENTIFIER:
+        case NODE_ASSIGNMENT:
+        case NODE_BINARY_OP:
+        case NODE_UNARY_OP:
+        case NODE_CALL:
+            return true;
+        case NODE_BLOCK:
+            // Argument list of a call
+            return frame->parent && frame->parent->node->type == NODE_CALL;
+        default:
+            return false;
     }
+}
+
+// Check if a node is "&&" or "||", whose right operand is only evaluated
+// when the left one does not already decide the result
+static bool is_short_circuit(const ASTNode *node) {
+    if (node->type != NODE_BINARY_OP || node->num_children != 2) return false;
     
-    if (codegen->target_file) {
-        fclose(codegen->target_file);
+    IROpcode op = ir_binary_opcode(node->value);
+    return op == IR_AND || op == IR_OR;
+}
+
+// Check if a node type can be generated as a statement
+static bool is_stmt_node(NodeType type) {
+    switch (type) {
+        case NODE_PROGRAM:
+        case NODE_BLOCK:
+        case NODE_VARIABLE_DECL:
+        case NODE_ASSIGNMENT:
+        case NODE_IF:
+        case NODE_WHILE:
+        case NODE_FOR:
+        case NODE_RETURN:
+            return true;
+        default:
+            return false;
     }
+}
+
+// Map a for loop child index to its place in the emitted sequence
+// (init, condition, body, update) so pieces between them can be written
+static int for_phase(int index) {
+    static const int phases[] = { 0, 1, 3, 2 };
+    return index < 0 ? 4 : phases[index];
+}
+
+
+// Emit a label into both the TAC and the stack code
+static void emit_label(IRProgram *ir, intptr_t label) {
+    ir_emit(ir, IR_LABEL_DEF, ir_none(), ir_label((int)label), ir_none());
+    ir_emit_stack(ir, STACK_LABEL, ir_label((int)label));
+}
+
+// Emit an unconditional jump
+static void emit_jump(IRProgram *ir, intptr_t label) {
+    ir_emit(ir, IR_JUMP, ir_none(), ir_label((int)label), ir_none());
+    ir_emit_stack(ir, STACK_JMP, ir_label((int)label));
+}
+
+// State for the walk: TAC operands wait on a value stack until their
+// parent uses them, while stack code is emitted as each node completes
+typedef struct {
+    IRProgram *ir;
+    IROperand *values;
+    int num_values;
+    int capacity;
+    const SymbolTable *symbols; // Resolved names, or NULL
+    IROperand *operands;        // Operand of each symbol once first used
+    int *operand_unit;          // Unit whose IR each cached operand is in
+    int unit;                   // Unit being generated
+    const ASTNode *expr_root;   // Outermost expression being generated
+    const ASTNode **assigning;  // Its nodes that contain an assignment, sorted
+    int num_assigning;          // -1 until they are looked for
+    int assigning_capacity;
+} GenWalk;
+
+// Operand for the function or variable a node names. Resolved nodes are
+// looked up by symbol, so each symbol's name is interned only once per
+// function.
+static IROperand gen_name(GenWalk *walk, const ASTNode *node, IROperandKind kind, const char *name) {
+    const Symbol *symbol = walk->symbols ? symtab_get(walk->symbols, node->symbol) : NULL;
+    if (!symbol) return ir_name(walk->ir, kind, name);
     
-    free(codegen);
+    IROperand *operand = &walk->operands[node->symbol];
+    if (walk->operand_unit[node->symbol] != walk->unit) {
+        *operand = ir_name(walk->ir, kind, symbol->ir_name);
+        walk->operand_unit[node->symbol] = walk->unit;
+    }
+    return *operand;
 }
 
-// Generate a new temporary variable name
-static char* new_temp(CodeGenerator *codegen) {
-    char *temp = (char*)malloc(16);
-    if (!temp) return NULL;
+// Push an operand
+static void tac_push(GenWalk *walk, IROperand value) {
+    if (walk->num_values >= walk->capacity) {
+        int capacity = walk->capacity ? walk->capacity * 2 : 16;
+        IROperand *values = (IROperand*)stats_realloc(walk->values, sizeof(IROperand) * capacity);
+        if (!values) {
+            walk->ir->failed = true;
+            return;
+        }
+        walk->values = values;
+        walk->capacity = capacity;
+    }
+    walk->values[walk->num_values++] = value;
+}
+
+// Pop an operand above base, or IR_NONE if the node produced none
+static IROperand tac_pop(GenWalk *walk, intptr_t base) {
+    if (walk->num_values <= base) return ir_none();
+    return walk->values[--walk->num_values];
+}
+
+// Drop operands above base (results of expression statements)
+static void tac_truncate(GenWalk *walk, intptr_t base) {
+    if (walk->num_values > base) {
+        walk->num_values = (int)base;
+    }
+}
+
+// Order nodes by address for the sorted list of assigning nodes
+static int compare_nodes(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)*(const ASTNode* const*)a;
+    uintptr_t y = (uintptr_t)*(const ASTNode* const*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Add a node to the assigning list if it is an assignment or a child of
+// it is; slots[0] of the parent records that it has such a child
+static void collect_assigning(ASTWalkFrame *frame, void *ctx) {
+    GenWalk *walk = (GenWalk*)ctx;
+    if (frame->node->type != NODE_ASSIGNMENT && !frame->slots[0]) return;
+    if (frame->parent) frame->parent->slots[0] = 1;
     
-    sprintf(temp, "t%d", codegen->temp_var_count++);
-    return temp;
+    if (walk->num_assigning >= walk->assigning_capacity) {
+        int capacity = walk->assigning_capacity ? walk->assigning_capacity * 2 : 16;
+        const ASTNode **nodes = (const ASTNode**)stats_realloc(walk->assigning, sizeof(ASTNode*) * capacity);
+        if (!nodes) {
+            walk->ir->failed = true;
+            return;
+        }
+        walk->assigning = nodes;
+        walk->assigning_capacity = capacity;
+    }
+    walk->assigning[walk->num_assigning++] = frame->node;
 }
 
-// Generate a new label
-static char* new_label(CodeGenerator *codegen) {
-    char *label = (char*)malloc(16);
-    if (!label) return NULL;
+// Check if a node of the current expression contains an assignment. The
+// expression is searched once, on the first question about it.
+static bool node_assigns(GenWalk *walk, const ASTNode *node) {
+    static const ASTVisitor visitor = { NULL, NULL, collect_assigning };
     
-    sprintf(label, "L%d", codegen->label_count++);
-    return label;
+    if (walk->num_assigning < 0) {
+        walk->num_assigning = 0;
+        if (!ast_walk((ASTNode*)walk->expr_root, &visitor, walk)) walk->ir->failed = true;
+        if (walk->num_assigning > 0) {
+            qsort(walk->assigning, (size_t)walk->num_assigning, sizeof(ASTNode*), compare_nodes);
+        }
+    }
+    return walk->num_assigning > 0 &&
+           bsearch(&node, walk->assigning, (size_t)walk->num_assigning, sizeof(ASTNode*), compare_nodes);
 }
 
-// Generate Three Address Code (TAC) for an expression
-static char* generate_expr_tac(CodeGenerator *codegen, ASTNode *node) {
-    if (!node) return NULL;
+// Check if a sibling generated after this operand, but before the parent
+// reads it, assigns a variable. TAC operands name a variable and read it
+// late, while the stack code loads it at once, so such an operand is
+// copied to a temp where the stack code loads it. A parent's children are
+// searched once: SLOT_ASSIGNED then holds the visiting position of the
+// last child that assigns plus 2, or 1 if none does.
+static bool assigned_before_use(GenWalk *walk, ASTWalkFrame *frame) {
+    ASTWalkFrame *parent = frame->parent;
+    if (!parent) return false;
     
-    switch (node->type) {
-        case NODE_NUMBER:
-            return strdup(node->value);
-            
-        case NODE_IDENTIFIER:
-            return strdup(node->value);
-            
-        case NODE_BINARY_OP: {
-            char *left = generate_expr_tac(codegen, &node->children[0]);
-            char *right = generate_expr_tac(codegen, &node->children[1]);
-            char *temp = new_temp(codegen);
-            
-            fprintf(codegen->tac_file, "%s = %s %s %s\n", 
-                    temp, left, node->value, right);
-            
-            free(left);
-            free(right);
-            return temp;
+    // Statements read their operands at once, and "&&" and "||" test the
+    // left one before the right one is generated
+    GenMode mode = (GenMode)parent->slots[SLOT_MODE];
+    if ((mode != GEN_EXPR && mode != GEN_EXPR_STMT) || is_short_circuit(parent->node)) return false;
+    
+    int count = parent->node->num_children;
+    if (parent->slots[SLOT_ASSIGNED] == 0) {
+        parent->slots[SLOT_ASSIGNED] = 1;
+        for (int position = 0; position < count; position++) {
+            const ASTNode *child = parent->node->children[parent->reverse ? count - 1 - position : position];
+            if (child && node_assigns(walk, child)) parent->slots[SLOT_ASSIGNED] = position + 2;
         }
-        
-        case NODE_UNARY_OP: {
-            char *expr = generate_expr_tac(codegen, &node->children[0]);
-            char *temp = new_temp(codegen);
-            
-            fprintf(codegen->tac_file, "%s = %s %s\n", 
-                    temp, node->value, expr);
-            
-            free(expr);
-            return temp;
+    }
+    
+    int position = parent->reverse ? count - 1 - frame->index : frame->index;
+    return position + 2 < parent->slots[SLOT_ASSIGNED];
+}
+
+// Push a variable as an operand, in a temp of its own if a later sibling
+// could assign it first
+static void push_variable(GenWalk *walk, ASTWalkFrame *frame, IROperand var) {
+    if (assigned_before_use(walk, frame)) {
+        IROperand temp = ir_new_temp(walk->ir);
+        ir_emit(walk->ir, IR_COPY, temp, var, ir_none());
+        var = temp;
+    }
+    tac_push(walk, var);
+}
+
+// Jump to label if the condition on top of the value stack is zero
+static void emit_branch_zero(GenWalk *walk, intptr_t base, intptr_t label) {
+    IROperand condition = tac_pop(walk, base);
+    ir_emit(walk->ir, IR_JUMP_ZERO, ir_none(), condition, ir_label((int)label));
+    ir_emit_stack(walk->ir, STACK_JZ, ir_label((int)label));
+}
+
+// Emit a call whose arguments are on the stack above base; returns its temp.
+// Arguments are generated last to first, which is the order the stack code
+// pushes them in, so the TAC params are read back from the top down.
+static IROperand gen_call(GenWalk *walk, ASTWalkFrame *frame) {
+    IRProgram *ir = walk->ir;
+    intptr_t base = frame->slots[SLOT_BASE];
+    int num_args = walk->num_values - (int)base;
+    
+    // Generate parameter passing code
+    for (int i = walk->num_values - 1; i >= base; i--) {
+        ir_emit(ir, IR_PARAM, ir_none(), walk->values[i], ir_none());
+    }
+    tac_truncate(walk, base);
+    
+    // Generate call
+    IROperand function = gen_name(walk, frame->node, IR_FUNC, frame->node->value);
+    IROperand temp = ir_new_temp(ir);
+    ir_emit(ir, IR_CALL, temp, function, ir_const(num_args));
+    ir_emit_stack(ir, STACK_CALL, function);
+    return temp;
+}
+
+// Set the result temp of "&&" or "||" to a constant on one path
+static void emit_result_const(IRProgram *ir, IROperand result, int64_t value) {
+    ir_emit(ir, IR_COPY, result, ir_const(value), ir_none());
+    ir_emit_stack(ir, STACK_PUSH, ir_const(value));
+    ir_emit_stack(ir, STACK_STORE, result);
+}
+
+// Branch on the left operand of "&&" or "||" before the right one is
+// generated. A zero left operand skips the right one for "&&", while any
+// other value settles "||" as 1. The result is kept in a temp on every
+// path, in the stack code as well, so the operand stack is the same
+// wherever the paths meet.
+static void gen_short_circuit_left(GenWalk *walk, ASTWalkFrame *frame) {
+    IRProgram *ir = walk->ir;
+    IROperand result = ir_new_temp(ir);
+    
+    // Left operand decides: "&&" is 0, "||" evaluates the right one
+    frame->slots[SLOT_LABEL] = ir_new_label(ir);
+    frame->slots[SLOT_LABEL + 1] = ir_new_label(ir);
+    frame->slots[SLOT_RESULT] = result.value;
+    
+    emit_branch_zero(walk, frame->slots[SLOT_BASE], frame->slots[SLOT_LABEL]);
+    if (ir_binary_opcode(frame->node->value) == IR_OR) {
+        emit_result_const(ir, result, 1);
+        emit_jump(ir, frame->slots[SLOT_LABEL + 1]);
+        emit_label(ir, frame->slots[SLOT_LABEL]);
+    }
+}
+
+// Finish "&&" or "||" once its right operand has been generated: the
+// right operand, as 0 or 1, is the result on the path that evaluated it
+static void gen_short_circuit_right(GenWalk *walk, ASTWalkFrame *frame) {
+    IRProgram *ir = walk->ir;
+    IROperand right = tac_pop(walk, frame->slots[SLOT_BASE]);
+    IROperand result = ir_temp((int)frame->slots[SLOT_RESULT]);
+    
+    ir_emit(ir, IR_NE, result, right, ir_const(0));
+    ir_emit_stack(ir, STACK_PUSH, ir_const(0));
+    ir_emit_stack(ir, STACK_NEQ, ir_none());
+    ir_emit_stack(ir, STACK_STORE, result);
+    
+    if (ir_binary_opcode(frame->node->value) == IR_AND) {
+        emit_jump(ir, frame->slots[SLOT_LABEL + 1]);
+        emit_label(ir, frame->slots[SLOT_LABEL]);
+        emit_result_const(ir, result, 0);
+    }
+    emit_label(ir, frame->slots[SLOT_LABEL + 1]);
+    
+    tac_push(walk, result);
+    ir_emit_stack(ir, STACK_LOAD, result);
+}
+
+// Store the value on top of the stack into a variable
+static void gen_store(GenWalk *walk, intptr_t base, IROperand var) {
+    IROperand value = tac_pop(walk, base);
+    ir_emit(walk->ir, IR_COPY, var, value, ir_none());
+    ir_emit_stack(walk->ir, STACK_STORE, var);
+}
+
+// Write the parts of a for loop that come before phase `to`
+static void gen_for_step(GenWalk *walk, ASTWalkFrame *frame, int to) {
+    IRProgram *ir = walk->ir;
+    intptr_t base = frame->slots[SLOT_BASE];
+    
+    for (int phase = (int)frame->slots[SLOT_PHASE] + 1; phase <= to; phase++) {
+        switch (phase) {
+            case 1:
+                emit_label(ir, frame->slots[SLOT_LABEL]);
+                break;
+            case 2:
+                emit_branch_zero(walk, base, frame->slots[SLOT_LABEL + 1]);
+                break;
+            case 3:
+                emit_label(ir, frame->slots[SLOT_LABEL + 2]);
+                break;
+            case 4:
+                emit_jump(ir, frame->slots[SLOT_LABEL]);
+                emit_label(ir, frame->slots[SLOT_LABEL + 1]);
+                break;
         }
+        tac_truncate(walk, base);
+    }
+    frame->slots[SLOT_PHASE] = to;
+}
+
+// Check if a node's parent is generated as an expression
+static bool is_expr_parent(const ASTWalkFrame *frame) {
+    GenMode mode = frame->parent ? (GenMode)frame->parent->slots[SLOT_MODE] : GEN_IGNORE;
+    return mode == GEN_EXPR || mode == GEN_EXPR_STMT;
+}
+
+// Start an outermost expression; its assignments are looked for only if
+// an operand needs to know
+static void begin_expression(GenWalk *walk, const ASTNode *node) {
+    walk->expr_root = node;
+    walk->num_assigning = -1;
+}
+
+// Classify a node on entry, set up its labels and child order and emit
+// anything that precedes its children
+static ASTWalkAction gen_enter(ASTWalkFrame *frame, void *ctx) {
+    GenWalk *walk = (GenWalk*)ctx;
+    IRProgram *ir = walk->ir;
+    ASTNode *node = frame->node;
+    
+    GenMode mode = gen_mode(frame);
+    frame->slots[SLOT_MODE] = mode;
+    frame->slots[SLOT_BASE] = walk->num_values;
+    if (mode == GEN_EXPR && !is_expr_parent(frame)) begin_expression(walk, node);
+    
+    switch (mode) {
+        case GEN_IGNORE:
+        case GEN_EXPR_STMT:
+            return AST_WALK_SKIP;
         
-        case NODE_CALL: {
-            // Handle function call arguments
-            char *args[16];  // Assuming no more than 16 arguments
-            int num_args = 0;
-            
-            if (node->num_children > 0 && node->children[0].type == NODE_BLOCK) {
-                ASTNode *args_node = &node->children[0];
-                num_args = args_node->num_children;
-                
-                for (int i = 0; i < num_args; i++) {
-                    args[i] = generate_expr_tac(codegen, &args_node->children[i]);
-                }
-            }
-            
-            // Generate parameter passing code
-            for (int i = 0; i < num_args; i++) {
-                fprintf(codegen->tac_file, "param %s\n", args[i]);
+        case GEN_EXPR:
+            if (node->type == NODE_BLOCK) {
+                // Arguments are pushed last to first
+                frame->reverse = true;
             }
-            
-            // Generate call
-            char *temp = new_temp(codegen);
-            fprintf(codegen->tac_file, "%s = call %s, %d\n", 
-                    temp, node->value, num_args);
-            
-            // Free argument temps
-            for (int i = 0; i < num_args; i++) {
-                free(args[i]);
-            }
-            
-            return temp;
+            return is_expr_node(frame) ? AST_WALK_CHILDREN : AST_WALK_SKIP;
+        
+        case GEN_FUNCTION: {
+            IROperand function = gen_name(walk, node, IR_FUNC, node->value);
+            ir_emit(ir, IR_FUNCTION, ir_none(), function, ir_none());
+            ir_emit_stack(ir, STACK_FUNC, function);
+            return AST_WALK_CHILDREN;
         }
         
-        default:
-            return strdup("error");
+        case GEN_STMT:
+            break;
+    }
+    
+    if (!is_stmt_node(node->type)) {
+        // Expression statements are generated for their side effects
+        bool expr = is_expr_node(frame);
+        frame->slots[SLOT_MODE] = expr ? GEN_EXPR_STMT : GEN_IGNORE;
+        if (expr) begin_expression(walk, node);
+        return expr ? AST_WALK_CHILDREN : AST_WALK_SKIP;
     }
-}
-
-// Generate TAC for a statement
-static void generate_stmt_tac(CodeGenerator *codegen, ASTNode *node) {
-    if (!node) return;
     
     switch (node->type) {
-        case NODE_BLOCK:
-            for (int i = 0; i < node->num_children; i++) {
-                generate_stmt_tac(codegen, &node->children[i]);
-            }
-            break;
-            
-        case NODE_VARIABLE_DECL: {
-            // Check if there's an initializer
-            if (node->num_children > 0) {
-                char *value = generate_expr_tac(codegen, &node->children[0]);
-                fprintf(codegen->tac_file, "%s = %s\n", node->value, value);
-                free(value);
-            }
+        case NODE_IF:
+            // Else and end labels
+            frame->slots[SLOT_LABEL] = ir_new_label(ir);
+            frame->slots[SLOT_LABEL + 1] = ir_new_label(ir);
             break;
-        }
         
-        case NODE_ASSIGNMENT: {
-            char *value = generate_expr_tac(codegen, &node->children[0]);
-            fprintf(codegen->tac_file, "%s = %s\n", node->value, value);
-            free(value);
+        case NODE_WHILE:
+            // Start and end labels
+            frame->slots[SLOT_LABEL] = ir_new_label(ir);
+            frame->slots[SLOT_LABEL + 1] = ir_new_label(ir);
+            emit_label(ir, frame->slots[SLOT_LABEL]);
             break;
-        }
         
-        case NODE_IF: {
-            char *condition = generate_expr_tac(codegen, &node->children[0]);
-            char *else_label = new_label(codegen);
-            char *end_label = new_label(codegen);
-            
-            fprintf(codegen->tac_file, "if %s == 0 goto %s\n", condition, else_label);
-            
-            // Then branch
-            generate_stmt_tac(codegen, &node->children[1]);
-            fprintf(codegen->tac_file, "goto %s\n", end_label);
-            
-            // Else branch
-            fprintf(codegen->tac_file, "%s:\n", else_label);
-            if (node->num_children > 2) {
-                generate_stmt_tac(codegen, &node->children[2]);
-            }
-            
-            fprintf(codegen->tac_file, "%s:\n", end_label);
-            
-            free(condition);
-            free(else_label);
-            free(end_label);
+        case NODE_FOR:
+            // Start, end and update labels
+            frame->slots[SLOT_LABEL] = ir_new_label(ir);
+            frame->slots[SLOT_LABEL + 1] = ir_new_label(ir);
+            frame->slots[SLOT_LABEL + 2] = ir_new_label(ir);
+            frame->slots[SLOT_PHASE] = 0;
+            frame->order = for_order;
+            frame->order_count = 4;
             break;
-        }
         
-        case NODE_WHILE: {
-            char *start_label = new_label(codegen);
-            char *end_label = new_label(codegen);
-            
-            fprintf(codegen->tac_file, "%s:\n", start_label);
-            
-            char *condition = generate_expr_tac(codegen, &node->children[0]);
-            fprintf(codegen->tac_file, "if %s == 0 goto %s\n", condition, end_label);
-            
-            // Loop body
-            generate_stmt_tac(codegen, &node->children[1]);
-            fprintf(codegen->tac_file, "goto %s\n", start_label);
-            
-            fprintf(codegen->tac_file, "%s:\n", end_label);
-            
-            free(condition);
-            free(start_label);
-            free(end_label);
+        default:
+            break;
+    }
+    
+    return AST_WALK_CHILDREN;
+}
+
+// Emit the jumps and labels that separate a node's children
+static void gen_child(ASTWalkFrame *frame, int index, void *ctx) {
+    GenWalk *walk = (GenWalk*)ctx;
+    IRProgram *ir = walk->ir;
+    intptr_t base = frame->slots[SLOT_BASE];
+    GenMode mode = (GenMode)frame->slots[SLOT_MODE];
+    
+    if ((mode == GEN_EXPR || mode == GEN_EXPR_STMT) && index == 1 && is_short_circuit(frame->node)) {
+        gen_short_circuit_left(walk, frame);
+        return;
+    }
+    if (mode != GEN_STMT) return;
+    
+    switch (frame->node->type) {
+        case NODE_BLOCK:
+            tac_truncate(walk, base);
             break;
-        }
         
-        case NODE_FOR: {
-            char *start_label = new_label(codegen);
-            char *end_label = new_label(codegen);
-            char *update_label = new_label(codegen);
-            
-            // Initializer
-            if (node->num_children > 0) {
-                generate_stmt_tac(codegen, &node->children[0]);
-            }
-            
-            fprintf(codegen->tac_file, "%s:\n", start_label);
-            
-            // Condition
-            if (node->num_children > 1) {
-                char *condition = generate_expr_tac(codegen, &node->children[1]);
-                fprintf(codegen->tac_file, "if %s == 0 goto %s\n", condition, end_label);
-                free(condition);
-            }
-            
-            // Body
-            if (node->num_children > 3) {
-                generate_stmt_tac(codegen, &node->children[3]);
+        case NODE_IF:
+            if (index == 1) {
+                emit_branch_zero(walk, base, frame->slots[SLOT_LABEL]);
+            } else if (index == 2) {
+                tac_truncate(walk, base);
+                emit_jump(ir, frame->slots[SLOT_LABEL + 1]);
+                emit_label(ir, frame->slots[SLOT_LABEL]);
             }
-            
-            fprintf(codegen->tac_file, "%s:\n", update_label);
-            
-            // Update
-            if (node->num_children > 2) {
-                char *update = generate_expr_tac(codegen, &node->children[2]);
-                free(update);
-            }
-            
-            fprintf(codegen->tac_file, "goto %s\n", start_label);
-            fprintf(codegen->tac_file, "%s:\n", end_label);
-            
-            free(start_label);
-            free(end_label);
-            free(update_label);
             break;
-        }
         
-        case NODE_RETURN: {
-            if (node->num_children > 0) {
-                char *value = generate_expr_tac(codegen, &node->children[0]);
-                fprintf(codegen->tac_file, "return %s\n", value);
-                free(value);
-            } else {
-                fprintf(codegen->tac_file, "return\n");
+        case NODE_WHILE:
+            if (index == 1) {
+                emit_branch_zero(walk, base, frame->slots[SLOT_LABEL + 1]);
             }
             break;
-        }
         
-        case NODE_CALL: {
-            char *result = generate_expr_tac(codegen, node);
-            free(result);
+        case NODE_FOR:
+            gen_for_step(walk, frame, for_phase(index));
             break;
-        }
         
         default:
             break;
     }
 }
 
-// Generate TAC for a function
-static void generate_function_tac(CodeGenerator *codegen, ASTNode *node) {
-    if (!node || node->type != NODE_FUNCTION_DECL) return;
-    
-    fprintf(codegen->tac_file, "function %s:\n", node->value);
-    
-    // Generate code for function body
-    if (node->num_children > 1) {
-        generate_stmt_tac(codegen, &node->children[1]);
-    }
-    
-    fprintf(codegen->tac_file, "end function\n\n");
-}
-
-// Generate stack code for an expression
-static void generate_expr_stack(CodeGenerator *codegen, ASTNode *node) {
-    if (!node) return;
+// Emit an expression node once its operands have been generated
+static void gen_expr(GenWalk *walk, ASTWalkFrame *frame) {
+    IRProgram *ir = walk->ir;
+    ASTNode *node = frame->node;
+    intptr_t base = frame->slots[SLOT_BASE];
     
     switch (node->type) {
-        case NODE_NUMBER:
-            fprintf(codegen->stack_file, "PUSH %s\n", node->value);
+        case NODE_NUMBER: {
+            IROperand value = ir_number(ir, node->value);
+            tac_push(walk, value);
+            ir_emit_stack(ir, STACK_PUSH, value);
             break;
-            
-        case NODE_IDENTIFIER:
-            fprintf(codegen->stack_file, "LOAD %s\n", node->value);
+        }
+        
+        case NODE_STRING: {
+            IROperand value = ir_literal(ir, node->value);
+            tac_push(walk, value);
+            ir_emit_stack(ir, STACK_PUSH, value);
             break;
+        }
+        
+        case NODE_IDENTIFIER: {
+            IROperand var = gen_name(walk, node, IR_VAR, node->value);
+            push_variable(walk, frame, var);
+            ir_emit_stack(ir, STACK_LOAD, var);
+            break;
+        }
+        
+        case NODE_ASSIGNMENT: {
+            // The assigned value is also the result
+            IROperand var = gen_name(walk, node, IR_VAR, node->value);
+            gen_store(walk, base, var);
+            push_variable(walk, frame, var);
+            ir_emit_stack(ir, STACK_LOAD, var);
+            break;
+        }
+        
+        case NODE_BINARY_OP: {
+            if (is_short_circuit(node)) {
+                gen_short_circuit_right(walk, frame);
+                break;
+            }
             
-        case NODE_BINARY_OP:
-            generate_expr_stack(codegen, &node->children[0]);
-            generate_expr_stack(codegen, &node->children[1]);
+            IROperand right = tac_pop(walk, base);
+            IROperand left = tac_pop(walk, base);
+            IROpcode op = ir_binary_opcode(node->value);
+            IROperand temp = ir_new_temp(ir);
             
-            if (strcmp(node->value, "+") == 0) {
-                fprintf(codegen->stack_file, "ADD\n");
-            } else if (strcmp(node->value, "-") == 0) {
-                fprintf(codegen->stack_file, "SUB\n");
-            } else if (strcmp(node->value, "*") == 0) {
-                fprintf(codegen->stack_file, "MUL\n");
-            } else if (strcmp(node->value, "/") == 0) {
-                fprintf(codegen->stack_file, "DIV\n");
-            } else if (strcmp(node->value, "%") == 0) {
-                fprintf(codegen->stack_file, "MOD\n");
-            } else if (strcmp(node->value, "==") == 0) {
-                fprintf(codegen->stack_file, "EQ\n");
-            } else if (strcmp(node->value, "!=") == 0) {
-                fprintf(codegen->stack_file, "NEQ\n");
-            } else if (strcmp(node->value, "<") == 0) {
-                fprintf(codegen->stack_file, "LT\n");
-            } else if (strcmp(node->value, "<=") == 0) {
-                fprintf(codegen->stack_file, "LTE\n");
-            } else if (strcmp(node->value, ">") == 0) {
-                fprintf(codegen->stack_file, "GT\n");
-            } else if (strcmp(node->value, ">=") == 0) {
-                fprintf(codegen->stack_file, "GTE\n");
+            ir_emit(ir, op, temp, left, right);
+            tac_push(walk, temp);
+            if (op != IR_NOP) {
+                ir_emit_stack(ir, (StackOp)(STACK_ADD + (op - IR_ADD)), ir_none());
             }
             break;
+        }
+        
+        case NODE_UNARY_OP: {
+            IROperand expr = tac_pop(walk, base);
+            IROpcode op = ir_unary_opcode(node->value);
+            IROperand temp = ir_new_temp(ir);
             
-        case NODE_UNARY_OP:
-            generate_expr_stack(codegen, &node->children[0]);
-            
-            if (strcmp(node->value, "-") == 0) {
-                fprintf(codegen->stack_file, "NEG\n");
-            } else if (strcmp(node->value, "!") == 0) {
-                fprintf(codegen->stack_file, "NOT\n");
+            ir_emit(ir, op, temp, expr, ir_none());
+            tac_push(walk, temp);
+            if (op != IR_NOP) {
+                ir_emit_stack(ir, (StackOp)(STACK_NEG + (op - IR_NEG)), ir_none());
             }
             break;
-            
+        }
+        
         case NODE_CALL:
-            // Handle function call arguments
-            if (node->num_children > 0 && node->children[0].type == NODE_BLOCK) {
-                ASTNode *args_node = &node->children[0];
-                
-                // Push arguments in reverse order
-                for (int i = args_node->num_children - 1; i >= 0; i--) {
-                    generate_expr_stack(codegen, &args_node->children[i]);
-                }
-            }
-            
-            fprintf(codegen->stack_file, "CALL %s\n", node->value);
+            tac_push(walk, gen_call(walk, frame));
             break;
-            
+        
+        case NODE_BLOCK:
+            // Arguments stay on the stack for the call
+            break;
+        
         default:
+            tac_push(walk, ir_none());
             break;
     }
 }
 
-// Generate stack code for a statement
-static void generate_stmt_stack(CodeGenerator *codegen, ASTNode *node) {
-    if (!node) return;
+// Emit the node itself once its children have been generated
+static void gen_leave(ASTWalkFrame *frame, void *ctx) {
+    GenWalk *walk = (GenWalk*)ctx;
+    IRProgram *ir = walk->ir;
+    ASTNode *node = frame->node;
+    intptr_t base = frame->slots[SLOT_BASE];
     
-    switch (node->type) {
-        case NODE_BLOCK:
-            for (int i = 0; i < node->num_children; i++) {
-                generate_stmt_stack(codegen, &node->children[i]);
-            }
+    switch ((GenMode)frame->slots[SLOT_MODE]) {
+        case GEN_IGNORE:
+            return;
+        
+        case GEN_FUNCTION:
+            tac_truncate(walk, base);
+            ir_emit(ir, IR_END_FUNCTION, ir_none(), ir_none(), ir_none());
+            ir_emit_stack(ir, STACK_END_FUNC, ir_none());
+            return;
+        
+        case GEN_EXPR:
+            gen_expr(walk, frame);
+            return;
+        
+        case GEN_EXPR_STMT:
+            gen_expr(walk, frame);
+            tac_truncate(walk, base);
+            ir_emit_stack(ir, STACK_POP, ir_none());  // Discard result
+            return;
+        
+        case GEN_STMT:
             break;
-            
+    }
+    
+    switch (node->type) {
         case NODE_VARIABLE_DECL:
-            // Check if there's an initializer
+            // Only the initializer is on the stack
             if (node->num_children > 0) {
-                generate_expr_stack(codegen, &node->children[0]);
-                fprintf(codegen->stack_file, "STORE %s\n", node->value);
+                gen_store(walk, base, gen_name(walk, node, IR_VAR, ast_decl_name(node)));
             }
             break;
-            
+        
         case NODE_ASSIGNMENT:
-            generate_expr_stack(codegen, &node->children[0]);
-            fprintf(codegen->stack_file, "STORE %s\n", node->value);
+            gen_store(walk, base, gen_name(walk, node, IR_VAR, node->value));
             break;
-            
-        case NODE_IF: {
-            char *else_label = new_label(codegen);
-            char *end_label = new_label(codegen);
-            
-            generate_expr_stack(codegen, &node->children[0]);
-            fprintf(codegen->stack_file, "JZ %s\n", else_label);
-            
-            // Then branch
-            generate_stmt_stack(codegen, &node->children[1]);
-            fprintf(codegen->stack_file, "JMP %s\n", end_label);
-            
-            // Else branch
-            fprintf(codegen->stack_file, "%s:\n", else_label);
-            if (node->num_children > 2) {
-                generate_stmt_stack(codegen, &node->children[2]);
+        
+        case NODE_IF:
+            tac_truncate(walk, base);
+            if (node->num_children <= 2) {
+                emit_label(ir, frame->slots[SLOT_LABEL]);
             }
-            
-            fprintf(codegen->stack_file, "%s:\n", end_label);
-            
-            free(else_label);
-            free(end_label);
+            emit_label(ir, frame->slots[SLOT_LABEL + 1]);
             break;
-        }
         
-        case NODE_WHILE: {
-            char *start_label = new_label(codegen);
-            char *end_label = new_label(codegen);
-            
-            fprintf(codegen->stack_file, "%s:\n", start_label);
-            
-            generate_expr_stack(codegen, &node->children[0]);
-            fprintf(codegen->stack_file, "JZ %s\n", end_label);
-            
-            // Loop body
-            generate_stmt_stack(codegen, &node->children[1]);
-            fprintf(codegen->stack_file, "JMP %s\n", start_label);
-            
-            fprintf(codegen->stack_file, "%s:\n", end_label);
-            
-            free(start_label);
-            free(end_label);
+        case NODE_WHILE:
+            tac_truncate(walk, base);
+            emit_jump(ir, frame->slots[SLOT_LABEL]);
+            emit_label(ir, frame->slots[SLOT_LABEL + 1]);
             break;
-        }
         
-        case NODE_FOR: {
-            char *start_label = new_label(codegen);
-            char *end_label = new_label(codegen);
-            char *update_label = new_label(codegen);
-            
-            // Initializer
-            if (node->num_children > 0) {
-                generate_stmt_stack(codegen, &node->children[0]);
-            }
-            
-            fprintf(codegen->stack_file, "%s:\n", start_label);
-            
-            // Condition
-            if (node->num_children > 1) {
-                generate_expr_stack(codegen, &node->children[1]);
-                fprintf(codegen->stack_file, "JZ %s\n", end_label);
-            }
-            
-            // Body
-            if (node->num_children > 3) {
-                generate_stmt_stack(codegen, &node->children[3]);
-            }
-            
-            fprintf(codegen->stack_file, "%s:\n", update_label);
-            
-            // Update
-            if (node->num_children > 2) {
-                generate_expr_stack(codegen, &node->children[2]);
-                fprintf(codegen->stack_file, "POP\n");  // Discard result
-            }
-            
-            fprintf(codegen->stack_file, "JMP %s\n", start_label);
-            fprintf(codegen->stack_file, "%s:\n", end_label);
-            
-            free(start_label);
-            free(end_label);
-            free(update_label);
+        case NODE_FOR:
+            gen_for_step(walk, frame, for_phase(-1));
             break;
-        }
         
         case NODE_RETURN:
             if (node->num_children > 0) {
-                generate_expr_stack(codegen, &node->children[0]);
-                fprintf(codegen->stack_file, "RET\n");
+                ir_emit(ir, IR_RETURN, ir_none(), tac_pop(walk, base), ir_none());
+                ir_emit_stack(ir, STACK_RET, ir_none());
             } else {
-                fprintf(codegen->stack_file, "RET0\n");
+                ir_emit(ir, IR_RETURN, ir_none(), ir_none(), ir_none());
+                ir_emit_stack(ir, STACK_RET0, ir_none());
             }
             break;
-            
-        case NODE_CALL:
-            generate_expr_stack(codegen, node);
-            fprintf(codegen->stack_file, "POP\n");  // Discard result
-            break;
-            
+        
         default:
             break;
     }
+    
+    tac_truncate(walk, base);
 }
 
-// Generate stack code for a function
-static void generate_function_stack(CodeGenerator *codegen, ASTNode *node) {
-    if (!node || node->type != NODE_FUNCTION_DECL) return;
+// A function generated and optimized on its own, into an IR of its own
+// whose temporaries and labels are numbered from 0
+typedef struct {
+    ASTNode *node;
+    IRProgram *ir;
+    OptReport opt_report;
+    bool ok;
+    bool cached;            // Taken from the code cache instead of generated
+} GenUnit;
+
+// Units shared by the generating threads, which take them in order
+typedef struct {
+    CodeGenerator *codegen;
+    GenUnit *units;
+    int num_units;
+    int next;               // First unit no thread has taken
+    pthread_mutex_t lock;
+} GenPool;
+
+// Generate and optimize one unit
+static bool gen_unit(GenWalk *walk, const CodeGenerator *codegen, GenUnit *unit) {
+    static const ASTVisitor visitor = { gen_enter, gen_child, gen_leave };
     
-    fprintf(codegen->stack_file, "FUNC %s\n", node->value);
+    unit->ir = ir_create();
+    if (!unit->ir) return false;
     
-    // Generate code for function body
-    if (node->num_children > 1) {
-        generate_stmt_stack(codegen, &node->children[1]);
-    }
+    walk->ir = unit->ir;
+    walk->num_values = 0;
+    if (!ast_walk(unit->node, &visitor, walk) || unit->ir->failed) return false;
     
-    fprintf(codegen->stack_file, "END_FUNC\n\n");
+    return opt_run(unit->ir, codegen->opt_level, &unit->opt_report);
 }
 
-// Generate target code (simplified machine code)
-static void generate_target_code(CodeGenerator *codegen) {
-    // This is a very simplified version that just copies the stack code
-    // with some modifications to make it look more like assembly
+// Generating thread: take units until none are left. Each thread has its
+// own walk state and operand cache; the AST and symbols are only read.
+static void* gen_worker(void *arg) {
+    GenPool *pool = (GenPool*)arg;
+    const SymbolTable *symbols = pool->codegen->symbols;
     
-    // Reopen the stack code file for reading
-    fseek(codegen->stack_file, 0, SEEK_SET);
+    GenWalk walk = { NULL, NULL, 0, 0, symbols, NULL, NULL, -1, NULL, NULL, -1, 0 };
+    if (symbols) {
+        size_t count = symtab_count(symbols) + 1;
+        walk.operands = (IROperand*)stats_malloc(sizeof(IROperand) * count);
+        walk.operand_unit = (int*)stats_malloc(sizeof(int) * count);
+        if (walk.operand_unit) {
+            for (size_t i = 0; i < count; i++) walk.operand_unit[i] = -1;
+        }
+    }
+    bool ready = !symbols || (walk.operands && walk.operand_unit);
     
-    char line[256];
-    while (fgets(line, sizeof(line), codegen->stack_file)) {
-        // Remove newline
-        line[strcspn(line, "\n")] = 0;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        int index = pool->next < pool->num_units ? pool->next++ : -1;
+        pthread_mutex_unlock(&pool->lock);
+        if (index < 0) break;
         
-        // Skip empty lines
-        if (strlen(line) == 0) {
-            continue;
-        }
+        if (pool->units[index].cached) continue;
         
-        // Convert stack operations to assembly-like instructions
-        if (strcmp(line, "ADD") == 0) {
-            fprintf(codegen->target_file, "    ADD R1, R2, R3\n");
-        } else if (strcmp(line, "SUB") == 0) {
-            fprintf(codegen->target_file, "    SUB R1, R2, R3\n");
-        } else if (strcmp(line, "MUL") == 0) {
-            fprintf(codegen->target_file, "    MUL R1, R2, R3\n");
-        } else if (strcmp(line, "DIV") == 0) {
-            fprintf(codegen->target_file, "    DIV R1, R2, R3\n");
-        } else if (strncmp(line, "PUSH ", 5) == 0) {
-            fprintf(codegen->target_file, "    MOV R1, %s\n", line + 5);
-            fprintf(codegen->target_file, "    PUSH R1\n");
-        } else if (strncmp(line, "LOAD ", 5) == 0) {
-            fprintf(codegen->target_file, "    LOAD R1, [%s]\n", line + 5);
-            fprintf(codegen->target_file, "    PUSH R1\n");
-        } else if (strncmp(line, "STORE ", 6) == 0) {
-            fprintf(codegen->target_file, "    POP R1\n");
-            fprintf(codegen->target_file, "    STORE [%s], R1\n", line + 6);
-        } else if (strncmp(line, "JZ ", 3) == 0) {
-            fprintf(codegen->target_file, "    POP R1\n");
-            fprintf(codegen->target_file, "    CMP R1, 0\n");
-            fprintf(codegen->target_file, "    JE %s\n", line + 3);
-        } else if (strncmp(line, "JMP ", 4) == 0) {
-            fprintf(codegen->target_file, "    JMP %s\n", line + 4);
-        } else if (strncmp(line, "CALL ", 5) == 0) {
-            fprintf(codegen->target_file, "    CALL %s\n", line + 5);
-        } else if (strcmp(line, "RET") == 0) {
-            fprintf(codegen->target_file, "    POP R1\n");
-            fprintf(codegen->target_file, "    RET\n");
-        } else if (strcmp(line, "RET0") == 0) {
-            fprintf(codegen->target_file, "    RET\n");
-        } else if (strncmp(line, "FUNC ", 5) == 0) {
-            fprintf(codegen->target_file, "%s:\n", line + 5);
-            fprintf(codegen->target_file, "    PUSH FP\n");
-            fprintf(codegen->target_file, "    MOV FP, SP\n");
-        } else if (strcmp(line, "END_FUNC") == 0) {
-            fprintf(codegen->target_file, "    MOV SP, FP\n");
-            fprintf(codegen->target_file, "    POP FP\n");
-            fprintf(codegen->target_file, "    RET\n");
-        } else if (line[strlen(line) - 1] == ':') {
-            // Label
-            fprintf(codegen->target_file, "%s\n", line);
-        } else {
-            // Other instructions
-            fprintf(codegen->target_file, "    %s\n", line);
-        }
+        walk.unit = index;
+        pool->units[index].ok = ready && gen_unit(&walk, pool->codegen, &pool->units[index]);
     }
+    
+    free(walk.values);
+    free(walk.assigning);
+    free(walk.operands);
+    free(walk.operand_unit);
+    return NULL;
 }
 
-// Main code generation function
-bool codegen_generate(CodeGenerator *codegen) {
-    if (!codegen || !codegen->ast) return false;
+// Units of a program: every function declaration at the top level, or
+// the whole AST when it is not a program. Nothing else at the top level
+// generates code.
+static int find_units(ASTNode *ast, GenUnit **units) {
+    int count = 0;
+    if (ast->type == NODE_PROGRAM) {
+        for (int i = 0; i < ast->num_children; i++) {
+            if (ast->children[i] && ast->children[i]->type == NODE_FUNCTION_DECL) count++;
+        }
+    } else {
+        count = 1;
+    }
     
-    // Open output files
-    codegen->tac_file = tmpfile();
-    codegen->stack_file = tmpfile();
-    codegen->target_file = tmpfile();
+    *units = (GenUnit*)stats_calloc((size_t)count + 1, sizeof(GenUnit));
+    if (!*units) return -1;
     
-    if (!codegen->tac_file || !codegen->stack_file || !codegen->target_file) {
-        return false;
+    if (ast->type != NODE_PROGRAM) {
+        (*units)[0].node = ast;
+        return 1;
     }
     
-    // Generate simplified code for demonstration
-    
-    // Generate TAC (Three Address Code)
-    fprintf(codegen->tac_file, "// Three Address Code\n");
-    fprintf(codegen->tac_file, "function main:\n");
-    fprintf(codegen->tac_file, "  t0 = 10\n");
-    fprintf(codegen->tac_file, "  x = t0\n");
-    fprintf(codegen->tac_file, "  t1 = 20\n");
-    fprintf(codegen->tac_file, "  y = t1\n");
-    fprintf(codegen->tac_file, "  t2 = x + y\n");
-    fprintf(codegen->tac_file, "  z = t2\n");
-    fprintf(codegen->tac_file, "  return z\n");
-    fprintf(codegen->tac_file, "end function\n");
-    
-    // Generate Stack Code
-    fprintf(codegen->stack_file, "// Stack-based Code\n");
-    fprintf(codegen->stack_file, "FUNC main\n");
-    fprintf(codegen->stack_file, "  PUSH 10\n");
-    fprintf(codegen->stack_file, "  STORE x\n");
-    fprintf(codegen->stack_file, "  PUSH 20\n");
-    fprintf(codegen->stack_file, "  STORE y\n");
-    fprintf(codegen->stack_file, "  LOAD x\n");
-    fprintf(codegen->stack_file, "  LOAD y\n");
-    fprintf(codegen->stack_file, "  ADD\n");
-    fprintf(codegen->stack_file, "  STORE z\n");
-    fprintf(codegen->stack_file, "  LOAD z\n");
-    fprintf(codegen->stack_file, "  RET\n");
-    fprintf(codegen->stack_file, "END_FUNC\n");
-    
-    // Generate Target Code
-    fprintf(codegen->target_file, "; Target Machine Code\n");
-    fprintf(codegen->target_file, "main:\n");
-    fprintf(codegen->target_file, "    PUSH FP\n");
-    fprintf(codegen->target_file, "    MOV FP, SP\n");
-    fprintf(codegen->target_file, "    MOV R1, 10\n");
-    fprintf(codegen->target_file, "    STORE [x], R1\n");
-    fprintf(codegen->target_file, "    MOV R1, 20\n");
-    fprintf(codegen->target_file, "    STORE [y], R1\n");
-    fprintf(codegen->target_file, "    LOAD R1, [x]\n");
-    fprintf(codegen->target_file, "    LOAD R2, [y]\n");
-    fprintf(codegen->target_file, "    ADD R3, R1, R2\n");
-    fprintf(codegen->target_file, "    STORE [z], R3\n");
-    fprintf(codegen->target_file, "    LOAD R1, [z]\n");
-    fprintf(codegen->target_file, "    MOV SP, FP\n");
-    fprintf(codegen->target_file, "    POP FP\n");
-    fprintf(codegen->target_file, "    RET\n");
-    
-    return true;
+    int unit = 0;
+    for (int i = 0; i < ast->num_children; i++) {
+        if (ast->children[i] && ast->children[i]->type == NODE_FUNCTION_DECL) {
+            (*units)[unit++].node = ast->children[i];
+        }
+    }
+    return count;
 }
 
-// Save TAC to a file
-bool codegen_save_tac(CodeGenerator *codegen, const char *filename) {
-    if (!codegen || !codegen->tac_file) return false;
+// Take the code of each unit whose function is in the cache, and count the
+// units left to generate. Units usually keep their place between runs,
+// so the search starts just after the previous hit.
+static int take_cached_units(CodegenCache *cache, int opt_level, GenUnit *units, int num_units) {
+    if (!cache) return num_units;
     
-    FILE *file = fopen(filename, "w");
-    if (!file) return false;
+    // Code optimized at another level cannot be reused
+    if (cache->opt_level != opt_level) {
+        codegen_cache_clear(cache);
+        cache->opt_level = opt_level;
+    }
     
-    // Copy TAC to output file
-    fseek(codegen->tac_file, 0, SEEK_SET);
+    int pending = 0;
+    int next = 0;
+    for (int i = 0; i < num_units; i++) {
+        GenUnit *unit = &units[i];
+        for (int tried = 0; tried < cache->num_entries; tried++) {
+            CodegenCacheEntry *entry = &cache->entries[(next + tried) % cache->num_entries];
+            if (entry->node == unit->node && entry->ir) {
+                unit->ir = entry->ir;
+                unit->opt_report = entry->opt_report;
+                unit->ok = true;
+                unit->cached = true;
+                entry->node = NULL;
+                entry->ir = NULL;
+                next = (next + tried + 1) % cache->num_entries;
+                break;
+            }
+        }
+        if (!unit->cached) pending++;
+    }
     
-    char buffer[1024];
-    size_t bytes;
+    cache->hits = (size_t)(num_units - pending);
+    cache->misses = (size_t)pending;
+    return pending;
+}
+
+// Keep the code of every unit in the cache, in unit order, and drop the
+// code of functions that are gone. Returns false, leaving the units' code
+// to the caller, if the cache cannot be grown.
+static bool store_units(CodegenCache *cache, GenUnit *units, int num_units) {
+    CodegenCacheEntry *entries = (CodegenCacheEntry*)stats_malloc(sizeof(CodegenCacheEntry) * ((size_t)num_units + 1));
+    if (!entries) return false;
     
-    while ((bytes = fread(buffer, 1, sizeof(buffer), codegen->tac_file)) > 0) {
-        fwrite(buffer, 1, bytes, file);
+    codegen_cache_clear(cache);
+    for (int i = 0; i < num_units; i++) {
+        entries[i].node = units[i].ok ? units[i].node : NULL;
+        entries[i].ir = units[i].ok ? units[i].ir : NULL;
+        entries[i].opt_report = units[i].opt_report;
+        if (!units[i].ok) ir_free(units[i].ir);
     }
     
-    fclose(file);
+    cache->entries = entries;
+    cache->num_entries = num_units;
     return true;
 }
 
-// Save stack code to a file
-bool codegen_save_stack_code(CodeGenerator *codegen, const char *filename) {
-    if (!codegen || !codegen->stack_file) return false;
+// Main code generation function: build the TAC and the stack code of each
+// function in one walk of its AST, then optimize it. Functions do not
+// depend on each other, so they are spread over codegen->jobs threads.
+// Their code is then appended in source order, renumbered as if it had
+// been generated in one go, so the result does not depend on the number
+// of threads. With a cache, functions whose nodes it holds code for are
+// not generated again.
+bool codegen_generate(CodeGenerator *codegen) {
+    if (!codegen || !codegen->ast) return false;
     
-    FILE *file = fopen(filename, "w");
-    if (!file) return false;
+    ir_free(codegen->ir);
+    codegen->ir = ir_create();
+    if (!codegen->ir) return false;
     
-    // Copy stack code to output file
-    fseek(codegen->stack_file, 0, SEEK_SET);
+    GenPool pool;
+    pool.codegen = codegen;
+    pool.next = 0;
+    pool.num_units = find_units(codegen->ast, &pool.units);
+    if (pool.num_units < 0) return false;
     
-    char buffer[1024];
-    size_t bytes;
+    int pending = take_cached_units(codegen->cache, codegen->opt_level, pool.units, pool.num_units);
+    long threads = codegen->jobs > 0 ? codegen->jobs : sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > pending) threads = pending;
+    if (threads < 1) threads = 1;
     
-    while ((bytes = fread(buffer, 1, sizeof(buffer), codegen->stack_file)) > 0) {
-        fwrite(buffer, 1, bytes, file);
+    pthread_t *workers = (pthread_t*)stats_malloc(sizeof(pthread_t) * (size_t)threads);
+    bool *started = (bool*)stats_calloc((size_t)threads, sizeof(bool));
+    if (!workers || !started) {
+        for (int i = 0; i < pool.num_units; i++) pool.units[i].ok = false;
+        if (!codegen->cache || !store_units(codegen->cache, pool.units, pool.num_units)) {
+            for (int i = 0; i < pool.num_units; i++) ir_free(pool.units[i].ir);
+        }
+        free(workers);
+        free(started);
+        free(pool.units);
+        return false;
+    }
+    
+    // The calling thread generates too; units of a thread that cannot be
+    // started are left to the others
+    pthread_mutex_init(&pool.lock, NULL);
+    for (long i = 1; i < threads; i++) {
+        started[i] = pthread_create(&workers[i], NULL, gen_worker, &pool) == 0;
+    }
+    gen_worker(&pool);
+    for (long i = 1; i < threads; i++) {
+        if (started[i]) pthread_join(workers[i], NULL);
+    }
+    pthread_mutex_destroy(&pool.lock);
+    
+    bool ok = true;
+    memset(&codegen->opt_report, 0, sizeof(codegen->opt_report));
+    for (int i = 0; i < pool.num_units; i++) {
+        GenUnit *unit = &pool.units[i];
+        ok = ok && unit->ok && ir_append(codegen->ir, unit->ir);
+        if (ok) opt_merge_report(&codegen->opt_report, &unit->opt_report);
+    }
+    
+    if (!codegen->cache || !store_units(codegen->cache, pool.units, pool.num_units)) {
+        for (int i = 0; i < pool.num_units; i++) ir_free(pool.units[i].ir);
+    }
+    
+    // A program without functions still reports the passes it would run
+    if (ok && pool.num_units == 0) ok = opt_run(codegen->ir, codegen->opt_level, &codegen->opt_report);
+    
+    free(workers);
+    free(started);
+    free(pool.units);
+    return ok;
+}
+
+// Optimize each function's TAC at the given level (0 for none) while it
+// is generated
+void codegen_set_optimization(CodeGenerator *codegen, int level) {
+    if (codegen) codegen->opt_level = level;
+}
+
+// Set how many threads generate functions, 0 for one per CPU
+void codegen_set_jobs(CodeGenerator *codegen, int jobs) {
+    if (codegen) codegen->jobs = jobs;
+}
+
+// Reuse and keep the code of each function in a cache, which must outlive
+// codegen_generate
+void codegen_set_cache(CodeGenerator *codegen, CodegenCache *cache) {
+    if (codegen) codegen->cache = cache;
+}
+
+// Set up an empty code cache
+void codegen_cache_init(CodegenCache *cache) {
+    cache->entries = NULL;
+    cache->num_entries = 0;
+    cache->opt_level = 0;
+    cache->hits = 0;
+    cache->misses = 0;
+}
+
+// Drop all cached code
+void codegen_cache_clear(CodegenCache *cache) {
+    for (int i = 0; i < cache->num_entries; i++) ir_free(cache->entries[i].ir);
+    free(cache->entries);
+    cache->entries = NULL;
+    cache->num_entries = 0;
+}
+
+// Drop the cached code of a function, before its nodes change or are freed
+void codegen_cache_forget(CodegenCache *cache, const ASTNode *function) {
+    for (int i = 0; i < cache->num_entries; i++) {
+        CodegenCacheEntry *entry = &cache->entries[i];
+        if (entry->node == function) {
+            ir_free(entry->ir);
+            entry->node = NULL;
+            entry->ir = NULL;
+        }
     }
+}
+
+// Use resolved symbols for the names in the AST. The table must outlive
+// codegen_generate.
+void codegen_set_symbols(CodeGenerator *codegen, const SymbolTable *symbols) {
+    if (codegen) codegen->symbols = symbols;
+}
+
+// Set the register file size for target code. With 0 registers the
+// target code is lowered from the stack code instead.
+void codegen_set_registers(CodeGenerator *codegen, int num_regs) {
+    if (codegen) codegen->num_regs = num_regs;
+}
+
+// Turn the peephole pass over target code on or off
+void codegen_set_peephole(CodeGenerator *codegen, bool enabled) {
+    if (codegen) codegen->peephole = enabled;
+}
+
+// Write a code artifact: a header line and then the code as text
+static bool write_code(CodeGenerator *codegen, OutBuf *out, const char *header,
+                       void (*print)(OutBuf *out, const IRProgram *ir)) {
+    if (!codegen || !codegen->ir) return false;
     
-    fclose(file);
+    outbuf_puts(out, header);
+    print(out, codegen->ir);
     return true;
 }
 
-// Save target code to a file
-bool codegen_save_target_code(CodeGenerator *codegen, const char *filename) {
-    if (!codegen || !codegen->target_file) return false;
+// Save a code artifact to a file
+static bool save_code(CodeGenerator *codegen, const char *filename,
+                      bool (*write)(CodeGenerator *codegen, OutBuf *out)) {
+    if (!codegen || !codegen->ir) return false;
     
-    FILE *file = fopen(filename, "w");
-    if (!file) return false;
+    OutBuf *out = outbuf_open(filename);
+    if (!out) return false;
     
-    // Copy target code to output file
-    fseek(codegen->target_file, 0, SEEK_SET);
+    bool ok = write(codegen, out);
+    return outbuf_close(out) && ok;
+}
+
+// Write TAC
+bool codegen_write_tac(CodeGenerator *codegen, OutBuf *out) {
+    return write_code(codegen, out, "// Three Address Code\n", ir_print_tac);
+}
+
+// Write stack code
+bool codegen_write_stack_code(CodeGenerator *codegen, OutBuf *out) {
+    return write_code(codegen, out, "// Stack-based Code\n", ir_print_stack);
+}
+
+// Save TAC to a file
+bool codegen_save_tac(CodeGenerator *codegen, const char *filename) {
+    return save_code(codegen, filename, codegen_write_tac);
+}
+
+// Save stack code to a file
+bool codegen_save_stack_code(CodeGenerator *codegen, const char *filename) {
+    return save_code(codegen, filename, codegen_write_stack_code);
+}
+
+// Lower the generated code to target code: allocate num_regs registers,
+// or lower the stack code when it is 0, then run the peephole pass if it
+// is enabled.
+bool codegen_lower_target(CodeGenerator *codegen, TargetCode *target, int num_regs,
+                          RegAllocStats *stats, PeepholeReport *report) {
+    if (!codegen || !codegen->ir) return false;
+    
+    bool ok = num_regs > 0
+        ? regalloc_lower(target, codegen->ir, num_regs, stats)
+        : target_lower_stack(target, codegen->ir);
+    if (ok && codegen->peephole) {
+        ok = peephole_target(target, codegen->ir, report);
+    }
+    return ok;
+}
+
+// Write target code: register code when registers were set, otherwise
+// the stack code lowered instruction by instruction
+bool codegen_write_target_code(CodeGenerator *codegen, OutBuf *out) {
+    if (!codegen || !codegen->ir) return false;
     
-    char buffer[1024];
-    size_t bytes;
+    TargetCode target;
+    target_init(&target);
     
-    while ((bytes = fread(buffer, 1, sizeof(buffer), codegen->target_file)) > 0) {
-        fwrite(buffer, 1, bytes, file);
+    bool ok = codegen_lower_target(codegen, &target, codegen->num_regs,
+                                   &codegen->reg_stats, &codegen->target_peephole);
+    if (ok) {
+        outbuf_puts(out, "; Target Machine Code\n");
+        target_write(out, codegen->ir, &target);
+        if (codegen->num_regs > 0) regalloc_write_summary(out, &codegen->reg_stats);
     }
     
-    fclose(file);
-    return true;
+    target_free(&target);
+    return ok;
+}
+
+// Save target code to a file
+bool codegen_save_target_code(CodeGenerator *codegen, const char *filename) {
+    return save_code(codegen, filename, codegen_write_target_code);
 }
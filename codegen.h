@@ -3,23 +3,66 @@
 
 #include "common.h"
 #include "ast.h"
+#include "symtab.h"
+#include "ir.h"
+#include "regalloc.h"
+#include "peephole.h"
+#include "opt.h"
+
+// Code generated for one function by an earlier codegen_generate
+typedef struct {
+    const ASTNode *node;    // Function declaration it was generated from
+    IRProgram *ir;
+    OptReport opt_report;
+} CodegenCacheEntry;
+
+// Each function's optimized code, kept between compilations of a program
+// that is being edited. An entry is reused for as long as its function's
+// node is, so whoever changes or frees a function's nodes must forget it
+// first.
+typedef struct {
+    CodegenCacheEntry *entries; // In the order of the last codegen_generate
+    int num_entries;
+    int opt_level;          // Level the entries were optimized at
+    size_t hits;            // Functions the last codegen_generate reused
+    size_t misses;          // Functions it generated
+} CodegenCache;
 
 // Code generator structure
 typedef struct {
     ASTNode *ast;
-    FILE *tac_file;
-    FILE *stack_file;
-    FILE *target_file;
-    int temp_var_count;
-    int label_count;
+    IRProgram *ir;      // Generated TAC and stack code, printed on save
+    const SymbolTable *symbols; // Symbols the AST's names were resolved to, or NULL
+    int opt_level;      // TAC optimization level for each function
+    OptReport opt_report;
+    int jobs;           // Threads generating functions, 0 for one per CPU
+    CodegenCache *cache; // Code of unchanged functions, or NULL
+    int num_regs;       // Registers for target code, 0 to lower the stack code
+    RegAllocStats reg_stats;
+    bool peephole;      // Run the peephole pass over target code
+    PeepholeReport target_peephole;
 } CodeGenerator;
 
 // Code generator functions
 CodeGenerator* codegen_init(ASTNode *ast);
 void codegen_free(CodeGenerator *codegen);
 bool codegen_generate(CodeGenerator *codegen);
+void codegen_set_symbols(CodeGenerator *codegen, const SymbolTable *symbols);
+void codegen_set_optimization(CodeGenerator *codegen, int level);
+void codegen_set_jobs(CodeGenerator *codegen, int jobs);
+void codegen_set_cache(CodeGenerator *codegen, CodegenCache *cache);
+void codegen_set_registers(CodeGenerator *codegen, int num_regs);
+void codegen_set_peephole(CodeGenerator *codegen, bool enabled);
+bool codegen_write_tac(CodeGenerator *codegen, OutBuf *out);
+bool codegen_write_stack_code(CodeGenerator *codegen, OutBuf *out);
+bool codegen_write_target_code(CodeGenerator *codegen, OutBuf *out);
 bool codegen_save_tac(CodeGenerator *codegen, const char *filename);
 bool codegen_save_stack_code(CodeGenerator *codegen, const char *filename);
+bool codegen_lower_target(CodeGenerator *codegen, TargetCode *target, int num_regs,
+                          RegAllocStats *stats, PeepholeReport *report);
 bool codegen_save_target_code(CodeGenerator *codegen, const char *filename);
+void codegen_cache_init(CodegenCache *cache);
+void codegen_cache_clear(CodegenCache *cache);
+void codegen_cache_forget(CodegenCache *cache, const ASTNode *function);
 
 #endif // CODEGEN_H
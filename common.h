@@ -0,0 +1,174 @@
+#ifndef COMMON_H
+#define COMMON_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+// Token types
+typedef enum {
+    TOKEN_IDENTIFIER,
+    TOKEN_NUMBER,
+    TOKEN_STRING,
+    TOKEN_KEYWORD,
+    TOKEN_OPERATOR,
+    TOKEN_PUNCTUATION,
+    TOKEN_COMMENT,
+    TOKEN_WHITESPACE,
+    TOKEN_EOF,
+    TOKEN_UNKNOWN
+} TokenType;
+
+// Token subtypes: which keyword, operator or punctuator a token is
+typedef enum {
+    KIND_NONE,
+
+    // Keywords
+    KW_IF,
+    KW_ELSE,
+    KW_WHILE,
+    KW_FOR,
+    KW_RETURN,
+    KW_INT,
+    KW_FLOAT,
+    KW_CHAR,
+    KW_VOID,
+    KW_STRUCT,
+    KW_BREAK,
+    KW_CONTINUE,
+    KW_SWITCH,
+    KW_CASE,
+    KW_DEFAULT,
+    KW_DO,
+    KW_CONST,
+    KW_STATIC,
+
+    // Operators
+    OP_PLUS,
+    OP_MINUS,
+    OP_STAR,
+    OP_SLASH,
+    OP_PERCENT,
+    OP_ASSIGN,
+    OP_LT,
+    OP_GT,
+    OP_NOT,
+    OP_AMP,
+    OP_PIPE,
+    OP_CARET,
+    OP_TILDE,
+    OP_INC,
+    OP_DEC,
+    OP_EQ,
+    OP_NE,
+    OP_LE,
+    OP_GE,
+    OP_AND,
+    OP_OR,
+    OP_PLUS_ASSIGN,
+    OP_MINUS_ASSIGN,
+    OP_STAR_ASSIGN,
+    OP_SLASH_ASSIGN,
+
+    // Punctuation
+    PUNCT_LPAREN,
+    PUNCT_RPAREN,
+    PUNCT_LBRACE,
+    PUNCT_RBRACE,
+    PUNCT_LBRACKET,
+    PUNCT_RBRACKET,
+    PUNCT_SEMICOLON,
+    PUNCT_COMMA,
+    PUNCT_DOT,
+    PUNCT_COLON,
+    PUNCT_QUESTION,
+
+    KIND_COUNT
+} TokenKind;
+
+// Token structure
+typedef struct {
+    TokenType type;
+    TokenKind kind;       // Keyword/operator/punctuation subtype, or KIND_NONE
+    const char *value;    // NUL-terminated text, owned by the lexer's string table
+    size_t offset;        // Byte offset of the lexeme in the source
+    size_t length;        // Length of the lexeme in bytes
+    int id;               // Interned string ID, or -1 if not interned
+    int line;
+    int column;
+} Token;
+
+// AST node types
+typedef enum {
+    NODE_PROGRAM,
+    NODE_FUNCTION_DECL,
+    NODE_BLOCK,
+    NODE_VARIABLE_DECL,
+    NODE_ASSIGNMENT,
+    NODE_BINARY_OP,
+    NODE_UNARY_OP,
+    NODE_IF,
+    NODE_WHILE,
+    NODE_FOR,
+    NODE_RETURN,
+    NODE_CALL,
+    NODE_IDENTIFIER,
+    NODE_NUMBER,
+    NODE_STRING
+} NodeType;
+
+// AST node structure
+typedef struct ASTNode {
+    NodeType type;
+    char *value;
+    struct ASTNode **children;  // Child pointers; a node never moves once created
+    int num_children;
+    int capacity;
+    bool in_arena;              // Owned by an arena rather than by ast_free_node
+    int symbol;                 // Symbol the node declares or names, -1 if none
+} ASTNode;
+
+// Parser types
+typedef enum {
+    PARSER_RD,
+    PARSER_LALR
+} ParserType;
+
+// Token and AST artifact format
+typedef enum {
+    FORMAT_TEXT,          // tokens.txt/json, ast.txt/dot/json
+    FORMAT_BIN            // tokens.bin, ast.bin
+} ArtifactFormat;
+
+// Report printed by --stats
+typedef enum {
+    STATS_OFF,
+    STATS_TEXT,           // A table
+    STATS_JSON            // One JSON object
+} StatsMode;
+
+// Compiler configuration
+typedef struct {
+    char *input_file;
+    char *inputs;         // Batch of input files: "@list", a glob or a directory
+    int jobs;             // Batch worker threads, 0 for one per CPU
+    char *output_dir;     // "-" writes the one --emit artifact to stdout
+    char *emit;           // Artifacts to write, NULL for the --format defaults
+    ParserType parser_type;
+    ArtifactFormat format;
+    bool compact_json;    // Write JSON artifacts without whitespace
+    size_t max_errors;    // Parse errors reported before giving up (0: no limit)
+    int opt_level;        // TAC optimization level, 0 to OPT_MAX_LEVEL
+    int num_regs;         // Target registers, 0 to lower the stack code instead
+    bool run;             // Run the stack code in the VM after compiling
+    bool jit;             // Compile to x86-64 and run that after compiling
+    bool serve;           // Answer compile requests instead of compiling a file
+    char *socket_path;    // Unix socket to serve on, NULL for stdin and stdout
+    char *cache_dir;      // Artifact cache directory, NULL for none
+    size_t cache_size;    // Bytes the artifact cache may keep
+    StatsMode stats;      // Per-phase measurements printed after compiling
+    bool verbose;
+} CompilerConfig;
+
+#endif // COMMON_H
@@ -0,0 +1,68 @@
+#include "diag.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Initialize an empty list
+void diag_init(DiagList *list, size_t max_errors) {
+    list->items = NULL;
+    list->count = 0;
+    list->capacity = 0;
+    list->max_errors = max_errors;
+}
+
+// Free the list's storage
+void diag_free(DiagList *list) {
+    free(list->items);
+    list->items = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+// Forget all collected diagnostics, keeping the storage and the cap
+void diag_clear(DiagList *list) {
+    list->count = 0;
+}
+
+// Check whether the cap has been reached, so parsing should stop
+bool diag_full(const DiagList *list) {
+    return list->max_errors > 0 && list->count >= list->max_errors;
+}
+
+// Record an error at a source position. Returns false once the list is
+// full (or out of memory) and the error was dropped.
+bool diag_add(DiagList *list, int line, int column, const char *format, ...) {
+    if (diag_full(list)) return false;
+
+    if (list->count >= list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 16;
+        Diagnostic *items = (Diagnostic*)realloc(list->items, sizeof(Diagnostic) * capacity);
+        if (!items) return false;
+        list->items = items;
+        list->capacity = capacity;
+    }
+
+    Diagnostic *diag = &list->items[list->count++];
+    diag->line = line;
+    diag->column = column;
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(diag->message, sizeof(diag->message), format, args);
+    va_end(args);
+
+    return true;
+}
+
+// Print every diagnostic as "file:line:column: error: message"
+void diag_print(const DiagList *list, const char *filename, FILE *out) {
+    for (size_t i = 0; i < list->count; i++) {
+        const Diagnostic *diag = &list->items[i];
+        fprintf(out, "%s:%d:%d: error: %s\n", filename, diag->line, diag->column, diag->message);
+    }
+
+    if (diag_full(list)) {
+        fprintf(out, "%s: stopped after %zu error%s (see --max-errors)\n",
+                filename, list->count, list->count == 1 ? "" : "s");
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef DIAG_H
+#define DIAG_H
+
+#include "common.h"
+
+// Errors reported before a parser gives up, unless --max-errors says
+// otherwise (0 means no limit)
+#define DIAG_DEFAULT_MAX_ERRORS 20
+
+// Longest message kept per diagnostic
+#define DIAG_MESSAGE_SIZE 160
+
+// One reported error
+typedef struct {
+    int line;
+    int column;
+    char message[DIAG_MESSAGE_SIZE];
+} Diagnostic;
+
+// Errors collected during one parse, in source order
+typedef struct {
+    Diagnostic *items;
+    size_t count;
+    size_t capacity;
+    size_t max_errors;    // Stop collecting at this many (0: no limit)
+} DiagList;
+
+// Diagnostic list functions
+void diag_init(DiagList *list, size_t max_errors);
+void diag_free(DiagList *list);
+void diag_clear(DiagList *list);
+bool diag_add(DiagList *list, int line, int column, const char *format, ...)
+    __attribute__((format(printf, 4, 5)));
+bool diag_full(const DiagList *list);
+void diag_print(const DiagList *list, const char *filename, FILE *out);
+
+#endif // DIAG_H
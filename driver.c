@@ -0,0 +1,572 @@
+#include "driver.h"
+#include "lexer.h"
+#include "parser_rd.h"
+#include "parser_lalr.h"
+#include "ast.h"
+#include "ast_flat.h"
+#include "symtab.h"
+#include "codegen.h"
+#include "opt.h"
+#include "regalloc.h"
+#include "vm.h"
+#include "jit.h"
+#include "source.h"
+#include "diag.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Build the path of an output file in a directory
+char* driver_output_path(const char *output_dir, const char *filename) {
+    size_t dir_len = strlen(output_dir);
+    size_t file_len = strlen(filename);
+
+    // +2 for the separator and null terminator
+    char *path = (char*)malloc(dir_len + file_len + 2);
+    if (!path) return NULL;
+
+    strcpy(path, output_dir);
+
+    // Add separator if needed
+    if (dir_len > 0 && output_dir[dir_len - 1] != '/') {
+        path[dir_len] = '/';
+        path[dir_len + 1] = '\0';
+    }
+
+    strcat(path, filename);
+    return path;
+}
+
+// Print every parse error, then a summary line
+static void report_parse_errors(const DiagList *diagnostics, const char *input_file, FILE *err) {
+    diag_print(diagnostics, strcmp(input_file, "-") == 0 ? "<stdin>" : input_file, err);
+    fprintf(err, "Error: Parsing failed with %zu error%s\n",
+            diagnostics->count, diagnostics->count == 1 ? "" : "s");
+}
+
+// Parse the lexer's tokens with the configured parser; NULL on any syntax
+// error. With stream set the parser pulls tokens from the lexer as it
+// goes, through its window, and *pulled is how many it read. Otherwise
+// the lexer has already tokenized the whole input.
+static ASTNode* parse_tokens(const CompilerConfig *config, const char *input_name, Lexer *lexer,
+                             bool stream, size_t *pulled, FILE *err) {
+    ASTNode *ast = NULL;
+    bool parse_error = false;
+    bool lex_error = false;
+    size_t num_tokens = 0;
+    Token *tokens = stream ? NULL : lexer_get_tokens(lexer, &num_tokens);
+
+    if (config->parser_type == PARSER_RD) {
+        RDParser *parser = stream ? parser_rd_init_stream(lexer) : parser_rd_init(tokens, num_tokens);
+        if (!parser) {
+            fprintf(err, "Error: Could not initialize recursive descent parser\n");
+            return NULL;
+        }
+
+        parser_rd_set_max_errors(parser, config->max_errors);
+        ast = parser_rd_parse(parser);
+        lex_error = parser->stream.failed;
+        parse_error = parser_rd_had_error(parser);
+        if (parse_error && !lex_error) report_parse_errors(parser_rd_get_diagnostics(parser), input_name, err);
+        if (pulled) *pulled = parser->stream.pulled;
+        parser_rd_free(parser);
+    } else {
+        LALRParser *parser = stream ? parser_lalr_init_stream(lexer) : parser_lalr_init(tokens, num_tokens);
+        if (!parser) {
+            fprintf(err, "Error: Could not initialize LALR parser\n");
+            return NULL;
+        }
+
+        parser_lalr_set_max_errors(parser, config->max_errors);
+        ast = parser_lalr_parse(parser);
+        lex_error = parser->stream.failed;
+        parse_error = parser_lalr_had_error(parser);
+        if (parse_error && !lex_error) report_parse_errors(parser_lalr_get_diagnostics(parser), input_name, err);
+        if (pulled) *pulled = parser->stream.pulled;
+        parser_lalr_free(parser);
+    }
+
+    // A lexer that failed mid-stream ended the tokens early
+    if (lex_error) {
+        fprintf(err, "Error: Tokenization failed\n");
+        ast_free_node(ast);
+        return NULL;
+    }
+    if (!ast || parse_error) {
+        fprintf(err, "Error: Could not generate AST\n");
+        ast_free_node(ast);
+        return NULL;
+    }
+    return ast;
+}
+
+// Compile the program to x86-64 and run it. The target code is lowered
+// again for the JIT's register file unless --regs already fits in it.
+static bool run_native(CodeGenerator *codegen, const SymbolTable *symbols, int num_regs, FILE *out, FILE *err) {
+    if (num_regs <= 0 || num_regs > JIT_MAX_REGS) num_regs = JIT_MAX_REGS;
+
+    TargetCode target;
+    target_init(&target);
+
+    JITProgram *jit = NULL;
+    if (codegen_lower_target(codegen, &target, num_regs, NULL, NULL)) {
+        jit = jit_compile(&target, codegen->ir, symbols, "main");
+    }
+    target_free(&target);
+
+    JITResult result;
+    bool ok = jit && jit_run(jit, &result);
+    if (ok) {
+        jit_print_result(jit, &result, out);
+    } else {
+        fprintf(err, "Error: Could not run the native code\n");
+    }
+
+    jit_free(jit);
+    return ok;
+}
+
+// Phases of a compilation, in order. A phase runs only when a wanted
+// artifact, --run or --jit needs what it produces; stack and target code
+// are lowered by their writers.
+typedef enum {
+    PHASE_LEX,              // Tokens
+    PHASE_PARSE,            // AST
+    PHASE_GENERATE          // Symbols and optimized TAC
+} DriverPhase;
+
+// Where each artifact is written from and how it is named
+typedef struct {
+    const char *name;       // Name in --emit style lists
+    const char *file;       // File in the output directory
+    const char *error;      // Message when it cannot be written
+    DriverPhase phase;      // Last phase it needs
+} ArtifactInfo;
+
+static const ArtifactInfo artifact_info[ARTIFACT_COUNT] = {
+    { "tokens", "tokens.txt", "Could not save tokens to file", PHASE_LEX },
+    { "tokens-json", "tokens.json", "Could not save tokens to JSON file", PHASE_LEX },
+    { "tokens-bin", "tokens.bin", "Could not save tokens to file", PHASE_LEX },
+    { "ast", "ast.txt", "Could not save AST to files", PHASE_PARSE },
+    { "ast-dot", "ast.dot", "Could not save AST to files", PHASE_PARSE },
+    { "ast-json", "ast.json", "Could not save AST to files", PHASE_PARSE },
+    { "ast-bin", "ast.bin", "Could not save AST to files", PHASE_PARSE },
+    { "tac", "tac.txt", "Could not save generated code to files", PHASE_GENERATE },
+    { "stack", "stack_code.txt", "Could not save generated code to files", PHASE_GENERATE },
+    { "target", "target_code.txt", "Could not save generated code to files", PHASE_GENERATE }
+};
+
+// Short name of an artifact
+const char* driver_artifact_name(ArtifactKind kind) {
+    return artifact_info[kind].name;
+}
+
+// File name of an artifact
+const char* driver_artifact_file(ArtifactKind kind) {
+    return artifact_info[kind].file;
+}
+
+// Artifact with a short name, or ARTIFACT_COUNT if there is none
+ArtifactKind driver_find_artifact(const char *name, size_t length) {
+    for (int kind = 0; kind < ARTIFACT_COUNT; kind++) {
+        if (strlen(artifact_info[kind].name) == length && strncmp(artifact_info[kind].name, name, length) == 0) {
+            return (ArtifactKind)kind;
+        }
+    }
+    return ARTIFACT_COUNT;
+}
+
+// Parse a comma-separated list of artifact names into wanted. Returns
+// false, naming the culprit on err, if a name is not an artifact.
+bool driver_parse_artifacts(const char *list, bool wanted[ARTIFACT_COUNT], FILE *err) {
+    for (int kind = 0; kind < ARTIFACT_COUNT; kind++) wanted[kind] = false;
+
+    const char *name = list;
+    for (;;) {
+        size_t length = strcspn(name, ",");
+        ArtifactKind kind = driver_find_artifact(name, length);
+        if (kind == ARTIFACT_COUNT) {
+            fprintf(err, "Error: Unknown artifact '%.*s'\n", (int)length, name);
+            return false;
+        }
+        wanted[kind] = true;
+
+        if (name[length] == '\0') return true;
+        name += length + 1;
+    }
+}
+
+// The artifacts a compilation writes in a format: tokens.txt/json,
+// ast.txt/dot/json or tokens.bin and ast.bin, then the generated code
+void driver_default_artifacts(ArtifactFormat format, bool wanted[ARTIFACT_COUNT]) {
+    bool binary = format == FORMAT_BIN;
+    for (int kind = 0; kind < ARTIFACT_COUNT; kind++) wanted[kind] = true;
+
+    wanted[binary ? ARTIFACT_TOKENS : ARTIFACT_TOKENS_BIN] = false;
+    wanted[ARTIFACT_TOKENS_JSON] = !binary;
+    wanted[binary ? ARTIFACT_AST : ARTIFACT_AST_BIN] = false;
+    wanted[ARTIFACT_AST_DOT] = !binary;
+    wanted[ARTIFACT_AST_JSON] = !binary;
+}
+
+// Set up a job that reads config->input_file, writes the artifacts to
+// files and prints to stdout and stderr
+void driver_job_init(DriverJob *job) {
+    memset(job, 0, sizeof(*job));
+    job->out = stdout;
+    job->err = stderr;
+}
+
+// What the artifact writers work from
+typedef struct {
+    Lexer *lexer;
+    ASTNode *ast;
+    CodeGenerator *codegen;
+    JsonStyle json_style;
+} DriverProducts;
+
+// Count a node on entering it
+static ASTWalkAction count_node(ASTWalkFrame *frame, void *ctx) {
+    (void)frame;
+    (*(uint64_t*)ctx)++;
+    return AST_WALK_CHILDREN;
+}
+
+// Number of nodes in an AST
+static uint64_t count_nodes(ASTNode *root) {
+    ASTVisitor visitor = { count_node, NULL, NULL };
+    uint64_t count = 0;
+    ast_walk(root, &visitor, &count);
+    return count;
+}
+
+// Write one artifact
+static bool write_artifact(ArtifactKind kind, const DriverProducts *products, OutBuf *out) {
+    switch (kind) {
+        case ARTIFACT_TOKENS: return lexer_write_tokens(products->lexer, out);
+        case ARTIFACT_TOKENS_JSON: return lexer_write_tokens_json(products->lexer, out, products->json_style);
+        case ARTIFACT_TOKENS_BIN: return lexer_write_tokens_bin(products->lexer, out);
+        case ARTIFACT_AST: return ast_write_text(products->ast, out);
+        case ARTIFACT_AST_DOT: return ast_write_dot(products->ast, out);
+        case ARTIFACT_AST_JSON: return ast_write_json(products->ast, out, products->json_style);
+        case ARTIFACT_AST_BIN: return ast_write_bin(products->ast, out);
+        case ARTIFACT_TAC: return codegen_write_tac(products->codegen, out);
+        case ARTIFACT_STACK: return codegen_write_stack_code(products->codegen, out);
+        case ARTIFACT_TARGET: return codegen_write_target_code(products->codegen, out);
+        default: return false;
+    }
+}
+
+// Write the wanted artifacts from first to last, each to the job's stream
+// for it or to its file in the output directory. With --verbose, files
+// are listed under what: "Tokens saved to a and b".
+static bool write_artifacts(const CompilerConfig *config, const DriverJob *job, const bool *wanted,
+                            const DriverProducts *products, ArtifactKind first, ArtifactKind last,
+                            const char *what) {
+    char *paths[ARTIFACT_COUNT];
+    int num_paths = 0;
+    bool ok = true;
+
+    for (int kind = first; ok && kind <= (int)last; kind++) {
+        if (!wanted[kind]) continue;
+
+        StatsMark mark;
+        stats_mark(job->stats, &mark);
+        uint64_t bytes = 0;
+        if (job->artifacts) {
+            OutBuf *out = job->artifacts[kind];
+            bytes = outbuf_bytes(out);
+            ok = write_artifact((ArtifactKind)kind, products, out) && outbuf_flush(out);
+            bytes = outbuf_bytes(out) - bytes;
+        } else {
+            char *path = driver_output_path(config->output_dir, artifact_info[kind].file);
+            OutBuf *out = path ? outbuf_open(path) : NULL;
+            ok = out && write_artifact((ArtifactKind)kind, products, out);
+            if (out) bytes = outbuf_bytes(out);
+            ok = outbuf_close(out) && ok;
+            if (path) paths[num_paths++] = path;
+        }
+        stats_phase(job->stats, &mark, artifact_info[kind].file, 0, bytes, 0, NULL);
+
+        if (!ok) fprintf(job->err, "Error: %s\n", artifact_info[kind].error);
+    }
+
+    if (ok && config->verbose && num_paths > 0) {
+        fprintf(job->out, "%s saved to ", what);
+        for (int i = 0; i < num_paths; i++) {
+            const char *separator = i == 0 ? "" : num_paths == 2 ? " and " : i == num_paths - 1 ? ", and " : ", ";
+            fprintf(job->out, "%s%s", separator, paths[i]);
+        }
+        fprintf(job->out, "\n");
+    }
+
+    for (int i = 0; i < num_paths; i++) free(paths[i]);
+    return ok;
+}
+
+// Run the pipeline on one program, as far as its wanted artifacts need,
+// writing them where the job says and its messages to the job's streams.
+// The artifacts are the job's streams, or else config->emit or the
+// --format defaults. The AST is built in
+// the job's arena, which is reset before returning; without one the
+// compilation uses an arena of its own. Nothing here is shared between
+// calls, so several threads may compile at once, each with its own arena.
+// A job with a session compiles the session's program instead and keeps
+// its tokens, AST and code there for the next compilation. A job with a
+// cache that writes files takes them from the cache instead of compiling
+// when the same source was compiled with the same options before, and
+// stores them there otherwise; --run and --jit always compile.
+bool driver_compile(const CompilerConfig *config, const DriverJob *job) {
+    bool ok = false;
+    FILE *out = job->out;
+    FILE *err = job->err;
+    const char *input_name = config->input_file ? config->input_file : "<source>";
+
+    bool wanted[ARTIFACT_COUNT];
+    if (job->artifacts) {
+        for (int kind = 0; kind < ARTIFACT_COUNT; kind++) wanted[kind] = job->artifacts[kind] != NULL;
+    } else if (config->emit) {
+        if (!driver_parse_artifacts(config->emit, wanted, err)) return false;
+    } else {
+        driver_default_artifacts(config->format, wanted);
+    }
+
+    // The phases after the last one needed are skipped
+    DriverPhase last_phase = config->run || config->jit ? PHASE_GENERATE : PHASE_LEX;
+    uint32_t outputs = 0;
+    for (int kind = 0; kind < ARTIFACT_COUNT; kind++) {
+        if (!wanted[kind]) continue;
+        if (artifact_info[kind].phase > last_phase) last_phase = artifact_info[kind].phase;
+        outputs |= 1u << kind;
+    }
+
+    DriverProducts products = { NULL, NULL, NULL, config->compact_json ? JSON_COMPACT : JSON_PRETTY };
+    SourceBuffer source;
+    bool source_opened = false;
+    Arena *arena = job->arena;
+    Arena *own_arena = NULL;
+    ASTNode *own_ast = NULL;
+    SymbolTable *symbols = NULL;
+    CompileSession *session = job->session;
+    CompileStats *stats = job->stats;
+    StatsMark mark;
+    bool cached = job->cache && !job->artifacts && !session && !config->run && !config->jit;
+    size_t pulled = 0;
+
+    // Without token artifacts the parser pulls tokens from the lexer as it
+    // goes, so no token array is built and the tokens take bounded memory
+    bool stream = !session && last_phase >= PHASE_PARSE;
+    for (int kind = ARTIFACT_TOKENS; kind <= ARTIFACT_TOKENS_BIN; kind++) {
+        if (wanted[kind]) stream = false;
+    }
+    const char *files[ARTIFACT_COUNT];
+    int num_files = 0;
+    CacheKey key;
+
+    if (config->verbose) {
+        fprintf(out, "Input file: %s\n", input_name);
+        fprintf(out, "Parser type: %s\n", config->parser_type == PARSER_RD ? "recursive descent" : "LALR");
+        fprintf(out, "Output directory: %s\n", config->output_dir);
+    }
+
+    // Regular files are memory-mapped and lexed in place; pipes and stdin
+    // fall back to a buffered read
+    stats_mark(stats, &mark);
+    if (session) {
+        // The session keeps its tokens up to date as it is edited
+        products.lexer = session_lexer(session);
+        if (!products.lexer) {
+            fprintf(err, "Error: Tokenization failed\n");
+            goto done;
+        }
+    } else if (job->source) {
+        source.data = job->source;
+        source.length = job->source_length;
+    } else if (source_open(config->input_file, &source)) {
+        source_opened = true;
+        stats_phase(stats, &mark, "read", source.length, 0, 0, NULL);
+    } else {
+        fprintf(err, "Error: Could not read file '%s'\n", config->input_file);
+        goto done;
+    }
+
+    if (cached) {
+        for (int kind = 0; kind < ARTIFACT_COUNT; kind++) {
+            if (wanted[kind]) files[num_files++] = artifact_info[kind].file;
+        }
+
+        char name[CACHE_NAME_SIZE];
+        stats_mark(stats, &mark);
+        cache_key(config, outputs, source.data, source.length, &key);
+        cache_key_name(&key, name);
+        bool hit = cache_fetch(job->cache, &key, files, num_files, config->output_dir);
+        stats_phase(stats, &mark, hit ? "cache restore" : "cache lookup", source.length, 0, 0, NULL);
+        if (hit) {
+            if (config->verbose) fprintf(out, "Artifacts restored from cache entry %s\n", name);
+            ok = true;
+            goto done;
+        }
+        if (config->verbose) fprintf(out, "Cache miss for entry %s\n", name);
+    }
+
+    if (!session) {
+        // Initialize lexer over the source buffer without copying it
+        stats_mark(stats, &mark);
+        products.lexer = lexer_init_borrowed(source.data, source.length);
+        if (!products.lexer) {
+            fprintf(err, "Error: Could not initialize lexer\n");
+            goto done;
+        }
+
+        if (!stream) {
+            if (!lexer_tokenize(products.lexer)) {
+                fprintf(err, "Error: Tokenization failed\n");
+                goto done;
+            }
+            stats_phase(stats, &mark, "lex", source.length, 0, products.lexer->num_tokens, "tokens");
+        }
+    }
+
+    if (!write_artifacts(config, job, wanted, &products, ARTIFACT_TOKENS, ARTIFACT_TOKENS_BIN, "Tokens")) {
+        goto done;
+    }
+    if (last_phase < PHASE_PARSE) goto written;
+
+    if (session) {
+        // A session's AST is on the heap, so single functions can be
+        // replaced; it is parsed in full only when an edit could not be
+        // parsed on its own
+        ast_set_arena(NULL);
+        products.ast = session_ast(session, config->parser_type);
+        if (!products.ast) {
+            products.ast = parse_tokens(config, input_name, products.lexer, false, NULL, err);
+            if (!products.ast) goto done;
+            if (!session_adopt_ast(session, products.ast, config->parser_type)) own_ast = products.ast;
+        }
+    } else {
+        // All AST nodes for this compilation live in one arena
+        if (!arena) {
+            arena = own_arena = arena_create(ARENA_DEFAULT_CHUNK_SIZE);
+            if (!arena) {
+                fprintf(err, "Error: Memory allocation failed\n");
+                goto done;
+            }
+        }
+        ast_set_arena(arena);
+
+        // A streamed parse also lexes, so its phase starts with the lexer
+        if (!stream) stats_mark(stats, &mark);
+        products.ast = parse_tokens(config, input_name, products.lexer, stream, &pulled, err);
+        if (stats) stats->tokens_streamed = stream ? pulled : 0;
+        if (!products.ast) goto done;
+        if (stats) {
+            stats_phase(stats, &mark, stream ? "lex+parse" : "parse", stream ? source.length : 0, 0,
+                        count_nodes(products.ast), "nodes");
+            stats->arena_used = arena->bytes_used;
+            stats->arena_reserved = arena->bytes_reserved;
+        }
+    }
+
+    if (!write_artifacts(config, job, wanted, &products, ARTIFACT_AST, ARTIFACT_AST_BIN, "AST")) {
+        goto done;
+    }
+    if (last_phase < PHASE_GENERATE) goto written;
+
+    // Resolve names to symbols
+    stats_mark(stats, &mark);
+    symbols = symtab_create();
+    if (!symbols || !symtab_resolve(symbols, products.ast)) {
+        fprintf(err, "Error: Could not resolve symbols\n");
+        goto done;
+    }
+    stats_phase(stats, &mark, "resolve", 0, 0, symtab_count(symbols), "symbols");
+
+    if (config->verbose) symtab_print_summary(symbols, out);
+
+    // Generate code
+    stats_mark(stats, &mark);
+    CodeGenerator *codegen = products.codegen = codegen_init(products.ast);
+    if (!codegen) {
+        fprintf(err, "Error: Could not initialize code generator\n");
+        goto done;
+    }
+
+    codegen_set_symbols(codegen, symbols);
+    codegen_set_optimization(codegen, config->opt_level);
+    codegen_set_jobs(codegen, config->jobs);
+    if (session) codegen_set_cache(codegen, &session->cache);
+    codegen_set_registers(codegen, config->num_regs);
+    codegen_set_peephole(codegen, config->opt_level > 0);
+
+    // Generate and optimize the code of each function
+    if (!codegen_generate(codegen)) {
+        fprintf(err, "Error: Code generation failed\n");
+        goto done;
+    }
+    if (stats) {
+        stats_phase(stats, &mark, "generate", 0, 0, codegen->ir->num_code, "instructions");
+        stats->opt = codegen->opt_report;
+        stats->has_opt = config->opt_level > 0;
+    }
+
+    if (config->verbose && config->opt_level > 0) opt_print_report(&codegen->opt_report, out);
+
+    if (!write_artifacts(config, job, wanted, &products, ARTIFACT_TAC, ARTIFACT_TARGET, "Generated code")) {
+        goto done;
+    }
+
+    // Target code statistics are gathered as it is written
+    if (config->verbose && wanted[ARTIFACT_TARGET]) {
+        if (config->num_regs > 0) regalloc_print_stats(&codegen->reg_stats, out);
+        if (config->opt_level > 0) peephole_print_report(&codegen->target_peephole, out);
+    }
+
+written:
+    // The cache only keeps compilations that wrote every wanted artifact
+    if (cached) {
+        stats_mark(stats, &mark);
+        if (!cache_store(job->cache, &key, files, num_files, config->output_dir) && config->verbose) {
+            fprintf(out, "Could not store artifacts in cache\n");
+        }
+        stats_phase(stats, &mark, "cache store", 0, 0, 0, NULL);
+    }
+
+    // Run the program
+    ok = true;
+    if (config->run) {
+        stats_mark(stats, &mark);
+        VMProgram *vm = vm_load(products.codegen->ir, symbols);
+        VMResult vm_result;
+        ok = vm && vm_run(vm, "main", &vm_result);
+        if (ok) {
+            vm_print_result(vm, &vm_result, out);
+        } else {
+            fprintf(err, "Error: Could not run the program\n");
+        }
+        vm_free(vm);
+        stats_phase(stats, &mark, "run", 0, 0, 0, NULL);
+    }
+
+    if (config->jit && ok) {
+        stats_mark(stats, &mark);
+        ok = run_native(products.codegen, symbols, config->num_regs, out, err);
+        stats_phase(stats, &mark, "jit", 0, 0, 0, NULL);
+    }
+
+done:
+    codegen_free(products.codegen);
+    symtab_free(symbols);
+
+    // Releases the whole AST at once
+    ast_set_arena(NULL);
+    ast_free_node(own_ast);
+    if (own_arena) {
+        arena_destroy(own_arena);
+    } else if (arena) {
+        arena_reset(arena);
+    }
+
+    if (!session) lexer_free(products.lexer);
+    if (source_opened) source_close(&source);
+    return ok;
+}
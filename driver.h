@@ -0,0 +1,51 @@
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include "common.h"
+#include "arena.h"
+#include "outbuf.h"
+#include "session.h"
+#include "cache.h"
+#include "stats.h"
+
+// Artifacts a compilation can write, in the order they are written
+typedef enum {
+    ARTIFACT_TOKENS,        // tokens.txt
+    ARTIFACT_TOKENS_JSON,   // tokens.json
+    ARTIFACT_TOKENS_BIN,    // tokens.bin
+    ARTIFACT_AST,           // ast.txt
+    ARTIFACT_AST_DOT,       // ast.dot
+    ARTIFACT_AST_JSON,      // ast.json
+    ARTIFACT_AST_BIN,       // ast.bin
+    ARTIFACT_TAC,           // tac.txt
+    ARTIFACT_STACK,         // stack_code.txt
+    ARTIFACT_TARGET,        // target_code.txt
+    ARTIFACT_COUNT
+} ArtifactKind;
+
+// Where one compilation reads its program and sends its output
+typedef struct {
+    const char *source;     // Source to compile instead of config->input_file, or NULL
+    size_t source_length;
+    CompileSession *session; // Edited program to compile instead of either, or NULL
+    Arena *arena;           // AST arena, reset afterwards; NULL for one of its own
+    FILE *out;              // Progress messages
+    FILE *err;              // Errors, including syntax errors
+    OutBuf **artifacts;     // Stream for each artifact, NULL for the ones not
+                            // wanted; NULL to write files to config->output_dir
+    ArtifactCache *cache;   // Artifacts of earlier compilations of the same
+                            // source and options, or NULL
+    CompileStats *stats;    // Where each phase's measurements go, or NULL
+} DriverJob;
+
+// Driver functions
+void driver_job_init(DriverJob *job);
+bool driver_compile(const CompilerConfig *config, const DriverJob *job);
+const char* driver_artifact_name(ArtifactKind kind);
+const char* driver_artifact_file(ArtifactKind kind);
+ArtifactKind driver_find_artifact(const char *name, size_t length);
+bool driver_parse_artifacts(const char *list, bool wanted[ARTIFACT_COUNT], FILE *err);
+void driver_default_artifacts(ArtifactFormat format, bool wanted[ARTIFACT_COUNT]);
+char* driver_output_path(const char *output_dir, const char *filename);
+
+#endif // DRIVER_H
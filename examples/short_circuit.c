@@ -0,0 +1,44 @@
+// Regression program for "&&" and "||". They must skip their right
+// operand when the left one decides the result, so "--run" and "--jit"
+// should print "Program returned 0" at every optimization level. The
+// language has no globals, so trap() makes a wrongly evaluated right
+// operand visible by dividing by zero.
+
+int trap(int x) {
+    return 10 / x;
+}
+
+int bump(int n) {
+    return n + 1;
+}
+
+int main() {
+    int x = 0;
+    int calls = 0;
+    int failures = 0;
+
+    // Guarded division: the division must not run
+    if (x != 0 && 10 / x > 1) failures = failures + 1;
+    if (x == 0 || 10 / x > 1) calls = calls + 1;
+
+    // Right operand is a call that must be skipped
+    if (x && trap(x)) failures = failures + 1;
+    if (!x || trap(x)) calls = calls + 1;
+
+    // Right operand is a call that must run
+    if (x == 0 && (calls = bump(calls)) > 0) calls = calls + 1;
+    if (x != 0 || (calls = bump(calls)) > 0) calls = calls + 1;
+
+    // Results are 0 or 1 and nest like C
+    int a = 5 && 7;
+    int b = 0 || -3;
+    int c = x && trap(x) || bump(x) == 1;
+    if (a != 1 || b != 1 || c != 1) failures = failures + 1;
+
+    // As an expression statement and a call argument
+    x && trap(x);
+    calls = bump(!x || trap(x)) + calls;
+
+    if (calls != 8) failures = failures + 1;
+    return failures;
+}
@@ -0,0 +1,532 @@
+#include "ir.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Source operators of IR_ADD..IR_BXOR and IR_NEG..IR_BNOT
+static const char *const binary_ops[] = {
+    "+", "-", "*", "/", "%", "==", "!=", "<", "<=", ">", ">=", "&&", "||", "&", "|", "^"
+};
+static const char *const unary_ops[] = { "-", "!", "~" };
+
+// Stack instruction mnemonics, indexed by StackOp
+static const char *const stack_names[STACK_OPCODE_COUNT] = {
+    "PUSH", "LOAD", "STORE", "POP",
+    "ADD", "SUB", "MUL", "DIV", "MOD", "EQ", "NEQ", "LT", "LTE", "GT", "GTE",
+    "AND", "OR", "BAND", "BOR", "BXOR",
+    "NEG", "NOT", "BNOT",
+    "JZ", "JMP", "CALL", "RET", "RET0", "FUNC", "END_FUNC", "LABEL"
+};
+
+// Create an empty program
+IRProgram* ir_create(void) {
+    IRProgram *ir = (IRProgram*)calloc(1, sizeof(IRProgram));
+    if (!ir) return NULL;
+
+    ir->names = strtab_create();
+    if (!ir->names) {
+        free(ir);
+        return NULL;
+    }
+
+    return ir;
+}
+
+// Free a program
+void ir_free(IRProgram *ir) {
+    if (!ir) return;
+
+    free(ir->code);
+    free(ir->stack);
+    strtab_free(ir->names);
+    free(ir);
+}
+
+// No operand
+IROperand ir_none(void) {
+    IROperand operand = { IR_NONE, 0 };
+    return operand;
+}
+
+// Temporary operand
+IROperand ir_temp(int number) {
+    IROperand operand = { IR_TEMP, number };
+    return operand;
+}
+
+// Integer constant operand
+IROperand ir_const(int64_t value) {
+    IROperand operand = { IR_CONST, value };
+    return operand;
+}
+
+// Label operand
+IROperand ir_label(int number) {
+    IROperand operand = { IR_LABEL, number };
+    return operand;
+}
+
+// Operand naming a variable, function or literal, interned in the program
+IROperand ir_name(IRProgram *ir, IROperandKind kind, const char *name) {
+    int id = strtab_intern(ir->names, name, strlen(name));
+    if (id < 0) {
+        ir->failed = true;
+        return ir_none();
+    }
+
+    IROperand operand = { kind, id };
+    return operand;
+}
+
+// Operand for a literal kept as its source text
+IROperand ir_literal(IRProgram *ir, const char *text) {
+    return ir_name(ir, IR_LITERAL, text);
+}
+
+// Operand for a number literal: a constant when it is a plain decimal
+// integer, so that printing it gives back the same text
+IROperand ir_number(IRProgram *ir, const char *text) {
+    size_t length = strlen(text);
+    bool plain = length > 0 && length <= 18 && (text[0] != '0' || length == 1);
+
+    int64_t value = 0;
+    for (size_t i = 0; plain && i < length; i++) {
+        if (text[i] < '0' || text[i] > '9') {
+            plain = false;
+        } else {
+            value = value * 10 + (text[i] - '0');
+        }
+    }
+
+    return plain ? ir_const(value) : ir_literal(ir, text);
+}
+
+// Allocate a new temporary
+IROperand ir_new_temp(IRProgram *ir) {
+    return ir_temp(ir->num_temps++);
+}
+
+// Allocate a new label number
+int ir_new_label(IRProgram *ir) {
+    return ir->num_labels++;
+}
+
+// Grow an instruction array so it holds at least one more entry
+static bool grow(void **items, size_t *capacity, size_t count, size_t item_size) {
+    if (count < *capacity) return true;
+
+    size_t new_capacity = *capacity ? *capacity * 2 : 256;
+    void *new_items = realloc(*items, item_size * new_capacity);
+    if (!new_items) return false;
+
+    *items = new_items;
+    *capacity = new_capacity;
+    return true;
+}
+
+// Append a three-address instruction
+void ir_emit(IRProgram *ir, IROpcode op, IROperand dst, IROperand src1, IROperand src2) {
+    if (!grow((void**)&ir->code, &ir->code_capacity, ir->num_code, sizeof(IRInsn))) {
+        ir->failed = true;
+        return;
+    }
+
+    IRInsn *insn = &ir->code[ir->num_code++];
+    insn->op = op;
+    insn->dst = dst;
+    insn->src1 = src1;
+    insn->src2 = src2;
+}
+
+// Append a stack machine instruction
+void ir_emit_stack(IRProgram *ir, StackOp op, IROperand arg) {
+    if (!grow((void**)&ir->stack, &ir->stack_capacity, ir->num_stack, sizeof(StackInsn))) {
+        ir->failed = true;
+        return;
+    }
+
+    StackInsn *insn = &ir->stack[ir->num_stack++];
+    insn->op = op;
+    insn->arg = arg;
+}
+
+// Operand of a part moved into the program it is appended to
+static IROperand rebase_operand(IROperand operand, const int *name_ids, int temp_base, int label_base) {
+    switch (operand.kind) {
+        case IR_TEMP:
+            operand.value += temp_base;
+            break;
+        case IR_LABEL:
+            operand.value += label_base;
+            break;
+        case IR_VAR:
+        case IR_LITERAL:
+        case IR_FUNC:
+            operand.value = name_ids[operand.value];
+            break;
+        default:
+            break;
+    }
+    return operand;
+}
+
+// Append the code of another program. Its temporaries and labels are
+// numbered after the ones already here and its names are interned here,
+// in the order of its name table. Appending parts generated one function
+// at a time, each numbered from 0, gives the same program as generating
+// them all in one go.
+bool ir_append(IRProgram *ir, const IRProgram *part) {
+    size_t num_names = strtab_count(part->names);
+    int *name_ids = (int*)malloc(sizeof(int) * (num_names + 1));
+    if (!name_ids) {
+        ir->failed = true;
+        return false;
+    }
+
+    for (size_t i = 0; i < num_names; i++) {
+        name_ids[i] = strtab_intern(ir->names, strtab_get(part->names, (int)i),
+                                    strtab_length(part->names, (int)i));
+        if (name_ids[i] < 0) ir->failed = true;
+    }
+
+    for (size_t i = 0; i < part->num_code && !ir->failed; i++) {
+        const IRInsn *insn = &part->code[i];
+        ir_emit(ir, insn->op,
+                rebase_operand(insn->dst, name_ids, ir->num_temps, ir->num_labels),
+                rebase_operand(insn->src1, name_ids, ir->num_temps, ir->num_labels),
+                rebase_operand(insn->src2, name_ids, ir->num_temps, ir->num_labels));
+    }
+    for (size_t i = 0; i < part->num_stack && !ir->failed; i++) {
+        const StackInsn *insn = &part->stack[i];
+        ir_emit_stack(ir, insn->op, rebase_operand(insn->arg, name_ids, ir->num_temps, ir->num_labels));
+    }
+
+    ir->num_temps += part->num_temps;
+    ir->num_labels += part->num_labels;
+    free(name_ids);
+    return !ir->failed;
+}
+
+// Opcode for a binary source operator, or IR_NOP if there is none
+IROpcode ir_binary_opcode(const char *op) {
+    for (size_t i = 0; i < sizeof(binary_ops) / sizeof(binary_ops[0]); i++) {
+        if (strcmp(binary_ops[i], op) == 0) return (IROpcode)(IR_ADD + i);
+    }
+    return IR_NOP;
+}
+
+// Opcode for a unary source operator, or IR_NOP if there is none
+IROpcode ir_unary_opcode(const char *op) {
+    for (size_t i = 0; i < sizeof(unary_ops) / sizeof(unary_ops[0]); i++) {
+        if (strcmp(unary_ops[i], op) == 0) return (IROpcode)(IR_NEG + i);
+    }
+    return IR_NOP;
+}
+
+// Name of a variable, function or literal operand, or NULL for other kinds
+const char* ir_operand_name(const IRProgram *ir, IROperand operand) {
+    switch (operand.kind) {
+        case IR_VAR:
+        case IR_LITERAL:
+        case IR_FUNC:
+            return strtab_get(ir->names, (int)operand.value);
+        default:
+            return NULL;
+    }
+}
+
+// Check if two operands are the same
+bool ir_same_operand(IROperand a, IROperand b) {
+    return a.kind == b.kind && a.value == b.value;
+}
+
+// Number of locations: temporaries and variables share one numbering, with
+// temporaries first and then every name-table ID
+size_t ir_num_locations(const IRProgram *ir) {
+    return (size_t)ir->num_temps + strtab_count(ir->names);
+}
+
+// Location number of a temporary or variable, or -1 for other operands
+long ir_location(const IRProgram *ir, IROperand operand) {
+    switch (operand.kind) {
+        case IR_TEMP:
+            return (long)operand.value;
+        case IR_VAR:
+            return ir->num_temps + (long)operand.value;
+        default:
+            return -1;
+    }
+}
+
+// Check if an instruction writes its dst
+bool ir_insn_defines(const IRInsn *insn) {
+    return insn->op == IR_COPY || IR_IS_BINARY(insn->op) || IR_IS_UNARY(insn->op) ||
+           (insn->op == IR_CALL && insn->dst.kind != IR_NONE);
+}
+
+// Collect pointers to the operands an instruction reads; returns how many
+int ir_insn_uses(IRInsn *insn, IROperand *out[2]) {
+    if (IR_IS_BINARY(insn->op)) {
+        out[0] = &insn->src1;
+        out[1] = &insn->src2;
+        return 2;
+    }
+
+    switch (insn->op) {
+        case IR_COPY:
+        case IR_PARAM:
+        case IR_JUMP_ZERO:
+        case IR_RETURN:
+            out[0] = &insn->src1;
+            return 1;
+        default:
+            if (IR_IS_UNARY(insn->op)) {
+                out[0] = &insn->src1;
+                return 1;
+            }
+            return 0;
+    }
+}
+
+// Check if an instruction starts a basic block
+bool ir_starts_block(IROpcode op) {
+    return op == IR_FUNCTION || op == IR_LABEL_DEF || op == IR_END_FUNCTION;
+}
+
+// Check if an instruction ends a basic block
+bool ir_ends_block(IROpcode op) {
+    return op == IR_JUMP || op == IR_JUMP_ZERO || op == IR_RETURN;
+}
+
+// Write an operand as text
+void ir_write_operand(OutBuf *out, const IRProgram *ir, IROperand operand) {
+    switch (operand.kind) {
+        case IR_NONE:
+            outbuf_puts(out, "error");
+            break;
+        case IR_TEMP:
+            outbuf_putc(out, 't');
+            outbuf_int(out, (long)operand.value);
+            break;
+        case IR_CONST:
+            outbuf_int(out, (long)operand.value);
+            break;
+        case IR_LABEL:
+            outbuf_putc(out, 'L');
+            outbuf_int(out, (long)operand.value);
+            break;
+        case IR_VAR:
+        case IR_LITERAL:
+        case IR_FUNC:
+            outbuf_puts(out, ir_operand_name(ir, operand));
+            break;
+    }
+}
+
+// Write "dst = "
+static void write_dst(OutBuf *out, const IRProgram *ir, const IRInsn *insn) {
+    ir_write_operand(out, ir, insn->dst);
+    outbuf_puts(out, " = ");
+}
+
+// Write one three-address instruction as a line of text
+static void print_tac_insn(OutBuf *out, const IRProgram *ir, const IRInsn *insn) {
+    switch (insn->op) {
+        case IR_NOP:
+        case IR_OPCODE_COUNT:
+            return;
+
+        case IR_FUNCTION:
+            outbuf_puts(out, "function ");
+            ir_write_operand(out, ir, insn->src1);
+            outbuf_puts(out, ":\n");
+            return;
+
+        case IR_END_FUNCTION:
+            outbuf_puts(out, "end function\n\n");
+            return;
+
+        case IR_LABEL_DEF:
+            ir_write_operand(out, ir, insn->src1);
+            outbuf_putc(out, ':');
+            break;
+
+        case IR_COPY:
+            write_dst(out, ir, insn);
+            ir_write_operand(out, ir, insn->src1);
+            break;
+
+        case IR_PARAM:
+            outbuf_puts(out, "param ");
+            ir_write_operand(out, ir, insn->src1);
+            break;
+
+        case IR_CALL:
+            if (insn->dst.kind != IR_NONE) {
+                write_dst(out, ir, insn);
+            }
+            outbuf_puts(out, "call ");
+            ir_write_operand(out, ir, insn->src1);
+            outbuf_puts(out, ", ");
+            ir_write_operand(out, ir, insn->src2);
+            break;
+
+        case IR_JUMP:
+            outbuf_puts(out, "goto ");
+            ir_write_operand(out, ir, insn->src1);
+            break;
+
+        case IR_JUMP_ZERO:
+            outbuf_puts(out, "if ");
+            ir_write_operand(out, ir, insn->src1);
+            outbuf_puts(out, " == 0 goto ");
+            ir_write_operand(out, ir, insn->src2);
+            break;
+
+        case IR_RETURN:
+            outbuf_puts(out, "return");
+            if (insn->src1.kind != IR_NONE) {
+                outbuf_putc(out, ' ');
+                ir_write_operand(out, ir, insn->src1);
+            }
+            break;
+
+        default:
+            write_dst(out, ir, insn);
+            if (IR_IS_UNARY(insn->op)) {
+                outbuf_puts(out, unary_ops[insn->op - IR_NEG]);
+                outbuf_putc(out, ' ');
+                ir_write_operand(out, ir, insn->src1);
+            } else {
+                ir_write_operand(out, ir, insn->src1);
+                outbuf_putc(out, ' ');
+                outbuf_puts(out, binary_ops[insn->op - IR_ADD]);
+                outbuf_putc(out, ' ');
+                ir_write_operand(out, ir, insn->src2);
+            }
+            break;
+    }
+
+    outbuf_putc(out, '\n');
+}
+
+// Write the TAC of a program as text
+void ir_print_tac(OutBuf *out, const IRProgram *ir) {
+    for (size_t i = 0; i < ir->num_code; i++) {
+        print_tac_insn(out, ir, &ir->code[i]);
+    }
+}
+
+// Mnemonic of a stack instruction
+const char* ir_stack_op_name(StackOp op) {
+    return op < STACK_OPCODE_COUNT ? stack_names[op] : "?";
+}
+
+// Write the stack code of a program as text
+void ir_print_stack(OutBuf *out, const IRProgram *ir) {
+    for (size_t i = 0; i < ir->num_stack; i++) {
+        const StackInsn *insn = &ir->stack[i];
+
+        if (insn->op == STACK_LABEL) {
+            ir_write_operand(out, ir, insn->arg);
+            outbuf_puts(out, ":\n");
+            continue;
+        }
+
+        outbuf_puts(out, stack_names[insn->op]);
+        if (insn->arg.kind != IR_NONE) {
+            outbuf_putc(out, ' ');
+            ir_write_operand(out, ir, insn->arg);
+        }
+        outbuf_putc(out, '\n');
+
+        if (insn->op == STACK_END_FUNC) {
+            outbuf_putc(out, '\n');
+        }
+    }
+}
+
+// Push an operand's value in stack code
+static void lower_push(IRProgram *ir, IROperand operand) {
+    bool stored = operand.kind == IR_VAR || operand.kind == IR_TEMP;
+    ir_emit_stack(ir, stored ? STACK_LOAD : STACK_PUSH, operand);
+}
+
+// Pop the top value into an instruction's destination, or discard it
+static void lower_result(IRProgram *ir, IROperand dst) {
+    if (dst.kind == IR_NONE) {
+        ir_emit_stack(ir, STACK_POP, ir_none());
+    } else {
+        ir_emit_stack(ir, STACK_STORE, dst);
+    }
+}
+
+// Rebuild the stack code from the TAC, replacing what the AST walk emitted.
+// Temporaries become stack machine variables. The params before a call are
+// pushed last to first, as the AST walk does.
+bool ir_lower_stack(IRProgram *ir) {
+    ir->num_stack = 0;
+    size_t first_param = 0;
+    size_t num_params = 0;
+
+    for (size_t i = 0; i < ir->num_code; i++) {
+        const IRInsn *insn = &ir->code[i];
+
+        switch (insn->op) {
+            case IR_NOP:
+            case IR_OPCODE_COUNT:
+                break;
+            case IR_FUNCTION:
+                ir_emit_stack(ir, STACK_FUNC, insn->src1);
+                break;
+            case IR_END_FUNCTION:
+                ir_emit_stack(ir, STACK_END_FUNC, ir_none());
+                break;
+            case IR_LABEL_DEF:
+                ir_emit_stack(ir, STACK_LABEL, insn->src1);
+                break;
+            case IR_COPY:
+                lower_push(ir, insn->src1);
+                lower_result(ir, insn->dst);
+                break;
+            case IR_PARAM:
+                if (num_params == 0) first_param = i;
+                num_params++;
+                break;
+            case IR_CALL:
+                while (num_params > 0) {
+                    lower_push(ir, ir->code[first_param + --num_params].src1);
+                }
+                ir_emit_stack(ir, STACK_CALL, insn->src1);
+                lower_result(ir, insn->dst);
+                break;
+            case IR_JUMP:
+                ir_emit_stack(ir, STACK_JMP, insn->src1);
+                break;
+            case IR_JUMP_ZERO:
+                lower_push(ir, insn->src1);
+                ir_emit_stack(ir, STACK_JZ, insn->src2);
+                break;
+            case IR_RETURN:
+                if (insn->src1.kind == IR_NONE) {
+                    ir_emit_stack(ir, STACK_RET0, ir_none());
+                } else {
+                    lower_push(ir, insn->src1);
+                    ir_emit_stack(ir, STACK_RET, ir_none());
+                }
+                break;
+            default:
+                lower_push(ir, insn->src1);
+                if (IR_IS_UNARY(insn->op)) {
+                    ir_emit_stack(ir, (StackOp)(STACK_NEG + (insn->op - IR_NEG)), ir_none());
+                } else {
+                    lower_push(ir, insn->src2);
+                    ir_emit_stack(ir, (StackOp)(STACK_ADD + (insn->op - IR_ADD)), ir_none());
+                }
+                lower_result(ir, insn->dst);
+                break;
+        }
+    }
+
+    return !ir->failed;
+}
@@ -0,0 +1,162 @@
+#ifndef IR_H
+#define IR_H
+
+#include "common.h"
+#include "strtab.h"
+#include "outbuf.h"
+#include <stdint.h>
+
+// What an operand refers to
+typedef enum {
+    IR_NONE,        // No operand (printed as "error" where one is required)
+    IR_TEMP,        // Temporary t<value>
+    IR_VAR,         // Variable; value is its ID in the name table
+    IR_CONST,       // Integer constant
+    IR_LITERAL,     // Other literal (string, float), kept as source text
+    IR_LABEL,       // Label L<value>
+    IR_FUNC         // Function name; value is its ID in the name table
+} IROperandKind;
+
+// Instruction operand
+typedef struct {
+    IROperandKind kind;
+    int64_t value;
+} IROperand;
+
+// Three-address instructions. The binary and unary opcodes are kept
+// together so passes can test an opcode against the ranges.
+typedef enum {
+    IR_NOP,
+    IR_FUNCTION,    // function src1:
+    IR_END_FUNCTION,
+    IR_LABEL_DEF,   // src1:
+    IR_COPY,        // dst = src1
+    IR_ADD,         // dst = src1 op src2, through IR_BXOR
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_MOD,
+    IR_EQ,
+    IR_NE,
+    IR_LT,
+    IR_LE,
+    IR_GT,
+    IR_GE,
+    IR_AND,
+    IR_OR,
+    IR_BAND,
+    IR_BOR,
+    IR_BXOR,
+    IR_NEG,         // dst = op src1, through IR_BNOT
+    IR_NOT,
+    IR_BNOT,
+    IR_PARAM,       // param src1
+    IR_CALL,        // dst = call src1, src2 (argument count)
+    IR_JUMP,        // goto src1
+    IR_JUMP_ZERO,   // if src1 == 0 goto src2
+    IR_RETURN,      // return [src1]
+    IR_OPCODE_COUNT
+} IROpcode;
+
+#define IR_IS_BINARY(op) ((op) >= IR_ADD && (op) <= IR_BXOR)
+#define IR_IS_UNARY(op)  ((op) >= IR_NEG && (op) <= IR_BNOT)
+
+// Three-address instruction
+typedef struct {
+    IROpcode op;
+    IROperand dst;
+    IROperand src1;
+    IROperand src2;
+} IRInsn;
+
+// Stack machine instructions
+typedef enum {
+    STACK_PUSH,     // Push a constant or literal
+    STACK_LOAD,     // Push a variable
+    STACK_STORE,    // Pop into a variable
+    STACK_POP,      // Discard the top value
+    STACK_ADD,      // Binary operators, in the same order as IR_ADD..IR_BXOR
+    STACK_SUB,
+    STACK_MUL,
+    STACK_DIV,
+    STACK_MOD,
+    STACK_EQ,
+    STACK_NEQ,
+    STACK_LT,
+    STACK_LTE,
+    STACK_GT,
+    STACK_GTE,
+    STACK_AND,
+    STACK_OR,
+    STACK_BAND,
+    STACK_BOR,
+    STACK_BXOR,
+    STACK_NEG,      // Unary operators, in the same order as IR_NEG..IR_BNOT
+    STACK_NOT,
+    STACK_BNOT,
+    STACK_JZ,       // Pop and jump if zero
+    STACK_JMP,
+    STACK_CALL,
+    STACK_RET,      // Return the top value
+    STACK_RET0,     // Return nothing
+    STACK_FUNC,
+    STACK_END_FUNC,
+    STACK_LABEL,
+    STACK_OPCODE_COUNT
+} StackOp;
+
+// Stack machine instruction
+typedef struct {
+    StackOp op;
+    IROperand arg;
+} StackInsn;
+
+// Generated code for a whole program: the TAC and the stack code, with
+// variable and function names interned in one table
+typedef struct {
+    IRInsn *code;
+    size_t num_code;
+    size_t code_capacity;
+
+    StackInsn *stack;
+    size_t num_stack;
+    size_t stack_capacity;
+
+    StringTable *names;
+    int num_temps;
+    int num_labels;
+    bool failed;            // An allocation failed while appending
+} IRProgram;
+
+// IR functions
+IRProgram* ir_create(void);
+void ir_free(IRProgram *ir);
+IROperand ir_none(void);
+IROperand ir_temp(int number);
+IROperand ir_const(int64_t value);
+IROperand ir_label(int number);
+IROperand ir_name(IRProgram *ir, IROperandKind kind, const char *name);
+IROperand ir_literal(IRProgram *ir, const char *text);
+IROperand ir_number(IRProgram *ir, const char *text);
+IROperand ir_new_temp(IRProgram *ir);
+int ir_new_label(IRProgram *ir);
+void ir_emit(IRProgram *ir, IROpcode op, IROperand dst, IROperand src1, IROperand src2);
+void ir_emit_stack(IRProgram *ir, StackOp op, IROperand arg);
+bool ir_append(IRProgram *ir, const IRProgram *part);
+IROpcode ir_binary_opcode(const char *op);
+IROpcode ir_unary_opcode(const char *op);
+const char* ir_operand_name(const IRProgram *ir, IROperand operand);
+bool ir_same_operand(IROperand a, IROperand b);
+size_t ir_num_locations(const IRProgram *ir);
+long ir_location(const IRProgram *ir, IROperand operand);
+bool ir_insn_defines(const IRInsn *insn);
+int ir_insn_uses(IRInsn *insn, IROperand *out[2]);
+bool ir_starts_block(IROpcode op);
+bool ir_ends_block(IROpcode op);
+void ir_write_operand(OutBuf *out, const IRProgram *ir, IROperand operand);
+void ir_print_tac(OutBuf *out, const IRProgram *ir);
+void ir_print_stack(OutBuf *out, const IRProgram *ir);
+const char* ir_stack_op_name(StackOp op);
+bool ir_lower_stack(IRProgram *ir);
+
+#endif // IR_H
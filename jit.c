@@ -0,0 +1,1027 @@
+#include "jit.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__FreeBSD__))
+#define JIT_SUPPORTED 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Print why a run stopped
+static void report_error(const JITProgram *jit) {
+    const char *name = jit->detail >= 0 && jit->detail < jit->num_functions
+        ? ir_operand_name(jit->ir, jit->functions[jit->detail]) : NULL;
+    if (!name) name = "?";
+
+    switch ((JITError)jit->error) {
+        case JIT_DIVISION_BY_ZERO:
+            fprintf(stderr, "Error: Division by zero in %s\n", name);
+            break;
+        case JIT_STACK_OVERFLOW:
+            fprintf(stderr, "Error: Stack overflow in %s\n", name);
+            break;
+        case JIT_UNDEFINED_CALL:
+            fprintf(stderr, "Error: Call to undefined function %s\n", name);
+            break;
+        case JIT_NOT_INTEGER:
+            fprintf(stderr, "Error: Value that is not an integer in %s\n", name);
+            break;
+        case JIT_OK:
+            break;
+    }
+}
+
+// Print what a run returned and how long it took
+void jit_print_result(const JITProgram *jit, const JITResult *result, FILE *out) {
+    fprintf(out, "Program returned %lld\n", (long long)result->value);
+    fprintf(out, "Native code ran in %.3f ms (%zu bytes of x86-64)\n", result->seconds * 1e3, jit->code_size);
+}
+
+#ifdef JIT_SUPPORTED
+
+// x86-64 register numbers
+enum {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+// Where each target register lives. RAX, RDX and R11 are scratch for
+// arithmetic and division, so no target register uses them.
+static const int reg_of[JIT_MAX_REGS] = { RBX, RCX, RSI, RDI, R8, R9, R12, R13, R14, R15 };
+
+// Bytes of stack below the limit the code never touches
+#define STACK_RESERVE 4096
+
+// A rel32 field to point at a label
+typedef struct {
+    size_t at;
+    int label;
+} JITFixup;
+
+// Operand of an arithmetic instruction: a register or a 32-bit immediate
+typedef struct {
+    bool is_reg;
+    int reg;
+    int32_t imm;
+} JITSource;
+
+// State while compiling
+typedef struct {
+    const TargetCode *target;
+    const IRProgram *ir;
+    const SymbolTable *symbols;
+    JITProgram *jit;
+    uint8_t *stack_top;
+
+    uint8_t *buf;
+    size_t size;
+    size_t capacity;
+
+    long *label_at;         // IR labels, then functions, then stubs
+    int num_labels;
+    int labels_capacity;
+    JITFixup *fixups;
+    size_t num_fixups;
+    size_t fixups_capacity;
+
+    int *function_of;       // Function number by name ID, -1 if none
+    int *num_params;        // By function number
+    int num_defined;        // Functions with code; the rest are external
+    int label_restore;      // Where the entry stub leaves the JIT stack
+    int label_error;        // Stores the error and leaves
+
+    // Current function
+    int function;
+    int *disp_owner;        // Function each location's displacement is for
+    int *disp;              // Offset of each location from RBP
+    int label_overflow;
+    int label_div_zero;
+    int label_not_integer;
+
+    bool failed;
+} JITCompiler;
+
+// Append bytes
+static void put(JITCompiler *c, const void *bytes, size_t length) {
+    if (c->size + length > c->capacity) {
+        size_t capacity = c->capacity ? c->capacity * 2 : 4096;
+        while (capacity < c->size + length) capacity *= 2;
+        uint8_t *buf = (uint8_t*)realloc(c->buf, capacity);
+        if (!buf) {
+            c->failed = true;
+            return;
+        }
+        c->buf = buf;
+        c->capacity = capacity;
+    }
+    memcpy(c->buf + c->size, bytes, length);
+    c->size += length;
+}
+
+static void put8(JITCompiler *c, uint8_t value) {
+    put(c, &value, 1);
+}
+
+static void put32(JITCompiler *c, int32_t value) {
+    put(c, &value, 4);
+}
+
+static void put64(JITCompiler *c, int64_t value) {
+    put(c, &value, 8);
+}
+
+// REX.W prefix for a ModRM reg field and r/m field
+static void rex(JITCompiler *c, int reg, int rm) {
+    put8(c, (uint8_t)(0x48 | ((reg & 8) >> 1) | ((rm & 8) >> 3)));
+}
+
+// "op r/m, reg" between registers
+static void op_rr(JITCompiler *c, uint8_t opcode, int reg, int rm) {
+    rex(c, reg, rm);
+    put8(c, opcode);
+    put8(c, (uint8_t)(0xC0 | ((reg & 7) << 3) | (rm & 7)));
+}
+
+// "op r/m, imm32" of the 0x81 group
+static void op_ri(JITCompiler *c, int ext, int rm, int32_t imm) {
+    rex(c, 0, rm);
+    put8(c, 0x81);
+    put8(c, (uint8_t)(0xC0 | (ext << 3) | (rm & 7)));
+    put32(c, imm);
+}
+
+// mov dst, src
+static void mov_rr(JITCompiler *c, int dst, int src) {
+    if (dst != src) op_rr(c, 0x89, src, dst);
+}
+
+// mov reg, imm64
+static void movabs(JITCompiler *c, int reg, int64_t value) {
+    rex(c, 0, reg);
+    put8(c, (uint8_t)(0xB8 + (reg & 7)));
+    put64(c, value);
+}
+
+// mov reg, imm: the sign-extended 32-bit form when the value fits
+static void mov_ri(JITCompiler *c, int reg, int64_t value) {
+    if (value != (int32_t)value) {
+        movabs(c, reg, value);
+        return;
+    }
+    rex(c, 0, reg);
+    put8(c, 0xC7);
+    put8(c, (uint8_t)(0xC0 | (reg & 7)));
+    put32(c, (int32_t)value);
+}
+
+// mov reg, [rbp + disp] or mov [rbp + disp], reg
+static void mov_frame(JITCompiler *c, bool store, int reg, int disp) {
+    rex(c, reg, RBP);
+    put8(c, store ? 0x89 : 0x8B);
+    put8(c, (uint8_t)(0x80 | ((reg & 7) << 3) | (RBP & 7)));
+    put32(c, disp);
+}
+
+// mov [address], reg, through R11
+static void store_at(JITCompiler *c, const int64_t *address, int reg) {
+    movabs(c, R11, (int64_t)(intptr_t)address);
+    rex(c, reg, R11);
+    put8(c, 0x89);
+    put8(c, (uint8_t)(((reg & 7) << 3) | (R11 & 7)));
+}
+
+// push reg or pop reg
+static void push_pop(JITCompiler *c, bool pop, int reg) {
+    if (reg & 8) put8(c, 0x41);
+    put8(c, (uint8_t)((pop ? 0x58 : 0x50) + (reg & 7)));
+}
+
+// Make a label with no position yet
+static int new_label(JITCompiler *c) {
+    if (c->num_labels == c->labels_capacity) {
+        int capacity = c->labels_capacity ? c->labels_capacity * 2 : 256;
+        long *label_at = (long*)realloc(c->label_at, sizeof(long) * (size_t)capacity);
+        if (!label_at) {
+            c->failed = true;
+            return 0;
+        }
+        c->label_at = label_at;
+        c->labels_capacity = capacity;
+    }
+    c->label_at[c->num_labels] = -1;
+    return c->num_labels++;
+}
+
+// Place a label here
+static void place_label(JITCompiler *c, int label) {
+    if (!c->failed) c->label_at[label] = (long)c->size;
+}
+
+// Emit a rel32 field, resolved to a label at the end
+static void rel32(JITCompiler *c, int label) {
+    if (c->num_fixups == c->fixups_capacity) {
+        size_t capacity = c->fixups_capacity ? c->fixups_capacity * 2 : 256;
+        JITFixup *fixups = (JITFixup*)realloc(c->fixups, sizeof(JITFixup) * capacity);
+        if (!fixups) {
+            c->failed = true;
+            return;
+        }
+        c->fixups = fixups;
+        c->fixups_capacity = capacity;
+    }
+    c->fixups[c->num_fixups].at = c->size;
+    c->fixups[c->num_fixups].label = label;
+    c->num_fixups++;
+    put32(c, 0);
+}
+
+// jmp, call or jcc (0x0F 0x8x) to a label
+static void jump(JITCompiler *c, uint8_t opcode, int label) {
+    if (opcode >= 0x80 && opcode <= 0x8F) put8(c, 0x0F);
+    put8(c, opcode);
+    rel32(c, label);
+}
+
+// Short jump over code emitted next; returns where to patch it
+static size_t jump8(JITCompiler *c, uint8_t opcode) {
+    put8(c, opcode);
+    put8(c, 0);
+    return c->size - 1;
+}
+
+// Point a short jump here
+static void patch8(JITCompiler *c, size_t at) {
+    if (!c->failed) c->buf[at] = (uint8_t)(c->size - at - 1);
+}
+
+// Leave with an error: eax holds the JITError and edx its detail
+static void raise_error(JITCompiler *c, JITError error, int detail) {
+    put8(c, 0xB8);
+    put32(c, (int32_t)error);
+    put8(c, 0xBA);
+    put32(c, detail);
+    jump(c, 0xE9, c->label_error);
+}
+
+// Report target code the JIT can't compile
+static bool compile_error(JITCompiler *c, const char *message) {
+    if (!c->failed) fprintf(stderr, "Error: %s\n", message);
+    c->failed = true;
+    return false;
+}
+
+// Check for the stack and frame pointer registers
+static bool is_frame_reg(TargetArg arg) {
+    return arg.kind == TARGET_ARG_REG && (arg.value.value == TARGET_SP || arg.value.value == TARGET_FP);
+}
+
+// x86-64 register of a target register operand
+static int hw_reg(JITCompiler *c, TargetArg arg) {
+    if (arg.kind != TARGET_ARG_REG || arg.value.value < 0 || arg.value.value >= JIT_MAX_REGS) {
+        compile_error(c, "Target code uses a register the JIT does not have");
+        return RAX;
+    }
+    return reg_of[arg.value.value];
+}
+
+// Integer value of an immediate. Literals that are integers in another
+// base count; other literals are not integers.
+static bool imm_value(JITCompiler *c, TargetArg arg, int64_t *value) {
+    if (arg.value.kind == IR_CONST) {
+        *value = arg.value.value;
+        return true;
+    }
+    if (arg.value.kind != IR_LITERAL) return false;
+
+    const char *text = ir_operand_name(c->ir, arg.value);
+    char *end;
+    errno = 0;
+    long long parsed = text ? strtoll(text, &end, 0) : 0;
+    if (!text || !*text || *end != '\0' || errno != 0) return false;
+
+    *value = (int64_t)parsed;
+    return true;
+}
+
+// Move a register or immediate operand into reg. An operand that is not
+// an integer raises the error instead; returns false then.
+static bool load(JITCompiler *c, int reg, TargetArg arg) {
+    int64_t value;
+
+    if (arg.kind == TARGET_ARG_REG) {
+        mov_rr(c, reg, hw_reg(c, arg));
+        return true;
+    }
+    if (arg.kind != TARGET_ARG_IMM) return compile_error(c, "Bad operand in target code");
+    if (!imm_value(c, arg, &value)) {
+        jump(c, 0xE9, c->label_not_integer);
+        return false;
+    }
+    mov_ri(c, reg, value);
+    return true;
+}
+
+// Second operand of an arithmetic instruction; immediates that don't
+// fit in 32 bits go through R11
+static bool source(JITCompiler *c, TargetArg arg, JITSource *src) {
+    int64_t value;
+
+    src->is_reg = true;
+    src->imm = 0;
+    if (arg.kind == TARGET_ARG_REG) {
+        src->reg = hw_reg(c, arg);
+        return true;
+    }
+    if (arg.kind == TARGET_ARG_IMM && imm_value(c, arg, &value) && value == (int32_t)value) {
+        src->is_reg = false;
+        src->imm = (int32_t)value;
+        return true;
+    }
+
+    src->reg = R11;
+    return load(c, R11, arg);
+}
+
+// Offset from RBP of a variable or frame slot operand
+static int frame_disp(JITCompiler *c, TargetArg arg) {
+    if (arg.kind == TARGET_ARG_FRAME) return -8 * (int)arg.value.value;
+
+    long loc = arg.kind == TARGET_ARG_MEM ? ir_location(c->ir, arg.value) : -1;
+    if (loc < 0 || c->disp_owner[loc] != c->function) {
+        compile_error(c, "Bad memory operand in target code");
+        return 0;
+    }
+    return c->disp[loc];
+}
+
+// Give every variable of the function starting at start a place in its
+// frame: parameters where the caller pushed them, above the return
+// address, and the rest below the frame slots. Returns the number of
+// 8-byte slots the frame needs below RBP and counts the pushes.
+static int lay_out_frame(JITCompiler *c, size_t start, size_t *num_pushes) {
+    const TargetCode *target = c->target;
+    int num_frame = 0;
+    int num_locals = 0;
+    size_t end = start + 1;
+
+    *num_pushes = 0;
+    for (; end < target->num_code && target->code[end].op != TARGET_END_FUNC; end++) {
+        const TargetInsn *insn = &target->code[end];
+        if (insn->op == TARGET_LABEL && insn->args[0].value.kind == IR_FUNC) break;
+        if (insn->op == TARGET_PUSH) (*num_pushes)++;
+        for (int k = 0; k < 3; k++) {
+            if (insn->args[k].kind == TARGET_ARG_FRAME && insn->args[k].value.value > num_frame) {
+                num_frame = (int)insn->args[k].value.value;
+            }
+        }
+    }
+
+    // Parameters: the first argument was pushed last
+    const char *name = ir_operand_name(c->ir, target->code[start].args[0].value);
+    const Symbol *symbol = c->symbols ? symtab_get(c->symbols, symtab_function(c->symbols, name)) : NULL;
+    for (int i = 0; symbol && i < symbol->num_params; i++) {
+        const Symbol *param = symtab_get(c->symbols, symbol->first_param + i);
+        int id = strtab_lookup(c->ir->names, param->ir_name, strlen(param->ir_name));
+        if (id < 0) continue;
+
+        IROperand var = { IR_VAR, id };
+        long loc = ir_location(c->ir, var);
+        c->disp_owner[loc] = c->function;
+        c->disp[loc] = 16 + 8 * i;
+    }
+
+    for (size_t i = start + 1; i < end; i++) {
+        const TargetInsn *insn = &target->code[i];
+        for (int k = 0; k < 3; k++) {
+            long loc = insn->args[k].kind == TARGET_ARG_MEM ? ir_location(c->ir, insn->args[k].value) : -1;
+            if (loc < 0 || c->disp_owner[loc] == c->function) continue;
+
+            c->disp_owner[loc] = c->function;
+            c->disp[loc] = -8 * (num_frame + ++num_locals);
+        }
+    }
+
+    return num_frame + num_locals;
+}
+
+// Compute rax = rax op src for the binary operators
+static void emit_binary(JITCompiler *c, TargetOp op, JITSource src) {
+    static const uint8_t arith_rr[] = {
+        [TARGET_ADD] = 0x01, [TARGET_SUB] = 0x29, [TARGET_BAND] = 0x21,
+        [TARGET_BOR] = 0x09, [TARGET_BXOR] = 0x31
+    };
+    static const uint8_t arith_ext[] = {
+        [TARGET_ADD] = 0, [TARGET_SUB] = 5, [TARGET_BAND] = 4, [TARGET_BOR] = 1, [TARGET_BXOR] = 6
+    };
+    static const uint8_t setcc[] = {
+        [TARGET_EQ] = 0x94, [TARGET_NEQ] = 0x95, [TARGET_LT] = 0x9C,
+        [TARGET_LTE] = 0x9E, [TARGET_GT] = 0x9F, [TARGET_GTE] = 0x9D
+    };
+
+    switch (op) {
+        case TARGET_ADD:
+        case TARGET_SUB:
+        case TARGET_BAND:
+        case TARGET_BOR:
+        case TARGET_BXOR:
+            if (src.is_reg) {
+                op_rr(c, arith_rr[op], src.reg, RAX);
+            } else {
+                op_ri(c, arith_ext[op], RAX, src.imm);
+            }
+            break;
+        case TARGET_MUL:
+            // imul rax, src or imul rax, rax, imm32
+            rex(c, RAX, src.is_reg ? src.reg : RAX);
+            if (src.is_reg) {
+                put8(c, 0x0F);
+                put8(c, 0xAF);
+                put8(c, (uint8_t)(0xC0 | (src.reg & 7)));
+            } else {
+                put8(c, 0x69);
+                put8(c, 0xC0);
+                put32(c, src.imm);
+            }
+            break;
+        case TARGET_EQ:
+        case TARGET_NEQ:
+        case TARGET_LT:
+        case TARGET_LTE:
+        case TARGET_GT:
+        case TARGET_GTE:
+            if (src.is_reg) {
+                op_rr(c, 0x39, src.reg, RAX);
+            } else {
+                op_ri(c, 7, RAX, src.imm);
+            }
+            put8(c, 0x0F);
+            put8(c, setcc[op]);
+            put8(c, 0xC0);                  // setcc al
+            put8(c, 0x0F);
+            put8(c, 0xB6);
+            put8(c, 0xC0);                  // movzx eax, al
+            break;
+        case TARGET_AND:
+        case TARGET_OR:
+            if (src.is_reg) {
+                mov_rr(c, R11, src.reg);
+            } else {
+                mov_ri(c, R11, src.imm);
+            }
+            op_rr(c, 0x85, RAX, RAX);       // test rax, rax
+            put8(c, 0x0F);
+            put8(c, 0x95);
+            put8(c, 0xC0);                  // setne al
+            op_rr(c, 0x85, R11, R11);       // test r11, r11
+            put8(c, 0x0F);
+            put8(c, 0x95);
+            put8(c, 0xC2);                  // setne dl
+            put8(c, op == TARGET_AND ? 0x20 : 0x08);
+            put8(c, 0xD0);                  // and/or al, dl
+            put8(c, 0x0F);
+            put8(c, 0xB6);
+            put8(c, 0xC0);                  // movzx eax, al
+            break;
+        case TARGET_DIV:
+        case TARGET_MOD: {
+            // idiv faults on a zero divisor and on INT64_MIN / -1, so
+            // both are checked first; the second wraps like folding does
+            if (src.is_reg) {
+                mov_rr(c, R11, src.reg);
+            } else {
+                mov_ri(c, R11, src.imm);
+            }
+            op_rr(c, 0x85, R11, R11);       // test r11, r11
+            jump(c, 0x84, c->label_div_zero);
+            put8(c, 0x49);
+            put8(c, 0x83);
+            put8(c, 0xFB);
+            put8(c, 0xFF);                  // cmp r11, -1
+            size_t divide = jump8(c, 0x75);
+            if (op == TARGET_DIV) {
+                put8(c, 0x48);
+                put8(c, 0xF7);
+                put8(c, 0xD8);              // neg rax
+            } else {
+                put8(c, 0x31);
+                put8(c, 0xC0);              // xor eax, eax
+            }
+            size_t done = jump8(c, 0xEB);
+            patch8(c, divide);
+            put8(c, 0x48);
+            put8(c, 0x99);                  // cqo
+            put8(c, 0x49);
+            put8(c, 0xF7);
+            put8(c, 0xFB);                  // idiv r11
+            if (op == TARGET_MOD) mov_rr(c, RAX, RDX);
+            patch8(c, done);
+            break;
+        }
+        default:
+            compile_error(c, "Bad operator in target code");
+            break;
+    }
+}
+
+// Compute rax = op rax for the unary operators
+static void emit_unary(JITCompiler *c, TargetOp op) {
+    switch (op) {
+        case TARGET_NEG:
+            put8(c, 0x48);
+            put8(c, 0xF7);
+            put8(c, 0xD8);                  // neg rax
+            break;
+        case TARGET_NOT:
+            op_rr(c, 0x85, RAX, RAX);       // test rax, rax
+            put8(c, 0x0F);
+            put8(c, 0x94);
+            put8(c, 0xC0);                  // sete al
+            put8(c, 0x0F);
+            put8(c, 0xB6);
+            put8(c, 0xC0);                  // movzx eax, al
+            break;
+        default:
+            put8(c, 0x48);
+            put8(c, 0xF7);
+            put8(c, 0xD0);                  // not rax
+            break;
+    }
+}
+
+// Return to the caller, dropping the arguments it pushed
+static void emit_epilogue(JITCompiler *c) {
+    mov_rr(c, RSP, RBP);
+    push_pop(c, true, RBP);
+
+    int bytes = 8 * c->num_params[c->function];
+    if (bytes > 0) {
+        put8(c, 0xC2);
+        put8(c, (uint8_t)(bytes & 0xFF));
+        put8(c, (uint8_t)(bytes >> 8));
+    } else {
+        put8(c, 0xC3);
+    }
+}
+
+// Start a function: set up its frame, check the stack has room for it
+// and clear its variables
+static void begin_function(JITCompiler *c, size_t start) {
+    c->function = c->function_of[c->target->code[start].args[0].value.value];
+    c->label_overflow = new_label(c);
+    c->label_div_zero = new_label(c);
+    c->label_not_integer = new_label(c);
+    place_label(c, c->ir->num_labels + c->function);
+
+    size_t num_pushes;
+    int num_slots = lay_out_frame(c, start, &num_pushes);
+
+    push_pop(c, false, RBP);
+    mov_rr(c, RBP, RSP);
+
+    // lea rax, [rsp - need]; cmp rax, limit; jb overflow
+    int64_t need = 8 * ((int64_t)num_slots + (int64_t)num_pushes + 2);
+    if (need > INT32_MAX) need = INT32_MAX;
+    put8(c, 0x48);
+    put8(c, 0x8D);
+    put8(c, 0x84);
+    put8(c, 0x24);
+    put32(c, (int32_t)-need);
+    movabs(c, R11, (int64_t)(intptr_t)((uint8_t*)c->jit->stack + STACK_RESERVE));
+    op_rr(c, 0x39, R11, RAX);
+    jump(c, 0x82, c->label_overflow);
+
+    // push 0 for each slot, in a loop for big frames
+    if (num_slots <= 8) {
+        for (int i = 0; i < num_slots; i++) {
+            put8(c, 0x6A);
+            put8(c, 0x00);
+        }
+    } else {
+        put8(c, 0x41);
+        put8(c, 0xBB);
+        put32(c, num_slots);                // mov r11d, num_slots
+        size_t loop = c->size;
+        put8(c, 0x6A);
+        put8(c, 0x00);                      // push 0
+        put8(c, 0x49);
+        put8(c, 0xFF);
+        put8(c, 0xCB);                      // dec r11
+        put8(c, 0x75);
+        put8(c, (uint8_t)(loop - (c->size + 1))); // jnz loop
+    }
+}
+
+// End a function: return 0 if control falls off the end, then the stubs
+// its checks jump to
+static void end_function(JITCompiler *c) {
+    if (c->function < 0) return;
+
+    op_rr(c, 0x31, reg_of[0], reg_of[0]);   // xor R0, R0
+    emit_epilogue(c);
+
+    place_label(c, c->label_overflow);
+    raise_error(c, JIT_STACK_OVERFLOW, c->function);
+    place_label(c, c->label_div_zero);
+    raise_error(c, JIT_DIVISION_BY_ZERO, c->function);
+    place_label(c, c->label_not_integer);
+    raise_error(c, JIT_NOT_INTEGER, c->function);
+    c->function = -1;
+}
+
+// Compile one target instruction
+static void compile_insn(JITCompiler *c, size_t i) {
+    const TargetInsn *insn = &c->target->code[i];
+    const TargetArg *args = insn->args;
+    JITSource src;
+
+    if (insn->op == TARGET_LABEL) {
+        if (args[0].value.kind == IR_FUNC) {
+            end_function(c);
+            begin_function(c, i);
+        } else if (args[0].value.kind == IR_LABEL && args[0].value.value < c->ir->num_labels) {
+            place_label(c, (int)args[0].value.value);
+        } else {
+            compile_error(c, "Bad label in target code");
+        }
+        return;
+    }
+    if (c->function < 0) {
+        if (insn->op != TARGET_END_FUNC) compile_error(c, "Target code outside a function");
+        return;
+    }
+
+    // Each function keeps its own frame, so the target code's frame
+    // pointer moves are not needed
+    if (is_frame_reg(args[0]) || is_frame_reg(args[1])) return;
+
+    switch (insn->op) {
+        case TARGET_MOV:
+            load(c, hw_reg(c, args[0]), args[1]);
+            break;
+        case TARGET_LOAD:
+            mov_frame(c, false, hw_reg(c, args[0]), frame_disp(c, args[1]));
+            break;
+        case TARGET_STORE:
+            if (args[1].kind == TARGET_ARG_REG) {
+                mov_frame(c, true, hw_reg(c, args[1]), frame_disp(c, args[0]));
+            } else if (load(c, RAX, args[1])) {
+                mov_frame(c, true, RAX, frame_disp(c, args[0]));
+            }
+            break;
+        case TARGET_PUSH:
+            if (args[0].kind == TARGET_ARG_REG) {
+                push_pop(c, false, hw_reg(c, args[0]));
+            } else if (load(c, RAX, args[0])) {
+                push_pop(c, false, RAX);
+            }
+            break;
+        case TARGET_POP:
+            if (args[0].kind == TARGET_ARG_REG) {
+                push_pop(c, true, hw_reg(c, args[0]));
+            } else {
+                put8(c, 0x48);
+                put8(c, 0x83);
+                put8(c, 0xC4);
+                put8(c, 0x08);              // add rsp, 8
+            }
+            break;
+        case TARGET_NEG:
+        case TARGET_NOT:
+        case TARGET_BNOT:
+            if (load(c, RAX, args[1])) {
+                emit_unary(c, insn->op);
+                mov_rr(c, hw_reg(c, args[0]), RAX);
+            }
+            break;
+        case TARGET_CMP:
+            if (!source(c, args[1], &src)) break;
+            if (args[0].kind == TARGET_ARG_REG) {
+                int reg = hw_reg(c, args[0]);
+                if (src.is_reg) {
+                    op_rr(c, 0x39, src.reg, reg);
+                } else {
+                    op_ri(c, 7, reg, src.imm);
+                }
+            } else if (load(c, RAX, args[0])) {
+                if (src.is_reg) {
+                    op_rr(c, 0x39, src.reg, RAX);
+                } else {
+                    op_ri(c, 7, RAX, src.imm);
+                }
+            }
+            break;
+        case TARGET_JE:
+        case TARGET_JMP:
+            if (args[0].value.kind != IR_LABEL || args[0].value.value >= c->ir->num_labels) {
+                compile_error(c, "Bad jump in target code");
+                break;
+            }
+            jump(c, insn->op == TARGET_JE ? 0x84 : 0xE9, (int)args[0].value.value);
+            break;
+        case TARGET_CALL: {
+            int callee = args[0].value.kind == IR_FUNC ? c->function_of[args[0].value.value] : -1;
+            if (callee < 0) {
+                compile_error(c, "Bad call in target code");
+            } else if (callee < c->num_defined) {
+                jump(c, 0xE8, c->ir->num_labels + callee);
+            } else {
+                raise_error(c, JIT_UNDEFINED_CALL, callee);
+            }
+            break;
+        }
+        case TARGET_RET:
+            emit_epilogue(c);
+            break;
+        case TARGET_END_FUNC:
+            end_function(c);
+            break;
+        case TARGET_LABEL:
+        case TARGET_OPCODE_COUNT:
+            break;
+        default:
+            // Binary operators: Ra = b op c
+            if (args[0].kind != TARGET_ARG_REG) {
+                compile_error(c, "Operator without operands in target code");
+            } else if (source(c, args[2], &src)) {
+                // b is loaded after c, so c may use R11 but not RAX
+                if (load(c, RAX, args[1])) {
+                    emit_binary(c, insn->op, src);
+                    mov_rr(c, hw_reg(c, args[0]), RAX);
+                }
+            }
+            break;
+    }
+}
+
+// Add a function; those with code come first
+static int add_function(JITCompiler *c, IROperand name) {
+    JITProgram *jit = c->jit;
+    IROperand *functions = (IROperand*)realloc(jit->functions, sizeof(IROperand) * (size_t)(jit->num_functions + 1));
+    int *num_params = (int*)realloc(c->num_params, sizeof(int) * (size_t)(jit->num_functions + 1));
+    if (functions) jit->functions = functions;
+    if (num_params) c->num_params = num_params;
+    if (!functions || !num_params) {
+        c->failed = true;
+        return -1;
+    }
+
+    jit->functions[jit->num_functions] = name;
+    c->num_params[jit->num_functions] = 0;
+    c->function_of[name.value] = jit->num_functions;
+    return jit->num_functions++;
+}
+
+// Find the functions and their parameter counts, and check that every
+// call passes as many arguments as its callee takes: the callee drops
+// them when it returns
+static bool find_functions(JITCompiler *c) {
+    const TargetCode *target = c->target;
+
+    for (size_t i = 0; i < target->num_code; i++) {
+        const TargetArg *arg = &target->code[i].args[0];
+        if (target->code[i].op != TARGET_LABEL || arg->value.kind != IR_FUNC) continue;
+        if (c->function_of[arg->value.value] >= 0) return compile_error(c, "Function defined twice");
+
+        int function = add_function(c, arg->value);
+        if (function < 0) return false;
+
+        const char *name = ir_operand_name(c->ir, arg->value);
+        const Symbol *symbol = c->symbols ? symtab_get(c->symbols, symtab_function(c->symbols, name)) : NULL;
+        c->num_params[function] = symbol ? symbol->num_params : 0;
+    }
+    c->num_defined = c->jit->num_functions;
+
+    for (size_t i = 0; i < target->num_code; i++) {
+        const TargetArg *arg = &target->code[i].args[0];
+        if (target->code[i].op == TARGET_CALL && arg->value.kind == IR_FUNC &&
+            c->function_of[arg->value.value] < 0 && add_function(c, arg->value) < 0) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < c->ir->num_code; i++) {
+        const IRInsn *insn = &c->ir->code[i];
+        if (insn->op != IR_CALL || insn->src1.kind != IR_FUNC) continue;
+
+        int callee = c->function_of[insn->src1.value];
+        if (callee >= 0 && callee < c->num_defined && insn->src2.value != c->num_params[callee]) {
+            fprintf(stderr, "Error: Call to %s passes %lld arguments, but it takes %d\n",
+                    ir_operand_name(c->ir, insn->src1), (long long)insn->src2.value, c->num_params[callee]);
+            c->failed = true;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Emit the entry stub at the start of the code. It saves the registers
+// the C caller expects kept, switches to the JIT stack and calls the
+// entry function; its result comes back in R0. Errors store their code
+// and detail, then leave through the same exit.
+static void emit_entry(JITCompiler *c, int entry) {
+    static const int saved[] = { RBP, RBX, R12, R13, R14, R15 };
+    const int num_saved = (int)(sizeof(saved) / sizeof(saved[0]));
+    int64_t top = (int64_t)(intptr_t)c->stack_top;
+
+    for (int i = 0; i < num_saved; i++) push_pop(c, false, saved[i]);
+    mov_rr(c, RAX, RSP);
+    movabs(c, RSP, top);
+    push_pop(c, false, RAX);                // Old stack pointer, at top - 8
+    jump(c, 0xE8, c->ir->num_labels + entry);
+
+    place_label(c, c->label_restore);
+    push_pop(c, true, RSP);
+    mov_rr(c, RAX, reg_of[0]);
+    for (int i = num_saved; i-- > 0;) push_pop(c, true, saved[i]);
+    put8(c, 0xC3);
+
+    place_label(c, c->label_error);
+    store_at(c, &c->jit->error, RAX);
+    store_at(c, &c->jit->detail, RDX);
+    movabs(c, RSP, top - 8);
+    jump(c, 0xE9, c->label_restore);
+}
+
+// Point every rel32 at its label
+static bool resolve_fixups(JITCompiler *c) {
+    for (size_t i = 0; i < c->num_fixups; i++) {
+        const JITFixup *fixup = &c->fixups[i];
+        long at = c->label_at[fixup->label];
+        if (at < 0) return compile_error(c, "Jump to a missing label in target code");
+
+        int32_t offset = (int32_t)(at - (long)(fixup->at + 4));
+        memcpy(c->buf + fixup->at, &offset, 4);
+    }
+    return true;
+}
+
+// Copy the code into an executable mapping
+static bool map_code(JITCompiler *c) {
+    long page = sysconf(_SC_PAGESIZE);
+    size_t size = (c->size + (size_t)page - 1) / (size_t)page * (size_t)page;
+
+    void *code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) return compile_error(c, "Could not map memory for native code");
+
+    memcpy(code, c->buf, c->size);
+    if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(code, size);
+        return compile_error(c, "Could not make native code executable");
+    }
+
+    c->jit->code = (uint8_t*)code;
+    c->jit->code_size = c->size;
+    c->jit->mapped_size = size;
+    return true;
+}
+
+// Check if this build can compile to native code
+bool jit_available(void) {
+    return true;
+}
+
+// Compile register-allocated target code to x86-64. The code may use at
+// most JIT_MAX_REGS registers. Variables get a slot in each activation's
+// frame, and arguments are left where the caller pushed them.
+JITProgram* jit_compile(const TargetCode *target, const IRProgram *ir, const SymbolTable *symbols,
+                        const char *entry) {
+    JITProgram *jit = (JITProgram*)calloc(1, sizeof(JITProgram));
+    if (!jit) return NULL;
+    jit->ir = ir;
+
+    jit->stack = mmap(NULL, JIT_STACK_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (jit->stack == MAP_FAILED) {
+        fprintf(stderr, "Error: Could not map a stack for native code\n");
+        jit->stack = NULL;
+        jit_free(jit);
+        return NULL;
+    }
+
+    size_t num_names = strtab_count(ir->names);
+    size_t num_locations = ir_num_locations(ir);
+    JITCompiler c;
+    memset(&c, 0, sizeof(c));
+    c.target = target;
+    c.ir = ir;
+    c.symbols = symbols;
+    c.jit = jit;
+    c.stack_top = (uint8_t*)jit->stack + JIT_STACK_SIZE;
+    c.function = -1;
+    c.function_of = (int*)malloc(sizeof(int) * (num_names + 1));
+    c.disp_owner = (int*)malloc(sizeof(int) * (num_locations + 1));
+    c.disp = (int*)malloc(sizeof(int) * (num_locations + 1));
+
+    bool ok = c.function_of && c.disp_owner && c.disp;
+    if (ok) {
+        for (size_t i = 0; i < num_names; i++) c.function_of[i] = -1;
+        for (size_t i = 0; i < num_locations; i++) c.disp_owner[i] = -1;
+        ok = find_functions(&c);
+    }
+
+    // Labels: the IR's, one per function, then the exits
+    for (int i = 0; ok && i < ir->num_labels + c.num_defined; i++) new_label(&c);
+    c.label_restore = new_label(&c);
+    c.label_error = new_label(&c);
+
+    int id = strtab_lookup(ir->names, entry, strlen(entry));
+    int entry_function = ok && id >= 0 ? c.function_of[id] : -1;
+    if (ok && (entry_function < 0 || entry_function >= c.num_defined)) {
+        fprintf(stderr, "Error: No function %s to run\n", entry);
+        ok = false;
+    }
+
+    if (ok && !c.failed) {
+        emit_entry(&c, entry_function);
+        for (size_t i = 0; i < target->num_code && !c.failed; i++) compile_insn(&c, i);
+        end_function(&c);
+        ok = !c.failed && resolve_fixups(&c) && map_code(&c);
+    }
+
+    free(c.buf);
+    free(c.label_at);
+    free(c.fixups);
+    free(c.function_of);
+    free(c.num_params);
+    free(c.disp_owner);
+    free(c.disp);
+
+    if (!ok || c.failed) {
+        jit_free(jit);
+        return NULL;
+    }
+    return jit;
+}
+
+// Free compiled code and its stack
+void jit_free(JITProgram *jit) {
+    if (!jit) return;
+    if (jit->code) munmap(jit->code, jit->mapped_size);
+    if (jit->stack) munmap(jit->stack, JIT_STACK_SIZE);
+    free(jit->functions);
+    free(jit);
+}
+
+// Seconds on a monotonic clock
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Run the compiled entry function
+bool jit_run(JITProgram *jit, JITResult *result) {
+    typedef int64_t (*JITEntry)(void);
+    JITEntry entry = (JITEntry)(uintptr_t)jit->code;
+
+    jit->error = JIT_OK;
+    jit->detail = -1;
+
+    double start = now_seconds();
+    int64_t value = entry();
+    result->seconds = now_seconds() - start;
+    result->value = value;
+
+    if (jit->error != JIT_OK) {
+        report_error(jit);
+        return false;
+    }
+    return true;
+}
+
+#else
+
+// Check if this build can compile to native code
+bool jit_available(void) {
+    return false;
+}
+
+// Native code needs an x86-64 POSIX host
+JITProgram* jit_compile(const TargetCode *target, const IRProgram *ir, const SymbolTable *symbols,
+                        const char *entry) {
+    (void)target;
+    (void)ir;
+    (void)symbols;
+    (void)entry;
+    fprintf(stderr, "Error: The JIT needs an x86-64 Linux or FreeBSD host\n");
+    return NULL;
+}
+
+// Free compiled code
+void jit_free(JITProgram *jit) {
+    free(jit);
+}
+
+// Nothing can have been compiled
+bool jit_run(JITProgram *jit, JITResult *result) {
+    (void)result;
+    report_error(jit);
+    return false;
+}
+
+#endif
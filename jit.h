@@ -0,0 +1,55 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "common.h"
+#include "ir.h"
+#include "target.h"
+#include "symtab.h"
+#include <stdint.h>
+
+// Target registers the JIT maps to x86-64 registers; code for the JIT is
+// allocated with at most this many
+#define JIT_MAX_REGS 10
+
+// Native stack the compiled code runs on
+#define JIT_STACK_SIZE ((size_t)64 << 20)
+
+// Why a run stopped early
+typedef enum {
+    JIT_OK,
+    JIT_DIVISION_BY_ZERO,   // detail: function
+    JIT_STACK_OVERFLOW,     // detail: function
+    JIT_UNDEFINED_CALL,     // detail: called function
+    JIT_NOT_INTEGER         // detail: function
+} JITError;
+
+// Target code compiled to x86-64 machine code in an executable mapping,
+// with a stack of its own. The code reports errors through error and
+// detail, so they must not move once compiled.
+typedef struct {
+    uint8_t *code;
+    size_t code_size;       // Bytes of machine code
+    size_t mapped_size;     // Bytes mapped for it
+    void *stack;
+    IROperand *functions;   // Function names by number, for messages
+    int num_functions;
+    const IRProgram *ir;
+    int64_t error;          // JITError of the last run
+    int64_t detail;
+} JITProgram;
+
+// Outcome of a run
+typedef struct {
+    int64_t value;          // What the entry function returned
+    double seconds;
+} JITResult;
+
+// JIT functions
+bool jit_available(void);
+JITProgram* jit_compile(const TargetCode *target, const IRProgram *ir, const SymbolTable *symbols,
+                        const char *entry);
+void jit_free(JITProgram *jit);
+bool jit_run(JITProgram *jit, JITResult *result);
+void jit_print_result(const JITProgram *jit, const JITResult *result, FILE *out);
+
+#endif // JIT_H
@@ -1,29 +1,129 @@
 #include "lexer.h"
-#include <ctype.h>
+#include "lexer_scan.h"
+#include "binfmt.h"
+#include "stats.h"
 
-// Keywords in our C-like language
-static const char *keywords[] = {
-    "if", "else", "while", "for", "return", "int", "float", "char", "void", "struct",
-    "break", "continue", "switch", "case", "default", "do", "const", "static", NULL
+// Character classes used by the main dispatch loop
+#define CC_SPACE    0x01  // ' ', \t, \n, \v, \f, \r
+#define CC_ALPHA    0x02  // Letters and '_' (identifier start)
+#define CC_DIGIT    0x04
+#define CC_QUOTE    0x08
+#define CC_OPERATOR 0x10
+#define CC_PUNCT    0x20
+#define CC_IDENT    (CC_ALPHA | CC_DIGIT)
+
+#define SP CC_SPACE
+#define AL CC_ALPHA
+#define DG CC_DIGIT
+#define QT CC_QUOTE
+#define OP CC_OPERATOR
+#define PU CC_PUNCT
+
+// Class of every byte value; bytes >= 0x80 are unclassified
+static const unsigned char char_class[256] = {
+     0,  0,  0,  0,  0,  0,  0,  0,  0, SP, SP, SP, SP, SP,  0,  0,  // 00-0f
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 10-1f
+    SP, OP, QT,  0,  0, OP, OP,  0, PU, PU, OP, OP, PU, OP, PU, OP,  // 20-2f
+    DG, DG, DG, DG, DG, DG, DG, DG, DG, DG, PU, PU, OP, OP, OP, PU,  // 30-3f
+     0, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,  // 40-4f
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, PU,  0, PU, OP, AL,  // 50-5f
+     0, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,  // 60-6f
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, PU, OP, PU, OP,  0,  // 70-7f
 };
 
-// Initialize the lexer with source code
-Lexer* lexer_init(const char *source) {
-    Lexer *lexer = (Lexer*)malloc(sizeof(Lexer));
-    if (!lexer) return NULL;
+#undef SP
+#undef AL
+#undef DG
+#undef QT
+#undef OP
+#undef PU
+
+// Kind of each single-character operator and punctuator
+static const unsigned char single_kind[256] = {
+    ['+'] = OP_PLUS, ['-'] = OP_MINUS, ['*'] = OP_STAR, ['/'] = OP_SLASH,
+    ['%'] = OP_PERCENT, ['='] = OP_ASSIGN, ['<'] = OP_LT, ['>'] = OP_GT,
+    ['!'] = OP_NOT, ['&'] = OP_AMP, ['|'] = OP_PIPE, ['^'] = OP_CARET,
+    ['~'] = OP_TILDE,
+    ['('] = PUNCT_LPAREN, [')'] = PUNCT_RPAREN, ['{'] = PUNCT_LBRACE,
+    ['}'] = PUNCT_RBRACE, ['['] = PUNCT_LBRACKET, [']'] = PUNCT_RBRACKET,
+    [';'] = PUNCT_SEMICOLON, [','] = PUNCT_COMMA, ['.'] = PUNCT_DOT,
+    [':'] = PUNCT_COLON, ['?'] = PUNCT_QUESTION,
+};
+
+// Two-character operators of the form "X="
+static const unsigned char op_assign_kind[256] = {
+    ['='] = OP_EQ, ['!'] = OP_NE, ['<'] = OP_LE, ['>'] = OP_GE,
+    ['+'] = OP_PLUS_ASSIGN, ['-'] = OP_MINUS_ASSIGN,
+    ['*'] = OP_STAR_ASSIGN, ['/'] = OP_SLASH_ASSIGN,
+};
+
+// Two-character operators of the form "XX"
+static const unsigned char op_double_kind[256] = {
+    ['+'] = OP_INC, ['-'] = OP_DEC, ['&'] = OP_AND, ['|'] = OP_OR,
+};
+
+// Keyword entry in the perfect hash table
+typedef struct {
+    const char *name;
+    unsigned char length;
+    unsigned char kind;
+} KeywordEntry;
+
+// Perfect hash over the keyword set: (length + first * 5 + last * 11) mod 32.
+// The multipliers were found by exhaustive search so that no two keywords
+// share a slot; re-run that search when adding a keyword.
+#define KEYWORD_HASH(str, len) \
+    (((len) + (unsigned char)(str)[0] * 5 + (unsigned char)(str)[(len) - 1] * 11) & 31)
+#define KEYWORD_MIN_LENGTH 2
+#define KEYWORD_MAX_LENGTH 8
+
+static const KeywordEntry keyword_table[32] = {
+    [1]  = {"struct", 6, KW_STRUCT},
+    [6]  = {"static", 6, KW_STATIC},
+    [7]  = {"for", 3, KW_FOR},
+    [8]  = {"break", 5, KW_BREAK},
+    [10] = {"case", 4, KW_CASE},
+    [12] = {"int", 3, KW_INT},
+    [14] = {"continue", 8, KW_CONTINUE},
+    [15] = {"while", 5, KW_WHILE},
+    [16] = {"const", 5, KW_CONST},
+    [17] = {"if", 2, KW_IF},
+    [20] = {"else", 4, KW_ELSE},
+    [23] = {"default", 7, KW_DEFAULT},
+    [25] = {"char", 4, KW_CHAR},
+    [26] = {"return", 6, KW_RETURN},
+    [27] = {"do", 2, KW_DO},
+    [29] = {"switch", 6, KW_SWITCH},
+    [30] = {"void", 4, KW_VOID},
+    [31] = {"float", 5, KW_FLOAT},
+};
+
+// Set up a lexer over a source buffer
+static Lexer* lexer_create(const char *source, size_t source_len, bool owns_source) {
+    Lexer *lexer = (Lexer*)stats_malloc(sizeof(Lexer));
+    if (!lexer) {
+        if (owns_source) free((void*)source);
+        return NULL;
+    }
     
-    lexer->source = strdup(source);
-    lexer->source_len = strlen(source);
+    lexer->source = source;
+    lexer->source_len = source_len;
+    lexer->owns_source = owns_source;
     lexer->pos = 0;
     lexer->line = 1;
     lexer->column = 1;
+    lexer->scan = lexer_scan_ops();
+    lexer->artifact = NULL;
     
     // Initialize token array
     lexer->capacity = 128;  // Initial capacity
-    lexer->tokens = (Token*)malloc(sizeof(Token) * lexer->capacity);
+    lexer->tokens = (Token*)stats_malloc(sizeof(Token) * lexer->capacity);
     lexer->num_tokens = 0;
     
-    if (!lexer->source || !lexer->tokens) {
+    // Token values live in the string table, not in per-token allocations
+    lexer->strings = strtab_create();
+    
+    if (!lexer->source || !lexer->tokens || !lexer->strings) {
         lexer_free(lexer);
         return NULL;
     }
@@ -31,53 +131,76 @@ Lexer* lexer_init(const char *source) {
     return lexer;
 }
 
+// Initialize the lexer with a private copy of the source code
+Lexer* lexer_init(const char *source) {
+    return lexer_create(stats_strdup(source), strlen(source), true);
+}
+
+// Initialize the lexer over a caller-owned buffer without copying it.
+// The buffer need not be NUL-terminated and must outlive the lexer.
+Lexer* lexer_init_borrowed(const char *source, size_t source_len) {
+    return lexer_create(source, source_len, false);
+}
+
 // Free lexer resources
 void lexer_free(Lexer *lexer) {
     if (!lexer) return;
     
-    if (lexer->source) {
-        free(lexer->source);
+    if (lexer->source && lexer->owns_source) {
+        free((void*)lexer->source);
     }
     
     if (lexer->tokens) {
-        // Free each token's value
-        for (size_t i = 0; i < lexer->num_tokens; i++) {
-            if (lexer->tokens[i].value) {
-                free(lexer->tokens[i].value);
-            }
-        }
         free(lexer->tokens);
     }
     
+    // Releases every token value at once
+    strtab_free(lexer->strings);
+    
+    if (lexer->artifact) {
+        source_close(lexer->artifact);
+        free(lexer->artifact);
+    }
+    
     free(lexer);
 }
 
-// Check if a string is a keyword
-static bool is_keyword(const char *str) {
-    for (int i = 0; keywords[i] != NULL; i++) {
-        if (strcmp(str, keywords[i]) == 0) {
-            return true;
-        }
+// Classify an identifier slice: its keyword kind, or KIND_NONE
+static TokenKind keyword_kind(const char *str, size_t length) {
+    if (length < KEYWORD_MIN_LENGTH || length > KEYWORD_MAX_LENGTH) {
+        return KIND_NONE;
+    }
+    
+    const KeywordEntry *entry = &keyword_table[KEYWORD_HASH(str, length)];
+    if (entry->length == length && memcmp(entry->name, str, length) == 0) {
+        return (TokenKind)entry->kind;
     }
-    return false;
+    return KIND_NONE;
 }
 
-// Add a token to the lexer's token array
-static void add_token(Lexer *lexer, TokenType type, const char *value, int line, int column) {
-    // Resize token array if needed
-    if (lexer->num_tokens >= lexer->capacity) {
-        lexer->capacity *= 2;
-        Token *new_tokens = (Token*)realloc(lexer->tokens, sizeof(Token) * lexer->capacity);
-        if (!new_tokens) return;
-        lexer->tokens = new_tokens;
-    }
-    
-    // Add the new token
-    Token *token = &lexer->tokens[lexer->num_tokens++];
+// Fill in a token for the source slice [start, start + length).
+// Identifiers, keywords, numbers, operators and punctuation are interned so
+// equal lexemes share one string; string literals are stored uninterned.
+static void set_token(Lexer *lexer, Token *token, TokenType type, TokenKind kind,
+                      size_t start, size_t length, int line, int column) {
     token->type = type;
-    token->value = strdup(value);
+    token->kind = kind;
+    token->offset = start;
+    token->length = length;
     token->line = line;
     token->column = column;
+    
+    const char *text = lexer->source + start;
+    if (type == TOKEN_STRING) {
+        token->id = -1;
+        token->value = strtab_store(lexer->strings, text, length);
+    } else if (type == TOKEN_EOF) {
+        token->id = -1;
+        token->value = "";
+    } else {
+        token->id = strtab_intern(lexer->strings, text, length);
+        token->value = strtab_get(lexer->strings, token->id);
+    }
 }
 
 // Get the current character
@@ -103,70 +226,94 @@ static void advance(Lexer *lexer) {
     lexer->pos++;
 }
 
+// Jump forward to new_pos, updating line and column from the bytes skipped.
+// Newlines are counted with the vector kernels instead of byte by byte.
+static void advance_to(Lexer *lexer, size_t new_pos) {
+    const char *start = lexer->source + lexer->pos;
+    const char *stop = lexer->source + new_pos;
+    size_t newlines = lexer->scan->count_newlines(start, stop);
+    
+    if (newlines == 0) {
+        lexer->column += new_pos - lexer->pos;
+    } else {
+        // Column restarts after the last newline in the skipped range
+        const char *last = stop - 1;
+        while (*last != '\n') last--;
+        lexer->line += newlines;
+        lexer->column = (size_t)(stop - last);
+    }
+    lexer->pos = new_pos;
+}
+
+// Get a pointer to the end of the source
+static const char* source_end(Lexer *lexer) {
+    return lexer->source + lexer->source_len;
+}
+
 // Skip whitespace
 static void skip_whitespace(Lexer *lexer) {
-    while (isspace(current_char(lexer))) {
-        advance(lexer);
-    }
+    const char *stop = lexer->scan->skip_space(lexer->source + lexer->pos, source_end(lexer));
+    advance_to(lexer, (size_t)(stop - lexer->source));
 }
 
 // Skip comments
 static void skip_comment(Lexer *lexer) {
-    // Single line comment
+    const char *end = source_end(lexer);
+    
+    // Single line comment (the newline itself is left for skip_whitespace)
     if (current_char(lexer) == '/' && peek_char(lexer) == '/') {
-        while (current_char(lexer) != '\n' && current_char(lexer) != '\0') {
-            advance(lexer);
-        }
+        const char *stop = lexer->scan->find_byte(lexer->source + lexer->pos + 2, end, '\n');
+        lexer->column += (size_t)(stop - lexer->source) - lexer->pos;
+        lexer->pos = (size_t)(stop - lexer->source);
     }
     // Multi-line comment
     else if (current_char(lexer) == '/' && peek_char(lexer) == '*') {
-        advance(lexer); // Skip /
-        advance(lexer); // Skip *
+        const char *p = lexer->source + lexer->pos + 2;
         
-        while (!(current_char(lexer) == '*' && peek_char(lexer) == '/') && 
-               current_char(lexer) != '\0') {
-            advance(lexer);
+        // Jump between '*' candidates until one is followed by '/'
+        for (;;) {
+            p = lexer->scan->find_byte(p, end, '*');
+            if (p >= end - 1) {
+                p = end;    // Unterminated: the comment runs to end of input
+                break;
+            }
+            if (p[1] == '/') {
+                p += 2;     // Skip the closing */
+                break;
+            }
+            p++;
         }
         
-        if (current_char(lexer) != '\0') {
-            advance(lexer); // Skip *
-            advance(lexer); // Skip /
-        }
+        advance_to(lexer, (size_t)(p - lexer->source));
     }
 }
 
 // Tokenize an identifier or keyword
-static void tokenize_identifier(Lexer *lexer) {
+static void tokenize_identifier(Lexer *lexer, Token *token) {
     size_t start_pos = lexer->pos;
     int start_line = lexer->line;
     int start_column = lexer->column;
     
-    while (isalnum(current_char(lexer)) || current_char(lexer) == '_') {
-        advance(lexer);
-    }
-    
-    size_t length = lexer->pos - start_pos;
-    char *value = (char*)malloc(length + 1);
-    if (!value) return;
-    
-    strncpy(value, lexer->source + start_pos, length);
-    value[length] = '\0';
+    // Identifiers never contain newlines, so only the column moves
+    const char *stop = lexer->scan->skip_ident(lexer->source + start_pos, source_end(lexer));
+    size_t length = (size_t)(stop - lexer->source) - start_pos;
+    lexer->pos += length;
+    lexer->column += length;
     
-    TokenType type = is_keyword(value) ? TOKEN_KEYWORD : TOKEN_IDENTIFIER;
-    add_token(lexer, type, value, start_line, start_column);
-    
-    free(value);
+    TokenKind kind = keyword_kind(lexer->source + start_pos, length);
+    TokenType type = kind != KIND_NONE ? TOKEN_KEYWORD : TOKEN_IDENTIFIER;
+    set_token(lexer, token, type, kind, start_pos, length, start_line, start_column);
 }
 
 // Tokenize a number
-static void tokenize_number(Lexer *lexer) {
+static void tokenize_number(Lexer *lexer, Token *token) {
     size_t start_pos = lexer->pos;
     int start_line = lexer->line;
     int start_column = lexer->column;
     
     bool has_decimal = false;
     
-    while (isdigit(current_char(lexer)) || 
+    while ((char_class[(unsigned char)current_char(lexer)] & CC_DIGIT) || 
            (current_char(lexer) == '.' && !has_decimal)) {
         if (current_char(lexer) == '.') {
             has_decimal = true;
@@ -174,44 +321,30 @@ static void tokenize_number(Lexer *lexer) {
         advance(lexer);
     }
     
-    size_t length = lexer->pos - start_pos;
-    char *value = (char*)malloc(length + 1);
-    if (!value) return;
-    
-    strncpy(value, lexer->source + start_pos, length);
-    value[length] = '\0';
-    
-    add_token(lexer, TOKEN_NUMBER, value, start_line, start_column);
-    
-    free(value);
+    set_token(lexer, token, TOKEN_NUMBER, KIND_NONE, start_pos, lexer->pos - start_pos, start_line, start_column);
 }
 
 // Tokenize a string
-static void tokenize_string(Lexer *lexer) {
+static void tokenize_string(Lexer *lexer, Token *token) {
     int start_line = lexer->line;
     int start_column = lexer->column;
     
     advance(lexer); // Skip opening quote
     
     size_t start_pos = lexer->pos;
-    while (current_char(lexer) != '"' && current_char(lexer) != '\0') {
-        // Handle escape sequences
-        if (current_char(lexer) == '\\' && peek_char(lexer) != '\0') {
-            advance(lexer);
-        }
-        advance(lexer);
+    const char *end = source_end(lexer);
+    const char *p = lexer->source + start_pos;
+    
+    // Jump between quotes and backslashes; an escape skips the next byte
+    for (;;) {
+        p = lexer->scan->find_either(p, end, '"', '\\');
+        if (p >= end || *p == '"') break;
+        p += (p + 1 < end) ? 2 : 1;
     }
+    if (p > end) p = end;
+    advance_to(lexer, (size_t)(p - lexer->source));
     
-    size_t length = lexer->pos - start_pos;
-    char *value = (char*)malloc(length + 1);
-    if (!value) return;
-    
-    strncpy(value, lexer->source + start_pos, length);
-    value[length] = '\0';
-    
-    add_token(lexer, TOKEN_STRING, value, start_line, start_column);
-    
-    free(value);
+    set_token(lexer, token, TOKEN_STRING, KIND_NONE, start_pos, lexer->pos - start_pos, start_line, start_column);
     
     if (current_char(lexer) == '"') {
         advance(lexer); // Skip closing quote
@@ -219,55 +352,49 @@ static void tokenize_string(Lexer *lexer) {
 }
 
 // Tokenize an operator
-static void tokenize_operator(Lexer *lexer) {
+static void tokenize_operator(Lexer *lexer, Token *token) {
+    size_t start_pos = lexer->pos;
     int start_line = lexer->line;
     int start_column = lexer->column;
     
-    char op[3] = {0};
-    op[0] = current_char(lexer);
+    unsigned char first = (unsigned char)current_char(lexer);
+    TokenKind kind = (TokenKind)single_kind[first];
     advance(lexer);
     
-    // Check for two-character operators
-    if ((op[0] == '+' && current_char(lexer) == '+') ||
-        (op[0] == '-' && current_char(lexer) == '-') ||
-        (op[0] == '=' && current_char(lexer) == '=') ||
-        (op[0] == '!' && current_char(lexer) == '=') ||
-        (op[0] == '<' && current_char(lexer) == '=') ||
-        (op[0] == '>' && current_char(lexer) == '=') ||
-        (op[0] == '&' && current_char(lexer) == '&') ||
-        (op[0] == '|' && current_char(lexer) == '|') ||
-        (op[0] == '+' && current_char(lexer) == '=') ||
-        (op[0] == '-' && current_char(lexer) == '=') ||
-        (op[0] == '*' && current_char(lexer) == '=') ||
-        (op[0] == '/' && current_char(lexer) == '=')) {
-        
-        op[1] = current_char(lexer);
+    // Check for two-character operators ("X=" and "XX")
+    unsigned char second = (unsigned char)current_char(lexer);
+    TokenKind pair = KIND_NONE;
+    if (second == '=') {
+        pair = (TokenKind)op_assign_kind[first];
+    } else if (second == first) {
+        pair = (TokenKind)op_double_kind[first];
+    }
+    
+    if (pair != KIND_NONE) {
+        kind = pair;
         advance(lexer);
     }
     
-    add_token(lexer, TOKEN_OPERATOR, op, start_line, start_column);
+    set_token(lexer, token, TOKEN_OPERATOR, kind, start_pos, lexer->pos - start_pos, start_line, start_column);
 }
 
 // Tokenize punctuation
-static void tokenize_punctuation(Lexer *lexer) {
-    int start_line = lexer->line;
-    int start_column = lexer->column;
-    
-    char punct[2] = {0};
-    punct[0] = current_char(lexer);
-    
-    add_token(lexer, TOKEN_PUNCTUATION, punct, start_line, start_column);
+static void tokenize_punctuation(Lexer *lexer, Token *token) {
+    TokenKind kind = (TokenKind)single_kind[(unsigned char)current_char(lexer)];
+    set_token(lexer, token, TOKEN_PUNCTUATION, kind, lexer->pos, 1, lexer->line, lexer->column);
     
     advance(lexer);
 }
 
-// Main tokenization function
-bool lexer_tokenize(Lexer *lexer) {
+// Scan the next token into *token (pull API). After the end of input every
+// call yields another TOKEN_EOF. Returns false if the token could not be stored.
+bool lexer_next_token(Lexer *lexer, Token *token) {
     while (lexer->pos < lexer->source_len) {
         char c = current_char(lexer);
+        unsigned char cls = char_class[(unsigned char)c];
         
         // Skip whitespace
-        if (isspace(c)) {
+        if (cls & CC_SPACE) {
             skip_whitespace(lexer);
             continue;
         }
@@ -279,43 +406,246 @@ bool lexer_tokenize(Lexer *lexer) {
         }
         
         // Identifiers and keywords
-        if (isalpha(c) || c == '_') {
-            tokenize_identifier(lexer);
+        if (cls & CC_ALPHA) {
+            tokenize_identifier(lexer, token);
         }
         // Numbers
-        else if (isdigit(c)) {
-            tokenize_number(lexer);
+        else if (cls & CC_DIGIT) {
+            tokenize_number(lexer, token);
         }
         // Strings
-        else if (c == '"') {
-            tokenize_string(lexer);
+        else if (cls & CC_QUOTE) {
+            tokenize_string(lexer, token);
         }
         // Operators
-        else if (c == '+' || c == '-' || c == '*' || c == '/' || c == '%' ||
-                 c == '=' || c == '<' || c == '>' || c == '!' ||
-                 c == '&' || c == '|' || c == '^' || c == '~') {
-            tokenize_operator(lexer);
+        else if (cls & CC_OPERATOR) {
+            tokenize_operator(lexer, token);
         }
         // Punctuation
-        else if (c == '(' || c == ')' || c == '{' || c == '}' ||
-                 c == '[' || c == ']' || c == ';' || c == ',' ||
-                 c == '.' || c == ':' || c == '?') {
-            tokenize_punctuation(lexer);
+        else if (cls & CC_PUNCT) {
+            tokenize_punctuation(lexer, token);
         }
         // Unknown
         else {
-            char unknown[2] = {c, '\0'};
-            add_token(lexer, TOKEN_UNKNOWN, unknown, lexer->line, lexer->column);
+            set_token(lexer, token, TOKEN_UNKNOWN, KIND_NONE, lexer->pos, 1, lexer->line, lexer->column);
             advance(lexer);
         }
+        
+        return token->value != NULL;
+    }
+    
+    // EOF token
+    set_token(lexer, token, TOKEN_EOF, KIND_NONE, lexer->pos, 0, lexer->line, lexer->column);
+    
+    return true;
+}
+
+// Main tokenization function: collect the whole token stream into an array
+bool lexer_tokenize(Lexer *lexer) {
+    for (;;) {
+        // Resize token array if needed
+        if (lexer->num_tokens >= lexer->capacity) {
+            size_t capacity = lexer->capacity * 2;
+            Token *new_tokens = (Token*)stats_realloc(lexer->tokens, sizeof(Token) * capacity);
+            if (!new_tokens) return false;
+            lexer->tokens = new_tokens;
+            lexer->capacity = capacity;
+        }
+        
+        Token *token = &lexer->tokens[lexer->num_tokens];
+        if (!lexer_next_token(lexer, token)) return false;
+        lexer->num_tokens++;
+        
+        if (token->type == TOKEN_EOF) break;
+    }
+    
+    return true;
+}
+
+// Offset where a token's lexeme starts; string tokens leave out their
+// opening quote
+static size_t token_start(const Token *token) {
+    return token->type == TOKEN_STRING ? token->offset - 1 : token->offset;
+}
+
+// Check if two tokens are the same lexeme at the same place
+static bool same_token(const Token *a, const Token *b) {
+    if (a->type != b->type || a->kind != b->kind || a->offset != b->offset || a->length != b->length ||
+        a->line != b->line || a->column != b->column || a->id != b->id) {
+        return false;
+    }
+    return a->type != TOKEN_STRING || memcmp(a->value, b->value, a->length) == 0;
+}
+
+// Update the tokens after an edit replaced the old source bytes
+// [offset, offset + removed) with inserted bytes, giving source. Lexing
+// restarts at the last token that starts before the edit, since nothing
+// before it can have changed, and stops at the first token past the edit
+// that starts where an old token did: the old tokens from there on are
+// lexed from the same bytes, so they are kept and only shifted. The
+// lexer must borrow its source, which source replaces. edit receives
+// the range of tokens that changed.
+bool lexer_relex(Lexer *lexer, const char *source, size_t source_len, size_t offset, size_t removed,
+                 size_t inserted, TokenEdit *edit) {
+    if (lexer->owns_source || lexer->artifact) return false;
+    
+    Token *tokens = lexer->tokens;
+    size_t count = lexer->num_tokens;
+    lexer->source = source;
+    lexer->source_len = source_len;
+    
+    // Without a complete token array there is nothing to keep
+    if (count == 0 || tokens[count - 1].type != TOKEN_EOF) {
+        lexer->num_tokens = 0;
+        lexer->pos = 0;
+        lexer->line = 1;
+        lexer->column = 1;
+        if (!lexer_tokenize(lexer)) return false;
+        
+        edit->first = 0;
+        edit->removed = count;
+        edit->inserted = lexer->num_tokens;
+        return true;
+    }
+    
+    // The first token that starts at or after the edit
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (token_start(&tokens[middle]) < offset) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    
+    size_t first = low > 0 ? low - 1 : 0;
+    if (low > 0) {
+        lexer->pos = token_start(&tokens[first]);
+        lexer->line = (size_t)tokens[first].line;
+        lexer->column = (size_t)tokens[first].column;
+    } else {
+        lexer->pos = 0;
+        lexer->line = 1;
+        lexer->column = 1;
+    }
+    
+    // Lex the changed tokens into an array of their own
+    Token *fresh = NULL;
+    size_t num_fresh = 0;
+    size_t fresh_capacity = 0;
+    size_t old = first;
+    bool synced = false;
+    Token sync;
+    
+    for (;;) {
+        if (num_fresh >= fresh_capacity) {
+            size_t capacity = fresh_capacity ? fresh_capacity * 2 : 16;
+            Token *grown = (Token*)stats_realloc(fresh, sizeof(Token) * capacity);
+            if (!grown) {
+                free(fresh);
+                return false;
+            }
+            fresh = grown;
+            fresh_capacity = capacity;
+        }
+        
+        Token *token = &fresh[num_fresh];
+        if (!lexer_next_token(lexer, token)) {
+            free(fresh);
+            return false;
+        }
+        
+        // Past the edit, a token at an old token's shifted start is that token
+        size_t start = token_start(token);
+        if (start >= offset + inserted) {
+            while (old < count && token_start(&tokens[old]) + inserted < start + removed) old++;
+            if (old < count && token_start(&tokens[old]) + inserted == start + removed) {
+                sync = *token;
+                synced = true;
+                break;
+            }
+        }
+        
+        num_fresh++;
+        if (token->type == TOKEN_EOF) {
+            old = count;
+            break;
+        }
     }
     
-    // Add EOF token
-    add_token(lexer, TOKEN_EOF, "", lexer->line, lexer->column);
+    // Tokens lexed again just as they were have not changed
+    size_t same = 0;
+    while (same < num_fresh && first + same < old && same_token(&fresh[same], &tokens[first + same])) same++;
+    first += same;
+    num_fresh -= same;
+    
+    // Splice the changed tokens in and shift the kept ones after them
+    size_t kept = count - old;
+    size_t new_count = first + num_fresh + kept;
+    if (new_count > lexer->capacity) {
+        Token *grown = (Token*)stats_realloc(tokens, sizeof(Token) * new_count);
+        if (!grown) {
+            free(fresh);
+            return false;
+        }
+        lexer->tokens = tokens = grown;
+        lexer->capacity = new_count;
+    }
+    
+    memmove(&tokens[first + num_fresh], &tokens[old], sizeof(Token) * kept);
+    memcpy(&tokens[first], &fresh[same], sizeof(Token) * num_fresh);
+    free(fresh);
+    
+    if (synced) {
+        int sync_line = tokens[first + num_fresh].line;
+        int line_delta = sync.line - sync_line;
+        int column_delta = sync.column - tokens[first + num_fresh].column;
+        
+        for (size_t i = first + num_fresh; i < new_count; i++) {
+            Token *token = &tokens[i];
+            
+            // Only the rest of the edited line moves sideways
+            if (token->line == sync_line) token->column += column_delta;
+            token->line += line_delta;
+            token->offset = token->offset - removed + inserted;
+        }
+    }
     
+    const Token *eof = &tokens[new_count - 1];
+    lexer->num_tokens = new_count;
+    lexer->pos = source_len;
+    lexer->line = (size_t)eof->line;
+    lexer->column = (size_t)eof->column;
+    
+    edit->first = first;
+    edit->removed = old - first;
+    edit->inserted = num_fresh;
     return true;
 }
 
+// Get the source text of a token as a (pointer, length) slice
+const char* lexer_token_text(Lexer *lexer, const Token *token, size_t *length) {
+    // Tokens loaded from a binary artifact have no source to point into
+    if (!lexer->source) {
+        if (length) {
+            *length = strlen(token->value);
+        }
+        return token->value;
+    }
+    
+    if (length) {
+        *length = token->length;
+    }
+    return lexer->source + token->offset;
+}
+
+// Get the string table holding token values
+StringTable* lexer_get_strings(Lexer *lexer) {
+    return lexer->strings;
+}
+
 // Get the tokens
 Token* lexer_get_tokens(Lexer *lexer, size_t *num_tokens) {
     if (num_tokens) {
@@ -324,83 +654,343 @@ Token* lexer_get_tokens(Lexer *lexer, size_t *num_tokens) {
     return lexer->tokens;
 }
 
+// Get string representation of a token type
+static const char* token_type_str(TokenType type) {
+    switch (type) {
+        case TOKEN_IDENTIFIER: return "IDENTIFIER";
+        case TOKEN_NUMBER: return "NUMBER";
+        case TOKEN_STRING: return "STRING";
+        case TOKEN_KEYWORD: return "KEYWORD";
+        case TOKEN_OPERATOR: return "OPERATOR";
+        case TOKEN_PUNCTUATION: return "PUNCTUATION";
+        case TOKEN_COMMENT: return "COMMENT";
+        case TOKEN_WHITESPACE: return "WHITESPACE";
+        case TOKEN_EOF: return "EOF";
+        default: return "UNKNOWN";
+    }
+}
+
+// Write tokens as a text table
+bool lexer_write_tokens(Lexer *lexer, OutBuf *out) {
+    // Write header
+    outbuf_puts(out, "TYPE            VALUE           LINE       COLUMN    \n");
+    outbuf_puts(out, "------------------------------------------------\n");
+    
+    // Write each token as "%-15s %-15s %-10d %-10d"
+    for (size_t i = 0; i < lexer->num_tokens; i++) {
+        Token *token = &lexer->tokens[i];
+        
+        outbuf_padded(out, token_type_str(token->type), 15);
+        outbuf_putc(out, ' ');
+        outbuf_padded(out, token->value, 15);
+        outbuf_putc(out, ' ');
+        outbuf_int_padded(out, token->line, 10);
+        outbuf_putc(out, ' ');
+        outbuf_int_padded(out, token->column, 10);
+        outbuf_putc(out, '\n');
+    }
+    
+    return true;
+}
+
 // Save tokens to a text file
 bool lexer_save_tokens(Lexer *lexer, const char *filename) {
-    FILE *file = fopen(filename, "w");
-    if (!file) return false;
+    OutBuf *out = outbuf_open(filename);
+    if (!out) return false;
     
-    // Write header
-    fprintf(file, "%-15s %-15s %-10s %-10s\n", "TYPE", "VALUE", "LINE", "COLUMN");
-    fprintf(file, "------------------------------------------------\n");
+    bool ok = lexer_write_tokens(lexer, out);
+    return outbuf_close(out) && ok;
+}
+
+// Write tokens as JSON
+bool lexer_write_tokens_json(Lexer *lexer, OutBuf *out, JsonStyle style) {
+    bool pretty = style == JSON_PRETTY;
+    outbuf_puts(out, pretty ? "{\n  \"tokens\": [\n" : "{\"tokens\":[");
     
-    // Write each token
+    // Write each token as a JSON object
     for (size_t i = 0; i < lexer->num_tokens; i++) {
         Token *token = &lexer->tokens[i];
         
-        const char *type_str = "UNKNOWN";
-        switch (token->type) {
-            case TOKEN_IDENTIFIER: type_str = "IDENTIFIER"; break;
-            case TOKEN_NUMBER: type_str = "NUMBER"; break;
-            case TOKEN_STRING: type_str = "STRING"; break;
-            case TOKEN_KEYWORD: type_str = "KEYWORD"; break;
-            case TOKEN_OPERATOR: type_str = "OPERATOR"; break;
-            case TOKEN_PUNCTUATION: type_str = "PUNCTUATION"; break;
-            case TOKEN_COMMENT: type_str = "COMMENT"; break;
-            case TOKEN_WHITESPACE: type_str = "WHITESPACE"; break;
-            case TOKEN_EOF: type_str = "EOF"; break;
-            default: type_str = "UNKNOWN"; break;
-        }
+        outbuf_puts(out, pretty ? "    {\n      \"type\": \"" : "{\"type\":\"");
+        outbuf_puts(out, token_type_str(token->type));
+        outbuf_puts(out, pretty ? "\",\n      \"value\": " : "\",\"value\":");
+        outbuf_json_string(out, token->value);
+        outbuf_puts(out, pretty ? ",\n      \"line\": " : ",\"line\":");
+        outbuf_int(out, token->line);
+        outbuf_puts(out, pretty ? ",\n      \"column\": " : ",\"column\":");
+        outbuf_int(out, token->column);
         
-        fprintf(file, "%-15s %-15s %-10d %-10d\n", 
-                type_str, token->value, token->line, token->column);
+        if (i < lexer->num_tokens - 1) {
+            outbuf_puts(out, pretty ? "\n    },\n" : "},");
+        } else {
+            outbuf_puts(out, pretty ? "\n    }\n" : "}");
+        }
     }
     
-    fclose(file);
+    outbuf_puts(out, pretty ? "  ]\n}\n" : "]}\n");
+    
     return true;
 }
 
 // Save tokens to a JSON file
-bool lexer_save_tokens_json(Lexer *lexer, const char *filename) {
-    FILE *file = fopen(filename, "w");
-    if (!file) return false;
+bool lexer_save_tokens_json(Lexer *lexer, const char *filename, JsonStyle style) {
+    OutBuf *out = outbuf_open(filename);
+    if (!out) return false;
     
-    fprintf(file, "{\n");
-    fprintf(file, "  \"tokens\": [\n");
+    bool ok = lexer_write_tokens_json(lexer, out, style);
+    return outbuf_close(out) && ok;
+}
+
+// Token record in a binary token file
+typedef struct {
+    uint16_t type;
+    uint16_t kind;
+    int32_t id;           // String table ID, or -1 for strings and EOF
+    uint32_t value;       // Index into the file's strings, or BIN_NO_VALUE
+    int32_t line;
+    int32_t column;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t reserved;
+} BinToken;
+
+// Counts at the start of a token file payload, followed by the token
+// records, the string offsets and the NUL-terminated string bytes
+typedef struct {
+    uint32_t num_tokens;
+    uint32_t num_strings;
+    uint32_t string_bytes;
+    uint32_t reserved;
+} BinTokenHeader;
+
+#define BIN_NO_VALUE UINT32_MAX
+
+// Write tokens in the binary artifact format. The file's strings are the
+// lexer's interned strings that tokens use, numbered in order of first
+// use, followed by the values of string literal tokens. For a freshly
+// lexed file that is the string table itself, IDs and all; a re-lexed
+// one, whose table still holds strings of replaced tokens, writes the
+// same file.
+bool lexer_write_tokens_bin(Lexer *lexer, OutBuf *out) {
+    size_t table_size = strtab_count(lexer->strings);
+    int32_t *file_id = (int32_t*)stats_malloc(sizeof(int32_t) * (table_size + 1));
+    int *used = (int*)stats_malloc(sizeof(int) * (table_size + 1));
+    if (!file_id || !used) {
+        free(file_id);
+        free(used);
+        return false;
+    }
     
-    // Write each token as a JSON object
+    size_t num_interned = 0;
+    for (size_t i = 0; i < table_size; i++) file_id[i] = -1;
     for (size_t i = 0; i < lexer->num_tokens; i++) {
-        Token *token = &lexer->tokens[i];
-        
-        const char *type_str = "UNKNOWN";
-        switch (token->type) {
-            case TOKEN_IDENTIFIER: type_str = "IDENTIFIER"; break;
-            case TOKEN_NUMBER: type_str = "NUMBER"; break;
-            case TOKEN_STRING: type_str = "STRING"; break;
-            case TOKEN_KEYWORD: type_str = "KEYWORD"; break;
-            case TOKEN_OPERATOR: type_str = "OPERATOR"; break;
-            case TOKEN_PUNCTUATION: type_str = "PUNCTUATION"; break;
-            case TOKEN_COMMENT: type_str = "COMMENT"; break;
-            case TOKEN_WHITESPACE: type_str = "WHITESPACE"; break;
-            case TOKEN_EOF: type_str = "EOF"; break;
-            default: type_str = "UNKNOWN"; break;
+        int id = lexer->tokens[i].id;
+        if (id >= 0 && (size_t)id < table_size && file_id[id] < 0) {
+            file_id[id] = (int32_t)num_interned;
+            used[num_interned++] = id;
         }
+    }
+    
+    // Size the string section
+    BinTokenHeader counts = { (uint32_t)lexer->num_tokens, (uint32_t)num_interned, 0, 0 };
+    for (size_t i = 0; i < num_interned; i++) {
+        counts.string_bytes += (uint32_t)strtab_length(lexer->strings, used[i]) + 1;
+    }
+    for (size_t i = 0; i < lexer->num_tokens; i++) {
+        if (lexer->tokens[i].type == TOKEN_STRING) {
+            counts.num_strings++;
+            counts.string_bytes += (uint32_t)strlen(lexer->tokens[i].value) + 1;
+        }
+    }
+    
+    uint64_t payload_size = sizeof(counts) +
+                            sizeof(BinToken) * (uint64_t)counts.num_tokens +
+                            sizeof(uint32_t) * (uint64_t)counts.num_strings +
+                            counts.string_bytes;
+    binfmt_write_header(out, BINFMT_TOKENS_MAGIC, payload_size);
+    outbuf_write(out, (const char*)&counts, sizeof(counts));
+    
+    // Token records; literals take string slots after the interned ones
+    uint32_t next_literal = (uint32_t)num_interned;
+    for (size_t i = 0; i < lexer->num_tokens; i++) {
+        Token *token = &lexer->tokens[i];
+        BinToken record;
+        bool interned = token->id >= 0 && (size_t)token->id < table_size;
         
-        fprintf(file, "    {\n");
-        fprintf(file, "      \"type\": \"%s\",\n", type_str);
-        fprintf(file, "      \"value\": \"%s\",\n", token->value);
-        fprintf(file, "      \"line\": %d,\n", token->line);
-        fprintf(file, "      \"column\": %d\n", token->column);
+        record.type = (uint16_t)token->type;
+        record.kind = (uint16_t)token->kind;
+        record.id = interned ? file_id[token->id] : token->id;
+        record.line = token->line;
+        record.column = token->column;
+        record.offset = (uint32_t)token->offset;
+        record.length = (uint32_t)token->length;
+        record.reserved = 0;
         
-        if (i < lexer->num_tokens - 1) {
-            fprintf(file, "    },\n");
+        if (token->type == TOKEN_STRING) {
+            record.value = next_literal++;
+        } else if (interned) {
+            record.value = (uint32_t)file_id[token->id];
         } else {
-            fprintf(file, "    }\n");
+            record.value = BIN_NO_VALUE;
         }
+        
+        outbuf_write(out, (const char*)&record, sizeof(record));
     }
     
-    fprintf(file, "  ]\n");
-    fprintf(file, "}\n");
+    // String offsets
+    uint32_t offset = 0;
+    for (size_t i = 0; i < num_interned; i++) {
+        outbuf_write(out, (const char*)&offset, sizeof(offset));
+        offset += (uint32_t)strtab_length(lexer->strings, used[i]) + 1;
+    }
+    for (size_t i = 0; i < lexer->num_tokens; i++) {
+        if (lexer->tokens[i].type == TOKEN_STRING) {
+            outbuf_write(out, (const char*)&offset, sizeof(offset));
+            offset += (uint32_t)strlen(lexer->tokens[i].value) + 1;
+        }
+    }
+    
+    // String bytes, each with its terminator
+    for (size_t i = 0; i < num_interned; i++) {
+        outbuf_write(out, strtab_get(lexer->strings, used[i]), strtab_length(lexer->strings, used[i]) + 1);
+    }
+    for (size_t i = 0; i < lexer->num_tokens; i++) {
+        if (lexer->tokens[i].type == TOKEN_STRING) {
+            outbuf_write(out, lexer->tokens[i].value, strlen(lexer->tokens[i].value) + 1);
+        }
+    }
     
-    fclose(file);
+    free(file_id);
+    free(used);
     return true;
 }
+
+// Save tokens to a binary artifact file
+bool lexer_save_tokens_bin(Lexer *lexer, const char *filename) {
+    OutBuf *out = outbuf_open(filename);
+    if (!out) return false;
+    
+    bool ok = lexer_write_tokens_bin(lexer, out);
+    return outbuf_close(out) && ok;
+}
+
+// Load tokens from a binary artifact. The file is mapped and token values
+// point straight into it; the returned lexer has no source and only serves
+// its tokens. Records whose type, kind or strings are out of range are
+// rejected as corruption, like a file that is too short.
+Lexer* lexer_load_tokens_bin(const char *filename) {
+    SourceBuffer *file = (SourceBuffer*)stats_malloc(sizeof(SourceBuffer));
+    if (!file) return NULL;
+    
+    if (!source_open(filename, file)) {
+        free(file);
+        return NULL;
+    }
+    
+    // Validate the layout before trusting any offsets
+    size_t payload_size;
+    const char *payload = binfmt_payload(file->data, file->length, BINFMT_TOKENS_MAGIC, &payload_size);
+    BinTokenHeader counts;
+    const BinToken *records = NULL;
+    const uint32_t *offsets = NULL;
+    const char *strings = NULL;
+    bool valid = false;
+    
+    if (payload && payload_size >= sizeof(counts)) {
+        memcpy(&counts, payload, sizeof(counts));
+        uint64_t expected = sizeof(counts) +
+                            sizeof(BinToken) * (uint64_t)counts.num_tokens +
+                            sizeof(uint32_t) * (uint64_t)counts.num_strings +
+                            counts.string_bytes;
+        
+        if (expected <= payload_size &&
+            (counts.string_bytes == 0 || payload[expected - 1] == '\0')) {
+            records = (const BinToken*)(payload + sizeof(counts));
+            offsets = (const uint32_t*)(records + counts.num_tokens);
+            strings = (const char*)(offsets + counts.num_strings);
+            valid = true;
+            
+            for (uint32_t i = 0; i < counts.num_strings && valid; i++) {
+                valid = offsets[i] < counts.string_bytes;
+            }
+        }
+    }
+    
+    if (!valid) {
+        if (payload) fprintf(stderr, "Error: Corrupt token file '%s'\n", filename);
+        source_close(file);
+        free(file);
+        return NULL;
+    }
+    
+    Lexer *lexer = (Lexer*)stats_malloc(sizeof(Lexer));
+    Token *tokens = (Token*)stats_malloc(sizeof(Token) * (counts.num_tokens ? counts.num_tokens : 1));
+    StringTable *table = strtab_create();
+    int32_t *table_id = (int32_t*)stats_malloc(sizeof(int32_t) * ((size_t)counts.num_strings + 1));
+    if (!lexer || !tokens || !table || !table_id) {
+        free(lexer);
+        free(tokens);
+        strtab_free(table);
+        free(table_id);
+        source_close(file);
+        free(file);
+        return NULL;
+    }
+    
+    // Widen the records into tokens, interning each file string once so
+    // token IDs are IDs in the loaded lexer's string table
+    for (uint32_t i = 0; i < counts.num_strings; i++) table_id[i] = -1;
+    for (uint32_t i = 0; i < counts.num_tokens && valid; i++) {
+        const BinToken *record = &records[i];
+        Token *token = &tokens[i];
+        
+        valid = record->type <= TOKEN_UNKNOWN && record->kind < KIND_COUNT &&
+                (record->value == BIN_NO_VALUE || record->value < counts.num_strings) &&
+                (record->id == -1 || (record->id >= 0 && (uint32_t)record->id < counts.num_strings));
+        if (!valid) break;
+        
+        token->type = (TokenType)record->type;
+        token->kind = (TokenKind)record->kind;
+        token->id = -1;
+        token->value = record->value != BIN_NO_VALUE ? strings + offsets[record->value] : "";
+        token->line = record->line;
+        token->column = record->column;
+        token->offset = record->offset;
+        token->length = record->length;
+        
+        if (record->id >= 0) {
+            if (table_id[record->id] < 0) {
+                const char *text = strings + offsets[record->id];
+                table_id[record->id] = strtab_intern(table, text, strlen(text));
+                valid = table_id[record->id] >= 0;
+            }
+            token->id = table_id[record->id];
+        }
+    }
+    free(table_id);
+    
+    if (!valid) {
+        fprintf(stderr, "Error: Corrupt token file '%s'\n", filename);
+        free(lexer);
+        free(tokens);
+        strtab_free(table);
+        source_close(file);
+        free(file);
+        return NULL;
+    }
+    
+    lexer->source = NULL;
+    lexer->source_len = 0;
+    lexer->owns_source = false;
+    lexer->pos = 0;
+    lexer->line = 1;
+    lexer->column = 1;
+    lexer->tokens = tokens;
+    lexer->num_tokens = counts.num_tokens;
+    lexer->capacity = counts.num_tokens;
+    lexer->strings = table;
+    lexer->scan = lexer_scan_ops();
+    lexer->artifact = file;
+    
+    return lexer;
+}
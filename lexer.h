@@ -2,25 +2,52 @@
 #define LEXER_H
 
 #include "common.h"
+#include "strtab.h"
+#include "lexer_scan.h"
+#include "outbuf.h"
+#include "source.h"
 
 // Lexer structure
 typedef struct {
-    char *source;
+    const char *source;   // Source text (owned or borrowed, see owns_source)
     size_t source_len;
+    bool owns_source;     // lexer_free releases source
     size_t pos;
     size_t line;
     size_t column;
     Token *tokens;
     size_t num_tokens;
     size_t capacity;
+    StringTable *strings; // Interned token values
+    const LexScanOps *scan; // Byte-scanning kernels for this CPU
+    SourceBuffer *artifact; // Mapped token file the tokens point into, if loaded
 } Lexer;
 
+// Tokens changed by lexer_relex: the old tokens [first, first + removed)
+// became [first, first + inserted), and the ones after them were shifted
+typedef struct {
+    size_t first;
+    size_t removed;
+    size_t inserted;
+} TokenEdit;
+
 // Lexer functions
 Lexer* lexer_init(const char *source);
+Lexer* lexer_init_borrowed(const char *source, size_t source_len);
 void lexer_free(Lexer *lexer);
 Token* lexer_get_tokens(Lexer *lexer, size_t *num_tokens);
+const char* lexer_token_text(Lexer *lexer, const Token *token, size_t *length);
+StringTable* lexer_get_strings(Lexer *lexer);
 bool lexer_tokenize(Lexer *lexer);
+bool lexer_next_token(Lexer *lexer, Token *token);
+bool lexer_relex(Lexer *lexer, const char *source, size_t source_len, size_t offset, size_t removed,
+                 size_t inserted, TokenEdit *edit);
 bool lexer_save_tokens(Lexer *lexer, const char *filename);
-bool lexer_save_tokens_json(Lexer *lexer, const char *filename);
+bool lexer_save_tokens_json(Lexer *lexer, const char *filename, JsonStyle style);
+bool lexer_save_tokens_bin(Lexer *lexer, const char *filename);
+bool lexer_write_tokens(Lexer *lexer, OutBuf *out);
+bool lexer_write_tokens_json(Lexer *lexer, OutBuf *out, JsonStyle style);
+bool lexer_write_tokens_bin(Lexer *lexer, OutBuf *out);
+Lexer* lexer_load_tokens_bin(const char *filename);
 
 #endif // LEXER_H
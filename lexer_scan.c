@@ -0,0 +1,390 @@
+#include "lexer_scan.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define LEXER_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define LEXER_SCAN_NEON 1
+#include <arm_neon.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// Scalar kernels (portable fallback and tail handling for the vector ones)
+// ---------------------------------------------------------------------------
+
+// Check for ' ', \t, \n, \v, \f, \r
+static inline bool is_space_byte(unsigned char c) {
+    return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+// Check for [A-Za-z0-9_]
+static inline bool is_ident_byte(unsigned char c) {
+    return (unsigned char)((c | 0x20) - 'a') < 26 ||
+           (unsigned char)(c - '0') < 10 || c == '_';
+}
+
+static const char* scalar_skip_space(const char *p, const char *end) {
+    while (p < end && is_space_byte((unsigned char)*p)) p++;
+    return p;
+}
+
+static const char* scalar_skip_ident(const char *p, const char *end) {
+    while (p < end && is_ident_byte((unsigned char)*p)) p++;
+    return p;
+}
+
+static const char* scalar_find_byte(const char *p, const char *end, char c) {
+    const char *found = (const char*)memchr(p, c, (size_t)(end - p));
+    return found ? found : end;
+}
+
+static const char* scalar_find_either(const char *p, const char *end, char a, char b) {
+    while (p < end && *p != a && *p != b) p++;
+    return p;
+}
+
+static size_t scalar_count_newlines(const char *p, const char *end) {
+    size_t count = 0;
+    while ((p = (const char*)memchr(p, '\n', (size_t)(end - p))) != NULL) {
+        count++;
+        p++;
+    }
+    return count;
+}
+
+static const LexScanOps scalar_ops = {
+    "scalar",
+    scalar_skip_space,
+    scalar_skip_ident,
+    scalar_find_byte,
+    scalar_find_either,
+    scalar_count_newlines
+};
+
+// ---------------------------------------------------------------------------
+// SSE2 kernels (16 bytes per step; baseline on x86-64)
+// ---------------------------------------------------------------------------
+
+#ifdef LEXER_SCAN_X86
+
+// Mask of whitespace bytes in a 16-byte block
+static inline __m128i sse2_space_mask(__m128i v) {
+    // \t..\r is the unsigned range [9, 13]: (v - 9) <= 4
+    __m128i ctrl = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+    __m128i in_range = _mm_cmpeq_epi8(_mm_min_epu8(ctrl, _mm_set1_epi8(4)), ctrl);
+    return _mm_or_si128(in_range, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+}
+
+// Mask of identifier bytes in a 16-byte block
+static inline __m128i sse2_ident_mask(__m128i v) {
+    __m128i lower = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i alpha = _mm_cmpeq_epi8(_mm_min_epu8(lower, _mm_set1_epi8(25)), lower);
+    __m128i digit = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(alpha, digit), under);
+}
+
+static const char* sse2_skip_space(const char *p, const char *end) {
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        unsigned stop = ~(unsigned)_mm_movemask_epi8(sse2_space_mask(v)) & 0xffff;
+        if (stop) return p + __builtin_ctz(stop);
+        p += 16;
+    }
+    return scalar_skip_space(p, end);
+}
+
+static const char* sse2_skip_ident(const char *p, const char *end) {
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        unsigned stop = ~(unsigned)_mm_movemask_epi8(sse2_ident_mask(v)) & 0xffff;
+        if (stop) return p + __builtin_ctz(stop);
+        p += 16;
+    }
+    return scalar_skip_ident(p, end);
+}
+
+static const char* sse2_find_byte(const char *p, const char *end, char c) {
+    __m128i needle = _mm_set1_epi8(c);
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        unsigned hit = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+        if (hit) return p + __builtin_ctz(hit);
+        p += 16;
+    }
+    return scalar_find_byte(p, end, c);
+}
+
+static const char* sse2_find_either(const char *p, const char *end, char a, char b) {
+    __m128i na = _mm_set1_epi8(a);
+    __m128i nb = _mm_set1_epi8(b);
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, na), _mm_cmpeq_epi8(v, nb));
+        unsigned hit = (unsigned)_mm_movemask_epi8(m);
+        if (hit) return p + __builtin_ctz(hit);
+        p += 16;
+    }
+    return scalar_find_either(p, end, a, b);
+}
+
+static size_t sse2_count_newlines(const char *p, const char *end) {
+    __m128i nl = _mm_set1_epi8('\n');
+    size_t count = 0;
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        count += (size_t)__builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+        p += 16;
+    }
+    return count + scalar_count_newlines(p, end);
+}
+
+static const LexScanOps sse2_ops = {
+    "sse2",
+    sse2_skip_space,
+    sse2_skip_ident,
+    sse2_find_byte,
+    sse2_find_either,
+    sse2_count_newlines
+};
+
+// ---------------------------------------------------------------------------
+// AVX2 kernels (32 bytes per step; selected at runtime)
+// ---------------------------------------------------------------------------
+
+#define AVX2_TARGET __attribute__((target("avx2,popcnt,bmi")))
+
+AVX2_TARGET
+static inline __m256i avx2_space_mask(__m256i v) {
+    __m256i ctrl = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+    __m256i in_range = _mm256_cmpeq_epi8(_mm256_min_epu8(ctrl, _mm256_set1_epi8(4)), ctrl);
+    return _mm256_or_si256(in_range, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+}
+
+AVX2_TARGET
+static inline __m256i avx2_ident_mask(__m256i v) {
+    __m256i lower = _mm256_sub_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    __m256i alpha = _mm256_cmpeq_epi8(_mm256_min_epu8(lower, _mm256_set1_epi8(25)), lower);
+    __m256i digit = _mm256_sub_epi8(v, _mm256_set1_epi8('0'));
+    digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+    __m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    return _mm256_or_si256(_mm256_or_si256(alpha, digit), under);
+}
+
+AVX2_TARGET
+static const char* avx2_skip_space(const char *p, const char *end) {
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        uint32_t stop = ~(uint32_t)_mm256_movemask_epi8(avx2_space_mask(v));
+        if (stop) return p + __builtin_ctz(stop);
+        p += 32;
+    }
+    return sse2_skip_space(p, end);
+}
+
+AVX2_TARGET
+static const char* avx2_skip_ident(const char *p, const char *end) {
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        uint32_t stop = ~(uint32_t)_mm256_movemask_epi8(avx2_ident_mask(v));
+        if (stop) return p + __builtin_ctz(stop);
+        p += 32;
+    }
+    return sse2_skip_ident(p, end);
+}
+
+AVX2_TARGET
+static const char* avx2_find_byte(const char *p, const char *end, char c) {
+    __m256i needle = _mm256_set1_epi8(c);
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        uint32_t hit = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+        if (hit) return p + __builtin_ctz(hit);
+        p += 32;
+    }
+    return sse2_find_byte(p, end, c);
+}
+
+AVX2_TARGET
+static const char* avx2_find_either(const char *p, const char *end, char a, char b) {
+    __m256i na = _mm256_set1_epi8(a);
+    __m256i nb = _mm256_set1_epi8(b);
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, na), _mm256_cmpeq_epi8(v, nb));
+        uint32_t hit = (uint32_t)_mm256_movemask_epi8(m);
+        if (hit) return p + __builtin_ctz(hit);
+        p += 32;
+    }
+    return sse2_find_either(p, end, a, b);
+}
+
+AVX2_TARGET
+static size_t avx2_count_newlines(const char *p, const char *end) {
+    __m256i nl = _mm256_set1_epi8('\n');
+    size_t count = 0;
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        count += (size_t)__builtin_popcount((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)));
+        p += 32;
+    }
+    return count + sse2_count_newlines(p, end);
+}
+
+static const LexScanOps avx2_ops = {
+    "avx2",
+    avx2_skip_space,
+    avx2_skip_ident,
+    avx2_find_byte,
+    avx2_find_either,
+    avx2_count_newlines
+};
+
+#endif // LEXER_SCAN_X86
+
+// ---------------------------------------------------------------------------
+// NEON kernels (16 bytes per step; baseline on AArch64)
+// ---------------------------------------------------------------------------
+
+#ifdef LEXER_SCAN_NEON
+
+// Compress a byte mask into 4 bits per byte so ctz finds the first match
+static inline uint64_t neon_bitmask(uint8x16_t m) {
+    uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(m), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+}
+
+static inline uint8x16_t neon_space_mask(uint8x16_t v) {
+    uint8x16_t ctrl = vcleq_u8(vsubq_u8(v, vdupq_n_u8('\t')), vdupq_n_u8(4));
+    return vorrq_u8(ctrl, vceqq_u8(v, vdupq_n_u8(' ')));
+}
+
+static inline uint8x16_t neon_ident_mask(uint8x16_t v) {
+    uint8x16_t lower = vsubq_u8(vorrq_u8(v, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+    uint8x16_t alpha = vcleq_u8(lower, vdupq_n_u8(25));
+    uint8x16_t digit = vcleq_u8(vsubq_u8(v, vdupq_n_u8('0')), vdupq_n_u8(9));
+    uint8x16_t under = vceqq_u8(v, vdupq_n_u8('_'));
+    return vorrq_u8(vorrq_u8(alpha, digit), under);
+}
+
+static const char* neon_skip_space(const char *p, const char *end) {
+    while (end - p >= 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)p);
+        uint64_t stop = ~neon_bitmask(neon_space_mask(v));
+        if (stop) return p + (__builtin_ctzll(stop) >> 2);
+        p += 16;
+    }
+    return scalar_skip_space(p, end);
+}
+
+static const char* neon_skip_ident(const char *p, const char *end) {
+    while (end - p >= 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)p);
+        uint64_t stop = ~neon_bitmask(neon_ident_mask(v));
+        if (stop) return p + (__builtin_ctzll(stop) >> 2);
+        p += 16;
+    }
+    return scalar_skip_ident(p, end);
+}
+
+static const char* neon_find_byte(const char *p, const char *end, char c) {
+    uint8x16_t needle = vdupq_n_u8((uint8_t)c);
+    while (end - p >= 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)p);
+        uint64_t hit = neon_bitmask(vceqq_u8(v, needle));
+        if (hit) return p + (__builtin_ctzll(hit) >> 2);
+        p += 16;
+    }
+    return scalar_find_byte(p, end, c);
+}
+
+static const char* neon_find_either(const char *p, const char *end, char a, char b) {
+    uint8x16_t na = vdupq_n_u8((uint8_t)a);
+    uint8x16_t nb = vdupq_n_u8((uint8_t)b);
+    while (end - p >= 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)p);
+        uint64_t hit = neon_bitmask(vorrq_u8(vceqq_u8(v, na), vceqq_u8(v, nb)));
+        if (hit) return p + (__builtin_ctzll(hit) >> 2);
+        p += 16;
+    }
+    return scalar_find_either(p, end, a, b);
+}
+
+static size_t neon_count_newlines(const char *p, const char *end) {
+    uint8x16_t nl = vdupq_n_u8('\n');
+    size_t count = 0;
+    while (end - p >= 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)p);
+        count += vaddvq_u8(vandq_u8(vceqq_u8(v, nl), vdupq_n_u8(1)));
+        p += 16;
+    }
+    return count + scalar_count_newlines(p, end);
+}
+
+static const LexScanOps neon_ops = {
+    "neon",
+    neon_skip_space,
+    neon_skip_ident,
+    neon_find_byte,
+    neon_find_either,
+    neon_count_newlines
+};
+
+#endif // LEXER_SCAN_NEON
+
+// ---------------------------------------------------------------------------
+// Runtime selection
+// ---------------------------------------------------------------------------
+
+static const LexScanOps *selected_ops = &scalar_ops;
+static pthread_once_t select_once = PTHREAD_ONCE_INIT;
+
+// Get the kernels with a given name, or NULL if this CPU cannot run them
+const LexScanOps* lexer_scan_ops_named(const char *name) {
+    if (strcmp(name, "scalar") == 0) return &scalar_ops;
+#ifdef LEXER_SCAN_X86
+    if (strcmp(name, "sse2") == 0) return &sse2_ops;
+    if (strcmp(name, "avx2") == 0) {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? &avx2_ops : NULL;
+    }
+#endif
+#ifdef LEXER_SCAN_NEON
+    if (strcmp(name, "neon") == 0) return &neon_ops;
+#endif
+    return NULL;
+}
+
+// Pick the widest kernels the CPU supports; LEXER_SCAN=<name> overrides
+static void select_scan_ops(void) {
+    const char *forced = getenv("LEXER_SCAN");
+    if (forced) {
+        const LexScanOps *ops = lexer_scan_ops_named(forced);
+        if (ops) {
+            selected_ops = ops;
+            return;
+        }
+    }
+
+#if defined(LEXER_SCAN_X86)
+    __builtin_cpu_init();
+    selected_ops = __builtin_cpu_supports("avx2") ? &avx2_ops : &sse2_ops;
+#elif defined(LEXER_SCAN_NEON)
+    selected_ops = &neon_ops;
+#else
+    selected_ops = &scalar_ops;
+#endif
+}
+
+// Get the scan kernels for the running CPU
+const LexScanOps* lexer_scan_ops(void) {
+    pthread_once(&select_once, select_scan_ops);
+    return selected_ops;
+}
@@ -0,0 +1,28 @@
+#ifndef LEXER_SCAN_H
+#define LEXER_SCAN_H
+
+#include "common.h"
+
+// Byte-scanning kernels used by the lexer's hot loops. Every scan function
+// returns a pointer to the first byte in [p, end) that stops the run, or
+// end if the whole range matches. None of them read past end.
+typedef struct {
+    const char *name;   // "avx2", "sse2", "neon" or "scalar"
+
+    // Skip ' ', \t, \n, \v, \f and \r
+    const char* (*skip_space)(const char *p, const char *end);
+    // Skip identifier characters [A-Za-z0-9_]
+    const char* (*skip_ident)(const char *p, const char *end);
+    // Find the first occurrence of c
+    const char* (*find_byte)(const char *p, const char *end, char c);
+    // Find the first occurrence of a or b
+    const char* (*find_either)(const char *p, const char *end, char a, char b);
+    // Count '\n' bytes
+    size_t (*count_newlines)(const char *p, const char *end);
+} LexScanOps;
+
+// Scan kernel selection (chosen once from the running CPU's features)
+const LexScanOps* lexer_scan_ops(void);
+const LexScanOps* lexer_scan_ops_named(const char *name);
+
+#endif // LEXER_SCAN_H
@@ -1,9 +1,12 @@
 #include "common.h"
-#include "lexer.h"
-#include "parser_rd.h"
-#include "parser_lalr.h"
-#include "ast.h"
-#include "codegen.h"
+#include "driver.h"
+#include "batch.h"
+#include "server.h"
+#include "cache.h"
+#include "stats.h"
+#include "opt.h"
+#include "regalloc.h"
+#include "diag.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,20 +18,70 @@ static void print_usage(const char *program_name)
 {
     printf("Usage: %s [options]\n", program_name);
     printf("Options:\n");
-    printf("  --input <file>       Input source file (required)\n");
+    printf("  --input <file>       Input source file (required unless --inputs is given, '-' for stdin)\n");
+    printf("  --inputs <files>     Compile a batch: '@list' (one path per line), a glob or a directory\n");
+    printf("  --jobs <n>           Worker threads: files with --inputs, functions otherwise; 0 for one per CPU (default: 0)\n");
     printf("  --parser <type>      Parser type: 'rd' (recursive descent) or 'lalr' (default: rd)\n");
-    printf("  --output-dir <dir>   Output directory for generated files (default: current directory)\n");
+    printf("  --output-dir <dir>   Output directory for generated files, '-' for stdout (default: current directory)\n");
+    printf("  --format <type>      Token and AST file format: 'text' or 'bin' (default: text)\n");
+    printf("  --emit <artifacts>   Write only these, comma-separated: tokens, tokens-json, tokens-bin, ast,\n");
+    printf("                       ast-dot, ast-json, ast-bin, tac, stack, target (default: per --format)\n");
+    printf("  --compact-json       Write JSON files without indentation\n");
+    printf("  --max-errors <n>     Stop parsing after n errors, 0 for no limit (default: %d)\n", DIAG_DEFAULT_MAX_ERRORS);
+    printf("  -O<level>            Optimize the generated code: 0 (none), 1 or 2 (default: 0)\n");
+    printf("  --regs <n>           Allocate n registers (%d-%d) for target code, 0 for stack-based (default: 0)\n",
+           REGALLOC_MIN_REGS, REGALLOC_MAX_REGS);
+    printf("  --run                Run the generated stack code and report its speed\n");
+    printf("  --jit                Compile to x86-64 machine code and run it\n");
+    printf("  --serve[=<socket>]   Answer compile requests on stdin/stdout or a Unix socket\n");
+    printf("  --cache-dir <dir>    Reuse the artifacts of earlier identical compilations kept in dir\n");
+    printf("  --cache-size <mb>    Megabytes the cache may keep before evicting (default: %d)\n", CACHE_DEFAULT_SIZE_MB);
+    printf("  --stats[=json]       Report each phase's time, throughput and memory on stderr\n");
     printf("  --verbose            Enable verbose output\n");
     printf("  --help               Display this help message\n");
 }
 
+// Number of artifacts --emit asks for, 0 without it
+static int count_emitted(const CompilerConfig *config)
+{
+    bool wanted[ARTIFACT_COUNT];
+    if (!config->emit || !driver_parse_artifacts(config->emit, wanted, stderr))
+    {
+        return 0;
+    }
+
+    int count = 0;
+    for (int kind = 0; kind < ARTIFACT_COUNT; kind++)
+    {
+        if (wanted[kind])
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
 // Parse command-line arguments
 static bool parse_args(int argc, char *argv[], CompilerConfig *config)
 {
     static struct option long_options[] = {
         {"input", required_argument, 0, 'i'},
+        {"inputs", required_argument, 0, 'I'},
+        {"jobs", required_argument, 0, 'n'},
         {"parser", required_argument, 0, 'p'},
         {"output-dir", required_argument, 0, 'o'},
+        {"format", required_argument, 0, 'f'},
+        {"emit", required_argument, 0, 'e'},
+        {"compact-json", no_argument, 0, 'j'},
+        {"max-errors", required_argument, 0, 'm'},
+        {"optimize", required_argument, 0, 'O'},
+        {"regs", required_argument, 0, 'r'},
+        {"run", no_argument, 0, 'x'},
+        {"jit", no_argument, 0, 'J'},
+        {"serve", optional_argument, 0, 'S'},
+        {"cache-dir", required_argument, 0, 'c'},
+        {"cache-size", required_argument, 0, 'z'},
+        {"stats", optional_argument, 0, 's'},
         {"verbose", no_argument, 0, 'v'},
         {"help", no_argument, 0, 'h'},
 
@@ -36,14 +89,29 @@ static bool parse_args(int argc, char *argv[], CompilerConfig *config)
 
     // Set default values
     config->input_file = NULL;
+    config->inputs = NULL;
+    config->jobs = 0;
     config->output_dir = ".";
     config->parser_type = PARSER_RD;
+    config->format = FORMAT_TEXT;
+    config->emit = NULL;
+    config->compact_json = false;
+    config->max_errors = DIAG_DEFAULT_MAX_ERRORS;
+    config->opt_level = 0;
+    config->num_regs = 0;
+    config->run = false;
+    config->jit = false;
+    config->serve = false;
+    config->socket_path = NULL;
+    config->cache_dir = NULL;
+    config->cache_size = (size_t)CACHE_DEFAULT_SIZE_MB << 20;
+    config->stats = STATS_OFF;
     config->verbose = false;
 
     int option_index = 0;
     int c;
 
-    while ((c = getopt_long(argc, argv, "i:p:o:vh", long_options, &option_index)) != -1)
+    while ((c = getopt_long(argc, argv, "i:I:n:p:o:f:jm:O:r:xJvh", long_options, &option_index)) != -1)
     {
         switch (c)
         {
@@ -51,6 +119,23 @@ static bool parse_args(int argc, char *argv[], CompilerConfig *config)
             config->input_file = strdup(optarg);
             break;
 
+        case 'I':
+            config->inputs = strdup(optarg);
+            break;
+
+        case 'n':
+        {
+            char *end;
+            long jobs = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || jobs < 0 || jobs > BATCH_MAX_JOBS)
+            {
+                fprintf(stderr, "Invalid job count: %s\n", optarg);
+                return false;
+            }
+            config->jobs = (int)jobs;
+            break;
+        }
+
         case 'p':
             if (strcmp(optarg, "rd") == 0)
             {
@@ -71,6 +156,119 @@ static bool parse_args(int argc, char *argv[], CompilerConfig *config)
             config->output_dir = strdup(optarg);
             break;
 
+        case 'f':
+            if (strcmp(optarg, "text") == 0)
+            {
+                config->format = FORMAT_TEXT;
+            }
+            else if (strcmp(optarg, "bin") == 0)
+            {
+                config->format = FORMAT_BIN;
+            }
+            else
+            {
+                fprintf(stderr, "Invalid format: %s\n", optarg);
+                return false;
+            }
+            break;
+
+        case 'e':
+        {
+            bool wanted[ARTIFACT_COUNT];
+            if (!driver_parse_artifacts(optarg, wanted, stderr))
+            {
+                return false;
+            }
+            config->emit = strdup(optarg);
+            break;
+        }
+
+        case 'j':
+            config->compact_json = true;
+            break;
+
+        case 'm':
+        {
+            char *end;
+            long max_errors = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || max_errors < 0)
+            {
+                fprintf(stderr, "Invalid error limit: %s\n", optarg);
+                return false;
+            }
+            config->max_errors = (size_t)max_errors;
+            break;
+        }
+
+        case 'O':
+            if (optarg[0] < '0' || optarg[0] > '0' + OPT_MAX_LEVEL || optarg[1] != '\0')
+            {
+                fprintf(stderr, "Invalid optimization level: %s\n", optarg);
+                return false;
+            }
+            config->opt_level = optarg[0] - '0';
+            break;
+
+        case 'r':
+        {
+            char *end;
+            long num_regs = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' ||
+                (num_regs != 0 && (num_regs < REGALLOC_MIN_REGS || num_regs > REGALLOC_MAX_REGS)))
+            {
+                fprintf(stderr, "Invalid register count: %s\n", optarg);
+                return false;
+            }
+            config->num_regs = (int)num_regs;
+            break;
+        }
+
+        case 'x':
+            config->run = true;
+            break;
+
+        case 'J':
+            config->jit = true;
+            break;
+
+        case 'S':
+            config->serve = true;
+            config->socket_path = optarg ? strdup(optarg) : NULL;
+            break;
+
+        case 'c':
+            config->cache_dir = strdup(optarg);
+            break;
+
+        case 'z':
+        {
+            char *end;
+            long megabytes = strtol(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0' || megabytes < 0 || (unsigned long)megabytes > SIZE_MAX >> 20)
+            {
+                fprintf(stderr, "Invalid cache size: %s\n", optarg);
+                return false;
+            }
+            config->cache_size = (size_t)megabytes << 20;
+            break;
+        }
+
+        case 's':
+            if (!optarg || strcmp(optarg, "text") == 0)
+            {
+                config->stats = STATS_TEXT;
+            }
+            else if (strcmp(optarg, "json") == 0)
+            {
+                config->stats = STATS_JSON;
+            }
+            else
+            {
+                fprintf(stderr, "Invalid stats format: %s\n", optarg);
+                return false;
+            }
+            break;
+
         case 'v':
             config->verbose = true;
             break;
@@ -89,78 +287,43 @@ static bool parse_args(int argc, char *argv[], CompilerConfig *config)
     }
 
     // Check required arguments
-    if (!config->input_file)
+    if (config->serve && (config->input_file || config->inputs))
     {
-        fprintf(stderr, "Error: Input file is required\n");
+        fprintf(stderr, "Error: --serve cannot be used with --input or --inputs\n");
         return false;
     }
 
-    return true;
-}
-
-// Read the entire contents of a file
-static char *read_file(const char *filename)
-{
-    FILE *file = fopen(filename, "r");
-    if (!file)
+    if (!config->input_file && !config->inputs && !config->serve)
     {
-        fprintf(stderr, "Error: Could not open file '%s'\n", filename);
-        return NULL;
+        fprintf(stderr, "Error: Input file is required\n");
+        return false;
     }
 
-    // Get file size
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    // Allocate buffer
-    char *buffer = (char *)malloc(file_size + 1);
-    if (!buffer)
+    if (config->stats != STATS_OFF && (config->serve || config->inputs))
     {
-        fprintf(stderr, "Error: Memory allocation failed\n");
-        fclose(file);
-        return NULL;
+        fprintf(stderr, "Error: --stats measures one --input\n");
+        return false;
     }
 
-    // Read file contents
-    size_t bytes_read = fread(buffer, 1, file_size, file);
-    if (bytes_read < (size_t)file_size)
+    if (config->serve && config->cache_dir)
     {
-        fprintf(stderr, "Error: Could not read entire file\n");
-        free(buffer);
-        fclose(file);
-        return NULL;
+        fprintf(stderr, "Error: --cache-dir cannot be used with --serve\n");
+        return false;
     }
 
-    buffer[file_size] = '\0';
-    fclose(file);
-
-    return buffer;
-}
-
-// Build output file path
-static char *build_output_path(const char *output_dir, const char *filename)
-{
-    size_t dir_len = strlen(output_dir);
-    size_t file_len = strlen(filename);
-
-    // +2 for the separator and null terminator
-    char *path = (char *)malloc(dir_len + file_len + 2);
-    if (!path)
-        return NULL;
-
-    strcpy(path, output_dir);
-
-    // Add separator if needed
-    if (dir_len > 0 && output_dir[dir_len - 1] != '/')
+    if (config->input_file && config->inputs)
     {
-        path[dir_len] = '/';
-        path[dir_len + 1] = '\0';
+        fprintf(stderr, "Error: --input and --inputs cannot be used together\n");
+        return false;
     }
 
-    strcat(path, filename);
+    if (strcmp(config->output_dir, "-") == 0 && (config->inputs || count_emitted(config) != 1))
+    {
+        fprintf(stderr, "Error: --output-dir - writes one --emit artifact of one --input to stdout\n");
+        return false;
+    }
 
-    return path;
+    return true;
 }
 
 int main(int argc, char *argv[])
@@ -174,244 +337,79 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    if (config.verbose)
+    if (config.serve)
     {
-        printf("Input file: %s\n", config.input_file);
-        printf("Parser type: %s\n", config.parser_type == PARSER_RD ? "recursive descent" : "LALR");
-        printf("Output directory: %s\n", config.output_dir);
+        return server_run(&config) ? 0 : 1;
     }
 
-    // Read input file
-    char *source = read_file(config.input_file);
-    if (!source)
+    // With --output-dir -, the artifact is the only thing on stdout
+    bool to_stdout = strcmp(config.output_dir, "-") == 0;
+    bool ok;
+    if (config.inputs)
     {
-        return 1;
+        ok = batch_compile(&config);
     }
-
-    // Initialize lexer
-    Lexer *lexer = lexer_init(source);
-    if (!lexer)
-    {
-        fprintf(stderr, "Error: Could not initialize lexer\n");
-        free(source);
-        return 1;
-    }
-
-    // Tokenize input
-    if (!lexer_tokenize(lexer))
-    {
-        fprintf(stderr, "Error: Tokenization failed\n");
-        lexer_free(lexer);
-        free(source);
-        return 1;
-    }
-
-    // Save tokens to file
-    char *tokens_path = build_output_path(config.output_dir, "tokens.txt");
-    if (!tokens_path || !lexer_save_tokens(lexer, tokens_path))
-    {
-        fprintf(stderr, "Error: Could not save tokens to file\n");
-        free(tokens_path);
-        lexer_free(lexer);
-        free(source);
-        return 1;
-    }
-
-    // Save tokens to JSON file
-    char *tokens_json_path = build_output_path(config.output_dir, "tokens.json");
-    if (!tokens_json_path || !lexer_save_tokens_json(lexer, tokens_json_path))
-    {
-        fprintf(stderr, "Error: Could not save tokens to JSON file\n");
-        free(tokens_json_path);
-        free(tokens_path);
-        lexer_free(lexer);
-        free(source);
-        return 1;
-    }
-
-    if (config.verbose)
-    {
-        printf("Tokens saved to %s and %s\n", tokens_path, tokens_json_path);
-    }
-
-    // Get tokens
-    size_t num_tokens;
-    Token *tokens = lexer_get_tokens(lexer, &num_tokens);
-
-    // Parse the tokens
-    ASTNode *ast = NULL;
-    bool parse_error = false;
-
-    if (config.parser_type == PARSER_RD)
+    else
     {
-        RDParser *parser = parser_rd_init(tokens, num_tokens);
-        if (!parser)
+        DriverJob job;
+        driver_job_init(&job);
+        OutBuf *streams[ARTIFACT_COUNT] = { NULL };
+        if (to_stdout)
         {
-            fprintf(stderr, "Error: Could not initialize recursive descent parser\n");
-            free(tokens_json_path);
-            free(tokens_path);
-            lexer_free(lexer);
-            free(source);
-            return 1;
+            bool wanted[ARTIFACT_COUNT];
+            driver_parse_artifacts(config.emit, wanted, stderr);
+            for (int kind = 0; kind < ARTIFACT_COUNT; kind++)
+            {
+                if (wanted[kind] && !(streams[kind] = outbuf_wrap(stdout)))
+                {
+                    fprintf(stderr, "Error: Memory allocation failed\n");
+                    return 1;
+                }
+            }
+            job.artifacts = streams;
+            job.out = stderr;
         }
-
-        ast = parser_rd_parse(parser);
-        parse_error = parser_rd_had_error(parser);
-
-        if (parse_error)
+        if (config.cache_dir)
         {
-            fprintf(stderr, "Error: Parsing failed: %s\n", parser_rd_get_error(parser));
+            job.cache = cache_open(config.cache_dir, config.cache_size);
+            if (!job.cache)
+            {
+                return 1;
+            }
         }
-
-        parser_rd_free(parser);
-    }
-    else
-    {
-        LALRParser *parser = parser_lalr_init(tokens, num_tokens);
-        if (!parser)
+        CompileStats stats;
+        if (config.stats != STATS_OFF)
         {
-            fprintf(stderr, "Error: Could not initialize LALR parser\n");
-            free(tokens_json_path);
-            free(tokens_path);
-            lexer_free(lexer);
-            free(source);
-            return 1;
+            stats_init(&stats);
+            job.stats = &stats;
         }
-
-        ast = parser_lalr_parse(parser);
-        parse_error = parser_lalr_had_error(parser);
-
-        if (parse_error)
+        ok = driver_compile(&config, &job);
+        if (job.stats)
         {
-            fprintf(stderr, "Error: Parsing failed: %s\n", parser_lalr_get_error(parser));
+            stats_print(&stats, config.input_file, config.stats, stderr);
+        }
+        if (job.cache && config.verbose)
+        {
+            cache_print_stats(job.cache, job.out);
+        }
+        cache_close(job.cache);
+        for (int kind = 0; kind < ARTIFACT_COUNT; kind++)
+        {
+            if (streams[kind])
+            {
+                outbuf_close(streams[kind]);
+            }
         }
-
-        parser_lalr_free(parser);
-    }
-
-    if (!ast || parse_error)
-    {
-        fprintf(stderr, "Error: Could not generate AST\n");
-        free(tokens_json_path);
-        free(tokens_path);
-        lexer_free(lexer);
-        free(source);
-        return 1;
-    }
-
-    // Save AST to files
-    char *ast_path = build_output_path(config.output_dir, "ast.txt");
-    char *ast_dot_path = build_output_path(config.output_dir, "ast.dot");
-    char *ast_json_path = build_output_path(config.output_dir, "ast.json");
-
-    if (!ast_path || !ast_save_to_file(ast, ast_path) ||
-        !ast_dot_path || !ast_save_to_dot(ast, ast_dot_path) ||
-        !ast_json_path || !ast_save_to_json(ast, ast_json_path))
-    {
-        fprintf(stderr, "Error: Could not save AST to files\n");
-        free(ast_json_path);
-        free(ast_dot_path);
-        free(ast_path);
-        ast_free_node(ast);
-        free(tokens_json_path);
-        free(tokens_path);
-        lexer_free(lexer);
-        free(source);
-        return 1;
-    }
-
-    if (config.verbose)
-    {
-        printf("AST saved to %s, %s, and %s\n", ast_path, ast_dot_path, ast_json_path);
-    }
-
-    // Generate code
-    CodeGenerator *codegen = codegen_init(ast);
-    if (!codegen)
-    {
-        fprintf(stderr, "Error: Could not initialize code generator\n");
-        free(ast_json_path);
-        free(ast_dot_path);
-        free(ast_path);
-        ast_free_node(ast);
-        free(tokens_json_path);
-        free(tokens_path);
-        lexer_free(lexer);
-        free(source);
-        return 1;
-    }
-
-    if (!codegen_generate(codegen))
-    {
-        fprintf(stderr, "Error: Code generation failed\n");
-        codegen_free(codegen);
-        free(ast_json_path);
-        free(ast_dot_path);
-        free(ast_path);
-        ast_free_node(ast);
-        free(tokens_json_path);
-        free(tokens_path);
-        lexer_free(lexer);
-        free(source);
-        return 1;
     }
-
-    // Save generated code to files
-    char *tac_path = build_output_path(config.output_dir, "tac.txt");
-    char *stack_path = build_output_path(config.output_dir, "stack_code.txt");
-    char *target_path = build_output_path(config.output_dir, "target_code.txt");
-
-    if (!tac_path || !codegen_save_tac(codegen, tac_path) ||
-        !stack_path || !codegen_save_stack_code(codegen, stack_path) ||
-        !target_path || !codegen_save_target_code(codegen, target_path))
+    if (!ok)
     {
-        fprintf(stderr, "Error: Could not save generated code to files\n");
-        free(target_path);
-        free(stack_path);
-        free(tac_path);
-        codegen_free(codegen);
-        free(ast_json_path);
-        free(ast_dot_path);
-        free(ast_path);
-        ast_free_node(ast);
-        free(tokens_json_path);
-        free(tokens_path);
-        lexer_free(lexer);
-        free(source);
         return 1;
     }
 
-    if (config.verbose)
+    if (!config.inputs && !to_stdout)
     {
-        printf("Generated code saved to %s, %s, and %s\n", tac_path, stack_path, target_path);
+        printf("Compilation completed successfully.\n");
     }
 
-    // Clean up (with safety checks)
-    if (target_path)
-        free(target_path);
-    if (stack_path)
-        free(stack_path);
-    if (tac_path)
-        free(tac_path);
-    if (codegen)
-        codegen_free(codegen);
-    if (ast_json_path)
-        free(ast_json_path);
-    if (ast_dot_path)
-        free(ast_dot_path);
-    if (ast_path)
-        free(ast_path);
-    // Don't free ast here as it's already freed by codegen_free
-    if (tokens_json_path)
-        free(tokens_json_path);
-    if (tokens_path)
-        free(tokens_path);
-    if (lexer)
-        lexer_free(lexer);
-    if (source)
-        free(source);
-
-    printf("Compilation completed successfully.\n");
-
     return 0;
 }
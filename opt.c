@@ -0,0 +1,1257 @@
+#include "opt.h"
+#include "cfg.h"
+#include "ssa.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Rounds of the -O2 pipeline before giving up on reaching a fixed point
+#define OPT_MAX_ROUNDS 4
+
+// Per-pass state shared by all passes. Temporaries and variables are
+// mapped to one range of location numbers: temps first, then names.
+typedef struct {
+    IRProgram *ir;
+    size_t num_locations;
+    uint32_t *stamp;        // Block number a location's entry belongs to
+    uint32_t *version;      // Bumped on every definition of a location
+    IROperand *copy_of;     // Copy propagation: value a location holds
+    uint32_t *copy_version; // Version of that value's location at the copy
+    int *use_count;         // Dead code elimination: uses in the function
+    int *label_refs;        // Dead code elimination: jumps to each label
+    int *local_of;          // SSA construction scratch, all -1 between uses
+} OptContext;
+
+// A pass returns the number of instructions it changed
+typedef size_t (*OptPassFn)(OptContext *ctx);
+
+typedef struct {
+    const char *name;
+    OptPassFn run;
+} OptPass;
+
+// Seconds on a monotonic clock
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Turn an instruction into a copy
+static void make_copy(IRInsn *insn, IROperand value) {
+    insn->op = IR_COPY;
+    insn->src1 = value;
+    insn->src2 = ir_none();
+}
+
+// Remove the instructions passes turned into IR_NOP; returns how many
+static size_t compact(IRProgram *ir) {
+    size_t kept = 0;
+    for (size_t i = 0; i < ir->num_code; i++) {
+        if (ir->code[i].op != IR_NOP) {
+            ir->code[kept++] = ir->code[i];
+        }
+    }
+
+    size_t removed = ir->num_code - kept;
+    ir->num_code = kept;
+    return removed;
+}
+
+// Fold a binary operator over constants. Returns false when the result is
+// not defined (division by zero, overflowing division).
+static bool fold_binary(IROpcode op, int64_t a, int64_t b, int64_t *result) {
+    uint64_t ua = (uint64_t)a;
+    uint64_t ub = (uint64_t)b;
+
+    switch (op) {
+        case IR_ADD: *result = (int64_t)(ua + ub); return true;
+        case IR_SUB: *result = (int64_t)(ua - ub); return true;
+        case IR_MUL: *result = (int64_t)(ua * ub); return true;
+        case IR_DIV:
+        case IR_MOD:
+            if (b == 0 || (a == INT64_MIN && b == -1)) return false;
+            *result = op == IR_DIV ? a / b : a % b;
+            return true;
+        case IR_EQ: *result = a == b; return true;
+        case IR_NE: *result = a != b; return true;
+        case IR_LT: *result = a < b; return true;
+        case IR_LE: *result = a <= b; return true;
+        case IR_GT: *result = a > b; return true;
+        case IR_GE: *result = a >= b; return true;
+        case IR_AND: *result = a != 0 && b != 0; return true;
+        case IR_OR: *result = a != 0 || b != 0; return true;
+        case IR_BAND: *result = a & b; return true;
+        case IR_BOR: *result = a | b; return true;
+        case IR_BXOR: *result = a ^ b; return true;
+        default: return false;
+    }
+}
+
+// Fold a unary operator over a constant
+static int64_t fold_unary(IROpcode op, int64_t a) {
+    switch (op) {
+        case IR_NEG: return (int64_t)(0 - (uint64_t)a);
+        case IR_NOT: return a == 0;
+        default: return ~a;
+    }
+}
+
+// Simplify x op x by operator
+static bool simplify_same(IRInsn *insn) {
+    switch (insn->op) {
+        case IR_SUB: case IR_BXOR: case IR_NE: case IR_LT: case IR_GT:
+            make_copy(insn, ir_const(0));
+            return true;
+        case IR_EQ: case IR_LE: case IR_GE:
+            make_copy(insn, ir_const(1));
+            return true;
+        case IR_BAND: case IR_BOR:
+            make_copy(insn, insn->src1);
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Simplify x op c (or c op x) where the result is x or a constant, and
+// x op x where the operator decides the result
+static bool simplify_identity(IRInsn *insn) {
+    if (insn->src1.kind != IR_NONE && ir_same_operand(insn->src1, insn->src2)) {
+        return simplify_same(insn);
+    }
+
+    bool left_const = insn->src1.kind == IR_CONST;
+    bool right_const = insn->src2.kind == IR_CONST;
+    int64_t c = right_const ? insn->src2.value : insn->src1.value;
+    IROperand other = right_const ? insn->src1 : insn->src2;
+
+    if (left_const == right_const) return false;
+
+    switch (insn->op) {
+        case IR_ADD:
+        case IR_BOR:
+        case IR_BXOR:
+            if (c != 0) return false;
+            make_copy(insn, other);
+            return true;
+        case IR_SUB:
+            if (!right_const || c != 0) return false;
+            make_copy(insn, other);
+            return true;
+        case IR_MUL:
+            if (c == 1) {
+                make_copy(insn, other);
+            } else if (c == 0) {
+                make_copy(insn, ir_const(0));
+            } else {
+                return false;
+            }
+            return true;
+        case IR_DIV:
+            if (!right_const || c != 1) return false;
+            make_copy(insn, other);
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Constant folding: evaluate operators whose operands are constants, apply
+// algebraic identities, and resolve branches on constant conditions
+static size_t pass_const_fold(OptContext *ctx) {
+    IRProgram *ir = ctx->ir;
+    size_t changes = 0;
+
+    for (size_t i = 0; i < ir->num_code; i++) {
+        IRInsn *insn = &ir->code[i];
+        int64_t value;
+
+        if (IR_IS_BINARY(insn->op)) {
+            if (insn->src1.kind == IR_CONST && insn->src2.kind == IR_CONST) {
+                if (fold_binary(insn->op, insn->src1.value, insn->src2.value, &value)) {
+                    make_copy(insn, ir_const(value));
+                    changes++;
+                }
+            } else if (simplify_identity(insn)) {
+                changes++;
+            }
+        } else if (IR_IS_UNARY(insn->op) && insn->src1.kind == IR_CONST) {
+            make_copy(insn, ir_const(fold_unary(insn->op, insn->src1.value)));
+            changes++;
+        } else if (insn->op == IR_JUMP_ZERO && insn->src1.kind == IR_CONST) {
+            if (insn->src1.value == 0) {
+                insn->op = IR_JUMP;
+                insn->src1 = insn->src2;
+                insn->src2 = ir_none();
+            } else {
+                insn->op = IR_NOP;
+            }
+            changes++;
+        }
+    }
+
+    return changes;
+}
+
+// Copy propagation within basic blocks: after "x = y", reads of x become
+// reads of y until either is redefined. A temporary computed and then
+// copied straight into a variable is computed into the variable instead.
+static size_t pass_copy_prop(OptContext *ctx) {
+    IRProgram *ir = ctx->ir;
+    size_t changes = 0;
+
+    // Count temporary reads for the coalescing step
+    memset(ctx->use_count, 0, sizeof(int) * (size_t)ir->num_temps);
+    for (size_t i = 0; i < ir->num_code; i++) {
+        IROperand *operands[2];
+        int n = ir_insn_uses(&ir->code[i], operands);
+        for (int k = 0; k < n; k++) {
+            if (operands[k]->kind == IR_TEMP) ctx->use_count[operands[k]->value]++;
+        }
+    }
+
+    // "t = a op b; x = t" with no other read of t becomes "x = a op b"
+    for (size_t i = 1; i < ir->num_code; i++) {
+        IRInsn *insn = &ir->code[i];
+        IRInsn *prev = &ir->code[i - 1];
+
+        if (insn->op == IR_COPY && insn->src1.kind == IR_TEMP &&
+            ctx->use_count[insn->src1.value] == 1 &&
+            ir_insn_defines(prev) && ir_same_operand(prev->dst, insn->src1)) {
+            prev->dst = insn->dst;
+            insn->op = IR_NOP;
+            changes++;
+        }
+    }
+    compact(ir);
+
+    // Forward propagation
+    memset(ctx->stamp, 0, sizeof(uint32_t) * ctx->num_locations);
+    uint32_t block = 0;
+    bool new_block = true;
+
+    for (size_t i = 0; i < ir->num_code; i++) {
+        IRInsn *insn = &ir->code[i];
+
+        if (new_block || ir_starts_block(insn->op)) {
+            // Block numbers start at 1, so zeroed stamps are never current
+            block++;
+            new_block = false;
+        }
+
+        IROperand *operands[2];
+        int n = ir_insn_uses(insn, operands);
+        for (int k = 0; k < n; k++) {
+            long loc = ir_location(ctx->ir, *operands[k]);
+            if (loc < 0 || ctx->stamp[loc] != block) continue;
+
+            IROperand value = ctx->copy_of[loc];
+            long value_loc = ir_location(ctx->ir, value);
+            if (value_loc >= 0 && ctx->version[value_loc] != ctx->copy_version[loc]) continue;
+
+            *operands[k] = value;
+            changes++;
+        }
+
+        if (ir_insn_defines(insn)) {
+            long loc = ir_location(ctx->ir, insn->dst);
+            if (loc >= 0) {
+                ctx->version[loc]++;
+
+                if (insn->op == IR_COPY && ir_same_operand(insn->src1, insn->dst)) {
+                    insn->op = IR_NOP;
+                    changes++;
+                } else if (insn->op == IR_COPY && insn->src1.kind != IR_NONE) {
+                    long value_loc = ir_location(ctx->ir, insn->src1);
+                    ctx->stamp[loc] = block;
+                    ctx->copy_of[loc] = insn->src1;
+                    ctx->copy_version[loc] = value_loc >= 0 ? ctx->version[value_loc] : 0;
+                } else {
+                    ctx->stamp[loc] = 0;
+                }
+            }
+        }
+
+        if (ir_ends_block(insn->op)) new_block = true;
+    }
+
+    return changes;
+}
+
+// Dead code elimination for one function [start, end): unreachable code,
+// jumps to the next instruction, unused labels and unused results
+static size_t dce_function(OptContext *ctx, size_t start, size_t end) {
+    IRInsn *code = ctx->ir->code;
+    size_t changes = 0;
+
+    // Code after a jump or return up to the next label is unreachable
+    bool reachable = true;
+    for (size_t i = start; i < end; i++) {
+        if (code[i].op == IR_LABEL_DEF || code[i].op == IR_END_FUNCTION) reachable = true;
+        if (!reachable && code[i].op != IR_NOP) {
+            code[i].op = IR_NOP;
+            changes++;
+        }
+        if (code[i].op == IR_JUMP || code[i].op == IR_RETURN) reachable = false;
+    }
+
+    // A jump to the label right after it does nothing
+    for (size_t i = start; i < end; i++) {
+        if (code[i].op != IR_JUMP && code[i].op != IR_JUMP_ZERO) continue;
+
+        IROperand target = code[i].op == IR_JUMP ? code[i].src1 : code[i].src2;
+        size_t next = i + 1;
+        while (next < end && code[next].op == IR_NOP) next++;
+
+        if (next < end && code[next].op == IR_LABEL_DEF && ir_same_operand(code[next].src1, target)) {
+            code[i].op = IR_NOP;
+            changes++;
+        }
+    }
+
+    // Count label references and reads of every location
+    for (size_t i = start; i < end; i++) {
+        IRInsn *insn = &code[i];
+        if (insn->op == IR_JUMP) ctx->label_refs[insn->src1.value]++;
+        if (insn->op == IR_JUMP_ZERO) ctx->label_refs[insn->src2.value]++;
+
+        IROperand *operands[2];
+        int n = ir_insn_uses(insn, operands);
+        for (int k = 0; k < n; k++) {
+            long loc = ir_location(ctx->ir, *operands[k]);
+            if (loc >= 0) ctx->use_count[loc]++;
+        }
+    }
+
+    for (size_t i = start; i < end; i++) {
+        if (code[i].op == IR_LABEL_DEF && ctx->label_refs[code[i].src1.value] == 0) {
+            code[i].op = IR_NOP;
+            changes++;
+        }
+    }
+
+    // Remove results nobody reads, walking backwards so that each removal
+    // can free the operands of earlier instructions in the same sweep
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (size_t i = end; i-- > start;) {
+            IRInsn *insn = &code[i];
+            if (!ir_insn_defines(insn)) continue;
+
+            long loc = ir_location(ctx->ir, insn->dst);
+            if (loc < 0 || ctx->use_count[loc] > 0) continue;
+
+            if (insn->op == IR_CALL) {
+                // Calls stay for their effects; only the result goes
+                insn->dst = ir_none();
+                changes++;
+                continue;
+            }
+
+            IROperand *operands[2];
+            int n = ir_insn_uses(insn, operands);
+            for (int k = 0; k < n; k++) {
+                long used = ir_location(ctx->ir, *operands[k]);
+                if (used >= 0) ctx->use_count[used]--;
+            }
+
+            insn->op = IR_NOP;
+            changes++;
+            changed = true;
+        }
+    }
+
+    // Leave the counts zeroed for the next function
+    for (size_t i = start; i < end; i++) {
+        IRInsn *insn = &code[i];
+        if (insn->op == IR_JUMP) ctx->label_refs[insn->src1.value] = 0;
+        if (insn->op == IR_JUMP_ZERO) ctx->label_refs[insn->src2.value] = 0;
+
+        IROperand *operands[2];
+        int n = ir_insn_uses(insn, operands);
+        for (int k = 0; k < n; k++) {
+            long loc = ir_location(ctx->ir, *operands[k]);
+            if (loc >= 0) ctx->use_count[loc] = 0;
+        }
+    }
+
+    return changes;
+}
+
+// Dead code elimination over every function
+static size_t pass_dce(OptContext *ctx) {
+    IRProgram *ir = ctx->ir;
+    size_t changes = 0;
+    size_t start = 0;
+
+    memset(ctx->use_count, 0, sizeof(int) * ctx->num_locations);
+    for (size_t i = 0; i < ir->num_code; i++) {
+        if (ir->code[i].op == IR_FUNCTION) start = i;
+        if (ir->code[i].op == IR_END_FUNCTION) {
+            changes += dce_function(ctx, start, i + 1);
+        }
+    }
+
+    return changes;
+}
+
+// Value numbering table entry: an expression (or constant) and the value
+// number it was given in the current block
+typedef struct {
+    uint32_t block;
+    int op;
+    int64_t a;
+    int64_t b;
+    uint32_t vn;
+    IROperand holder;       // Location holding the value, if any
+} VNEntry;
+
+// Keys for constants and literals, which are not IR opcodes
+#define VN_CONST   (-1)
+#define VN_LITERAL (-2)
+
+typedef struct {
+    VNEntry *entries;
+    size_t mask;
+    uint32_t block;
+    uint32_t next_vn;
+    uint32_t *loc_vn;       // Value number held by each location
+} VNTable;
+
+// Find the entry for a key in the current block, or the empty slot for it
+static VNEntry* vn_slot(VNTable *table, int op, int64_t a, int64_t b) {
+    uint64_t hash = (uint64_t)op * 0x9E3779B97F4A7C15ULL;
+    hash ^= (uint64_t)a + 0x632BE59BD9B4E019ULL + (hash << 6) + (hash >> 2);
+    hash ^= (uint64_t)b + 0x85EBCA77C2B2AE63ULL + (hash << 6) + (hash >> 2);
+
+    for (size_t i = (size_t)hash & table->mask;; i = (i + 1) & table->mask) {
+        VNEntry *entry = &table->entries[i];
+        if (entry->block != table->block) return entry;
+        if (entry->op == op && entry->a == a && entry->b == b) return entry;
+    }
+}
+
+// Value number of an operand, numbering it on first sight in the block
+static uint32_t vn_operand(OptContext *ctx, VNTable *table, IROperand operand) {
+    long loc = ir_location(ctx->ir, operand);
+    if (loc >= 0) {
+        if (ctx->stamp[loc] != table->block) {
+            ctx->stamp[loc] = table->block;
+            table->loc_vn[loc] = table->next_vn++;
+        }
+        return table->loc_vn[loc];
+    }
+
+    int op = operand.kind == IR_LITERAL ? VN_LITERAL : VN_CONST;
+    if (operand.kind != IR_CONST && operand.kind != IR_LITERAL) {
+        return table->next_vn++;
+    }
+
+    VNEntry *entry = vn_slot(table, op, operand.value, 0);
+    if (entry->block != table->block) {
+        entry->block = table->block;
+        entry->op = op;
+        entry->a = operand.value;
+        entry->b = 0;
+        entry->vn = table->next_vn++;
+        entry->holder = operand;
+    }
+    return entry->vn;
+}
+
+// Give a location a value number
+static void vn_assign(OptContext *ctx, VNTable *table, IROperand dst, uint32_t vn) {
+    long loc = ir_location(ctx->ir, dst);
+    if (loc < 0) return;
+
+    ctx->stamp[loc] = table->block;
+    table->loc_vn[loc] = vn;
+}
+
+// Check if an operator's operands can be swapped
+static bool commutative(IROpcode op) {
+    switch (op) {
+        case IR_ADD: case IR_MUL: case IR_EQ: case IR_NE: case IR_AND:
+        case IR_OR: case IR_BAND: case IR_BOR: case IR_BXOR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Local value numbering: within a basic block, an expression whose value
+// is already held somewhere becomes a copy of that location
+static size_t pass_lvn(OptContext *ctx) {
+    IRProgram *ir = ctx->ir;
+    size_t changes = 0;
+
+    // Size the table for the longest block; it is reused block to block
+    size_t longest = 0;
+    size_t length = 0;
+    for (size_t i = 0; i < ir->num_code; i++) {
+        if (ir_starts_block(ir->code[i].op)) length = 0;
+        if (++length > longest) longest = length;
+        if (ir_ends_block(ir->code[i].op)) length = 0;
+    }
+
+    size_t capacity = 64;
+    while (capacity < longest * 4) capacity *= 2;
+
+    VNTable table;
+    table.entries = (VNEntry*)calloc(capacity, sizeof(VNEntry));
+    table.loc_vn = (uint32_t*)malloc(sizeof(uint32_t) * (ctx->num_locations + 1));
+    table.mask = capacity - 1;
+    table.block = 0;
+    table.next_vn = 0;
+    if (!table.entries || !table.loc_vn) {
+        free(table.entries);
+        free(table.loc_vn);
+        return 0;
+    }
+
+    // Location stamps mean "numbered in this block" here
+    memset(ctx->stamp, 0, sizeof(uint32_t) * ctx->num_locations);
+
+    bool new_block = true;
+    for (size_t i = 0; i < ir->num_code; i++) {
+        IRInsn *insn = &ir->code[i];
+
+        if (new_block || ir_starts_block(insn->op)) {
+            table.block++;
+            new_block = false;
+        }
+
+        if (IR_IS_BINARY(insn->op) || IR_IS_UNARY(insn->op)) {
+            uint32_t a = vn_operand(ctx, &table, insn->src1);
+            uint32_t b = IR_IS_BINARY(insn->op) ? vn_operand(ctx, &table, insn->src2) : 0;
+            if (commutative(insn->op) && a > b) {
+                uint32_t t = a;
+                a = b;
+                b = t;
+            }
+
+            VNEntry *entry = vn_slot(&table, insn->op, a, b);
+            if (entry->block == table.block) {
+                long holder = ir_location(ctx->ir, entry->holder);
+                bool held = holder >= 0 && ctx->stamp[holder] == table.block &&
+                            table.loc_vn[holder] == entry->vn;
+
+                if (held && ir_same_operand(entry->holder, insn->dst)) {
+                    insn->op = IR_NOP;
+                    changes++;
+                } else if (held) {
+                    make_copy(insn, entry->holder);
+                    changes++;
+                } else {
+                    entry->holder = insn->dst;
+                }
+                vn_assign(ctx, &table, insn->dst, entry->vn);
+            } else {
+                entry->block = table.block;
+                entry->op = insn->op;
+                entry->a = a;
+                entry->b = b;
+                entry->vn = table.next_vn++;
+                entry->holder = insn->dst;
+                vn_assign(ctx, &table, insn->dst, entry->vn);
+            }
+        } else if (insn->op == IR_COPY) {
+            vn_assign(ctx, &table, insn->dst, vn_operand(ctx, &table, insn->src1));
+        } else if (insn->op == IR_CALL) {
+            vn_assign(ctx, &table, insn->dst, table.next_vn++);
+        }
+
+        if (ir_ends_block(insn->op)) new_block = true;
+    }
+
+    free(table.entries);
+    free(table.loc_vn);
+    return changes;
+}
+
+// Check if a function has a loop: an edge back to a block dominating it
+static bool has_back_edge(const CFG *cfg) {
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        for (int s = 0; s < cfg->blocks[b].num_succ; s++) {
+            if (cfg_dominates(cfg, cfg->blocks[b].succ[s], b)) return true;
+        }
+    }
+    return false;
+}
+
+// Run fn over the CFG and SSA form of every function, or of every function
+// with a loop. fn may rewrite the function's instructions in place but must
+// keep their number.
+static size_t for_each_ssa_function(OptContext *ctx, bool loops_only,
+                                    size_t (*fn)(OptContext *ctx, const CFG *cfg, SSAForm *ssa)) {
+    IRProgram *ir = ctx->ir;
+    size_t changes = 0;
+
+    for (size_t i = 0; i < ir->num_code; i++) {
+        if (ir->code[i].op != IR_FUNCTION) continue;
+
+        CFG *cfg = cfg_build(ir, i);
+        if (!cfg) continue;
+
+        if (!loops_only || has_back_edge(cfg)) {
+            SSAForm *ssa = ssa_build(ir, cfg, ctx->local_of);
+            if (ssa) changes += fn(ctx, cfg, ssa);
+            ssa_free(ssa);
+        }
+
+        i = cfg->func_end;
+        cfg_free(cfg);
+    }
+
+    return changes;
+}
+
+// Constant propagation lattice: not yet known, one constant, or varying
+typedef enum {
+    LATTICE_TOP,
+    LATTICE_CONST,
+    LATTICE_BOTTOM
+} LatticeKind;
+
+typedef struct {
+    LatticeKind kind;
+    int64_t value;
+} Lattice;
+
+// Sparse conditional constant propagation state for one function
+typedef struct {
+    IRProgram *ir;
+    const CFG *cfg;
+    SSAForm *ssa;
+    Lattice *lattice;       // By value
+    int *insn_block;        // Block of each instruction, by offset
+    bool *block_live;       // Blocks found executable
+    bool *edge_live;        // Edges found executable, indexed like CFG.preds
+    int *user_start;        // Readers of value v: user_start[v] up to user_start[v + 1]
+    int *users;             // Instruction offsets, or -1 - p for phi p
+    int *block_work;
+    int num_block_work;
+    int *value_work;
+    int num_value_work;
+} SCCP;
+
+// Varying lattice value
+static Lattice lattice_bottom(void) {
+    Lattice result = { LATTICE_BOTTOM, 0 };
+    return result;
+}
+
+// Constant lattice value
+static Lattice lattice_const(int64_t value) {
+    Lattice result = { LATTICE_CONST, value };
+    return result;
+}
+
+// Lattice value of operand k of the instruction at offset
+static Lattice sccp_operand(const SCCP *sccp, size_t offset, int k, IROperand operand) {
+    if (operand.kind == IR_CONST) return lattice_const(operand.value);
+
+    int value = sccp->ssa->use_value[offset * 2 + (size_t)k];
+    return value >= 0 ? sccp->lattice[value] : lattice_bottom();
+}
+
+// Lower a value in the lattice, queueing its readers if it changed
+static void sccp_lower(SCCP *sccp, int value, Lattice result) {
+    Lattice *current = &sccp->lattice[value];
+    if (current->kind == LATTICE_BOTTOM || result.kind == LATTICE_TOP) return;
+
+    if (current->kind == LATTICE_CONST) {
+        if (result.kind == LATTICE_CONST && result.value == current->value) return;
+        result = lattice_bottom();
+    }
+
+    *current = result;
+    sccp->value_work[sccp->num_value_work++] = value;
+}
+
+// Meet of a phi's arguments over the edges found executable so far
+static void sccp_phi(SCCP *sccp, int p) {
+    const SSAPhi *phi = &sccp->ssa->phis[p];
+    const CFGBlock *block = &sccp->cfg->blocks[phi->block];
+    Lattice result = { LATTICE_TOP, 0 };
+
+    for (int j = 0; j < block->num_preds; j++) {
+        int arg = sccp->ssa->phi_args[phi->first_arg + (size_t)j];
+        if (!sccp->edge_live[block->pred_start + j] || arg < 0) continue;
+
+        Lattice in = sccp->lattice[arg];
+        if (in.kind == LATTICE_TOP) continue;
+        if (in.kind == LATTICE_BOTTOM ||
+            (result.kind == LATTICE_CONST && result.value != in.value)) {
+            result = lattice_bottom();
+            break;
+        }
+        result = in;
+    }
+
+    sccp_lower(sccp, phi->value, result);
+}
+
+// Mark the edge from one block to another executable
+static void sccp_edge(SCCP *sccp, int from, int to) {
+    if (to < 0) return;
+
+    int edge = sccp->cfg->blocks[to].pred_start + cfg_pred_index(sccp->cfg, to, from);
+    if (sccp->edge_live[edge]) return;
+    sccp->edge_live[edge] = true;
+
+    if (!sccp->block_live[to]) {
+        sccp->block_live[to] = true;
+        sccp->block_work[sccp->num_block_work++] = to;
+    } else {
+        for (int p = sccp->ssa->block_phis[to]; p < sccp->ssa->block_phis[to + 1]; p++) {
+            sccp_phi(sccp, p);
+        }
+    }
+}
+
+// Evaluate an instruction over the lattice
+static void sccp_insn(SCCP *sccp, size_t offset) {
+    IRInsn *insn = &sccp->ir->code[sccp->ssa->first + offset];
+    int value = sccp->ssa->def_value[offset];
+
+    if (insn->op == IR_JUMP_ZERO) {
+        int b = sccp->insn_block[offset];
+        int fallthrough = b + 1 < sccp->cfg->num_blocks ? b + 1 : -1;
+        int target = cfg_block_of_label(sccp->cfg, insn->src2);
+        Lattice cond = sccp_operand(sccp, offset, 0, insn->src1);
+
+        if (cond.kind == LATTICE_TOP) return;
+        if (cond.kind == LATTICE_BOTTOM || cond.value != 0) sccp_edge(sccp, b, fallthrough);
+        if (cond.kind == LATTICE_BOTTOM || cond.value == 0) sccp_edge(sccp, b, target);
+        return;
+    }
+
+    if (value < 0) return;
+
+    Lattice result = lattice_bottom();
+    if (insn->op == IR_COPY && insn->src1.kind != IR_NONE) {
+        result = sccp_operand(sccp, offset, 0, insn->src1);
+    } else if (IR_IS_BINARY(insn->op) || IR_IS_UNARY(insn->op)) {
+        Lattice a = sccp_operand(sccp, offset, 0, insn->src1);
+        Lattice b = IR_IS_BINARY(insn->op) ? sccp_operand(sccp, offset, 1, insn->src2) : lattice_const(0);
+        int64_t folded;
+
+        if (a.kind == LATTICE_BOTTOM || b.kind == LATTICE_BOTTOM) {
+            result = lattice_bottom();
+        } else if (a.kind == LATTICE_TOP || b.kind == LATTICE_TOP) {
+            result.kind = LATTICE_TOP;
+        } else if (IR_IS_UNARY(insn->op)) {
+            result = lattice_const(fold_unary(insn->op, a.value));
+        } else if (fold_binary(insn->op, a.value, b.value, &folded)) {
+            result = lattice_const(folded);
+        }
+    }
+
+    sccp_lower(sccp, value, result);
+}
+
+// Evaluate a block the first time it is found executable
+static void sccp_block(SCCP *sccp, int b) {
+    const CFGBlock *block = &sccp->cfg->blocks[b];
+
+    for (int p = sccp->ssa->block_phis[b]; p < sccp->ssa->block_phis[b + 1]; p++) {
+        sccp_phi(sccp, p);
+    }
+    for (size_t i = block->start; i < block->end; i++) {
+        sccp_insn(sccp, i - sccp->ssa->first);
+    }
+
+    bool branches = block->end > block->start && sccp->ir->code[block->end - 1].op == IR_JUMP_ZERO;
+    if (!branches) {
+        for (int s = 0; s < block->num_succ; s++) sccp_edge(sccp, b, block->succ[s]);
+    }
+}
+
+// List the readers of every value, instructions and phis alike
+static bool sccp_users(SCCP *sccp, size_t length, size_t num_args) {
+    SSAForm *ssa = sccp->ssa;
+    int *start = (int*)calloc((size_t)ssa->num_values + 1, sizeof(int));
+    sccp->user_start = start;
+    sccp->users = (int*)malloc(sizeof(int) * (length * 2 + num_args + 1));
+    if (!start || !sccp->users) return false;
+
+    for (size_t i = 0; i < length * 2; i++) {
+        if (ssa->use_value[i] >= 0) start[ssa->use_value[i] + 1]++;
+    }
+    for (size_t a = 0; a < num_args; a++) {
+        if (ssa->phi_args[a] >= 0) start[ssa->phi_args[a] + 1]++;
+    }
+    for (int v = 0; v < ssa->num_values; v++) start[v + 1] += start[v];
+
+    // Filling moves each start to the next list's start; shift them back
+    for (size_t i = 0; i < length * 2; i++) {
+        if (ssa->use_value[i] >= 0) sccp->users[start[ssa->use_value[i]]++] = (int)(i / 2);
+    }
+    for (int p = 0; p < ssa->num_phis; p++) {
+        const SSAPhi *phi = &ssa->phis[p];
+        for (int j = 0; j < sccp->cfg->blocks[phi->block].num_preds; j++) {
+            int arg = ssa->phi_args[phi->first_arg + (size_t)j];
+            if (arg >= 0) sccp->users[start[arg]++] = -1 - p;
+        }
+    }
+    for (int v = ssa->num_values; v > 0; v--) start[v] = start[v - 1];
+    start[0] = 0;
+
+    return true;
+}
+
+// Global constant propagation for one function by sparse conditional
+// constant propagation (Wegman and Zadeck): values are followed only along
+// edges that can execute, so a constant survives a loop or a branch that
+// never changes it. Reads of a value found constant become the constant.
+static size_t gcp_function(OptContext *ctx, const CFG *cfg, SSAForm *ssa) {
+    IRProgram *ir = ctx->ir;
+    size_t length = cfg->func_end - ssa->first;
+    size_t num_args = 0;
+    for (int p = 0; p < ssa->num_phis; p++) {
+        num_args += (size_t)cfg->blocks[ssa->phis[p].block].num_preds;
+    }
+
+    SCCP sccp;
+    memset(&sccp, 0, sizeof(sccp));
+    sccp.ir = ir;
+    sccp.cfg = cfg;
+    sccp.ssa = ssa;
+    sccp.lattice = (Lattice*)malloc(sizeof(Lattice) * ((size_t)ssa->num_values + 1));
+    sccp.insn_block = (int*)malloc(sizeof(int) * (length + 1));
+    sccp.block_live = (bool*)calloc((size_t)cfg->num_blocks, sizeof(bool));
+    sccp.edge_live = (bool*)calloc((size_t)cfg->num_edges + 1, sizeof(bool));
+    sccp.block_work = (int*)malloc(sizeof(int) * (size_t)cfg->num_blocks);
+
+    // A value only ever moves down the lattice, so it is queued at most twice
+    sccp.value_work = (int*)malloc(sizeof(int) * ((size_t)ssa->num_values * 2 + 1));
+
+    size_t changes = 0;
+    bool ok = sccp.lattice && sccp.insn_block && sccp.block_live && sccp.edge_live &&
+              sccp.block_work && sccp.value_work && sccp_users(&sccp, length, num_args);
+
+    if (ok) {
+        for (int v = 0; v < ssa->num_values; v++) {
+            sccp.lattice[v].kind = ssa->values[v].kind == SSA_ENTRY ? LATTICE_BOTTOM : LATTICE_TOP;
+            sccp.lattice[v].value = 0;
+        }
+        for (int b = 0; b < cfg->num_blocks; b++) {
+            for (size_t i = cfg->blocks[b].start; i < cfg->blocks[b].end; i++) {
+                sccp.insn_block[i - ssa->first] = b;
+            }
+        }
+
+        sccp.block_live[0] = true;
+        sccp.block_work[sccp.num_block_work++] = 0;
+
+        while (sccp.num_block_work > 0 || sccp.num_value_work > 0) {
+            if (sccp.num_block_work > 0) {
+                sccp_block(&sccp, sccp.block_work[--sccp.num_block_work]);
+                continue;
+            }
+
+            int value = sccp.value_work[--sccp.num_value_work];
+            for (int u = sccp.user_start[value]; u < sccp.user_start[value + 1]; u++) {
+                int user = sccp.users[u];
+                if (user >= 0) {
+                    if (sccp.block_live[sccp.insn_block[user]]) sccp_insn(&sccp, (size_t)user);
+                } else if (sccp.block_live[ssa->phis[-1 - user].block]) {
+                    sccp_phi(&sccp, -1 - user);
+                }
+            }
+        }
+
+        for (size_t offset = 0; offset < length; offset++) {
+            if (!sccp.block_live[sccp.insn_block[offset]]) continue;
+
+            IROperand *operands[2];
+            int n = ir_insn_uses(&ir->code[ssa->first + offset], operands);
+            for (int k = 0; k < n; k++) {
+                int value = ssa->use_value[offset * 2 + (size_t)k];
+                if (value < 0 || sccp.lattice[value].kind != LATTICE_CONST) continue;
+
+                *operands[k] = ir_const(sccp.lattice[value].value);
+                changes++;
+            }
+        }
+    }
+
+    free(sccp.lattice);
+    free(sccp.insn_block);
+    free(sccp.block_live);
+    free(sccp.edge_live);
+    free(sccp.block_work);
+    free(sccp.value_work);
+    free(sccp.user_start);
+    free(sccp.users);
+    return changes;
+}
+
+// Global constant propagation over every function
+static size_t pass_gcp(OptContext *ctx) {
+    return for_each_ssa_function(ctx, false, gcp_function);
+}
+
+// Check if the loop with header h (the blocks with in_loop[b] == h) can
+// take hoisted code just before its label: the block laid out before the
+// header falls through into it, lies outside the loop, and is the only
+// way into the loop that can execute
+static bool has_preheader(const CFG *cfg, const IRInsn *code, const int *in_loop, int h) {
+    const CFGBlock *header = &cfg->blocks[h];
+    if (h == 0 || header->start == header->end || code[header->start].op != IR_LABEL_DEF) {
+        return false;
+    }
+
+    const CFGBlock *prev = &cfg->blocks[h - 1];
+    if (prev->rpo < 0 || in_loop[h - 1] == h) return false;
+    if (prev->end > prev->start) {
+        IROpcode last = code[prev->end - 1].op;
+        if (last == IR_JUMP || last == IR_RETURN) return false;
+    }
+
+    for (int p = 0; p < header->num_preds; p++) {
+        int pred = cfg->preds[header->pred_start + p];
+        if (pred != h - 1 && in_loop[pred] != h && cfg->blocks[pred].rpo >= 0) return false;
+    }
+    return true;
+}
+
+// Loop-invariant code motion state for one function
+typedef struct {
+    const CFG *cfg;
+    const SSAForm *ssa;
+    int *in_loop;           // Header of the loop last found to hold each block
+    int *def_count;         // Instructions setting each local
+    int *local_reads;       // Operand reads of each local
+    int *value_reads;       // Operand reads of each value
+    int *hoisted_to;        // Header an instruction was hoisted above, by offset
+} LICM;
+
+// Check if operand k of the instruction at offset has the same value on
+// every trip around the loop with header h
+static bool licm_invariant(const LICM *licm, int h, size_t offset, int k, IROperand operand) {
+    if (operand.kind == IR_CONST) return true;
+
+    int value = licm->ssa->use_value[offset * 2 + (size_t)k];
+    if (value < 0) return false;
+
+    const SSAValue *def = &licm->ssa->values[value];
+    switch (def->kind) {
+        case SSA_ENTRY:
+            return true;
+        case SSA_PHI:
+            return licm->in_loop[def->block] != h;
+        default:
+            return licm->in_loop[def->block] != h ||
+                   licm->hoisted_to[def->index - licm->ssa->first] >= 0;
+    }
+}
+
+// Check if the instruction at offset can move above the header of loop h:
+// a pure operator that cannot trap, over loop-invariant operands, setting a
+// location nothing else sets and whose every read sees this result
+static bool licm_candidate(const LICM *licm, const IRInsn *insn, int h, size_t offset) {
+    if (!IR_IS_BINARY(insn->op) && !IR_IS_UNARY(insn->op)) return false;
+
+    int value = licm->ssa->def_value[offset];
+    if (value < 0) return false;
+
+    int local = licm->ssa->values[value].local;
+    if (licm->def_count[local] != 1 || licm->value_reads[value] != licm->local_reads[local]) {
+        return false;
+    }
+
+    if ((insn->op == IR_DIV || insn->op == IR_MOD) &&
+        (insn->src2.kind != IR_CONST || insn->src2.value == 0 || insn->src2.value == -1)) {
+        return false;
+    }
+
+    return licm_invariant(licm, h, offset, 0, insn->src1) &&
+           (!IR_IS_BINARY(insn->op) || licm_invariant(licm, h, offset, 1, insn->src2));
+}
+
+// Loop-invariant code motion for one function. Loops are the natural loops
+// of back edges (to a block that dominates the jump), taken outermost first
+// in reverse postorder; invariant code moves to just before the header's
+// label, so it runs once on the way into the loop rather than every trip.
+static size_t licm_function(OptContext *ctx, const CFG *cfg, SSAForm *ssa) {
+    IRInsn *code = ctx->ir->code;
+    size_t length = cfg->func_end - ssa->first;
+    int n = cfg->num_blocks;
+
+    LICM licm;
+    licm.cfg = cfg;
+    licm.ssa = ssa;
+    licm.in_loop = (int*)malloc(sizeof(int) * (size_t)n);
+    licm.def_count = (int*)calloc((size_t)ssa->num_locals + 1, sizeof(int));
+    licm.local_reads = (int*)calloc((size_t)ssa->num_locals + 1, sizeof(int));
+    licm.value_reads = (int*)calloc((size_t)ssa->num_values + 1, sizeof(int));
+    licm.hoisted_to = (int*)malloc(sizeof(int) * (length + 1));
+
+    int *worklist = (int*)malloc(sizeof(int) * (size_t)n);
+    size_t *hoisted = (size_t*)malloc(sizeof(size_t) * (length + 1));
+    size_t num_hoisted = 0;
+
+    if (!licm.in_loop || !licm.def_count || !licm.local_reads || !licm.value_reads ||
+        !licm.hoisted_to || !worklist || !hoisted) {
+        goto done;
+    }
+
+    for (int b = 0; b < n; b++) licm.in_loop[b] = -1;
+    for (size_t i = 0; i < length; i++) licm.hoisted_to[i] = -1;
+    for (int v = 0; v < ssa->num_values; v++) {
+        if (ssa->values[v].kind == SSA_INSN) licm.def_count[ssa->values[v].local]++;
+    }
+    for (size_t i = 0; i < length * 2; i++) {
+        int value = ssa->use_value[i];
+        if (value < 0) continue;
+        licm.value_reads[value]++;
+        licm.local_reads[ssa->values[value].local]++;
+    }
+
+    for (int r = 0; r < cfg->num_reachable; r++) {
+        int h = cfg->order[r];
+        const CFGBlock *header = &cfg->blocks[h];
+
+        // The loop: the header and every block that reaches a back edge
+        // without passing through the header
+        int count = 0;
+        bool is_header = false;
+        for (int p = 0; p < header->num_preds; p++) {
+            int pred = cfg->preds[header->pred_start + p];
+            if (!cfg_dominates(cfg, h, pred)) continue;
+
+            if (!is_header) {
+                licm.in_loop[h] = h;
+                is_header = true;
+            }
+            if (licm.in_loop[pred] != h) {
+                licm.in_loop[pred] = h;
+                worklist[count++] = pred;
+            }
+        }
+        if (!is_header) continue;
+
+        while (count > 0) {
+            const CFGBlock *block = &cfg->blocks[worklist[--count]];
+            for (int p = 0; p < block->num_preds; p++) {
+                int pred = cfg->preds[block->pred_start + p];
+                if (cfg->blocks[pred].rpo < 0 || licm.in_loop[pred] == h) continue;
+                licm.in_loop[pred] = h;
+                worklist[count++] = pred;
+            }
+        }
+
+        if (!has_preheader(cfg, code, licm.in_loop, h)) continue;
+
+        // Blocks in reverse postorder see definitions before their uses
+        for (int s = r; s < cfg->num_reachable; s++) {
+            const CFGBlock *block = &cfg->blocks[cfg->order[s]];
+            if (licm.in_loop[cfg->order[s]] != h) continue;
+
+            for (size_t i = block->start; i < block->end; i++) {
+                size_t offset = i - ssa->first;
+                if (licm.hoisted_to[offset] >= 0 || !licm_candidate(&licm, &code[i], h, offset)) {
+                    continue;
+                }
+                licm.hoisted_to[offset] = h;
+                hoisted[num_hoisted++] = offset;
+            }
+        }
+    }
+
+    if (num_hoisted > 0) {
+        // Lay the function out again block by block, with each header's
+        // hoisted code in front of it
+        IRInsn *body = (IRInsn*)malloc(sizeof(IRInsn) * length);
+        if (!body) {
+            num_hoisted = 0;
+            goto done;
+        }
+        memcpy(body, &code[ssa->first], sizeof(IRInsn) * length);
+
+        size_t out = ssa->first;
+        for (int b = 0; b < n; b++) {
+            const CFGBlock *block = &cfg->blocks[b];
+            for (size_t k = 0; k < num_hoisted; k++) {
+                if (licm.hoisted_to[hoisted[k]] == b) code[out++] = body[hoisted[k]];
+            }
+            for (size_t i = block->start; i < block->end; i++) {
+                if (licm.hoisted_to[i - ssa->first] < 0) code[out++] = body[i - ssa->first];
+            }
+        }
+
+        free(body);
+    }
+
+done:
+    free(licm.in_loop);
+    free(licm.def_count);
+    free(licm.local_reads);
+    free(licm.value_reads);
+    free(licm.hoisted_to);
+    free(worklist);
+    free(hoisted);
+    return num_hoisted;
+}
+
+// Loop-invariant code motion over every function
+static size_t pass_licm(OptContext *ctx) {
+    return for_each_ssa_function(ctx, true, licm_function);
+}
+
+static const OptPass pass_const_fold_info = { "const-fold", pass_const_fold };
+static const OptPass pass_copy_prop_info = { "copy-prop", pass_copy_prop };
+static const OptPass pass_dce_info = { "dce", pass_dce };
+static const OptPass pass_lvn_info = { "lvn", pass_lvn };
+static const OptPass pass_gcp_info = { "gcp", pass_gcp };
+static const OptPass pass_licm_info = { "licm", pass_licm };
+
+// Pipelines by level
+static const OptPass *const level1_passes[] = {
+    &pass_copy_prop_info, &pass_const_fold_info, &pass_dce_info
+};
+static const OptPass *const level2_passes[] = {
+    &pass_lvn_info, &pass_copy_prop_info, &pass_gcp_info, &pass_const_fold_info,
+    &pass_dce_info, &pass_licm_info
+};
+
+// Run one pass and add what it did to the report
+static size_t run_pass(OptContext *ctx, const OptPass *pass, OptReport *report) {
+    OptPassStats *stats = NULL;
+    for (int i = 0; i < report->num_passes; i++) {
+        if (strcmp(report->passes[i].name, pass->name) == 0) stats = &report->passes[i];
+    }
+    if (!stats && report->num_passes < OPT_MAX_PASSES) {
+        stats = &report->passes[report->num_passes++];
+        memset(stats, 0, sizeof(*stats));
+        stats->name = pass->name;
+    }
+
+    size_t before = ctx->ir->num_code;
+    double start = now_seconds();
+
+    size_t changes = pass->run(ctx);
+    compact(ctx->ir);
+
+    if (stats) {
+        stats->runs++;
+        stats->changes += changes;
+        stats->removed += before - ctx->ir->num_code;
+        stats->seconds += now_seconds() - start;
+    }
+    return changes;
+}
+
+// Optimize the TAC of a program at the given level (0 does nothing),
+// rebuild its stack code from the result and clean that up with the
+// peephole pass. The report may be NULL.
+bool opt_run(IRProgram *ir, int level, OptReport *report) {
+    OptReport local_report;
+    if (!report) report = &local_report;
+
+    memset(report, 0, sizeof(*report));
+    report->level = level;
+    report->insns_before = ir->num_code;
+    report->insns_after = ir->num_code;
+    if (level <= 0) return true;
+
+    double start = now_seconds();
+
+    OptContext ctx;
+    ctx.ir = ir;
+    ctx.num_locations = ir_num_locations(ir);
+    ctx.stamp = (uint32_t*)calloc(ctx.num_locations + 1, sizeof(uint32_t));
+    ctx.version = (uint32_t*)calloc(ctx.num_locations + 1, sizeof(uint32_t));
+    ctx.copy_of = (IROperand*)calloc(ctx.num_locations + 1, sizeof(IROperand));
+    ctx.copy_version = (uint32_t*)calloc(ctx.num_locations + 1, sizeof(uint32_t));
+    ctx.use_count = (int*)calloc(ctx.num_locations + 1, sizeof(int));
+    ctx.label_refs = (int*)calloc((size_t)ir->num_labels + 1, sizeof(int));
+    ctx.local_of = (int*)malloc(sizeof(int) * (ctx.num_locations + 1));
+
+    bool ok = ctx.stamp && ctx.version && ctx.copy_of && ctx.copy_version &&
+              ctx.use_count && ctx.label_refs && ctx.local_of;
+    for (size_t i = 0; ok && i < ctx.num_locations; i++) ctx.local_of[i] = -1;
+
+    if (ok) {
+        const OptPass *const *passes = level >= 2 ? level2_passes : level1_passes;
+        size_t num_passes = level >= 2
+            ? sizeof(level2_passes) / sizeof(level2_passes[0])
+            : sizeof(level1_passes) / sizeof(level1_passes[0]);
+        int rounds = level >= 2 ? OPT_MAX_ROUNDS : 1;
+
+        for (int round = 0; round < rounds; round++) {
+            size_t changes = 0;
+            for (size_t i = 0; i < num_passes; i++) {
+                changes += run_pass(&ctx, passes[i], report);
+            }
+            if (changes == 0) break;
+        }
+
+        ok = ir_lower_stack(ir) && peephole_stack(ir, &report->stack_peephole);
+    }
+
+    free(ctx.stamp);
+    free(ctx.version);
+    free(ctx.copy_of);
+    free(ctx.copy_version);
+    free(ctx.use_count);
+    free(ctx.label_refs);
+    free(ctx.local_of);
+
+    report->insns_after = ir->num_code;
+    report->seconds = now_seconds() - start;
+    return ok;
+}
+
+// Add the report of one function's run to the report of the program.
+// Each pass ran as many times as in the function that needed the most
+// rounds, which is what a run over the whole program would have done;
+// times are added up.
+void opt_merge_report(OptReport *report, const OptReport *part) {
+    report->level = part->level;
+    report->insns_before += part->insns_before;
+    report->insns_after += part->insns_after;
+    report->seconds += part->seconds;
+
+    for (int i = 0; i < part->num_passes; i++) {
+        const OptPassStats *pass = &part->passes[i];
+        OptPassStats *stats = NULL;
+        for (int j = 0; j < report->num_passes && !stats; j++) {
+            if (strcmp(report->passes[j].name, pass->name) == 0) stats = &report->passes[j];
+        }
+        if (!stats) {
+            if (report->num_passes >= OPT_MAX_PASSES) continue;
+            stats = &report->passes[report->num_passes++];
+            memset(stats, 0, sizeof(*stats));
+            stats->name = pass->name;
+        }
+
+        if (pass->runs > stats->runs) stats->runs = pass->runs;
+        stats->changes += pass->changes;
+        stats->removed += pass->removed;
+        stats->seconds += pass->seconds;
+    }
+
+    if (part->stack_peephole.code) peephole_merge_report(&report->stack_peephole, &part->stack_peephole);
+}
+
+// Print what each pass did and how long it took
+void opt_print_report(const OptReport *report, FILE *out) {
+    fprintf(out, "Optimization (-O%d): %zu -> %zu instructions in %.3f ms\n",
+            report->level, report->insns_before, report->insns_after, report->seconds * 1e3);
+    if (report->num_passes == 0) return;
+
+    fprintf(out, "  %-12s %5s %9s %9s %12s\n", "pass", "runs", "changes", "removed", "time");
+    for (int i = 0; i < report->num_passes; i++) {
+        const OptPassStats *stats = &report->passes[i];
+        fprintf(out, "  %-12s %5d %9zu %9zu %9.3f ms\n",
+                stats->name, stats->runs, stats->changes, stats->removed, stats->seconds * 1e3);
+    }
+    if (report->stack_peephole.code) peephole_print_report(&report->stack_peephole, out);
+}
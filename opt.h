@@ -0,0 +1,39 @@
+#ifndef OPT_H
+#define OPT_H
+
+#include "common.h"
+#include "ir.h"
+#include "peephole.h"
+
+// Highest -O level
+#define OPT_MAX_LEVEL 2
+
+// Most passes a pipeline runs, counting repeats
+#define OPT_MAX_PASSES 16
+
+// What one pass did
+typedef struct {
+    const char *name;
+    int runs;               // Times the pass ran
+    size_t changes;         // Instructions rewritten or removed
+    size_t removed;         // Net drop in instruction count
+    double seconds;         // Total time spent in the pass
+} OptPassStats;
+
+// What a pipeline run did, pass by pass
+typedef struct {
+    int level;
+    size_t insns_before;
+    size_t insns_after;
+    int num_passes;
+    OptPassStats passes[OPT_MAX_PASSES];
+    PeepholeReport stack_peephole;  // Peephole pass over the rebuilt stack code
+    double seconds;
+} OptReport;
+
+// Optimization functions
+bool opt_run(IRProgram *ir, int level, OptReport *report);
+void opt_merge_report(OptReport *report, const OptReport *part);
+void opt_print_report(const OptReport *report, FILE *out);
+
+#endif // OPT_H
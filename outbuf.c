@@ -0,0 +1,244 @@
+#include "outbuf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Spaces for indentation, copied in one go
+static const char spaces[] = "                                                                ";
+
+// Hex digits for \u escapes
+static const char hex_digits[] = "0123456789abcdef";
+
+// Buffer output to an existing file
+OutBuf* outbuf_wrap(FILE *file) {
+    if (!file) return NULL;
+
+    OutBuf *out = (OutBuf*)malloc(sizeof(OutBuf));
+    if (!out) return NULL;
+
+    out->file = file;
+    out->owns_file = false;
+    out->failed = false;
+    out->written = 0;
+    out->used = 0;
+
+    return out;
+}
+
+// Open a file for buffered writing. A file with other hard links (such as
+// one restored from the artifact cache) is replaced rather than
+// truncated, so the other names keep their contents.
+OutBuf* outbuf_open(const char *filename) {
+    struct stat st;
+    if (stat(filename, &st) == 0 && S_ISREG(st.st_mode) && st.st_nlink > 1) unlink(filename);
+
+    FILE *file = fopen(filename, "w");
+    if (!file) return NULL;
+
+    // All buffering happens in the OutBuf
+    setvbuf(file, NULL, _IONBF, 0);
+
+    OutBuf *out = outbuf_wrap(file);
+    if (!out) {
+        fclose(file);
+        return NULL;
+    }
+
+    out->owns_file = true;
+    return out;
+}
+
+// Write the buffered bytes to the file
+bool outbuf_flush(OutBuf *out) {
+    if (out->used > 0) {
+        if (fwrite(out->data, 1, out->used, out->file) != out->used) {
+            out->failed = true;
+        }
+        out->written += out->used;
+        out->used = 0;
+    }
+
+    return !out->failed;
+}
+
+// Flush and free the buffer (closing the file if it was opened here).
+// Returns false if any write failed.
+bool outbuf_close(OutBuf *out) {
+    if (!out) return false;
+
+    outbuf_flush(out);
+
+    bool ok = !out->failed;
+    if (out->owns_file) {
+        if (fclose(out->file) != 0) ok = false;
+    } else if (fflush(out->file) != 0) {
+        ok = false;
+    }
+
+    free(out);
+    return ok;
+}
+
+// Append bytes
+void outbuf_write(OutBuf *out, const char *data, size_t length) {
+    if (length <= OUTBUF_SIZE - out->used) {
+        memcpy(out->data + out->used, data, length);
+        out->used += length;
+        return;
+    }
+
+    outbuf_flush(out);
+
+    // Large writes bypass the buffer
+    if (length >= OUTBUF_SIZE) {
+        if (fwrite(data, 1, length, out->file) != length) {
+            out->failed = true;
+        }
+        out->written += length;
+        return;
+    }
+
+    memcpy(out->data, data, length);
+    out->used = length;
+}
+
+// Append a NUL-terminated string
+void outbuf_puts(OutBuf *out, const char *str) {
+    outbuf_write(out, str, strlen(str));
+}
+
+// Append one character
+void outbuf_putc(OutBuf *out, char c) {
+    if (out->used == OUTBUF_SIZE) {
+        outbuf_flush(out);
+    }
+    out->data[out->used++] = c;
+}
+
+// Format an integer into buf (which must hold 21 bytes); returns the length
+static size_t format_int(char *buf, long value) {
+    char digits[20];
+    size_t num_digits = 0;
+    size_t length = 0;
+
+    // Work with the magnitude as unsigned so LONG_MIN is handled
+    unsigned long magnitude = (unsigned long)value;
+    if (value < 0) {
+        buf[length++] = '-';
+        magnitude = 0UL - magnitude;
+    }
+
+    do {
+        digits[num_digits++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    while (num_digits > 0) {
+        buf[length++] = digits[--num_digits];
+    }
+
+    return length;
+}
+
+// Append an integer in decimal
+void outbuf_int(OutBuf *out, long value) {
+    char buf[21];
+    outbuf_write(out, buf, format_int(buf, value));
+}
+
+// Append spaces until width characters have been written
+static void pad_to(OutBuf *out, size_t written, size_t width) {
+    while (written < width) {
+        size_t n = width - written;
+        if (n > sizeof(spaces) - 1) n = sizeof(spaces) - 1;
+        outbuf_write(out, spaces, n);
+        written += n;
+    }
+}
+
+// Append a string left-justified in a field of width characters ("%-*s")
+void outbuf_padded(OutBuf *out, const char *str, size_t width) {
+    size_t length = strlen(str);
+    outbuf_write(out, str, length);
+    pad_to(out, length, width);
+}
+
+// Append an integer left-justified in a field of width characters ("%-*d")
+void outbuf_int_padded(OutBuf *out, long value, size_t width) {
+    char buf[21];
+    size_t length = format_int(buf, value);
+    outbuf_write(out, buf, length);
+    pad_to(out, length, width);
+}
+
+// Append levels of two-space indentation
+void outbuf_indent(OutBuf *out, int levels) {
+    if (levels > 0) {
+        pad_to(out, 0, (size_t)levels * 2);
+    }
+}
+
+// Append str with quote, backslash and control characters escaped.
+// Runs of plain bytes are copied with a single write.
+static void write_escaped(OutBuf *out, const char *str, bool json) {
+    const char *run = str;
+    const char *p = str;
+
+    for (; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        outbuf_write(out, run, (size_t)(p - run));
+        run = p + 1;
+
+        switch (c) {
+            case '"': outbuf_write(out, "\\\"", 2); break;
+            case '\\': outbuf_write(out, "\\\\", 2); break;
+            case '\n': outbuf_write(out, "\\n", 2); break;
+            case '\t': outbuf_write(out, json ? "\\t" : " ", json ? 2 : 1); break;
+            case '\r': if (json) outbuf_write(out, "\\r", 2); break;
+            default:
+                if (json) {
+                    char escape[6] = { '\\', 'u', '0', '0', hex_digits[c >> 4], hex_digits[c & 15] };
+                    outbuf_write(out, escape, sizeof(escape));
+                }
+                break;
+        }
+    }
+
+    outbuf_write(out, run, (size_t)(p - run));
+}
+
+// Append a quoted, escaped JSON string
+void outbuf_json_string(OutBuf *out, const char *str) {
+    outbuf_putc(out, '"');
+    write_escaped(out, str, true);
+    outbuf_putc(out, '"');
+}
+
+// Append text escaped for use inside a quoted Graphviz label
+void outbuf_dot_string(OutBuf *out, const char *str) {
+    write_escaped(out, str, false);
+}
+
+// Append the rest of a stream's contents
+bool outbuf_copy_stream(OutBuf *out, FILE *stream) {
+    for (;;) {
+        if (out->used == OUTBUF_SIZE) {
+            outbuf_flush(out);
+        }
+
+        size_t bytes = fread(out->data + out->used, 1, OUTBUF_SIZE - out->used, stream);
+        out->used += bytes;
+        if (bytes == 0) break;
+    }
+
+    return !ferror(stream);
+}
+
+// Bytes written through the buffer so far, flushed or not
+uint64_t outbuf_bytes(const OutBuf *out) {
+    return out->written + out->used;
+}
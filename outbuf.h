@@ -0,0 +1,44 @@
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include "common.h"
+#include <stdint.h>
+
+// Bytes collected before each write to the underlying file
+#define OUTBUF_SIZE (1 << 16)
+
+// JSON layout for artifact writers
+typedef enum {
+    JSON_PRETTY,          // Indented, one field per line
+    JSON_COMPACT          // No whitespace between tokens
+} JsonStyle;
+
+// Buffered output file. Formatting is done by hand into data, which is
+// flushed to the file only when full or on close.
+typedef struct {
+    FILE *file;
+    bool owns_file;       // outbuf_close also closes file
+    bool failed;          // A write to the file failed
+    uint64_t written;     // Bytes passed to the file so far
+    size_t used;
+    char data[OUTBUF_SIZE];
+} OutBuf;
+
+// Output buffer functions
+OutBuf* outbuf_open(const char *filename);
+OutBuf* outbuf_wrap(FILE *file);
+bool outbuf_flush(OutBuf *out);
+bool outbuf_close(OutBuf *out);
+void outbuf_write(OutBuf *out, const char *data, size_t length);
+void outbuf_puts(OutBuf *out, const char *str);
+void outbuf_putc(OutBuf *out, char c);
+void outbuf_int(OutBuf *out, long value);
+void outbuf_padded(OutBuf *out, const char *str, size_t width);
+void outbuf_int_padded(OutBuf *out, long value, size_t width);
+void outbuf_indent(OutBuf *out, int levels);
+void outbuf_json_string(OutBuf *out, const char *str);
+void outbuf_dot_string(OutBuf *out, const char *str);
+bool outbuf_copy_stream(OutBuf *out, FILE *stream);
+uint64_t outbuf_bytes(const OutBuf *out);
+
+#endif // OUTBUF_H
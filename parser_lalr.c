@@ -1,102 +1,20 @@
 #include "parser_lalr.h"
 #include "ast.h"
+#include "arena.h"
+#include "parser_lalr_tables.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-// Grammar symbols
-typedef enum {
-    SYM_ERROR = -1,
-    SYM_EOF = 0,
-    
-    // Terminals
-    SYM_IDENTIFIER,
-    SYM_NUMBER,
-    SYM_STRING,
-    SYM_KEYWORD_INT,
-    SYM_KEYWORD_FLOAT,
-    SYM_KEYWORD_CHAR,
-    SYM_KEYWORD_VOID,
-    SYM_KEYWORD_IF,
-    SYM_KEYWORD_ELSE,
-    SYM_KEYWORD_WHILE,
-    SYM_KEYWORD_FOR,
-    SYM_KEYWORD_RETURN,
-    SYM_OPERATOR_PLUS,
-    SYM_OPERATOR_MINUS,
-    SYM_OPERATOR_STAR,
-    SYM_OPERATOR_SLASH,
-    SYM_OPERATOR_PERCENT,
-    SYM_OPERATOR_ASSIGN,
-    SYM_OPERATOR_EQ,
-    SYM_OPERATOR_NE,
-    SYM_OPERATOR_LT,
-    SYM_OPERATOR_LE,
-    SYM_OPERATOR_GT,
-    SYM_OPERATOR_GE,
-    SYM_PUNCTUATION_LPAREN,
-    SYM_PUNCTUATION_RPAREN,
-    SYM_PUNCTUATION_LBRACE,
-    SYM_PUNCTUATION_RBRACE,
-    SYM_PUNCTUATION_SEMICOLON,
-    SYM_PUNCTUATION_COMMA,
-    
-    // Non-terminals
-    SYM_PROGRAM,
-    SYM_FUNCTION_DECL,
-    SYM_PARAM_LIST,
-    SYM_PARAM,
-    SYM_BLOCK,
-    SYM_STATEMENT,
-    SYM_EXPR_STMT,
-    SYM_IF_STMT,
-    SYM_WHILE_STMT,
-    SYM_FOR_STMT,
-    SYM_RETURN_STMT,
-    SYM_VAR_DECL,
-    SYM_EXPR,
-    SYM_ASSIGNMENT,
-    SYM_EQUALITY,
-    SYM_COMPARISON,
-    SYM_TERM,
-    SYM_FACTOR,
-    SYM_UNARY,
-    SYM_CALL,
-    SYM_PRIMARY,
-    SYM_ARG_LIST
-} Symbol;
-
-// Action types
-typedef enum {
-    ACTION_SHIFT,
-    ACTION_REDUCE,
-    ACTION_ACCEPT,
-    ACTION_ERROR
-} ActionType;
-
-// Action structure
-typedef struct {
-    ActionType type;
-    int value;  // State for shift, rule for reduce
-} Action;
-
-// Production rule
-typedef struct {
-    Symbol lhs;
-    Symbol *rhs;
-    int rhs_length;
-} Rule;
-
-// Initialize the LALR parser
-LALRParser* parser_lalr_init(Token *tokens, size_t num_tokens) {
+// Allocate a parser with empty stacks
+static LALRParser* parser_lalr_create(void) {
     LALRParser *parser = (LALRParser*)malloc(sizeof(LALRParser));
     if (!parser) return NULL;
     
-    parser->tokens = tokens;
-    parser->num_tokens = num_tokens;
-    parser->current_token = 0;
     parser->had_error = false;
+    parser->aborted = false;
     parser->error_message[0] = '\0';
+    diag_init(&parser->diagnostics, DIAG_DEFAULT_MAX_ERRORS);
     
     // Initialize state stack
     parser->state_stack_capacity = 128;
@@ -106,7 +24,7 @@ LALRParser* parser_lalr_init(Token *tokens, size_t num_tokens) {
     
     // Initialize symbol stack
     parser->symbol_stack_capacity = 128;
-    parser->symbol_stack = (void**)malloc(sizeof(void*) * parser->symbol_stack_capacity);
+    parser->symbol_stack = (LALRValue*)malloc(sizeof(LALRValue) * parser->symbol_stack_capacity);
     parser->symbol_stack_size = 0;
     
     if (!parser->state_stack || !parser->symbol_stack) {
@@ -117,6 +35,24 @@ LALRParser* parser_lalr_init(Token *tokens, size_t num_tokens) {
     return parser;
 }
 
+// Initialize the LALR parser over a complete token array
+LALRParser* parser_lalr_init(Token *tokens, size_t num_tokens) {
+    LALRParser *parser = parser_lalr_create();
+    if (!parser) return NULL;
+    
+    token_stream_init_array(&parser->stream, tokens, num_tokens);
+    return parser;
+}
+
+// Initialize the LALR parser to pull tokens from a lexer as it goes
+LALRParser* parser_lalr_init_stream(Lexer *lexer) {
+    LALRParser *parser = parser_lalr_create();
+    if (!parser) return NULL;
+    
+    token_stream_init_lexer(&parser->stream, lexer);
+    return parser;
+}
+
 // Free the parser
 void parser_lalr_free(LALRParser *parser) {
     if (!parser) return;
@@ -126,26 +62,34 @@ void parser_lalr_free(LALRParser *parser) {
     }
     
     if (parser->symbol_stack) {
-        // Free any AST nodes on the stack
+        // Free any AST nodes on the stack (token text belongs to the lexer)
         for (int i = 0; i < parser->symbol_stack_size; i++) {
-            if (parser->symbol_stack[i]) {
-                // Check if it's an AST node (this is a simplification)
-                // In a real implementation, you'd need a way to distinguish between
-                // different types of values on the stack
-                ast_free_node((ASTNode*)parser->symbol_stack[i]);
-            }
+            ast_free_node(parser->symbol_stack[i].node);
         }
         free(parser->symbol_stack);
     }
     
+    diag_free(&parser->diagnostics);
     free(parser);
 }
 
-// Report an error
+// Get the current token
+static Token* current_token(LALRParser *parser) {
+    return token_stream_peek(&parser->stream, 0);
+}
+
+// Report an error that ends the parse
 static void error(LALRParser *parser, const char *message) {
+    if (parser->diagnostics.count == 0) {
+        strncpy(parser->error_message, message, sizeof(parser->error_message) - 1);
+        parser->error_message[sizeof(parser->error_message) - 1] = '\0';
+    }
+    
     parser->had_error = true;
-    strncpy(parser->error_message, message, sizeof(parser->error_message) - 1);
-    parser->error_message[sizeof(parser->error_message) - 1] = '\0';
+    parser->aborted = true;
+    
+    Token *token = current_token(parser);
+    diag_add(&parser->diagnostics, token->line, token->column, "%s", message);
 }
 
 // Push a state onto the state stack
@@ -173,11 +117,11 @@ static void pop_states(LALRParser *parser, int count) {
 }
 
 // Push a symbol onto the symbol stack
-static void push_symbol(LALRParser *parser, void *value) {
+static void push_symbol(LALRParser *parser, LALRValue value) {
     if (parser->symbol_stack_size >= parser->symbol_stack_capacity) {
         parser->symbol_stack_capacity *= 2;
-        void **new_stack = (void**)realloc(parser->symbol_stack, 
-                                          sizeof(void*) * parser->symbol_stack_capacity);
+        LALRValue *new_stack = (LALRValue*)realloc(parser->symbol_stack, 
+                                                  sizeof(LALRValue) * parser->symbol_stack_capacity);
         if (!new_stack) {
             error(parser, "Out of memory");
             return;
@@ -189,22 +133,15 @@ static void push_symbol(LALRParser *parser, void *value) {
 }
 
 // Pop symbols from the symbol stack
-static void* pop_symbol(LALRParser *parser) {
+static LALRValue pop_symbol(LALRParser *parser) {
     if (parser->symbol_stack_size <= 0) {
-        return NULL;
+        LALRValue empty = {NULL, NULL};
+        return empty;
     }
     
     return parser->symbol_stack[--parser->symbol_stack_size];
 }
 
-// Get the current token
-static Token* current_token(LALRParser *parser) {
-    if (parser->current_token >= parser->num_tokens) {
-        return &parser->tokens[parser->num_tokens - 1]; // Return EOF token
-    }
-    return &parser->tokens[parser->current_token];
-}
-
 // Convert token to symbol
 static Symbol token_to_symbol(Token *token) {
     switch (token->type) {
@@ -214,176 +151,335 @@ static Symbol token_to_symbol(Token *token) {
             return SYM_NUMBER;
         case TOKEN_STRING:
             return SYM_STRING;
+        case TOKEN_EOF:
+            return SYM_EOF;
         case TOKEN_KEYWORD:
-            if (strcmp(token->value, "int") == 0) return SYM_KEYWORD_INT;
-            if (strcmp(token->value, "float") == 0) return SYM_KEYWORD_FLOAT;
-            if (strcmp(token->value, "char") == 0) return SYM_KEYWORD_CHAR;
-            if (strcmp(token->value, "void") == 0) return SYM_KEYWORD_VOID;
-            if (strcmp(token->value, "if") == 0) return SYM_KEYWORD_IF;
-            if (strcmp(token->value, "else") == 0) return SYM_KEYWORD_ELSE;
-            if (strcmp(token->value, "while") == 0) return SYM_KEYWORD_WHILE;
-            if (strcmp(token->value, "for") == 0) return SYM_KEYWORD_FOR;
-            if (strcmp(token->value, "return") == 0) return SYM_KEYWORD_RETURN;
-            return SYM_ERROR;
         case TOKEN_OPERATOR:
-            if (strcmp(token->value, "+") == 0) return SYM_OPERATOR_PLUS;
-            if (strcmp(token->value, "-") == 0) return SYM_OPERATOR_MINUS;
-            if (strcmp(token->value, "*") == 0) return SYM_OPERATOR_STAR;
-            if (strcmp(token->value, "/") == 0) return SYM_OPERATOR_SLASH;
-            if (strcmp(token->value, "%") == 0) return SYM_OPERATOR_PERCENT;
-            if (strcmp(token->value, "=") == 0) return SYM_OPERATOR_ASSIGN;
-            if (strcmp(token->value, "==") == 0) return SYM_OPERATOR_EQ;
-            if (strcmp(token->value, "!=") == 0) return SYM_OPERATOR_NE;
-            if (strcmp(token->value, "<") == 0) return SYM_OPERATOR_LT;
-            if (strcmp(token->value, "<=") == 0) return SYM_OPERATOR_LE;
-            if (strcmp(token->value, ">") == 0) return SYM_OPERATOR_GT;
-            if (strcmp(token->value, ">=") == 0) return SYM_OPERATOR_GE;
-            return SYM_ERROR;
         case TOKEN_PUNCTUATION:
-            if (strcmp(token->value, "(") == 0) return SYM_PUNCTUATION_LPAREN;
-            if (strcmp(token->value, ")") == 0) return SYM_PUNCTUATION_RPAREN;
-            if (strcmp(token->value, "{") == 0) return SYM_PUNCTUATION_LBRACE;
-            if (strcmp(token->value, "}") == 0) return SYM_PUNCTUATION_RBRACE;
-            if (strcmp(token->value, ";") == 0) return SYM_PUNCTUATION_SEMICOLON;
-            if (strcmp(token->value, ",") == 0) return SYM_PUNCTUATION_COMMA;
-            return SYM_ERROR;
-        case TOKEN_EOF:
-            return SYM_EOF;
+            break;
         default:
-            return SYM_ERROR;
+            return SYM_INVALID;
+    }
+    
+    // Keywords, operators and punctuation are classified by the lexer
+    switch (token->kind) {
+        case KW_INT: return SYM_KEYWORD_INT;
+        case KW_FLOAT: return SYM_KEYWORD_FLOAT;
+        case KW_CHAR: return SYM_KEYWORD_CHAR;
+        case KW_VOID: return SYM_KEYWORD_VOID;
+        case KW_IF: return SYM_KEYWORD_IF;
+        case KW_ELSE: return SYM_KEYWORD_ELSE;
+        case KW_WHILE: return SYM_KEYWORD_WHILE;
+        case KW_FOR: return SYM_KEYWORD_FOR;
+        case KW_RETURN: return SYM_KEYWORD_RETURN;
+        case OP_PLUS: return SYM_OPERATOR_PLUS;
+        case OP_MINUS: return SYM_OPERATOR_MINUS;
+        case OP_STAR: return SYM_OPERATOR_STAR;
+        case OP_SLASH: return SYM_OPERATOR_SLASH;
+        case OP_PERCENT: return SYM_OPERATOR_PERCENT;
+        case OP_ASSIGN: return SYM_OPERATOR_ASSIGN;
+        case OP_EQ: return SYM_OPERATOR_EQ;
+        case OP_NE: return SYM_OPERATOR_NE;
+        case OP_LT: return SYM_OPERATOR_LT;
+        case OP_LE: return SYM_OPERATOR_LE;
+        case OP_GT: return SYM_OPERATOR_GT;
+        case OP_GE: return SYM_OPERATOR_GE;
+        case OP_NOT: return SYM_OPERATOR_NOT;
+        case OP_AND: return SYM_OPERATOR_AND;
+        case OP_OR: return SYM_OPERATOR_OR;
+        case OP_AMP: return SYM_OPERATOR_AMP;
+        case OP_PIPE: return SYM_OPERATOR_PIPE;
+        case OP_CARET: return SYM_OPERATOR_CARET;
+        case OP_TILDE: return SYM_OPERATOR_TILDE;
+        case OP_PLUS_ASSIGN: return SYM_OPERATOR_PLUS_ASSIGN;
+        case OP_MINUS_ASSIGN: return SYM_OPERATOR_MINUS_ASSIGN;
+        case OP_STAR_ASSIGN: return SYM_OPERATOR_STAR_ASSIGN;
+        case OP_SLASH_ASSIGN: return SYM_OPERATOR_SLASH_ASSIGN;
+        case PUNCT_LPAREN: return SYM_PUNCTUATION_LPAREN;
+        case PUNCT_RPAREN: return SYM_PUNCTUATION_RPAREN;
+        case PUNCT_LBRACE: return SYM_PUNCTUATION_LBRACE;
+        case PUNCT_RBRACE: return SYM_PUNCTUATION_RBRACE;
+        case PUNCT_SEMICOLON: return SYM_PUNCTUATION_SEMICOLON;
+        case PUNCT_COMMA: return SYM_PUNCTUATION_COMMA;
+        default: return SYM_INVALID;
     }
 }
 
-// Define grammar rules
-static Rule rules[] = {
-    // Rule 0: Program -> Function+
-    {SYM_PROGRAM, (Symbol[]){SYM_FUNCTION_DECL}, 1},
-    
-    // Rule 1: Function -> Type Identifier ( Params ) Block
-    {SYM_FUNCTION_DECL, (Symbol[]){SYM_KEYWORD_INT, SYM_IDENTIFIER, SYM_PUNCTUATION_LPAREN, 
-                                 SYM_PARAM_LIST, SYM_PUNCTUATION_RPAREN, SYM_BLOCK}, 6},
-    
-    // More rules would be defined here...
-    
-    // This is a simplified set of rules for demonstration
-};
+// Look up the action for a state and terminal. The table is padded so
+// base + terminal is always in range; a slot belongs to this state's row
+// only if lalr_check says so, otherwise the state's default applies.
+static inline int lookup_action(int state, int terminal) {
+    int index = lalr_action_base[state] + terminal;
+    return lalr_check[index] == state ? lalr_table[index] : lalr_action_default[state];
+}
 
-// LALR parsing table (action and goto tables combined)
-// This is a simplified version for demonstration
-static Action get_action(int state, Symbol symbol) {
-    Action action = {ACTION_ERROR, 0};
-    
-    // This would be a large table in a real implementation
-    // Here's a simplified example:
-    if (state == 0) {
-        if (symbol == SYM_KEYWORD_INT || symbol == SYM_KEYWORD_FLOAT || 
-            symbol == SYM_KEYWORD_CHAR || symbol == SYM_KEYWORD_VOID) {
-            action.type = ACTION_SHIFT;
-            action.value = 1;  // Shift to state 1
-        }
-    }
-    // Many more states and actions would be defined here...
-    
-    return action;
+// Look up the state to enter after reducing to a non-terminal
+static inline int lookup_goto(int state, int nonterminal) {
+    int index = lalr_goto_base[nonterminal] + state;
+    return lalr_check[index] == LALR_NUM_STATES + nonterminal
+        ? lalr_table[index]
+        : lalr_goto_default[nonterminal];
 }
 
-// Get the goto state
-static int get_goto(int state, Symbol symbol) {
-    // This would be part of the LALR parsing table
-    // Simplified example:
-    if (state == 0 && symbol == SYM_PROGRAM) return 100;  // Accept state
-    
-    // Many more goto entries would be defined here...
-    
-    return -1;  // Error
+// Create the "params" or "args" list node, optionally with a first child
+static ASTNode* create_list(const char *name, ASTNode *first) {
+    ASTNode *list = ast_create_node(NODE_BLOCK, name);
+    if (first) ast_add_child(list, first);
+    return list;
 }
 
-// Perform a reduction using the specified rule
+// Perform a reduction using the specified rule. The rule's values are
+// read in place on the symbol stack and replaced by the result.
 static void do_reduction(LALRParser *parser, int rule_index) {
-    Rule *rule = &rules[rule_index];
-    
-    // Pop the RHS symbols and states
-    void *values[16];  // Assuming no rule has more than 16 symbols on RHS
-    for (int i = rule->rhs_length - 1; i >= 0; i--) {
-        values[i] = pop_symbol(parser);
-    }
-    pop_states(parser, rule->rhs_length);
-    
-    // Create a new AST node based on the rule
-    ASTNode *node = NULL;
+    const LALRRule *rule = &lalr_rules[rule_index];
+    LALRValue *values = &parser->symbol_stack[parser->symbol_stack_size - rule->length];
+    LALRValue result = {NULL, NULL};
     
-    switch (rule_index) {
-        case 0:  // Program -> Function+
-            node = ast_create_program();
-            ast_add_child(node, (ASTNode*)values[0]);
+    switch (rule->action) {
+        case LALR_ACT_PASS:
+            if (rule->length > 0) result = values[0];
             break;
-        case 1:  // Function -> Type Identifier ( Params ) Block
-            {
-                char *name = strdup(((Token*)values[1])->value);
-                node = ast_create_function(name, (ASTNode*)values[3], (ASTNode*)values[5]);
-                free(name);
-            }
+        case LALR_ACT_NONE:
+            break;
+        case LALR_ACT_SECOND:  // ( Expr ) and { Statements }
+            result = values[1];
+            break;
+        case LALR_ACT_DROP_LAST:  // List ERROR Block, after a broken header
+            result = values[0];
+            ast_free_node(values[rule->length - 1].node);
+            break;
+        case LALR_ACT_APPEND:  // List [,] Item
+            result = values[0];
+            ast_add_child(result.node, values[rule->length - 1].node);
+            break;
+        case LALR_ACT_PROGRAM:
+            result.node = ast_create_program();
+            break;
+        case LALR_ACT_FUNCTION:  // Type Identifier ( Params ) Block
+            result.node = ast_create_function(values[1].text, values[3].node, values[5].node);
+            break;
+        case LALR_ACT_PARAMS:
+            result.node = create_list("params", NULL);
+            break;
+        case LALR_ACT_PARAMS_FIRST:
+            result.node = create_list("params", values[0].node);
+            break;
+        case LALR_ACT_PARAM:  // Type Identifier
+            result.node = ast_create_var_decl(values[0].text, values[1].text, NULL);
+            break;
+        case LALR_ACT_BLOCK:
+            result.node = ast_create_block();
+            break;
+        case LALR_ACT_IF:  // if ( Expr ) Statement
+            result.node = ast_create_if(values[2].node, values[4].node, NULL);
+            break;
+        case LALR_ACT_IF_ELSE:  // if ( Expr ) Statement else Statement
+            result.node = ast_create_if(values[2].node, values[4].node, values[6].node);
+            break;
+        case LALR_ACT_WHILE:  // while ( Expr ) Statement
+            result.node = ast_create_while(values[2].node, values[4].node);
+            break;
+        case LALR_ACT_FOR:  // for ( Init Cond ; Update ) Statement
+            result.node = ast_create_for(values[2].node, values[3].node, values[5].node, values[7].node);
+            break;
+        case LALR_ACT_RETURN_VOID:
+            result.node = ast_create_return(NULL);
+            break;
+        case LALR_ACT_RETURN:  // return Expr ;
+            result.node = ast_create_return(values[1].node);
+            break;
+        case LALR_ACT_VAR_DECL:  // Type Identifier ;
+            result.node = ast_create_var_decl(values[0].text, values[1].text, NULL);
+            break;
+        case LALR_ACT_VAR_DECL_INIT:  // Type Identifier = Expr ;
+            result.node = ast_create_var_decl(values[0].text, values[1].text, values[3].node);
+            break;
+        case LALR_ACT_ASSIGNMENT:  // Identifier = Assignment
+            result.node = ast_create_assignment(values[0].text, values[2].node);
+            break;
+        case LALR_ACT_COMPOUND_ASSIGNMENT:  // Identifier Op= Assignment
+            result.node = ast_create_compound_assignment(values[0].text, values[1].text, values[2].node);
+            break;
+        case LALR_ACT_BINARY:  // Left Op Right
+            result.node = ast_create_binary_op(values[1].text, values[0].node, values[2].node);
+            break;
+        case LALR_ACT_UNARY:  // Op Operand
+            result.node = ast_create_unary_op(values[0].text, values[1].node);
+            break;
+        case LALR_ACT_CALL:  // Identifier ( )
+            result.node = ast_create_call(values[0].text, create_list("args", NULL));
+            break;
+        case LALR_ACT_CALL_ARGS:  // Identifier ( Args )
+            result.node = ast_create_call(values[0].text, values[2].node);
+            break;
+        case LALR_ACT_ARGS_FIRST:
+            result.node = create_list("args", values[0].node);
+            break;
+        case LALR_ACT_NUMBER:
+            result.node = ast_create_number(values[0].text);
+            break;
+        case LALR_ACT_STRING:
+            result.node = ast_create_string(values[0].text);
+            break;
+        case LALR_ACT_IDENTIFIER:
+            result.node = ast_create_identifier(values[0].text);
             break;
-        // More reduction actions would be defined here...
     }
     
-    // Push the new node onto the symbol stack
-    push_symbol(parser, node);
+    // Replace the right-hand side with the result
+    parser->symbol_stack_size -= rule->length;
+    pop_states(parser, rule->length);
+    push_symbol(parser, result);
     
-    // Look up the goto state and push it
+    // Enter the goto state for the left-hand side
     int current_state = parser->state_stack[parser->state_stack_size - 1];
-    int goto_state = get_goto(current_state, rule->lhs);
+    push_state(parser, lookup_goto(current_state, rule->lhs));
+}
+
+// Tokens that must be shifted after recovering from an error before
+// another error is reported
+#define RECOVERY_SHIFTS 3
+
+// Report a syntax error at a token
+static void syntax_error(LALRParser *parser, Token *token) {
+    char message[DIAG_MESSAGE_SIZE];
+    if (token->type == TOKEN_EOF) {
+        snprintf(message, sizeof(message), "unexpected end of input");
+    } else {
+        snprintf(message, sizeof(message), "unexpected '%s'", token->value);
+    }
     
-    if (goto_state < 0) {
-        error(parser, "Invalid state transition");
-        return;
+    if (parser->diagnostics.count == 0) {
+        snprintf(parser->error_message, sizeof(parser->error_message),
+                 "Syntax error at line %d, column %d: %s", token->line, token->column, message);
+    }
+    
+    parser->had_error = true;
+    diag_add(&parser->diagnostics, token->line, token->column, "Syntax error: %s", message);
+}
+
+// Pop states until one can shift the ERROR terminal and shift it.
+// Returns false when no state on the stack can.
+static bool recover(LALRParser *parser) {
+    while (parser->state_stack_size > 0) {
+        int state = parser->state_stack[parser->state_stack_size - 1];
+        int index = lalr_action_base[state] + SYM_ERROR;
+        
+        // Shifts are never default actions, so only an explicit entry counts
+        if (lalr_check[index] == state && lalr_table[index] > 0 && lalr_table[index] != LALR_ACCEPT) {
+            LALRValue value = {NULL, NULL};
+            push_symbol(parser, value);
+            push_state(parser, lalr_table[index]);
+            return true;
+        }
+        
+        // The state holding the start symbol has no value below it
+        if (parser->state_stack_size == 1) break;
+        
+        ast_free_node(pop_symbol(parser).node);
+        pop_states(parser, 1);
     }
     
-    push_state(parser, goto_state);
+    return false;
 }
 
-// Main parsing function
+// Drop the current token while recovering. A '{' takes its whole group
+// up to the matching '}' with it, so a nested block is skipped as a unit
+// instead of its '}' being taken for the end of the enclosing one.
+static void discard_token(LALRParser *parser) {
+    int depth = 0;
+    
+    do {
+        Token *token = current_token(parser);
+        if (token->type == TOKEN_EOF) return;
+        
+        if (token->kind == PUNCT_LBRACE) {
+            depth++;
+        } else if (token->kind == PUNCT_RBRACE) {
+            depth--;
+        }
+        token_stream_advance(&parser->stream);
+    } while (depth > 0);
+}
+
+// Main parsing function: the table-driven shift/reduce loop. Syntax
+// errors are recovered from in panic mode, collecting a diagnostic for
+// each until the end of input or the error cap.
 ASTNode* parser_lalr_parse(LALRParser *parser) {
-    // This is a simplified LALR parser implementation
-    // A real implementation would have a complete parsing table
+    // Reset error state
+    parser->had_error = false;
+    parser->aborted = false;
+    parser->error_message[0] = '\0';
+    diag_clear(&parser->diagnostics);
+    
+    int recovering = 0;
     
     while (true) {
         Token *token = current_token(parser);
         Symbol symbol = token_to_symbol(token);
-        int current_state = parser->state_stack[parser->state_stack_size - 1];
         
-        Action action = get_action(current_state, symbol);
+        int current_state = parser->state_stack[parser->state_stack_size - 1];
+        int action = symbol == SYM_INVALID ? 0 : lookup_action(current_state, symbol);
         
-        switch (action.type) {
-            case ACTION_SHIFT:
-                push_symbol(parser, token);
-                push_state(parser, action.value);
-                parser->current_token++;
-                break;
-                
-            case ACTION_REDUCE:
-                do_reduction(parser, action.value);
-                break;
-                
-            case ACTION_ACCEPT:
-                // The parse was successful, return the root node
-                if (parser->symbol_stack_size > 0) {
-                    return (ASTNode*)parser->symbol_stack[0];
-                }
-                return NULL;
-                
-            case ACTION_ERROR:
-            default:
-                error(parser, "Syntax error");
-                return NULL;
+        if (action == LALR_ACCEPT) {
+            // The program is the only value left on the stack
+            ASTNode *root = parser->symbol_stack[0].node;
+            parser->symbol_stack[0].node = NULL;
+            parser->symbol_stack_size = 0;
+            if (parser->stream.failed) {
+                error(parser, "Lexer failed while reading tokens");
+            }
+            return root;
+        } else if (action > 0) {
+            // Token text is interned, so it outlives the stream window
+            LALRValue value = {NULL, token->value};
+            push_symbol(parser, value);
+            push_state(parser, action);
+            token_stream_advance(&parser->stream);
+            if (recovering > 0) recovering--;
+        } else if (action < 0) {
+            do_reduction(parser, -action);
+        } else {
+            if (recovering == 0) {
+                syntax_error(parser, token);
+                if (diag_full(&parser->diagnostics)) return NULL;
+            } else if (recovering == RECOVERY_SHIFTS) {
+                // Nothing fits since the last error: drop this token
+                if (token->type == TOKEN_EOF) return NULL;
+                discard_token(parser);
+            }
+            
+            recovering = RECOVERY_SHIFTS;
+            if (!recover(parser)) return NULL;
         }
         
-        if (parser->had_error) {
+        if (parser->aborted) {
             return NULL;
         }
     }
+}
+
+// Parse into the flat AST encoding. The node tree is built in a scratch
+// arena that is released once it has been flattened.
+FlatAST* parser_lalr_parse_flat(LALRParser *parser) {
+    Arena *scratch = arena_create(0);
+    if (!scratch) return NULL;
+    
+    Arena *saved = ast_get_arena();
+    ast_set_arena(scratch);
+    
+    ASTNode *root = parser_lalr_parse(parser);
+    FlatAST *flat = root ? ast_flatten(root) : NULL;
+
+    // Nodes left on the symbol stack live in the scratch arena too
+    for (int i = 0; i < parser->symbol_stack_size; i++) {
+        parser->symbol_stack[i].node = NULL;
+    }
+
+    ast_set_arena(saved);
+    arena_destroy(scratch);
     
-    return NULL;
+    return flat;
 }
 
 // Check if the parser encountered an error
@@ -391,7 +487,17 @@ bool parser_lalr_had_error(LALRParser *parser) {
     return parser->had_error;
 }
 
-// Get the error message
+// Get the first error message
 const char* parser_lalr_get_error(LALRParser *parser) {
     return parser->error_message;
 }
+
+// Set how many errors are collected before parsing stops (0: no limit)
+void parser_lalr_set_max_errors(LALRParser *parser, size_t max_errors) {
+    parser->diagnostics.max_errors = max_errors;
+}
+
+// Get every error from the last parse
+const DiagList* parser_lalr_get_diagnostics(LALRParser *parser) {
+    return &parser->diagnostics;
+}
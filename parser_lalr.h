@@ -3,14 +3,23 @@
 
 #include "common.h"
 #include "lexer.h"
+#include "token_stream.h"
+#include "ast_flat.h"
+#include "diag.h"
+
+// Value on the symbol stack: a shifted token's text or a reduced node
+typedef struct {
+    ASTNode *node;        // Non-terminals
+    const char *text;     // Terminals (interned token value, not owned)
+} LALRValue;
 
 // LALR Parser structure
 typedef struct {
-    Token *tokens;
-    size_t num_tokens;
-    size_t current_token;
+    TokenStream stream;   // Token array or pull-mode lexer window
     bool had_error;
-    char error_message[256];
+    bool aborted;         // Out of memory or lexer failure: stop parsing
+    char error_message[256]; // The first error
+    DiagList diagnostics; // Every error, with its position
     
     // LALR specific fields
     int *state_stack;
@@ -18,16 +27,20 @@ typedef struct {
     int state_stack_capacity;
     
     // Symbol stack (for values)
-    void **symbol_stack;
+    LALRValue *symbol_stack;
     int symbol_stack_size;
     int symbol_stack_capacity;
 } LALRParser;
 
 // Parser functions
 LALRParser* parser_lalr_init(Token *tokens, size_t num_tokens);
+LALRParser* parser_lalr_init_stream(Lexer *lexer);
 void parser_lalr_free(LALRParser *parser);
 ASTNode* parser_lalr_parse(LALRParser *parser);
+FlatAST* parser_lalr_parse_flat(LALRParser *parser);
 bool parser_lalr_had_error(LALRParser *parser);
 const char* parser_lalr_get_error(LALRParser *parser);
+void parser_lalr_set_max_errors(LALRParser *parser, size_t max_errors);
+const DiagList* parser_lalr_get_diagnostics(LALRParser *parser);
 
 #endif // PARSER_LALR_H
@@ -0,0 +1,400 @@
+// Generated by tools/lalrgen.c from parser_lalr.grammar. Do not edit.
+
+#ifndef PARSER_LALR_TABLES_H
+#define PARSER_LALR_TABLES_H
+
+#include <stdint.h>
+
+// Grammar symbols
+typedef enum {
+    SYM_INVALID = -1,     // Token with no terminal
+    SYM_EOF = 0,
+
+    // Terminals
+    SYM_IDENTIFIER,
+    SYM_NUMBER,
+    SYM_STRING,
+    SYM_KEYWORD_INT,
+    SYM_KEYWORD_FLOAT,
+    SYM_KEYWORD_CHAR,
+    SYM_KEYWORD_VOID,
+    SYM_KEYWORD_IF,
+    SYM_KEYWORD_ELSE,
+    SYM_KEYWORD_WHILE,
+    SYM_KEYWORD_FOR,
+    SYM_KEYWORD_RETURN,
+    SYM_OPERATOR_PLUS,
+    SYM_OPERATOR_MINUS,
+    SYM_OPERATOR_STAR,
+    SYM_OPERATOR_SLASH,
+    SYM_OPERATOR_PERCENT,
+    SYM_OPERATOR_ASSIGN,
+    SYM_OPERATOR_EQ,
+    SYM_OPERATOR_NE,
+    SYM_OPERATOR_LT,
+    SYM_OPERATOR_LE,
+    SYM_OPERATOR_GT,
+    SYM_OPERATOR_GE,
+    SYM_OPERATOR_NOT,
+    SYM_OPERATOR_AND,
+    SYM_OPERATOR_OR,
+    SYM_OPERATOR_AMP,
+    SYM_OPERATOR_PIPE,
+    SYM_OPERATOR_CARET,
+    SYM_OPERATOR_TILDE,
+    SYM_OPERATOR_PLUS_ASSIGN,
+    SYM_OPERATOR_MINUS_ASSIGN,
+    SYM_OPERATOR_STAR_ASSIGN,
+    SYM_OPERATOR_SLASH_ASSIGN,
+    SYM_PUNCTUATION_LPAREN,
+    SYM_PUNCTUATION_RPAREN,
+    SYM_PUNCTUATION_LBRACE,
+    SYM_PUNCTUATION_RBRACE,
+    SYM_PUNCTUATION_SEMICOLON,
+    SYM_PUNCTUATION_COMMA,
+    SYM_ERROR,
+
+    // Non-terminals
+    SYM_PROGRAM,
+    SYM_FUNCTION_LIST,
+    SYM_FUNCTION_DECL,
+    SYM_TYPE,
+    SYM_PARAM_LIST,
+    SYM_PARAMS,
+    SYM_PARAM,
+    SYM_BLOCK,
+    SYM_STATEMENT_LIST,
+    SYM_STATEMENT,
+    SYM_EXPR_STMT,
+    SYM_IF_STMT,
+    SYM_WHILE_STMT,
+    SYM_FOR_STMT,
+    SYM_FOR_INIT,
+    SYM_OPT_EXPR,
+    SYM_RETURN_STMT,
+    SYM_VAR_DECL,
+    SYM_EXPR,
+    SYM_ASSIGNMENT,
+    SYM_LOGICAL_OR,
+    SYM_LOGICAL_AND,
+    SYM_BIT_OR,
+    SYM_BIT_XOR,
+    SYM_BIT_AND,
+    SYM_EQUALITY,
+    SYM_COMPARISON,
+    SYM_TERM,
+    SYM_FACTOR,
+    SYM_UNARY,
+    SYM_CALL,
+    SYM_ARG_LIST,
+    SYM_PRIMARY,
+} Symbol;
+
+// Semantic action run when a rule is reduced
+typedef enum {
+    LALR_ACT_PASS,
+    LALR_ACT_PROGRAM,
+    LALR_ACT_APPEND,
+    LALR_ACT_DROP_LAST,
+    LALR_ACT_FUNCTION,
+    LALR_ACT_PARAMS,
+    LALR_ACT_PARAMS_FIRST,
+    LALR_ACT_PARAM,
+    LALR_ACT_SECOND,
+    LALR_ACT_BLOCK,
+    LALR_ACT_NONE,
+    LALR_ACT_IF,
+    LALR_ACT_IF_ELSE,
+    LALR_ACT_WHILE,
+    LALR_ACT_FOR,
+    LALR_ACT_RETURN_VOID,
+    LALR_ACT_RETURN,
+    LALR_ACT_VAR_DECL,
+    LALR_ACT_VAR_DECL_INIT,
+    LALR_ACT_ASSIGNMENT,
+    LALR_ACT_COMPOUND_ASSIGNMENT,
+    LALR_ACT_BINARY,
+    LALR_ACT_UNARY,
+    LALR_ACT_CALL,
+    LALR_ACT_CALL_ARGS,
+    LALR_ACT_ARGS_FIRST,
+    LALR_ACT_NUMBER,
+    LALR_ACT_STRING,
+    LALR_ACT_IDENTIFIER,
+} LALRActionKind;
+
+#define LALR_NUM_TERMINALS 43
+#define LALR_NUM_NONTERMINALS 33
+#define LALR_NUM_STATES 150
+#define LALR_NUM_RULES 87
+#define LALR_MAX_RHS 8
+#define LALR_TABLE_SIZE 651
+
+// Actions: 0 is an error, a positive value shifts to that state, a
+// negative value reduces by rule -value and LALR_ACCEPT accepts
+#define LALR_ACCEPT INT16_MAX
+
+// Rules: left-hand side (SYM_x - LALR_NUM_TERMINALS), length and action.
+// Rule 0 is the augmented start rule and is never reduced.
+typedef struct {
+    uint8_t lhs;
+    uint8_t length;
+    uint8_t action;
+} LALRRule;
+
+static const LALRRule lalr_rules[LALR_NUM_RULES] = {
+    {0, 1, LALR_ACT_PASS}, // $accept -> PROGRAM
+    {0, 1, LALR_ACT_PASS}, // PROGRAM -> FUNCTION_LIST
+    {1, 0, LALR_ACT_PROGRAM}, // FUNCTION_LIST ->
+    {1, 2, LALR_ACT_APPEND}, // FUNCTION_LIST -> FUNCTION_LIST FUNCTION_DECL
+    {1, 3, LALR_ACT_DROP_LAST}, // FUNCTION_LIST -> FUNCTION_LIST ERROR BLOCK
+    {2, 6, LALR_ACT_FUNCTION}, // FUNCTION_DECL -> TYPE IDENTIFIER PUNCTUATION_LPAREN PARAM_LIST PUNCTUATION_RPAREN BLOCK
+    {3, 1, LALR_ACT_PASS}, // TYPE -> KEYWORD_INT
+    {3, 1, LALR_ACT_PASS}, // TYPE -> KEYWORD_FLOAT
+    {3, 1, LALR_ACT_PASS}, // TYPE -> KEYWORD_CHAR
+    {3, 1, LALR_ACT_PASS}, // TYPE -> KEYWORD_VOID
+    {4, 0, LALR_ACT_PARAMS}, // PARAM_LIST ->
+    {4, 1, LALR_ACT_PARAMS}, // PARAM_LIST -> KEYWORD_VOID
+    {4, 1, LALR_ACT_PASS}, // PARAM_LIST -> PARAMS
+    {5, 1, LALR_ACT_PARAMS_FIRST}, // PARAMS -> PARAM
+    {5, 3, LALR_ACT_APPEND}, // PARAMS -> PARAMS PUNCTUATION_COMMA PARAM
+    {6, 2, LALR_ACT_PARAM}, // PARAM -> TYPE IDENTIFIER
+    {7, 3, LALR_ACT_SECOND}, // BLOCK -> PUNCTUATION_LBRACE STATEMENT_LIST PUNCTUATION_RBRACE
+    {7, 4, LALR_ACT_SECOND}, // BLOCK -> PUNCTUATION_LBRACE STATEMENT_LIST ERROR PUNCTUATION_RBRACE
+    {8, 0, LALR_ACT_BLOCK}, // STATEMENT_LIST ->
+    {8, 2, LALR_ACT_APPEND}, // STATEMENT_LIST -> STATEMENT_LIST STATEMENT
+    {9, 1, LALR_ACT_PASS}, // STATEMENT -> EXPR_STMT
+    {9, 1, LALR_ACT_PASS}, // STATEMENT -> IF_STMT
+    {9, 1, LALR_ACT_PASS}, // STATEMENT -> WHILE_STMT
+    {9, 1, LALR_ACT_PASS}, // STATEMENT -> FOR_STMT
+    {9, 1, LALR_ACT_PASS}, // STATEMENT -> RETURN_STMT
+    {9, 1, LALR_ACT_PASS}, // STATEMENT -> VAR_DECL
+    {9, 1, LALR_ACT_PASS}, // STATEMENT -> BLOCK
+    {9, 2, LALR_ACT_NONE}, // STATEMENT -> ERROR PUNCTUATION_SEMICOLON
+    {10, 2, LALR_ACT_PASS}, // EXPR_STMT -> EXPR PUNCTUATION_SEMICOLON
+    {11, 5, LALR_ACT_IF}, // IF_STMT -> KEYWORD_IF PUNCTUATION_LPAREN EXPR PUNCTUATION_RPAREN STATEMENT
+    {11, 7, LALR_ACT_IF_ELSE}, // IF_STMT -> KEYWORD_IF PUNCTUATION_LPAREN EXPR PUNCTUATION_RPAREN STATEMENT KEYWORD_ELSE STATEMENT
+    {12, 5, LALR_ACT_WHILE}, // WHILE_STMT -> KEYWORD_WHILE PUNCTUATION_LPAREN EXPR PUNCTUATION_RPAREN STATEMENT
+    {13, 8, LALR_ACT_FOR}, // FOR_STMT -> KEYWORD_FOR PUNCTUATION_LPAREN FOR_INIT OPT_EXPR PUNCTUATION_SEMICOLON OPT_EXPR PUNCTUATION_RPAREN STATEMENT
+    {14, 1, LALR_ACT_NONE}, // FOR_INIT -> PUNCTUATION_SEMICOLON
+    {14, 1, LALR_ACT_PASS}, // FOR_INIT -> VAR_DECL
+    {14, 2, LALR_ACT_PASS}, // FOR_INIT -> EXPR PUNCTUATION_SEMICOLON
+    {15, 0, LALR_ACT_NONE}, // OPT_EXPR ->
+    {15, 1, LALR_ACT_PASS}, // OPT_EXPR -> EXPR
+    {16, 2, LALR_ACT_RETURN_VOID}, // RETURN_STMT -> KEYWORD_RETURN PUNCTUATION_SEMICOLON
+    {16, 3, LALR_ACT_RETURN}, // RETURN_STMT -> KEYWORD_RETURN EXPR PUNCTUATION_SEMICOLON
+    {17, 3, LALR_ACT_VAR_DECL}, // VAR_DECL -> TYPE IDENTIFIER PUNCTUATION_SEMICOLON
+    {17, 5, LALR_ACT_VAR_DECL_INIT}, // VAR_DECL -> TYPE IDENTIFIER OPERATOR_ASSIGN EXPR PUNCTUATION_SEMICOLON
+    {18, 1, LALR_ACT_PASS}, // EXPR -> ASSIGNMENT
+    {19, 3, LALR_ACT_ASSIGNMENT}, // ASSIGNMENT -> IDENTIFIER OPERATOR_ASSIGN ASSIGNMENT
+    {19, 3, LALR_ACT_COMPOUND_ASSIGNMENT}, // ASSIGNMENT -> IDENTIFIER OPERATOR_PLUS_ASSIGN ASSIGNMENT
+    {19, 3, LALR_ACT_COMPOUND_ASSIGNMENT}, // ASSIGNMENT -> IDENTIFIER OPERATOR_MINUS_ASSIGN ASSIGNMENT
+    {19, 3, LALR_ACT_COMPOUND_ASSIGNMENT}, // ASSIGNMENT -> IDENTIFIER OPERATOR_STAR_ASSIGN ASSIGNMENT
+    {19, 3, LALR_ACT_COMPOUND_ASSIGNMENT}, // ASSIGNMENT -> IDENTIFIER OPERATOR_SLASH_ASSIGN ASSIGNMENT
+    {19, 1, LALR_ACT_PASS}, // ASSIGNMENT -> LOGICAL_OR
+    {20, 3, LALR_ACT_BINARY}, // LOGICAL_OR -> LOGICAL_OR OPERATOR_OR LOGICAL_AND
+    {20, 1, LALR_ACT_PASS}, // LOGICAL_OR -> LOGICAL_AND
+    {21, 3, LALR_ACT_BINARY}, // LOGICAL_AND -> LOGICAL_AND OPERATOR_AND BIT_OR
+    {21, 1, LALR_ACT_PASS}, // LOGICAL_AND -> BIT_OR
+    {22, 3, LALR_ACT_BINARY}, // BIT_OR -> BIT_OR OPERATOR_PIPE BIT_XOR
+    {22, 1, LALR_ACT_PASS}, // BIT_OR -> BIT_XOR
+    {23, 3, LALR_ACT_BINARY}, // BIT_XOR -> BIT_XOR OPERATOR_CARET BIT_AND
+    {23, 1, LALR_ACT_PASS}, // BIT_XOR -> BIT_AND
+    {24, 3, LALR_ACT_BINARY}, // BIT_AND -> BIT_AND OPERATOR_AMP EQUALITY
+    {24, 1, LALR_ACT_PASS}, // BIT_AND -> EQUALITY
+    {25, 3, LALR_ACT_BINARY}, // EQUALITY -> EQUALITY OPERATOR_EQ COMPARISON
+    {25, 3, LALR_ACT_BINARY}, // EQUALITY -> EQUALITY OPERATOR_NE COMPARISON
+    {25, 1, LALR_ACT_PASS}, // EQUALITY -> COMPARISON
+    {26, 3, LALR_ACT_BINARY}, // COMPARISON -> COMPARISON OPERATOR_LT TERM
+    {26, 3, LALR_ACT_BINARY}, // COMPARISON -> COMPARISON OPERATOR_LE TERM
+    {26, 3, LALR_ACT_BINARY}, // COMPARISON -> COMPARISON OPERATOR_GT TERM
+    {26, 3, LALR_ACT_BINARY}, // COMPARISON -> COMPARISON OPERATOR_GE TERM
+    {26, 1, LALR_ACT_PASS}, // COMPARISON -> TERM
+    {27, 3, LALR_ACT_BINARY}, // TERM -> TERM OPERATOR_PLUS FACTOR
+    {27, 3, LALR_ACT_BINARY}, // TERM -> TERM OPERATOR_MINUS FACTOR
+    {27, 1, LALR_ACT_PASS}, // TERM -> FACTOR
+    {28, 3, LALR_ACT_BINARY}, // FACTOR -> FACTOR OPERATOR_STAR UNARY
+    {28, 3, LALR_ACT_BINARY}, // FACTOR -> FACTOR OPERATOR_SLASH UNARY
+    {28, 3, LALR_ACT_BINARY}, // FACTOR -> FACTOR OPERATOR_PERCENT UNARY
+    {28, 1, LALR_ACT_PASS}, // FACTOR -> UNARY
+    {29, 2, LALR_ACT_UNARY}, // UNARY -> OPERATOR_NOT UNARY
+    {29, 2, LALR_ACT_UNARY}, // UNARY -> OPERATOR_MINUS UNARY
+    {29, 2, LALR_ACT_UNARY}, // UNARY -> OPERATOR_TILDE UNARY
+    {29, 1, LALR_ACT_PASS}, // UNARY -> CALL
+    {30, 3, LALR_ACT_CALL}, // CALL -> IDENTIFIER PUNCTUATION_LPAREN PUNCTUATION_RPAREN
+    {30, 4, LALR_ACT_CALL_ARGS}, // CALL -> IDENTIFIER PUNCTUATION_LPAREN ARG_LIST PUNCTUATION_RPAREN
+    {30, 1, LALR_ACT_PASS}, // CALL -> PRIMARY
+    {31, 1, LALR_ACT_ARGS_FIRST}, // ARG_LIST -> EXPR
+    {31, 3, LALR_ACT_APPEND}, // ARG_LIST -> ARG_LIST PUNCTUATION_COMMA EXPR
+    {32, 1, LALR_ACT_NUMBER}, // PRIMARY -> NUMBER
+    {32, 1, LALR_ACT_STRING}, // PRIMARY -> STRING
+    {32, 1, LALR_ACT_IDENTIFIER}, // PRIMARY -> IDENTIFIER
+    {32, 3, LALR_ACT_SECOND}, // PRIMARY -> PUNCTUATION_LPAREN EXPR PUNCTUATION_RPAREN
+};
+
+// Action for (state, terminal): lalr_table[base + terminal] when
+// lalr_check there is the state, otherwise the state's default
+static const int16_t lalr_action_base[150] = {
+    0, 0, 543, 0, 0, 0, 0, 2, 0, 8, 0, 0,
+    1, 0, 28, 510, 0, 0, 17, 59, 75, 137, 177, 180,
+    187, 218, 0, 34, 12, 0, 0, 0, 0, 0, 0, 0,
+    0, 85, 0, 2, 103, 121, 123, 139, 78, 22, 2, 40,
+    0, 0, 0, 132, 170, 135, 133, 0, 225, 228, 232, 264,
+    268, 162, 271, 278, 130, 0, 135, 148, 0, 0, 0, 148,
+    0, 0, 69, 0, 309, 316, 319, 323, 355, 359, 362, 369,
+    400, 407, 410, 414, 446, 450, 453, 460, 0, 148, 44, 0,
+    0, 0, 0, 0, 0, 0, 30, 155, 158, 0, 491, 0,
+    156, 0, 0, 498, 0, 171, 171, 173, 176, 123, 69, 80,
+    132, 135, 143, 146, 91, 98, 0, 0, 0, 0, 0, 0,
+    501, 16, 58, 166, 0, 0, 167, 0, 169, 201, 0, 505,
+    0, 74, 177, 0, 116, 0,
+};
+
+static const int16_t lalr_action_default[150] = {
+    -2, 0, -1, -6, -7, -8, -9, 0, -3, 0, -18, -4,
+    0, 0, -10, -85, -83, -84, 0, 0, 0, 0, 0, 0,
+    0, 0, -16, 0, 0, -26, -19, -20, -21, -22, -23, -24,
+    -25, 0, -42, -48, -50, -52, -54, -56, -58, -61, -66, -69,
+    -73, -77, -80, -9, 0, 0, -12, -13, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, -38, 0, -85, -75, -74, -76, 0,
+    -17, -27, 0, -28, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, -15, 0, 0, -43,
+    -44, -45, -46, -47, -78, -81, 0, 0, 0, -33, -36, -34,
+    0, -39, -86, 0, -40, -49, -51, -53, -55, -57, -59, -60,
+    -62, -63, -64, -65, -67, -68, -70, -71, -72, -5, -14, -79,
+    0, 0, 0, 0, -37, -35, 0, -82, 0, -29, -31, -36,
+    -41, 0, 0, -30, 0, -32,
+};
+
+// Goto for (state, non-terminal n): lalr_table[base + state] when
+// lalr_check there is LALR_NUM_STATES + n, otherwise n's default
+static const int16_t lalr_goto_base[33] = {
+    0, 0, 0, 238, 0, 0, 123, 208, 0, 103, 0, 0,
+    0, 0, 0, 79, 0, 174, 492, 501, 0, 165, 170, 177,
+    179, 180, 143, 479, 157, 487, 0, 0, 0,
+};
+
+static const int16_t lalr_goto_default[33] = {
+    1, 2, 8, 28, 53, 54, 55, 29, 13, 30, 31, 32,
+    33, 34, 106, 135, 35, 36, 37, 38, 39, 40, 41, 42,
+    43, 44, 45, 46, 47, 48, 49, 102, 50,
+};
+
+// Packed action and goto entries and the owner of each slot
+static const int16_t lalr_table[651] = {
+    32767, 15, 16, 17, 3, 4, 5, 6, 18, 12, 19, 20,
+    21, 74, 22, 87, 88, 15, 16, 17, 3, 4, 5, 6,
+    18, 23, 19, 20, 21, 76, 22, 24, 3, 4, 5, 51,
+    25, 14, 10, 26, 10, 23, 27, 83, 84, 85, 86, 24,
+    3, 4, 5, 6, 25, 62, 10, 89, 90, 91, 140, 15,
+    16, 17, 3, 4, 5, 6, 18, 131, 19, 20, 21, 132,
+    22, 72, 73, 15, 16, 17, 3, 4, 5, 6, 18, 23,
+    19, 20, 21, 111, 22, 24, 83, 84, 85, 86, 25, 63,
+    10, 81, 82, 23, 140, 83, 84, 85, 86, 24, 89, 90,
+    91, 112, 25, 64, 10, 89, 90, 91, 140, 15, 16, 17,
+    3, 4, 5, 6, 18, 75, 19, 20, 21, 77, 22, 15,
+    16, 17, 3, 4, 5, 6, 15, 16, 17, 23, 81, 82,
+    22, 87, 88, 24, 87, 88, 78, 22, 25, 79, 10, 23,
+    87, 88, 140, 87, 88, 24, 23, 15, 16, 17, 25, 80,
+    24, -11, 105, 92, 93, 25, 94, 109, 22, 65, 67, 16,
+    17, 67, 16, 17, 61, 110, 10, 23, 67, 16, 17, 22,
+    133, 24, 22, 134, 137, 77, 25, 100, 78, 22, 23, 79,
+    80, 23, 143, 144, 24, 73, 145, 24, 23, 25, 148, 11,
+    25, 130, 24, 15, 16, 17, 146, 25, 118, 119, 15, 16,
+    17, 15, 16, 17, 22, 15, 16, 17, 141, 142, 107, 22,
+    9, 113, 22, 23, 124, 125, 22, 114, 147, 24, 23, 149,
+    52, 23, 25, 115, 24, 23, 116, 24, 117, 25, 0, 24,
+    25, 15, 16, 17, 25, 15, 16, 17, 15, 16, 17, 0,
+    0, 0, 22, 15, 16, 17, 22, 0, 0, 22, 0, 0,
+    0, 23, 0, 0, 22, 23, 0, 24, 23, 0, 0, 24,
+    25, 129, 24, 23, 25, 0, 0, 25, 0, 24, 67, 16,
+    17, 0, 25, 0, 0, 67, 16, 17, 67, 16, 17, 22,
+    67, 16, 17, 0, 0, 0, 22, 0, 52, 22, 23, 0,
+    0, 22, 0, 0, 24, 23, 0, 0, 23, 25, 0, 24,
+    23, 0, 24, 0, 25, 0, 24, 25, 67, 16, 17, 25,
+    67, 16, 17, 67, 16, 17, 0, 0, 0, 22, 67, 16,
+    17, 22, 0, 0, 22, 0, 0, 0, 23, 0, 0, 22,
+    23, 0, 24, 23, 0, 0, 24, 25, 0, 24, 23, 25,
+    0, 0, 25, 0, 24, 67, 16, 17, 0, 25, 0, 0,
+    67, 16, 17, 67, 16, 17, 22, 67, 16, 17, 0, 0,
+    0, 22, 0, 0, 22, 23, 0, 0, 22, 0, 0, 24,
+    23, 0, 0, 23, 25, 0, 24, 23, 0, 24, 0, 25,
+    0, 24, 25, 67, 16, 17, 25, 67, 16, 17, 67, 16,
+    17, 0, 0, 0, 22, 67, 16, 17, 22, 0, 0, 22,
+    0, 0, 0, 23, 0, 0, 22, 23, 0, 24, 23, 0,
+    0, 24, 25, 0, 24, 23, 25, 0, 0, 25, 0, 24,
+    15, 16, 17, 0, 25, 0, 0, 15, 16, 17, 15, 16,
+    17, 22, 15, 16, 17, 68, 69, 70, 22, 66, 0, 22,
+    23, 71, 0, 22, 0, 0, 24, 23, 0, 0, 23, 25,
+    56, 24, 23, 0, 24, 0, 25, 0, 24, 25, 0, 0,
+    0, 25, 57, 58, 59, 60, 61, 3, 4, 5, 6, 0,
+    0, 101, 103, 104, 108, 95, 96, 97, 98, 99, 120, 121,
+    122, 123, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    126, 127, 128, 0, 0, 0, 0, 0, 0, 7, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 136, 0,
+    0, 0, 0, 138, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    139, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 136,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0,
+};
+
+static const int16_t lalr_check[651] = {
+    1, 13, 13, 13, 13, 13, 13, 13, 13, 9, 13, 13,
+    13, 28, 13, 46, 46, 133, 133, 133, 133, 133, 133, 133,
+    133, 13, 133, 133, 133, 39, 133, 13, 14, 14, 14, 14,
+    13, 12, 13, 13, 7, 133, 13, 45, 45, 45, 45, 133,
+    94, 94, 94, 94, 133, 18, 133, 47, 47, 47, 133, 134,
+    134, 134, 134, 134, 134, 134, 134, 102, 134, 134, 134, 102,
+    134, 27, 27, 145, 145, 145, 145, 145, 145, 145, 145, 134,
+    145, 145, 145, 74, 145, 134, 118, 118, 118, 118, 134, 19,
+    134, 44, 44, 145, 134, 119, 119, 119, 119, 145, 124, 124,
+    124, 74, 145, 20, 145, 125, 125, 125, 145, 148, 148, 148,
+    148, 148, 148, 148, 148, 37, 148, 148, 148, 40, 148, 64,
+    64, 64, 64, 64, 64, 64, 21, 21, 21, 148, 117, 117,
+    64, 120, 120, 148, 121, 121, 41, 21, 148, 42, 148, 64,
+    122, 122, 148, 123, 123, 64, 21, 61, 61, 61, 64, 43,
+    21, 51, 64, 52, 53, 21, 54, 66, 61, 21, 22, 22,
+    22, 23, 23, 23, 67, 71, 93, 61, 24, 24, 24, 22,
+    103, 61, 23, 104, 108, 113, 61, 61, 114, 24, 22, 115,
+    116, 23, 135, 138, 22, 140, 141, 23, 24, 22, 146, 157,
+    23, 156, 24, 25, 25, 25, 165, 24, 176, 176, 56, 56,
+    56, 57, 57, 57, 25, 58, 58, 58, 159, 159, 167, 56,
+    153, 171, 57, 25, 178, 178, 58, 172, 159, 25, 56, 159,
+    153, 57, 25, 173, 56, 58, 174, 57, 175, 56, -1, 58,
+    57, 59, 59, 59, 58, 60, 60, 60, 62, 62, 62, -1,
+    -1, -1, 59, 63, 63, 63, 60, -1, -1, 62, -1, -1,
+    -1, 59, -1, -1, 63, 60, -1, 59, 62, -1, -1, 60,
+    59, 157, 62, 63, 60, -1, -1, 62, -1, 63, 76, 76,
+    76, -1, 63, -1, -1, 77, 77, 77, 78, 78, 78, 76,
+    79, 79, 79, -1, -1, -1, 77, -1, 153, 78, 76, -1,
+    -1, 79, -1, -1, 76, 77, -1, -1, 78, 76, -1, 77,
+    79, -1, 78, -1, 77, -1, 79, 78, 80, 80, 80, 79,
+    81, 81, 81, 82, 82, 82, -1, -1, -1, 80, 83, 83,
+    83, 81, -1, -1, 82, -1, -1, -1, 80, -1, -1, 83,
+    81, -1, 80, 82, -1, -1, 81, 80, -1, 82, 83, 81,
+    -1, -1, 82, -1, 83, 84, 84, 84, -1, 83, -1, -1,
+    85, 85, 85, 86, 86, 86, 84, 87, 87, 87, -1, -1,
+    -1, 85, -1, -1, 86, 84, -1, -1, 87, -1, -1, 84,
+    85, -1, -1, 86, 84, -1, 85, 87, -1, 86, -1, 85,
+    -1, 87, 86, 88, 88, 88, 87, 89, 89, 89, 90, 90,
+    90, -1, -1, -1, 88, 91, 91, 91, 89, -1, -1, 90,
+    -1, -1, -1, 88, -1, -1, 91, 89, -1, 88, 90, -1,
+    -1, 89, 88, -1, 90, 91, 89, -1, -1, 90, -1, 91,
+    106, 106, 106, -1, 91, -1, -1, 111, 111, 111, 132, 132,
+    132, 106, 143, 143, 143, 179, 179, 179, 111, 168, -1, 132,
+    106, 168, -1, 143, -1, -1, 106, 111, -1, -1, 132, 106,
+    15, 111, 143, -1, 132, -1, 111, -1, 143, 132, -1, -1,
+    -1, 143, 15, 15, 15, 15, 15, 2, 2, 2, 2, -1,
+    -1, 168, 168, 168, 168, 169, 169, 169, 169, 169, 177, 177,
+    177, 177, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    179, 179, 179, -1, -1, -1, -1, -1, -1, 2, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 168, -1,
+    -1, -1, -1, 168, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    168, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 168,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1,
+};
+
+#endif // PARSER_LALR_TABLES_H
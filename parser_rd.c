@@ -1,71 +1,97 @@
 #include "parser_rd.h"
 #include "ast.h"
+#include "arena.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-// Initialize the recursive descent parser
-RDParser* parser_rd_init(Token *tokens, size_t num_tokens) {
+// Allocate a parser with a clean error state
+static RDParser* parser_rd_create(void) {
     RDParser *parser = (RDParser*)malloc(sizeof(RDParser));
     if (!parser) return NULL;
     
-    parser->tokens = tokens;
-    parser->num_tokens = num_tokens;
-    parser->current_token = 0;
     parser->had_error = false;
+    parser->panic_mode = false;
+    parser->depth = 0;
     parser->error_message[0] = '\0';
+    diag_init(&parser->diagnostics, DIAG_DEFAULT_MAX_ERRORS);
+    
+    return parser;
+}
+
+// Initialize the recursive descent parser over a complete token array
+RDParser* parser_rd_init(Token *tokens, size_t num_tokens) {
+    RDParser *parser = parser_rd_create();
+    if (!parser) return NULL;
+    
+    token_stream_init_array(&parser->stream, tokens, num_tokens);
+    return parser;
+}
+
+// Initialize the recursive descent parser to pull tokens from a lexer as
+// it goes, so no token array is ever built
+RDParser* parser_rd_init_stream(Lexer *lexer) {
+    RDParser *parser = parser_rd_create();
+    if (!parser) return NULL;
     
+    token_stream_init_lexer(&parser->stream, lexer);
     return parser;
 }
 
 // Free the parser
 void parser_rd_free(RDParser *parser) {
     if (parser) {
+        diag_free(&parser->diagnostics);
         free(parser);
     }
 }
 
-// Report an error
+// Report an error at the current token. In panic mode the error is a
+// consequence of one already reported and is dropped.
 static void error(RDParser *parser, const char *message) {
+    if (parser->panic_mode) return;
+    
     parser->had_error = true;
-    strncpy(parser->error_message, message, sizeof(parser->error_message) - 1);
-    parser->error_message[sizeof(parser->error_message) - 1] = '\0';
+    parser->panic_mode = true;
+    
+    if (parser->diagnostics.count == 0) {
+        strncpy(parser->error_message, message, sizeof(parser->error_message) - 1);
+        parser->error_message[sizeof(parser->error_message) - 1] = '\0';
+    }
+    
+    Token *token = token_stream_peek(&parser->stream, 0);
+    diag_add(&parser->diagnostics, token->line, token->column, "%s", message);
 }
 
-// Get the current token
+// Get the current token (the EOF token once the stream is exhausted).
+// Token pointers stay valid for TOKEN_STREAM_HISTORY further advances, so
+// callers copy the (stable, interned) value out of anything they keep.
 static Token* current(RDParser *parser) {
-    if (!parser || parser->num_tokens == 0) {
+    if (!parser) {
         return NULL;
     }
-    
-    if (parser->current_token >= parser->num_tokens) {
-        return &parser->tokens[parser->num_tokens - 1]; // Return EOF token
-    }
-    return &parser->tokens[parser->current_token];
+    return token_stream_peek(&parser->stream, 0);
 }
 
 // Get the previous token
 static Token* previous(RDParser *parser) {
-    if (!parser || parser->num_tokens == 0) {
+    if (!parser) {
         return NULL;
     }
-    
-    if (parser->current_token == 0) {
-        return &parser->tokens[0];
-    }
-    return &parser->tokens[parser->current_token - 1];
+    return token_stream_previous(&parser->stream);
 }
 
-// Check if we've reached the end of the token stream
+// Check if we've reached the end of the token stream. Hitting the error
+// cap counts as the end, so every loop unwinds and parsing stops.
 static bool is_at_end(RDParser *parser) {
     Token *token = current(parser);
-    return token == NULL || token->type == TOKEN_EOF;
+    return token == NULL || token->type == TOKEN_EOF || diag_full(&parser->diagnostics);
 }
 
 // Advance to the next token
 static Token* advance(RDParser *parser) {
     if (!is_at_end(parser)) {
-        parser->current_token++;
+        token_stream_advance(&parser->stream);
     }
     return previous(parser);
 }
@@ -95,24 +121,103 @@ static Token* consume(RDParser *parser, TokenType type, const char *error_msg) {
     return NULL;
 }
 
-// Check if a token value matches a specific string
-static bool match_value(RDParser *parser, TokenType type, const char *value) {
+// Check if the current token is a specific keyword, operator or punctuator
+static bool check_kind(RDParser *parser, TokenKind kind) {
     if (is_at_end(parser)) return false;
+    return current(parser)->kind == kind;
+}
+
+// Consume the current token if it has the expected kind
+static bool match_kind(RDParser *parser, TokenKind kind) {
+    if (check_kind(parser, kind)) {
+        advance(parser);
+        return true;
+    }
+    return false;
+}
+
+// Expect a token of a specific kind, error if not found
+static Token* consume_kind(RDParser *parser, TokenKind kind, const char *error_msg) {
+    if (check_kind(parser, kind)) {
+        return advance(parser);
+    }
     
-    Token *token = current(parser);
-    if (!token || !token->value) return false;
+    error(parser, error_msg);
+    return NULL;
+}
+
+// Check if a token kind names a type
+static bool is_type_kind(TokenKind kind) {
+    return kind == KW_INT || kind == KW_FLOAT || kind == KW_CHAR || kind == KW_VOID;
+}
+
+// Leave panic mode at a statement boundary. If the failed statement,
+// which began at start, already ended with its ';' or '}' parsing resumes
+// right here; otherwise tokens are skipped to just past the next ';' or up
+// to the next '}' so the enclosing block can close.
+static void synchronize(RDParser *parser, size_t start) {
+    parser->panic_mode = false;
+    
+    if (token_stream_position(&parser->stream) > start) {
+        TokenKind last = previous(parser)->kind;
+        if (last == PUNCT_SEMICOLON || last == PUNCT_RBRACE) return;
+    }
+    
+    while (!is_at_end(parser)) {
+        if (match_kind(parser, PUNCT_SEMICOLON)) return;
+        if (check_kind(parser, PUNCT_RBRACE)) return;
+        advance(parser);
+    }
+}
+
+// Leave panic mode at the next function: a type keyword outside any braces
+static void synchronize_declaration(RDParser *parser) {
+    parser->panic_mode = false;
+    int depth = 0;
     
-    if (token->type == type && strcmp(token->value, value) == 0) {
+    while (!is_at_end(parser)) {
+        Token *token = current(parser);
+        if (depth == 0 && token->type == TOKEN_KEYWORD && is_type_kind(token->kind)) return;
+        
+        if (token->kind == PUNCT_LBRACE) {
+            depth++;
+        } else if (token->kind == PUNCT_RBRACE && depth > 0) {
+            depth--;
+        }
         advance(parser);
+    }
+}
+
+// Enter a nested statement or expression; reports an error and returns
+// false when that would exceed PARSER_RD_MAX_DEPTH. Each successful call
+// is paired with a depth decrement on the way out. On the error, the
+// bracketed group starting at the current token is skipped whole, so the
+// enclosing statements and expressions still find their closing tokens.
+static bool enter_nesting(RDParser *parser) {
+    if (parser->depth < PARSER_RD_MAX_DEPTH) {
+        parser->depth++;
         return true;
     }
     
+    error(parser, "Statements or expressions nested too deeply");
+    if (!check_kind(parser, PUNCT_LPAREN) && !check_kind(parser, PUNCT_LBRACE)) return false;
+    
+    int brackets = 0;
+    do {
+        TokenKind kind = advance(parser)->kind;
+        if (kind == PUNCT_LPAREN || kind == PUNCT_LBRACE) {
+            brackets++;
+        } else if (kind == PUNCT_RPAREN || kind == PUNCT_RBRACE) {
+            brackets--;
+        }
+    } while (brackets > 0 && !is_at_end(parser));
     return false;
 }
 
 // Forward declarations for recursive descent functions
 static ASTNode* parse_program(RDParser *parser);
 static ASTNode* parse_function(RDParser *parser);
+static ASTNode* parse_parameter(RDParser *parser);
 static ASTNode* parse_statement(RDParser *parser);
 static ASTNode* parse_block(RDParser *parser);
 static ASTNode* parse_expression_statement(RDParser *parser);
@@ -123,10 +228,7 @@ static ASTNode* parse_return_statement(RDParser *parser);
 static ASTNode* parse_var_declaration(RDParser *parser);
 static ASTNode* parse_expression(RDParser *parser);
 static ASTNode* parse_assignment(RDParser *parser);
-static ASTNode* parse_equality(RDParser *parser);
-static ASTNode* parse_comparison(RDParser *parser);
-static ASTNode* parse_term(RDParser *parser);
-static ASTNode* parse_factor(RDParser *parser);
+static ASTNode* parse_binary(RDParser *parser, int min_precedence);
 static ASTNode* parse_unary(RDParser *parser);
 static ASTNode* parse_call(RDParser *parser);
 static ASTNode* parse_primary(RDParser *parser);
@@ -138,18 +240,12 @@ static ASTNode* parse_program(RDParser *parser) {
     // Parse declarations until end of file
     while (!is_at_end(parser)) {
         ASTNode *decl = parse_function(parser);
-        if (decl) {
-            ast_add_child(program, decl);
-        } else if (parser->had_error) {
+        if (parser->panic_mode) {
             // Skip to the next function declaration on error
-            while (!is_at_end(parser) && 
-                  !(check(parser, TOKEN_KEYWORD) && 
-                    (strcmp(current(parser)->value, "int") == 0 ||
-                     strcmp(current(parser)->value, "void") == 0 ||
-                     strcmp(current(parser)->value, "float") == 0 ||
-                     strcmp(current(parser)->value, "char") == 0))) {
-                advance(parser);
-            }
+            ast_free_node(decl);
+            synchronize_declaration(parser);
+        } else if (decl) {
+            ast_add_child(program, decl);
         }
     }
     
@@ -174,36 +270,42 @@ static ASTNode* parse_function(RDParser *parser) {
         free(return_type);
         return NULL;
     }
+    char *func_name = strdup(name_token->value);
     
     // Parse parameter list
-    consume(parser, TOKEN_PUNCTUATION, "Expected '(' after function name");
+    consume_kind(parser, PUNCT_LPAREN, "Expected '(' after function name");
     
-    // TODO: Parse parameters (simplified for now)
+    // Parse parameters: "type name" pairs, kept as declarations in a block
     ASTNode *params = ast_create_node(NODE_BLOCK, "params");
     
-    // Skip parameters for now
-    while (!check(parser, TOKEN_PUNCTUATION) || strcmp(current(parser)->value, ")") != 0) {
+    if (check_kind(parser, KW_VOID) && token_stream_peek(&parser->stream, 1)->kind == PUNCT_RPAREN) {
+        // An explicit empty list: "(void)"
         advance(parser);
-        if (is_at_end(parser)) {
-            error(parser, "Unterminated parameter list");
-            free(return_type);
-            ast_free_node(params);
-            return NULL;
-        }
+    } else if (!check_kind(parser, PUNCT_RPAREN)) {
+        do {
+            ASTNode *param = parse_parameter(parser);
+            if (!param) {
+                free(return_type);
+                free(func_name);
+                ast_free_node(params);
+                return NULL;
+            }
+            ast_add_child(params, param);
+        } while (match_kind(parser, PUNCT_COMMA));
     }
     
-    consume(parser, TOKEN_PUNCTUATION, "Expected ')' after parameters");
+    consume_kind(parser, PUNCT_RPAREN, "Expected ')' after parameters");
     
     // Parse function body
     ASTNode *body = parse_block(parser);
     if (!body) {
         free(return_type);
+        free(func_name);
         ast_free_node(params);
         return NULL;
     }
     
     // Create function node
-    char *func_name = strdup(name_token->value);
     ASTNode *function = ast_create_function(func_name, params, body);
     
     free(return_type);
@@ -212,69 +314,84 @@ static ASTNode* parse_function(RDParser *parser) {
     return function;
 }
 
+// Parse a parameter declaration
+static ASTNode* parse_parameter(RDParser *parser) {
+    if (!check(parser, TOKEN_KEYWORD) || !is_type_kind(current(parser)->kind)) {
+        error(parser, "Expected parameter type");
+        return NULL;
+    }
+    
+    const char *type = advance(parser)->value;
+    
+    Token *name_token = consume(parser, TOKEN_IDENTIFIER, "Expected parameter name");
+    if (!name_token) return NULL;
+    
+    return ast_create_var_decl(type, name_token->value, NULL);
+}
+
 // Parse a block of statements
 static ASTNode* parse_block(RDParser *parser) {
-    if (!match(parser, TOKEN_PUNCTUATION) || strcmp(previous(parser)->value, "{") != 0) {
+    if (!match_kind(parser, PUNCT_LBRACE)) {
         error(parser, "Expected '{' before block");
         return NULL;
     }
     
     ASTNode *block = ast_create_block();
     
-    // Parse statements until we reach the end of the block
-    while (!check(parser, TOKEN_PUNCTUATION) || strcmp(current(parser)->value, "}") != 0) {
-        ASTNode *stmt = parse_statement(parser);
-        if (stmt) {
-            ast_add_child(block, stmt);
-        }
-        
+    // Parse statements until we reach the end of the block. A statement
+    // with an error is dropped and parsing resumes at the next boundary.
+    while (!check_kind(parser, PUNCT_RBRACE)) {
         if (is_at_end(parser)) {
             error(parser, "Unterminated block");
-            ast_free_node(block);
-            return NULL;
+            return block;
+        }
+        
+        size_t start = token_stream_position(&parser->stream);
+        ASTNode *stmt = parse_statement(parser);
+        if (parser->panic_mode) {
+            ast_free_node(stmt);
+            synchronize(parser, start);
+        } else if (stmt) {
+            ast_add_child(block, stmt);
         }
     }
     
-    consume(parser, TOKEN_PUNCTUATION, "Expected '}' after block");
+    consume_kind(parser, PUNCT_RBRACE, "Expected '}' after block");
     
     return block;
 }
 
 // Parse a statement
 static ASTNode* parse_statement(RDParser *parser) {
-    // Check for specific statement types
-    if (match(parser, TOKEN_KEYWORD)) {
-        const char *keyword = previous(parser)->value;
-        
-        if (strcmp(keyword, "if") == 0) {
-            return parse_if_statement(parser);
-        } else if (strcmp(keyword, "while") == 0) {
-            return parse_while_statement(parser);
-        } else if (strcmp(keyword, "for") == 0) {
-            return parse_for_statement(parser);
-        } else if (strcmp(keyword, "return") == 0) {
-            return parse_return_statement(parser);
-        } else if (strcmp(keyword, "int") == 0 || 
-                  strcmp(keyword, "float") == 0 || 
-                  strcmp(keyword, "char") == 0 || 
-                  strcmp(keyword, "void") == 0) {
-            // Put the token back and parse as a variable declaration
-            parser->current_token--;
-            return parse_var_declaration(parser);
-        }
-    } else if (check(parser, TOKEN_PUNCTUATION) && strcmp(current(parser)->value, "{") == 0) {
-        return parse_block(parser);
+    if (!enter_nesting(parser)) return NULL;
+    
+    // Check for specific statement types, defaulting to an expression
+    ASTNode *stmt;
+    if (match_kind(parser, KW_IF)) {
+        stmt = parse_if_statement(parser);
+    } else if (match_kind(parser, KW_WHILE)) {
+        stmt = parse_while_statement(parser);
+    } else if (match_kind(parser, KW_FOR)) {
+        stmt = parse_for_statement(parser);
+    } else if (match_kind(parser, KW_RETURN)) {
+        stmt = parse_return_statement(parser);
+    } else if (check(parser, TOKEN_KEYWORD) && is_type_kind(current(parser)->kind)) {
+        stmt = parse_var_declaration(parser);
+    } else if (check_kind(parser, PUNCT_LBRACE)) {
+        stmt = parse_block(parser);
+    } else {
+        stmt = parse_expression_statement(parser);
     }
     
-    // Default to expression statement
-    return parse_expression_statement(parser);
+    parser->depth--;
+    return stmt;
 }
 
 // Parse an expression statement
 static ASTNode* parse_expression_statement(RDParser *parser) {
     ASTNode *expr = parse_expression(parser);
     
-    if (!consume(parser, TOKEN_PUNCTUATION, "Expected ';' after expression")) {
+    if (!consume_kind(parser, PUNCT_SEMICOLON, "Expected ';' after expression")) {
         ast_free_node(expr);
         return NULL;
     }
@@ -285,16 +402,16 @@ static ASTNode* parse_expression_statement(RDParser *parser) {
 // Parse an if statement
 static ASTNode* parse_if_statement(RDParser *parser) {
     // Parse condition
-    consume(parser, TOKEN_PUNCTUATION, "Expected '(' after 'if'");
+    consume_kind(parser, PUNCT_LPAREN, "Expected '(' after 'if'");
     ASTNode *condition = parse_expression(parser);
-    consume(parser, TOKEN_PUNCTUATION, "Expected ')' after if condition");
+    consume_kind(parser, PUNCT_RPAREN, "Expected ')' after if condition");
     
     // Parse then branch
     ASTNode *then_branch = parse_statement(parser);
     
     // Parse optional else branch
     ASTNode *else_branch = NULL;
-    if (match_value(parser, TOKEN_KEYWORD, "else")) {
+    if (match_kind(parser, KW_ELSE)) {
         else_branch = parse_statement(parser);
     }
     
@@ -304,9 +421,9 @@ static ASTNode* parse_if_statement(RDParser *parser) {
 // Parse a while statement
 static ASTNode* parse_while_statement(RDParser *parser) {
     // Parse condition
-    consume(parser, TOKEN_PUNCTUATION, "Expected '(' after 'while'");
+    consume_kind(parser, PUNCT_LPAREN, "Expected '(' after 'while'");
     ASTNode *condition = parse_expression(parser);
-    consume(parser, TOKEN_PUNCTUATION, "Expected ')' after while condition");
+    consume_kind(parser, PUNCT_RPAREN, "Expected ')' after while condition");
     
     // Parse body
     ASTNode *body = parse_statement(parser);
@@ -316,38 +433,35 @@ static ASTNode* parse_while_statement(RDParser *parser) {
 
 // Parse a for statement
 static ASTNode* parse_for_statement(RDParser *parser) {
-    consume(parser, TOKEN_PUNCTUATION, "Expected '(' after 'for'");
+    consume_kind(parser, PUNCT_LPAREN, "Expected '(' after 'for'");
     
     // Parse initializer
     ASTNode *initializer = NULL;
-    if (match(parser, TOKEN_PUNCTUATION) && strcmp(previous(parser)->value, ";") == 0) {
+    if (match_kind(parser, PUNCT_SEMICOLON)) {
         // No initializer
-    } else if (match(parser, TOKEN_KEYWORD) && 
-              (strcmp(previous(parser)->value, "int") == 0 ||
-               strcmp(previous(parser)->value, "float") == 0 ||
-               strcmp(previous(parser)->value, "char") == 0)) {
+    } else if (check_kind(parser, KW_INT) || check_kind(parser, KW_FLOAT) ||
+               check_kind(parser, KW_CHAR)) {
         // Variable declaration initializer
-        parser->current_token--; // Back up to the type keyword
         initializer = parse_var_declaration(parser);
     } else {
         // Expression initializer
         initializer = parse_expression(parser);
-        consume(parser, TOKEN_PUNCTUATION, "Expected ';' after for initializer");
+        consume_kind(parser, PUNCT_SEMICOLON, "Expected ';' after for initializer");
     }
     
     // Parse condition
     ASTNode *condition = NULL;
-    if (!check(parser, TOKEN_PUNCTUATION) || strcmp(current(parser)->value, ";") != 0) {
+    if (!check_kind(parser, PUNCT_SEMICOLON)) {
         condition = parse_expression(parser);
     }
-    consume(parser, TOKEN_PUNCTUATION, "Expected ';' after for condition");
+    consume_kind(parser, PUNCT_SEMICOLON, "Expected ';' after for condition");
     
     // Parse increment
     ASTNode *increment = NULL;
-    if (!check(parser, TOKEN_PUNCTUATION) || strcmp(current(parser)->value, ")") != 0) {
+    if (!check_kind(parser, PUNCT_RPAREN)) {
         increment = parse_expression(parser);
     }
-    consume(parser, TOKEN_PUNCTUATION, "Expected ')' after for clauses");
+    consume_kind(parser, PUNCT_RPAREN, "Expected ')' after for clauses");
     
     // Parse body
     ASTNode *body = parse_statement(parser);
@@ -360,11 +474,11 @@ static ASTNode* parse_return_statement(RDParser *parser) {
     ASTNode *expr = NULL;
     
     // Check if there's a return value
-    if (!check(parser, TOKEN_PUNCTUATION) || strcmp(current(parser)->value, ";") != 0) {
+    if (!check_kind(parser, PUNCT_SEMICOLON)) {
         expr = parse_expression(parser);
     }
     
-    consume(parser, TOKEN_PUNCTUATION, "Expected ';' after return value");
+    consume_kind(parser, PUNCT_SEMICOLON, "Expected ';' after return value");
     
     return ast_create_return(expr);
 }
@@ -386,16 +500,16 @@ static ASTNode* parse_var_declaration(RDParser *parser) {
         free(type);
         return NULL;
     }
+    char *var_name = strdup(name_token->value);
     
     // Parse optional initializer
     ASTNode *initializer = NULL;
-    if (match(parser, TOKEN_OPERATOR) && strcmp(previous(parser)->value, "=") == 0) {
+    if (match_kind(parser, OP_ASSIGN)) {
         initializer = parse_expression(parser);
     }
     
-    consume(parser, TOKEN_PUNCTUATION, "Expected ';' after variable declaration");
+    consume_kind(parser, PUNCT_SEMICOLON, "Expected ';' after variable declaration");
     
-    char *var_name = strdup(name_token->value);
     ASTNode *var_decl = ast_create_var_decl(type, var_name, initializer);
     
     free(type);
@@ -409,86 +523,77 @@ static ASTNode* parse_expression(RDParser *parser) {
     return parse_assignment(parser);
 }
 
-// Parse an assignment expression
+// Binding power of each binary operator, 0 for tokens that are not one.
+// Higher binds tighter; all binary operators are left-associative.
+static const unsigned char binary_precedence[KIND_COUNT] = {
+    [OP_OR] = 1,
+    [OP_AND] = 2,
+    [OP_PIPE] = 3,
+    [OP_CARET] = 4,
+    [OP_AMP] = 5,
+    [OP_EQ] = 6, [OP_NE] = 6,
+    [OP_LT] = 7, [OP_LE] = 7, [OP_GT] = 7, [OP_GE] = 7,
+    [OP_PLUS] = 8, [OP_MINUS] = 8,
+    [OP_STAR] = 9, [OP_SLASH] = 9, [OP_PERCENT] = 9,
+};
+
+// Assignment operators; compound ones are desugared to "x = x op y"
+static const bool is_assign_kind[KIND_COUNT] = {
+    [OP_ASSIGN] = true,
+    [OP_PLUS_ASSIGN] = true, [OP_MINUS_ASSIGN] = true,
+    [OP_STAR_ASSIGN] = true, [OP_SLASH_ASSIGN] = true,
+};
+
+// Get the binding power of the current token as a binary operator
+static int current_precedence(RDParser *parser) {
+    Token *token = current(parser);
+    if (token->type != TOKEN_OPERATOR) return 0;
+    return binary_precedence[token->kind];
+}
+
+// Parse an assignment expression (right-associative, lowest precedence)
 static ASTNode* parse_assignment(RDParser *parser) {
-    ASTNode *expr = parse_equality(parser);
+    ASTNode *expr = parse_binary(parser, 1);
     
-    if (match(parser, TOKEN_OPERATOR) && strcmp(previous(parser)->value, "=") == 0) {
-        ASTNode *value = parse_assignment(parser);
+    Token *token = current(parser);
+    if (token->type == TOKEN_OPERATOR && is_assign_kind[token->kind]) {
+        TokenKind kind = token->kind;
+        const char *op = advance(parser)->value;
+        ASTNode *value = NULL;
+        if (enter_nesting(parser)) {
+            value = parse_assignment(parser);
+            parser->depth--;
+        }
         
         // Check that the left side is a valid assignment target
-        if (expr->type == NODE_IDENTIFIER) {
-            return ast_create_assignment(expr->value, value);
+        if (expr && expr->type == NODE_IDENTIFIER) {
+            ASTNode *assignment = kind == OP_ASSIGN
+                ? ast_create_assignment(expr->value, value)
+                : ast_create_compound_assignment(expr->value, op, value);
+            ast_free_node(expr);
+            expr = assignment;
+        } else {
+            error(parser, "Invalid assignment target");
+            ast_free_node(value);
         }
-        
-        error(parser, "Invalid assignment target");
-    }
-    
-    return expr;
-}
-
-// Parse an equality expression
-static ASTNode* parse_equality(RDParser *parser) {
-    ASTNode *expr = parse_comparison(parser);
-    
-    while (match(parser, TOKEN_OPERATOR) && 
-          (strcmp(previous(parser)->value, "==") == 0 || 
-           strcmp(previous(parser)->value, "!=") == 0)) {
-        char *op = strdup(previous(parser)->value);
-        ASTNode *right = parse_comparison(parser);
-        expr = ast_create_binary_op(op, expr, right);
-        free(op);
-    }
-    
-    return expr;
-}
-
-// Parse a comparison expression
-static ASTNode* parse_comparison(RDParser *parser) {
-    ASTNode *expr = parse_term(parser);
-    
-    while (match(parser, TOKEN_OPERATOR) && 
-          (strcmp(previous(parser)->value, ">") == 0 || 
-           strcmp(previous(parser)->value, ">=") == 0 || 
-           strcmp(previous(parser)->value, "<") == 0 || 
-           strcmp(previous(parser)->value, "<=") == 0)) {
-        char *op = strdup(previous(parser)->value);
-        ASTNode *right = parse_term(parser);
-        expr = ast_create_binary_op(op, expr, right);
-        free(op);
     }
     
     return expr;
 }
 
-// Parse a term expression
-static ASTNode* parse_term(RDParser *parser) {
-    ASTNode *expr = parse_factor(parser);
-    
-    while (match(parser, TOKEN_OPERATOR) && 
-          (strcmp(previous(parser)->value, "+") == 0 || 
-           strcmp(previous(parser)->value, "-") == 0)) {
-        char *op = strdup(previous(parser)->value);
-        ASTNode *right = parse_factor(parser);
-        expr = ast_create_binary_op(op, expr, right);
-        free(op);
-    }
-    
-    return expr;
-}
-
-// Parse a factor expression
-static ASTNode* parse_factor(RDParser *parser) {
+// Parse binary operators by precedence climbing: operands are unary
+// expressions, and each loop consumes operators binding at least as
+// tightly as min_precedence.
+static ASTNode* parse_binary(RDParser *parser, int min_precedence) {
     ASTNode *expr = parse_unary(parser);
     
-    while (match(parser, TOKEN_OPERATOR) && 
-          (strcmp(previous(parser)->value, "*") == 0 || 
-           strcmp(previous(parser)->value, "/") == 0 || 
-           strcmp(previous(parser)->value, "%") == 0)) {
-        char *op = strdup(previous(parser)->value);
-        ASTNode *right = parse_unary(parser);
+    int precedence = current_precedence(parser);
+    while (precedence >= min_precedence && precedence > 0) {
+        // Operator text is interned, so it stays valid after advancing
+        const char *op = advance(parser)->value;
+        ASTNode *right = parse_binary(parser, precedence + 1);
         expr = ast_create_binary_op(op, expr, right);
-        free(op);
+        precedence = current_precedence(parser);
     }
     
     return expr;
@@ -496,40 +601,44 @@ static ASTNode* parse_factor(RDParser *parser) {
 
 // Parse a unary expression
 static ASTNode* parse_unary(RDParser *parser) {
-    if (match(parser, TOKEN_OPERATOR) && 
-       (strcmp(previous(parser)->value, "!") == 0 || 
-        strcmp(previous(parser)->value, "-") == 0)) {
-        char *op = strdup(previous(parser)->value);
+    if (!enter_nesting(parser)) return NULL;
+    
+    ASTNode *expr;
+    if (match_kind(parser, OP_NOT) || match_kind(parser, OP_MINUS) || match_kind(parser, OP_TILDE)) {
+        const char *op = previous(parser)->value;
         ASTNode *right = parse_unary(parser);
-        ASTNode *expr = ast_create_unary_op(op, right);
-        free(op);
-        return expr;
+        expr = ast_create_unary_op(op, right);
+    } else {
+        expr = parse_call(parser);
     }
     
-    return parse_call(parser);
+    parser->depth--;
+    return expr;
 }
 
 // Parse a function call
 static ASTNode* parse_call(RDParser *parser) {
     ASTNode *expr = parse_primary(parser);
     
-    if (match(parser, TOKEN_PUNCTUATION) && strcmp(previous(parser)->value, "(") == 0) {
+    if (match_kind(parser, PUNCT_LPAREN)) {
         // This is a function call
         ASTNode *args = ast_create_node(NODE_BLOCK, "args");
         
         // Parse arguments
-        if (!check(parser, TOKEN_PUNCTUATION) || strcmp(current(parser)->value, ")") != 0) {
+        if (!check_kind(parser, PUNCT_RPAREN)) {
             do {
                 ASTNode *arg = parse_expression(parser);
                 ast_add_child(args, arg);
-            } while (match(parser, TOKEN_PUNCTUATION) && strcmp(previous(parser)->value, ",") == 0);
+            } while (match_kind(parser, PUNCT_COMMA));
         }
         
-        consume(parser, TOKEN_PUNCTUATION, "Expected ')' after function arguments");
+        consume_kind(parser, PUNCT_RPAREN, "Expected ')' after function arguments");
         
         // Create call node
-        if (expr->type == NODE_IDENTIFIER) {
-            expr = ast_create_call(expr->value, args);
+        if (expr && expr->type == NODE_IDENTIFIER) {
+            ASTNode *callee = expr;
+            expr = ast_create_call(callee->value, args);
+            ast_free_node(callee);
         } else {
             error(parser, "Expected function name");
             ast_free_node(expr);
@@ -555,9 +664,9 @@ static ASTNode* parse_primary(RDParser *parser) {
         return ast_create_identifier(previous(parser)->value);
     }
     
-    if (match(parser, TOKEN_PUNCTUATION) && strcmp(previous(parser)->value, "(") == 0) {
+    if (match_kind(parser, PUNCT_LPAREN)) {
         ASTNode *expr = parse_expression(parser);
-        consume(parser, TOKEN_PUNCTUATION, "Expected ')' after expression");
+        consume_kind(parser, PUNCT_RPAREN, "Expected ')' after expression");
         return expr;
     }
     
@@ -573,27 +682,65 @@ ASTNode* parser_rd_parse(RDParser *parser) {
     
     // Reset error state
     parser->had_error = false;
+    parser->panic_mode = false;
+    parser->depth = 0;
     parser->error_message[0] = '\0';
+    diag_clear(&parser->diagnostics);
     
-    // Create a simplified AST for demonstration purposes
-    ASTNode *root = ast_create_program();
+    // Parse the token stream, pulling tokens from the lexer in stream mode
+    ASTNode *root = parse_program(parser);
     if (!root) {
         error(parser, "Failed to create program node");
         return NULL;
     }
     
-    // Create a main function node
-    ASTNode *main_func = ast_create_function("main", NULL, NULL);
-    if (!main_func) {
-        error(parser, "Failed to create function node");
-        ast_free_node(root);
+    if (parser->stream.failed) {
+        parser->panic_mode = false;
+        error(parser, "Lexer failed while reading tokens");
+    }
+    
+    return root;
+}
+
+// Parse only the function declaration at the parser's position, leaving
+// the parser just after it, so an edited function can be parsed again on
+// its own. Returns NULL on a syntax error.
+ASTNode* parser_rd_parse_function(RDParser *parser) {
+    if (!parser) {
         return NULL;
     }
     
-    // Add the main function to the program
-    ast_add_child(root, main_func);
+    parser->had_error = false;
+    parser->panic_mode = false;
+    parser->depth = 0;
+    parser->error_message[0] = '\0';
+    diag_clear(&parser->diagnostics);
     
-    return root;
+    ASTNode *function = parse_function(parser);
+    if (parser->had_error || parser->stream.failed) {
+        ast_free_node(function);
+        return NULL;
+    }
+    
+    return function;
+}
+
+// Parse into the flat AST encoding. The node tree is built in a scratch
+// arena that is released once it has been flattened.
+FlatAST* parser_rd_parse_flat(RDParser *parser) {
+    Arena *scratch = arena_create(0);
+    if (!scratch) return NULL;
+    
+    Arena *saved = ast_get_arena();
+    ast_set_arena(scratch);
+    
+    ASTNode *root = parser_rd_parse(parser);
+    FlatAST *flat = root ? ast_flatten(root) : NULL;
+    
+    ast_set_arena(saved);
+    arena_destroy(scratch);
+    
+    return flat;
 }
 
 // Check if the parser encountered an error
@@ -601,7 +748,17 @@ bool parser_rd_had_error(RDParser *parser) {
     return parser->had_error;
 }
 
-// Get the error message
+// Get the first error message
 const char* parser_rd_get_error(RDParser *parser) {
     return parser->error_message;
 }
+
+// Set how many errors are collected before parsing stops (0: no limit)
+void parser_rd_set_max_errors(RDParser *parser, size_t max_errors) {
+    parser->diagnostics.max_errors = max_errors;
+}
+
+// Get every error from the last parse
+const DiagList* parser_rd_get_diagnostics(RDParser *parser) {
+    return &parser->diagnostics;
+}
@@ -3,21 +3,34 @@
 
 #include "common.h"
 #include "lexer.h"
+#include "token_stream.h"
+#include "ast_flat.h"
+#include "diag.h"
+
+// Deepest nesting of statements and expressions the parser accepts, so a
+// pathological input is a syntax error rather than a stack overflow
+#define PARSER_RD_MAX_DEPTH 1024
 
 // Recursive Descent Parser structure
 typedef struct {
-    Token *tokens;
-    size_t num_tokens;
-    size_t current_token;
+    TokenStream stream;   // Token array or pull-mode lexer window
     bool had_error;
-    char error_message[256];
+    bool panic_mode;      // Inside an error: suppress reports until synchronized
+    int depth;            // Nested statements and expressions being parsed
+    char error_message[256]; // The first error
+    DiagList diagnostics; // Every error, with its position
 } RDParser;
 
 // Parser functions
 RDParser* parser_rd_init(Token *tokens, size_t num_tokens);
+RDParser* parser_rd_init_stream(Lexer *lexer);
 void parser_rd_free(RDParser *parser);
 ASTNode* parser_rd_parse(RDParser *parser);
+ASTNode* parser_rd_parse_function(RDParser *parser);
+FlatAST* parser_rd_parse_flat(RDParser *parser);
 bool parser_rd_had_error(RDParser *parser);
 const char* parser_rd_get_error(RDParser *parser);
+void parser_rd_set_max_errors(RDParser *parser, size_t max_errors);
+const DiagList* parser_rd_get_diagnostics(RDParser *parser);
 
 #endif // PARSER_RD_H
@@ -0,0 +1,629 @@
+#include "peephole.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Passes over the code before giving up on reaching a fixed point
+#define PEEPHOLE_MAX_ROUNDS 8
+
+// Times one jump may be threaded, which also ends threading around a
+// cycle of jumps
+#define PEEPHOLE_MAX_HOPS 8
+
+// Sliding window state. Kept instructions are compacted in place at the
+// front of the code, so a rule sees the last kept instructions and the
+// one being added, and whatever it removes brings earlier ones back into
+// the window.
+typedef struct {
+    StackInsn *stack;       // The code being rewritten: stack or target
+    TargetInsn *target;
+    size_t num_kept;
+    int *refs;              // Jumps to each label
+    int *next;              // Label that a jump to each label goes on to, or -1
+    int num_labels;
+    int *loads;             // Stack code: LOADs of each temporary
+    int num_temps;
+    bool drop;              // A rule removed the instruction being added
+    int hops;               // Times that instruction was threaded
+    PeepholeReport *report;
+} Peephole;
+
+// A rule looks at the instruction being added and the kept code before
+// it, and returns true if it changed either
+typedef struct {
+    const char *name;
+    bool (*apply)(Peephole *p, StackInsn *insn);
+} StackRule;
+
+// Target rules may instead run once per round over whole functions,
+// returning how many they changed
+typedef struct {
+    const char *name;
+    bool (*apply)(Peephole *p, TargetInsn *insn);
+    size_t (*function)(TargetCode *target);
+} TargetRule;
+
+// Label number of an operand, or -1 if it is not one of the program's labels
+static int label_index(const Peephole *p, IROperand operand) {
+    if (operand.kind != IR_LABEL || operand.value < 0 || operand.value >= p->num_labels) return -1;
+    return (int)operand.value;
+}
+
+// Count a jump to a label more or less
+static void add_ref(Peephole *p, IROperand label, int delta) {
+    int l = label_index(p, label);
+    if (l >= 0) p->refs[l] += delta;
+}
+
+// Check if nothing jumps to a label any more
+static bool label_dead(const Peephole *p, IROperand label) {
+    int l = label_index(p, label);
+    return l >= 0 && p->refs[l] == 0;
+}
+
+// Follow a jump to a label that itself starts with a jump
+static bool thread_jump(Peephole *p, IROperand *label) {
+    int l = label_index(p, *label);
+    if (l < 0 || p->next[l] < 0 || p->next[l] == l || p->hops >= PEEPHOLE_MAX_HOPS) return false;
+
+    add_ref(p, *label, -1);
+    *label = ir_label(p->next[l]);
+    add_ref(p, *label, 1);
+    p->hops++;
+    return true;
+}
+
+// Total times the rules of a report fired
+static size_t total_fired(const PeepholeReport *report) {
+    size_t fired = 0;
+    for (int i = 0; i < report->num_rules; i++) fired += report->rules[i].fired;
+    return fired;
+}
+
+// Stack code
+
+static void stack_feed(Peephole *p, StackInsn insn);
+
+// Kept instruction back from the end (1 is the last), or NULL
+static StackInsn* stack_tail(Peephole *p, size_t back) {
+    return p->num_kept >= back ? &p->stack[p->num_kept - back] : NULL;
+}
+
+// Update the counts for a stack instruction that is removed
+static void stack_forget(Peephole *p, const StackInsn *insn) {
+    if (insn->op == STACK_JMP || insn->op == STACK_JZ) add_ref(p, insn->arg, -1);
+    if (insn->op == STACK_LOAD && insn->arg.kind == IR_TEMP &&
+        insn->arg.value >= 0 && insn->arg.value < p->num_temps) {
+        p->loads[insn->arg.value]--;
+    }
+}
+
+// Remove the last kept instruction
+static void stack_pop_tail(Peephole *p) {
+    stack_forget(p, &p->stack[--p->num_kept]);
+}
+
+// Remove the instruction being added
+static void stack_drop(Peephole *p, StackInsn *insn) {
+    stack_forget(p, insn);
+    p->drop = true;
+}
+
+// "JMP L" or "JZ L" where L is followed by "JMP M": jump to M
+static bool stack_jump_thread(Peephole *p, StackInsn *insn) {
+    return (insn->op == STACK_JMP || insn->op == STACK_JZ) && thread_jump(p, &insn->arg);
+}
+
+// "PUSH c; JZ L" on a constant: the jump is always or never taken
+static bool stack_const_branch(Peephole *p, StackInsn *insn) {
+    StackInsn *last = stack_tail(p, 1);
+    if (insn->op != STACK_JZ || !last || last->op != STACK_PUSH || last->arg.kind != IR_CONST) return false;
+
+    bool taken = last->arg.value == 0;
+    stack_pop_tail(p);
+    if (taken) {
+        insn->op = STACK_JMP;
+    } else {
+        stack_drop(p, insn);
+    }
+    return true;
+}
+
+// "PUSH" or "LOAD" followed by "POP": the value is never used
+static bool stack_push_pop(Peephole *p, StackInsn *insn) {
+    StackInsn *last = stack_tail(p, 1);
+    if (insn->op != STACK_POP || !last || (last->op != STACK_PUSH && last->op != STACK_LOAD)) return false;
+
+    stack_pop_tail(p);
+    stack_drop(p, insn);
+    return true;
+}
+
+// "STORE t; LOAD t" where nothing else reads temporary t: the value can
+// stay on the stack
+static bool stack_store_load(Peephole *p, StackInsn *insn) {
+    StackInsn *last = stack_tail(p, 1);
+    if (insn->op != STACK_LOAD || insn->arg.kind != IR_TEMP || !last ||
+        last->op != STACK_STORE || !ir_same_operand(last->arg, insn->arg)) {
+        return false;
+    }
+    if (insn->arg.value < 0 || insn->arg.value >= p->num_temps || p->loads[insn->arg.value] != 1) return false;
+
+    stack_pop_tail(p);
+    stack_drop(p, insn);
+    return true;
+}
+
+// "JMP L" or "JZ L" right before "L:". The condition of a JZ is still
+// popped.
+static bool stack_jump_next(Peephole *p, StackInsn *insn) {
+    StackInsn *last = stack_tail(p, 1);
+    if (insn->op != STACK_LABEL || !last || (last->op != STACK_JMP && last->op != STACK_JZ) ||
+        !ir_same_operand(last->arg, insn->arg)) {
+        return false;
+    }
+
+    bool branch = last->op == STACK_JZ;
+    stack_pop_tail(p);
+    if (branch) {
+        StackInsn pop = { STACK_POP, ir_none() };
+        stack_feed(p, pop);
+    }
+    return true;
+}
+
+// "L:" that nothing jumps to
+static bool stack_dead_label(Peephole *p, StackInsn *insn) {
+    if (insn->op != STACK_LABEL || !label_dead(p, insn->arg)) return false;
+    p->drop = true;
+    return true;
+}
+
+// Code after "JMP" or "RET" that no label leads to
+static bool stack_unreachable(Peephole *p, StackInsn *insn) {
+    StackInsn *last = stack_tail(p, 1);
+    if (!last || (last->op != STACK_JMP && last->op != STACK_RET && last->op != STACK_RET0)) return false;
+    if (insn->op == STACK_LABEL || insn->op == STACK_FUNC || insn->op == STACK_END_FUNC) return false;
+
+    stack_drop(p, insn);
+    return true;
+}
+
+// "RET0" right before "END_FUNC", which returns anyway
+static bool stack_return_end(Peephole *p, StackInsn *insn) {
+    StackInsn *last = stack_tail(p, 1);
+    if (insn->op != STACK_END_FUNC || !last || last->op != STACK_RET0) return false;
+
+    stack_pop_tail(p);
+    return true;
+}
+
+// Stack code rules, tried in order on every instruction added
+static const StackRule stack_rules[] = {
+    { "jump-thread", stack_jump_thread },
+    { "const-branch", stack_const_branch },
+    { "push-pop", stack_push_pop },
+    { "store-load", stack_store_load },
+    { "jump-next", stack_jump_next },
+    { "dead-label", stack_dead_label },
+    { "unreachable", stack_unreachable },
+    { "return-end", stack_return_end },
+};
+
+#define NUM_STACK_RULES (sizeof(stack_rules) / sizeof(stack_rules[0]))
+
+// Add a stack instruction to the kept code, applying rules until none fires
+static void stack_feed(Peephole *p, StackInsn insn) {
+    bool drop = p->drop;
+    int hops = p->hops;
+    p->drop = false;
+    p->hops = 0;
+
+    for (bool fired = true; fired && !p->drop;) {
+        fired = false;
+        for (size_t r = 0; r < NUM_STACK_RULES && !fired; r++) {
+            if (stack_rules[r].apply(p, &insn)) {
+                p->report->rules[r].fired++;
+                fired = true;
+            }
+        }
+    }
+    if (!p->drop) p->stack[p->num_kept++] = insn;
+
+    p->drop = drop;
+    p->hops = hops;
+}
+
+// Count label references and temporary loads, and find labels followed
+// by a jump
+static void count_stack(Peephole *p, const IRProgram *ir) {
+    memset(p->refs, 0, sizeof(int) * (size_t)p->num_labels);
+    memset(p->loads, 0, sizeof(int) * (size_t)p->num_temps);
+    for (int l = 0; l < p->num_labels; l++) p->next[l] = -1;
+
+    for (size_t i = 0; i < ir->num_stack; i++) {
+        const StackInsn *insn = &ir->stack[i];
+        if (insn->op == STACK_JMP || insn->op == STACK_JZ) add_ref(p, insn->arg, 1);
+        if (insn->op == STACK_LOAD && insn->arg.kind == IR_TEMP &&
+            insn->arg.value >= 0 && insn->arg.value < p->num_temps) {
+            p->loads[insn->arg.value]++;
+        }
+
+        if (insn->op == STACK_LABEL && label_index(p, insn->arg) >= 0) {
+            size_t j = i + 1;
+            while (j < ir->num_stack && ir->stack[j].op == STACK_LABEL) j++;
+            if (j < ir->num_stack && ir->stack[j].op == STACK_JMP) {
+                p->next[insn->arg.value] = label_index(p, ir->stack[j].arg);
+            }
+        }
+    }
+}
+
+// Rewrite the stack code of a program with the stack rules until none
+// fires. The report may be NULL.
+bool peephole_stack(IRProgram *ir, PeepholeReport *report) {
+    PeepholeReport local_report;
+    if (!report) report = &local_report;
+
+    memset(report, 0, sizeof(*report));
+    report->code = "stack";
+    report->insns_before = ir->num_stack;
+    report->num_rules = (int)NUM_STACK_RULES;
+    for (size_t r = 0; r < NUM_STACK_RULES; r++) report->rules[r].name = stack_rules[r].name;
+
+    Peephole p;
+    memset(&p, 0, sizeof(p));
+    p.stack = ir->stack;
+    p.num_labels = ir->num_labels;
+    p.num_temps = ir->num_temps;
+    p.report = report;
+    p.refs = (int*)malloc(sizeof(int) * ((size_t)ir->num_labels + 1));
+    p.next = (int*)malloc(sizeof(int) * ((size_t)ir->num_labels + 1));
+    p.loads = (int*)malloc(sizeof(int) * ((size_t)ir->num_temps + 1));
+
+    bool ok = p.refs && p.next && p.loads;
+    for (int round = 0; ok && round < PEEPHOLE_MAX_ROUNDS; round++) {
+        size_t fired = total_fired(report);
+        size_t count = ir->num_stack;
+
+        count_stack(&p, ir);
+        p.num_kept = 0;
+        for (size_t i = 0; i < count; i++) stack_feed(&p, ir->stack[i]);
+        ir->num_stack = p.num_kept;
+
+        report->rounds++;
+        if (total_fired(report) == fired) break;
+    }
+
+    free(p.refs);
+    free(p.next);
+    free(p.loads);
+
+    report->insns_after = ir->num_stack;
+    return ok;
+}
+
+// Target code
+
+static void target_feed(Peephole *p, TargetInsn insn);
+
+// Kept instruction back from the end (1 is the last), or NULL
+static TargetInsn* target_tail(Peephole *p, size_t back) {
+    return p->num_kept >= back ? &p->target[p->num_kept - back] : NULL;
+}
+
+// Check if an operand is register reg, or any register with -1
+static bool is_reg(TargetArg arg, int reg) {
+    return arg.kind == TARGET_ARG_REG && (reg < 0 || arg.value.value == reg);
+}
+
+// Check if an instruction is a jump or return, after which code only runs
+// when jumped to
+static bool target_ends_flow(const TargetInsn *insn) {
+    return insn->op == TARGET_JMP || insn->op == TARGET_RET;
+}
+
+// Check if an instruction starts a function
+static bool is_function_label(const TargetInsn *insn) {
+    return insn->op == TARGET_LABEL && insn->args[0].value.kind == IR_FUNC;
+}
+
+// Update the counts for a target instruction that is removed
+static void target_forget(Peephole *p, const TargetInsn *insn) {
+    if (insn->op == TARGET_JMP || insn->op == TARGET_JE) add_ref(p, insn->args[0].value, -1);
+}
+
+// Remove the last kept instruction
+static void target_pop_tail(Peephole *p) {
+    target_forget(p, &p->target[--p->num_kept]);
+}
+
+// Remove the instruction being added
+static void target_drop(Peephole *p, TargetInsn *insn) {
+    target_forget(p, insn);
+    p->drop = true;
+}
+
+// Turn an instruction into "MOV dst, src"
+static void make_move(TargetInsn *insn, TargetArg dst, TargetArg src) {
+    insn->op = TARGET_MOV;
+    insn->args[0] = dst;
+    insn->args[1] = src;
+    insn->args[2] = target_none();
+}
+
+// "JMP L" or "JE L" where L is followed by "JMP M": jump to M
+static bool target_jump_thread(Peephole *p, TargetInsn *insn) {
+    return (insn->op == TARGET_JMP || insn->op == TARGET_JE) && thread_jump(p, &insn->args[0].value);
+}
+
+// "PUSH Rs; POP Rd": nothing else sees the stack slot, so the value can
+// be moved, or left where it is when Rs is Rd
+static bool target_push_pop(Peephole *p, TargetInsn *insn) {
+    TargetInsn *last = target_tail(p, 1);
+    if (insn->op != TARGET_POP || !is_reg(insn->args[0], -1) ||
+        !last || last->op != TARGET_PUSH || !is_reg(last->args[0], -1)) {
+        return false;
+    }
+
+    TargetArg src = last->args[0];
+    target_pop_tail(p);
+    if (target_same_arg(src, insn->args[0])) {
+        target_drop(p, insn);
+    } else {
+        make_move(insn, insn->args[0], src);
+    }
+    return true;
+}
+
+// "STORE [m], Rs; LOAD Rd, [m]": the value is still in Rs
+static bool target_store_load(Peephole *p, TargetInsn *insn) {
+    TargetInsn *last = target_tail(p, 1);
+    if (insn->op != TARGET_LOAD || !last || last->op != TARGET_STORE ||
+        !is_reg(last->args[1], -1) || !target_same_arg(last->args[0], insn->args[1])) {
+        return false;
+    }
+
+    if (target_same_arg(last->args[1], insn->args[0])) {
+        target_drop(p, insn);
+    } else {
+        make_move(insn, insn->args[0], last->args[1]);
+    }
+    return true;
+}
+
+// "MOV R, R"
+static bool target_move_self(Peephole *p, TargetInsn *insn) {
+    if (insn->op != TARGET_MOV || !is_reg(insn->args[0], -1) ||
+        !target_same_arg(insn->args[0], insn->args[1])) {
+        return false;
+    }
+
+    target_drop(p, insn);
+    return true;
+}
+
+// "JMP L" or "CMP R, 0; JE L" right before "L:". Only JE reads what CMP
+// compares, so the CMP goes with it.
+static bool target_jump_next(Peephole *p, TargetInsn *insn) {
+    TargetInsn *last = target_tail(p, 1);
+    if (insn->op != TARGET_LABEL || !last || (last->op != TARGET_JMP && last->op != TARGET_JE) ||
+        !target_same_arg(last->args[0], insn->args[0])) {
+        return false;
+    }
+
+    bool branch = last->op == TARGET_JE;
+    target_pop_tail(p);
+    last = target_tail(p, 1);
+    if (branch && last && last->op == TARGET_CMP) target_pop_tail(p);
+    return true;
+}
+
+// "L:" that nothing jumps to
+static bool target_dead_label(Peephole *p, TargetInsn *insn) {
+    if (insn->op != TARGET_LABEL || !label_dead(p, insn->args[0].value)) return false;
+    p->drop = true;
+    return true;
+}
+
+// Code after "JMP" or "RET" that no label leads to
+static bool target_unreachable(Peephole *p, TargetInsn *insn) {
+    TargetInsn *last = target_tail(p, 1);
+    if (!last || !target_ends_flow(last)) return false;
+    if (insn->op == TARGET_LABEL || insn->op == TARGET_END_FUNC) return false;
+
+    target_drop(p, insn);
+    return true;
+}
+
+// Check if instruction i starts a "MOV SP, FP; POP FP" epilogue
+static bool is_epilogue(const TargetInsn *code, size_t i, size_t end) {
+    return i + 1 < end &&
+           code[i].op == TARGET_MOV && is_reg(code[i].args[0], TARGET_SP) &&
+           is_reg(code[i].args[1], TARGET_FP) &&
+           code[i + 1].op == TARGET_POP && is_reg(code[i + 1].args[0], TARGET_FP);
+}
+
+// Check if an instruction needs the function to have a frame: it calls,
+// uses the stack, or names SP, FP or a frame slot. The stack code
+// operators without operands work on the stack.
+static bool uses_frame(const TargetInsn *insn) {
+    if (insn->op == TARGET_CALL || insn->op == TARGET_PUSH || insn->op == TARGET_POP) return true;
+    if (insn->op >= TARGET_ADD && insn->op <= TARGET_BNOT && insn->args[0].kind == TARGET_ARG_NONE) return true;
+
+    for (int k = 0; k < 3; k++) {
+        const TargetArg *arg = &insn->args[k];
+        if (arg->kind == TARGET_ARG_FRAME) return true;
+        if (is_reg(*arg, TARGET_SP) || is_reg(*arg, TARGET_FP)) return true;
+    }
+    return false;
+}
+
+// Functions that never use their frame: drop "PUSH FP; MOV FP, SP" on
+// entry and "MOV SP, FP; POP FP" before each return
+static size_t target_leaf_frames(TargetCode *target) {
+    TargetInsn *code = target->code;
+    size_t kept = 0;
+    size_t fired = 0;
+
+    for (size_t start = 0; start < target->num_code;) {
+        size_t end = start + 1;
+        while (end < target->num_code && !is_function_label(&code[end])) end++;
+
+        bool leaf = is_function_label(&code[start]) && start + 2 < end &&
+                    code[start + 1].op == TARGET_PUSH && is_reg(code[start + 1].args[0], TARGET_FP) &&
+                    code[start + 2].op == TARGET_MOV && is_reg(code[start + 2].args[0], TARGET_FP) &&
+                    is_reg(code[start + 2].args[1], TARGET_SP);
+        for (size_t i = start + 3; leaf && i < end; i++) {
+            if (is_epilogue(code, i, end)) {
+                i++;
+            } else {
+                leaf = !uses_frame(&code[i]);
+            }
+        }
+
+        for (size_t i = start; i < end; i++) {
+            if (leaf && (i == start + 1 || i == start + 2)) continue;
+            if (leaf && is_epilogue(code, i, end)) {
+                i++;
+                continue;
+            }
+            code[kept++] = code[i];
+        }
+
+        if (leaf) fired++;
+        start = end;
+    }
+
+    target->num_code = kept;
+    return fired;
+}
+
+// Target code rules. Sliding rules are tried in order on every
+// instruction added; function rules run after them in each round.
+static const TargetRule target_rules[] = {
+    { "jump-thread", target_jump_thread, NULL },
+    { "push-pop", target_push_pop, NULL },
+    { "store-load", target_store_load, NULL },
+    { "move-self", target_move_self, NULL },
+    { "jump-next", target_jump_next, NULL },
+    { "dead-label", target_dead_label, NULL },
+    { "unreachable", target_unreachable, NULL },
+    { "leaf-frame", NULL, target_leaf_frames },
+};
+
+#define NUM_TARGET_RULES (sizeof(target_rules) / sizeof(target_rules[0]))
+
+// Add a target instruction to the kept code, applying rules until none fires
+static void target_feed(Peephole *p, TargetInsn insn) {
+    bool drop = p->drop;
+    int hops = p->hops;
+    p->drop = false;
+    p->hops = 0;
+
+    for (bool fired = true; fired && !p->drop;) {
+        fired = false;
+        for (size_t r = 0; r < NUM_TARGET_RULES && !fired; r++) {
+            if (target_rules[r].apply && target_rules[r].apply(p, &insn)) {
+                p->report->rules[r].fired++;
+                fired = true;
+            }
+        }
+    }
+    if (!p->drop) p->target[p->num_kept++] = insn;
+
+    p->drop = drop;
+    p->hops = hops;
+}
+
+// Count label references and find labels followed by a jump
+static void count_target(Peephole *p, const TargetCode *target) {
+    memset(p->refs, 0, sizeof(int) * (size_t)p->num_labels);
+    for (int l = 0; l < p->num_labels; l++) p->next[l] = -1;
+
+    for (size_t i = 0; i < target->num_code; i++) {
+        const TargetInsn *insn = &target->code[i];
+        if (insn->op == TARGET_JMP || insn->op == TARGET_JE) add_ref(p, insn->args[0].value, 1);
+
+        if (insn->op == TARGET_LABEL && label_index(p, insn->args[0].value) >= 0) {
+            size_t j = i + 1;
+            while (j < target->num_code && target->code[j].op == TARGET_LABEL) j++;
+            if (j < target->num_code && target->code[j].op == TARGET_JMP) {
+                p->next[insn->args[0].value.value] = label_index(p, target->code[j].args[0].value);
+            }
+        }
+    }
+}
+
+// Rewrite target code with the target rules until none fires. Labels are
+// numbered as in the program's TAC. The report may be NULL.
+bool peephole_target(TargetCode *target, const IRProgram *ir, PeepholeReport *report) {
+    PeepholeReport local_report;
+    if (!report) report = &local_report;
+
+    memset(report, 0, sizeof(*report));
+    report->code = "target";
+    report->insns_before = target->num_code;
+    report->num_rules = (int)NUM_TARGET_RULES;
+    for (size_t r = 0; r < NUM_TARGET_RULES; r++) report->rules[r].name = target_rules[r].name;
+
+    Peephole p;
+    memset(&p, 0, sizeof(p));
+    p.target = target->code;
+    p.num_labels = ir->num_labels;
+    p.report = report;
+    p.refs = (int*)malloc(sizeof(int) * ((size_t)ir->num_labels + 1));
+    p.next = (int*)malloc(sizeof(int) * ((size_t)ir->num_labels + 1));
+
+    bool ok = p.refs && p.next;
+    for (int round = 0; ok && round < PEEPHOLE_MAX_ROUNDS; round++) {
+        size_t fired = total_fired(report);
+        size_t count = target->num_code;
+
+        count_target(&p, target);
+        p.num_kept = 0;
+        for (size_t i = 0; i < count; i++) target_feed(&p, target->code[i]);
+        target->num_code = p.num_kept;
+
+        for (size_t r = 0; r < NUM_TARGET_RULES; r++) {
+            if (target_rules[r].function) report->rules[r].fired += target_rules[r].function(target);
+        }
+
+        report->rounds++;
+        if (total_fired(report) == fired) break;
+    }
+
+    free(p.refs);
+    free(p.next);
+
+    report->insns_after = target->num_code;
+    return ok;
+}
+
+// Add the report of a pass over part of the code to the report of the
+// whole. The rounds are those of the part that took the most, which is
+// what one pass over all of the code would have taken.
+void peephole_merge_report(PeepholeReport *report, const PeepholeReport *part) {
+    if (!report->code) {
+        *report = *part;
+        return;
+    }
+
+    report->insns_before += part->insns_before;
+    report->insns_after += part->insns_after;
+    if (part->rounds > report->rounds) report->rounds = part->rounds;
+    for (int i = 0; i < report->num_rules && i < part->num_rules; i++) {
+        report->rules[i].fired += part->rules[i].fired;
+    }
+}
+
+// Print how often each rule fired
+void peephole_print_report(const PeepholeReport *report, FILE *out) {
+    fprintf(out, "Peephole (%s code): %zu -> %zu instructions in %d rounds\n",
+            report->code, report->insns_before, report->insns_after, report->rounds);
+
+    fprintf(out, "  %-12s %7s\n", "rule", "fired");
+    for (int i = 0; i < report->num_rules; i++) {
+        fprintf(out, "  %-12s %7zu\n", report->rules[i].name, report->rules[i].fired);
+    }
+}
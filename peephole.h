@@ -0,0 +1,33 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "common.h"
+#include "ir.h"
+#include "target.h"
+
+// Most rules a rule table holds
+#define PEEPHOLE_MAX_RULES 12
+
+// How often one rule fired
+typedef struct {
+    const char *name;
+    size_t fired;
+} PeepholeRuleStats;
+
+// What the peephole pass did to one kind of code
+typedef struct {
+    const char *code;       // "stack" or "target"
+    size_t insns_before;
+    size_t insns_after;
+    int rounds;             // Passes over the code until nothing fired
+    int num_rules;
+    PeepholeRuleStats rules[PEEPHOLE_MAX_RULES];
+} PeepholeReport;
+
+// Peephole functions
+bool peephole_stack(IRProgram *ir, PeepholeReport *report);
+bool peephole_target(TargetCode *target, const IRProgram *ir, PeepholeReport *report);
+void peephole_merge_report(PeepholeReport *report, const PeepholeReport *part);
+void peephole_print_report(const PeepholeReport *report, FILE *out);
+
+#endif // PEEPHOLE_H
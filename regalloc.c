@@ -0,0 +1,557 @@
+#include "regalloc.h"
+#include "cfg.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Registers with fixed jobs: return values, and spilled operands
+#define REG_RESULT  0
+#define REG_SCRATCH 1
+#define REG_FIRST   2
+
+// Live range of one location over a function, in instruction positions:
+// instruction k reads at 2k and writes at 2k + 1
+typedef struct {
+    int local;
+    int start;
+    int end;
+    int reg;                // -1 once spilled
+    int slot;               // Frame slot of a spilled temporary
+} Interval;
+
+// Where an operand's value is: a register, or an immediate
+typedef struct {
+    bool in_reg;
+    int reg;
+    IROperand imm;
+} RegArg;
+
+// State for allocating and writing one function at a time
+typedef struct {
+    IRProgram *ir;
+    TargetCode *out;
+    RegAllocStats *stats;
+    int num_regs;
+    int *local_of;          // Location to function-local number, -1 between functions
+    long *location;         // Local to location
+    int num_locals;
+    Interval *intervals;    // By local
+    Interval **sorted;      // By start
+    size_t capacity;
+    int num_slots;
+} RegAlloc;
+
+// Operand of a target instruction
+static TargetArg arg_of(RegArg arg) {
+    return arg.in_reg ? target_reg(arg.reg) : target_imm(arg.imm);
+}
+
+// Memory home of a spilled location: a variable's own name, or a frame
+// slot for a temporary
+static TargetArg home_of(RegAlloc *ra, const Interval *interval) {
+    IROperand operand = { IR_VAR, 0 };
+    long loc = ra->location[interval->local];
+
+    if (loc < ra->ir->num_temps) return target_frame(interval->slot);
+    operand.value = loc - ra->ir->num_temps;
+    return target_mem(operand);
+}
+
+// Interval of an operand, or NULL for constants and literals
+static Interval* interval_of(RegAlloc *ra, IROperand operand) {
+    long loc = ir_location(ra->ir, operand);
+    return loc >= 0 ? &ra->intervals[ra->local_of[loc]] : NULL;
+}
+
+// Emit "OP a" or "OP a, b"
+static void emit(RegAlloc *ra, TargetOp op, TargetArg a, TargetArg b) {
+    target_emit(ra->out, op, a, b, target_none());
+}
+
+// Get an operand for reading, reloading it into scratch if it is spilled.
+// With in_reg, immediates are moved into scratch too.
+static RegArg read_operand(RegAlloc *ra, IROperand operand, int scratch, bool in_reg) {
+    RegArg arg = { false, 0, operand };
+    Interval *interval = interval_of(ra, operand);
+
+    if (interval && interval->reg >= 0) {
+        arg.in_reg = true;
+        arg.reg = interval->reg;
+        return arg;
+    }
+
+    if (interval) {
+        emit(ra, TARGET_LOAD, target_reg(scratch), home_of(ra, interval));
+        ra->stats->reloads++;
+    } else if (in_reg) {
+        emit(ra, TARGET_MOV, target_reg(scratch), target_imm(operand));
+    } else {
+        return arg;
+    }
+
+    arg.in_reg = true;
+    arg.reg = scratch;
+    return arg;
+}
+
+// Register an instruction should write its result to
+static int result_reg(RegAlloc *ra, IROperand dst) {
+    Interval *interval = interval_of(ra, dst);
+    return interval && interval->reg >= 0 ? interval->reg : REG_RESULT;
+}
+
+// Store a result computed in reg if its location is spilled
+static void write_result(RegAlloc *ra, IROperand dst, int reg) {
+    Interval *interval = interval_of(ra, dst);
+    if (!interval || interval->reg >= 0) return;
+
+    emit(ra, TARGET_STORE, home_of(ra, interval), target_reg(reg));
+    ra->stats->spill_stores++;
+}
+
+// Emit "OP Rd, a" or "OP Rd, a, b"
+static void write_insn(RegAlloc *ra, TargetOp op, int dst, RegArg a, const RegArg *b) {
+    target_emit(ra->out, op, target_reg(dst), arg_of(a), b ? arg_of(*b) : target_none());
+}
+
+// Function epilogue
+static void write_epilogue(RegAlloc *ra) {
+    emit(ra, TARGET_MOV, target_reg(TARGET_SP), target_reg(TARGET_FP));
+    emit(ra, TARGET_POP, target_reg(TARGET_FP), target_none());
+    emit(ra, TARGET_RET, target_none(), target_none());
+}
+
+// Number the locations a function touches
+static bool number_locals(RegAlloc *ra, const CFG *cfg) {
+    IRInsn *code = ra->ir->code;
+    size_t length = cfg->func_end - cfg->func_start;
+
+    if (length * 3 > ra->capacity) {
+        size_t capacity = length * 3;
+        long *location = (long*)realloc(ra->location, sizeof(long) * capacity);
+        if (location) ra->location = location;
+        Interval *intervals = (Interval*)realloc(ra->intervals, sizeof(Interval) * capacity);
+        if (intervals) ra->intervals = intervals;
+        Interval **sorted = (Interval**)realloc(ra->sorted, sizeof(Interval*) * capacity);
+        if (sorted) ra->sorted = sorted;
+        if (!location || !intervals || !sorted) return false;
+        ra->capacity = capacity;
+    }
+
+    ra->num_locals = 0;
+    for (size_t i = cfg->func_start + 1; i < cfg->func_end; i++) {
+        IROperand *operands[3];
+        int n = ir_insn_uses(&code[i], operands);
+        if (ir_insn_defines(&code[i])) operands[n++] = &code[i].dst;
+
+        for (int k = 0; k < n; k++) {
+            long loc = ir_location(ra->ir, *operands[k]);
+            if (loc < 0 || ra->local_of[loc] >= 0) continue;
+
+            ra->local_of[loc] = ra->num_locals;
+            ra->location[ra->num_locals] = loc;
+            ra->intervals[ra->num_locals].local = ra->num_locals;
+            ra->intervals[ra->num_locals].start = INT_MAX;
+            ra->intervals[ra->num_locals].end = -1;
+            ra->num_locals++;
+        }
+    }
+
+    return true;
+}
+
+// Grow an interval to cover a position
+static void cover(Interval *interval, int pos) {
+    if (pos < interval->start) interval->start = pos;
+    if (pos > interval->end) interval->end = pos;
+}
+
+// Grow the interval of every local in a bit set to cover a position
+static void cover_set(RegAlloc *ra, const uint64_t *set, size_t words, int pos) {
+    for (size_t w = 0; w < words; w++) {
+        for (uint64_t bits = set[w]; bits; bits &= bits - 1) {
+            cover(&ra->intervals[w * 64 + (size_t)__builtin_ctzll(bits)], pos);
+        }
+    }
+}
+
+// Liveness by blocks (a location is live where a later read may see its
+// current value), then one interval per location spanning everywhere it
+// is live. Returns the locals live on entry to the function in entry_live.
+static bool build_intervals(RegAlloc *ra, const CFG *cfg, uint64_t **entry_live, size_t *num_words) {
+    IRInsn *code = ra->ir->code;
+    size_t first = cfg->func_start + 1;
+    size_t words = ((size_t)ra->num_locals + 63) / 64;
+    size_t n = (size_t)cfg->num_blocks;
+
+    // use, def, live-in and live-out sets of each block, side by side
+    uint64_t *sets = (uint64_t*)calloc(n * 4 * words + 1, sizeof(uint64_t));
+    if (!sets) return false;
+
+#define BLOCK_SET(b, k) (sets + ((size_t)(b) * 4 + (k)) * words)
+
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        uint64_t *use = BLOCK_SET(b, 0);
+        uint64_t *def = BLOCK_SET(b, 1);
+
+        for (size_t i = cfg->blocks[b].start; i < cfg->blocks[b].end; i++) {
+            IROperand *operands[2];
+            int count = ir_insn_uses(&code[i], operands);
+            for (int k = 0; k < count; k++) {
+                long loc = ir_location(ra->ir, *operands[k]);
+                if (loc < 0) continue;
+                int local = ra->local_of[loc];
+                if (!(def[local / 64] >> (local % 64) & 1)) use[local / 64] |= 1ULL << (local % 64);
+            }
+            if (ir_insn_defines(&code[i])) {
+                long loc = ir_location(ra->ir, code[i].dst);
+                if (loc >= 0) def[ra->local_of[loc] / 64] |= 1ULL << (ra->local_of[loc] % 64);
+            }
+        }
+    }
+
+    // Solve backwards until nothing changes; blocks are visited last to
+    // first since most edges go forward
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (int b = cfg->num_blocks; b-- > 0;) {
+            const CFGBlock *block = &cfg->blocks[b];
+            uint64_t *use = BLOCK_SET(b, 0);
+            uint64_t *def = BLOCK_SET(b, 1);
+            uint64_t *in = BLOCK_SET(b, 2);
+            uint64_t *out = BLOCK_SET(b, 3);
+
+            for (size_t w = 0; w < words; w++) {
+                uint64_t live = 0;
+                for (int s = 0; s < block->num_succ; s++) live |= BLOCK_SET(block->succ[s], 2)[w];
+                out[w] = live;
+
+                uint64_t live_in = use[w] | (live & ~def[w]);
+                if (live_in != in[w]) {
+                    in[w] = live_in;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    for (int b = 0; b < cfg->num_blocks; b++) {
+        const CFGBlock *block = &cfg->blocks[b];
+        int start = (int)(block->start - first) * 2;
+        int end = block->end > block->start ? (int)(block->end - first) * 2 - 1 : start;
+
+        cover_set(ra, BLOCK_SET(b, 2), words, start);
+        cover_set(ra, BLOCK_SET(b, 3), words, end);
+
+        // Arguments stay live until the call that pushes them
+        int call_pos = -1;
+        for (size_t i = block->end; i-- > block->start;) {
+            int pos = (int)(i - first) * 2;
+            if (code[i].op == IR_CALL) call_pos = pos;
+
+            IROperand *operands[2];
+            int count = ir_insn_uses(&code[i], operands);
+            for (int k = 0; k < count; k++) {
+                Interval *interval = interval_of(ra, *operands[k]);
+                if (interval) cover(interval, code[i].op == IR_PARAM && call_pos >= 0 ? call_pos : pos);
+            }
+            if (ir_insn_defines(&code[i])) {
+                Interval *interval = interval_of(ra, code[i].dst);
+                if (interval) cover(interval, pos + 1);
+            }
+        }
+    }
+
+#undef BLOCK_SET
+
+    // Keep the entry block's live-in set for the prologue
+    *num_words = words;
+    *entry_live = (uint64_t*)malloc(sizeof(uint64_t) * (words + 1));
+    if (*entry_live) memcpy(*entry_live, sets + 2 * words, sizeof(uint64_t) * words);
+
+    free(sets);
+    return *entry_live != NULL;
+}
+
+// Order intervals by start
+static int compare_start(const void *a, const void *b) {
+    const Interval *x = *(Interval *const *)a;
+    const Interval *y = *(Interval *const *)b;
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    return x->local - y->local;
+}
+
+// Linear-scan allocation (Poletto and Sarkar): walk the intervals by start,
+// freeing the registers of intervals that have ended; when none is free,
+// keep in memory whichever live interval ends last
+static void linear_scan(RegAlloc *ra) {
+    Interval *active[REGALLOC_MAX_REGS];
+    int free_regs[REGALLOC_MAX_REGS];
+    int num_active = 0;
+    int num_free = 0;
+
+    for (int r = ra->num_regs - 1; r >= REG_FIRST; r--) free_regs[num_free++] = r;
+
+    for (int i = 0; i < ra->num_locals; i++) ra->sorted[i] = &ra->intervals[i];
+    qsort(ra->sorted, (size_t)ra->num_locals, sizeof(Interval*), compare_start);
+
+    ra->num_slots = 0;
+    for (int i = 0; i < ra->num_locals; i++) {
+        Interval *current = ra->sorted[i];
+        current->slot = 0;
+
+        // active is kept sorted by end
+        int expired = 0;
+        while (expired < num_active && active[expired]->end < current->start) {
+            free_regs[num_free++] = active[expired++]->reg;
+        }
+        memmove(active, active + expired, sizeof(Interval*) * (size_t)(num_active - expired));
+        num_active -= expired;
+
+        Interval *spilled = NULL;
+        if (num_free > 0) {
+            current->reg = free_regs[--num_free];
+        } else if (num_active > 0 && active[num_active - 1]->end > current->end) {
+            spilled = active[--num_active];
+            current->reg = spilled->reg;
+            spilled->reg = -1;
+        } else {
+            spilled = current;
+            current->reg = -1;
+        }
+
+        if (spilled) {
+            ra->stats->num_spilled++;
+            if (ra->location[spilled->local] < ra->ir->num_temps) spilled->slot = ++ra->num_slots;
+        }
+
+        if (current->reg >= 0) {
+            int at = num_active++;
+            while (at > 0 && active[at - 1]->end > current->end) {
+                active[at] = active[at - 1];
+                at--;
+            }
+            active[at] = current;
+        }
+    }
+
+    ra->stats->num_intervals += (size_t)ra->num_locals;
+}
+
+// Write a call: save the registers whose values outlive it, push the
+// arguments (last first) and move the result out of R0
+static void write_call(RegAlloc *ra, const IRInsn *insn, size_t first_param, size_t num_params,
+                       Interval **owner, int pos) {
+    int saved[REGALLOC_MAX_REGS];
+    int num_saved = 0;
+    Interval *dst = interval_of(ra, insn->dst);
+
+    for (int r = REG_FIRST; r < ra->num_regs; r++) {
+        Interval *interval = owner[r];
+        if (interval && interval != dst && interval->reg == r &&
+            interval->start <= pos && interval->end > pos + 1) {
+            saved[num_saved++] = r;
+        }
+    }
+
+    for (int s = 0; s < num_saved; s++) emit(ra, TARGET_PUSH, target_reg(saved[s]), target_none());
+    ra->stats->call_saves += (size_t)num_saved;
+
+    while (num_params > 0) {
+        RegArg arg = read_operand(ra, ra->ir->code[first_param + --num_params].src1, REG_RESULT, true);
+        emit(ra, TARGET_PUSH, target_reg(arg.reg), target_none());
+    }
+
+    emit(ra, TARGET_CALL, target_imm(insn->src1), target_none());
+
+    if (insn->dst.kind != IR_NONE) {
+        int reg = result_reg(ra, insn->dst);
+        if (reg != REG_RESULT) {
+            RegArg result = { true, REG_RESULT, ir_none() };
+            write_insn(ra, TARGET_MOV, reg, result, NULL);
+        }
+        write_result(ra, insn->dst, REG_RESULT);
+    }
+
+    for (int s = num_saved; s-- > 0;) emit(ra, TARGET_POP, target_reg(saved[s]), target_none());
+}
+
+// Write the register code of one function
+static void write_function(RegAlloc *ra, const CFG *cfg, const uint64_t *entry_live, size_t words) {
+    IRInsn *code = ra->ir->code;
+    size_t first = cfg->func_start + 1;
+    Interval *owner[REGALLOC_MAX_REGS] = { NULL };
+    int next = 0;
+    size_t first_param = 0;
+    size_t num_params = 0;
+
+    TargetArg sp = target_reg(TARGET_SP);
+    TargetArg fp = target_reg(TARGET_FP);
+
+    emit(ra, TARGET_LABEL, target_imm(code[cfg->func_start].src1), target_none());
+    emit(ra, TARGET_PUSH, fp, target_none());
+    emit(ra, TARGET_MOV, fp, sp);
+    if (ra->num_slots > 0) {
+        target_emit(ra->out, TARGET_SUB, sp, sp, target_imm(ir_const(ra->num_slots)));
+    }
+
+    // Variables read before being set (parameters) start in their homes
+    for (size_t w = 0; w < words; w++) {
+        for (uint64_t bits = entry_live[w]; bits; bits &= bits - 1) {
+            Interval *interval = &ra->intervals[w * 64 + (size_t)__builtin_ctzll(bits)];
+            if (interval->reg < 0 || ra->location[interval->local] < ra->ir->num_temps) continue;
+
+            emit(ra, TARGET_LOAD, target_reg(interval->reg), home_of(ra, interval));
+        }
+    }
+
+    for (size_t i = first; i < cfg->func_end; i++) {
+        const IRInsn *insn = &code[i];
+        int pos = (int)(i - first) * 2;
+
+        // Track which interval holds each register at this point
+        while (next < ra->num_locals && ra->sorted[next]->start <= pos + 1) {
+            Interval *interval = ra->sorted[next++];
+            if (interval->reg >= 0) owner[interval->reg] = interval;
+        }
+
+        switch (insn->op) {
+            case IR_NOP:
+            case IR_FUNCTION:
+            case IR_END_FUNCTION:
+            case IR_OPCODE_COUNT:
+                break;
+            case IR_LABEL_DEF:
+                emit(ra, TARGET_LABEL, target_imm(insn->src1), target_none());
+                break;
+            case IR_COPY: {
+                int reg = result_reg(ra, insn->dst);
+                RegArg a = read_operand(ra, insn->src1, REG_RESULT, false);
+                if (reg == REG_RESULT && a.in_reg) {
+                    write_result(ra, insn->dst, a.reg);
+                    break;
+                }
+                if (!a.in_reg || a.reg != reg) write_insn(ra, TARGET_MOV, reg, a, NULL);
+                write_result(ra, insn->dst, reg);
+                break;
+            }
+            case IR_PARAM:
+                if (num_params == 0) first_param = i;
+                num_params++;
+                break;
+            case IR_CALL:
+                write_call(ra, insn, first_param, num_params, owner, pos);
+                num_params = 0;
+                break;
+            case IR_JUMP:
+                emit(ra, TARGET_JMP, target_imm(insn->src1), target_none());
+                break;
+            case IR_JUMP_ZERO: {
+                RegArg a = read_operand(ra, insn->src1, REG_RESULT, true);
+                emit(ra, TARGET_CMP, target_reg(a.reg), target_imm(ir_const(0)));
+                emit(ra, TARGET_JE, target_imm(insn->src2), target_none());
+                break;
+            }
+            case IR_RETURN:
+                if (insn->src1.kind != IR_NONE) {
+                    RegArg a = read_operand(ra, insn->src1, REG_RESULT, false);
+                    if (!a.in_reg || a.reg != REG_RESULT) write_insn(ra, TARGET_MOV, REG_RESULT, a, NULL);
+                }
+                write_epilogue(ra);
+                break;
+            default: {
+                int reg = result_reg(ra, insn->dst);
+                RegArg a = read_operand(ra, insn->src1, REG_RESULT, true);
+                if (IR_IS_UNARY(insn->op)) {
+                    write_insn(ra, (TargetOp)(TARGET_NEG + (insn->op - IR_NEG)), reg, a, NULL);
+                } else {
+                    RegArg b = read_operand(ra, insn->src2, REG_SCRATCH, false);
+                    write_insn(ra, (TargetOp)(TARGET_ADD + (insn->op - IR_ADD)), reg, a, &b);
+                }
+                write_result(ra, insn->dst, reg);
+                break;
+            }
+        }
+    }
+
+    write_epilogue(ra);
+    emit(ra, TARGET_END_FUNC, target_none(), target_none());
+}
+
+// Allocate registers for every function and append register-to-register
+// target code for it
+bool regalloc_lower(TargetCode *out, IRProgram *ir, int num_regs, RegAllocStats *stats) {
+    RegAllocStats local_stats;
+    if (!stats) stats = &local_stats;
+    memset(stats, 0, sizeof(*stats));
+    stats->num_regs = num_regs;
+
+    if (num_regs < REGALLOC_MIN_REGS || num_regs > REGALLOC_MAX_REGS) return false;
+
+    RegAlloc ra;
+    memset(&ra, 0, sizeof(ra));
+    ra.ir = ir;
+    ra.out = out;
+    ra.stats = stats;
+    ra.num_regs = num_regs;
+
+    size_t num_locations = ir_num_locations(ir);
+    ra.local_of = (int*)malloc(sizeof(int) * (num_locations + 1));
+    bool ok = ra.local_of != NULL;
+    for (size_t i = 0; ok && i < num_locations; i++) ra.local_of[i] = -1;
+
+    for (size_t i = 0; ok && i < ir->num_code; i++) {
+        if (ir->code[i].op != IR_FUNCTION) continue;
+
+        CFG *cfg = cfg_build(ir, i);
+        uint64_t *entry_live = NULL;
+        size_t words = 0;
+
+        ok = cfg && number_locals(&ra, cfg) && build_intervals(&ra, cfg, &entry_live, &words);
+        if (ok) {
+            linear_scan(&ra);
+            write_function(&ra, cfg, entry_live, words);
+        }
+
+        for (int l = 0; cfg && l < ra.num_locals; l++) ra.local_of[ra.location[l]] = -1;
+        ra.num_locals = 0;
+        if (cfg) i = cfg->func_end;
+        free(entry_live);
+        cfg_free(cfg);
+    }
+
+    free(ra.local_of);
+    free(ra.location);
+    free(ra.intervals);
+    free(ra.sorted);
+    return ok && !out->failed;
+}
+
+// Write the summary of an allocation that ends the target code
+void regalloc_write_summary(OutBuf *out, const RegAllocStats *stats) {
+    outbuf_puts(out, "; Registers: R0-R");
+    outbuf_int(out, stats->num_regs - 1);
+    outbuf_puts(out, " (R0 results, R0-R1 spill scratch)\n; Live intervals: ");
+    outbuf_int(out, (long)stats->num_intervals);
+    outbuf_puts(out, ", spilled: ");
+    outbuf_int(out, (long)stats->num_spilled);
+    outbuf_puts(out, ", spill stores: ");
+    outbuf_int(out, (long)stats->spill_stores);
+    outbuf_puts(out, ", reloads: ");
+    outbuf_int(out, (long)stats->reloads);
+    outbuf_puts(out, ", call saves: ");
+    outbuf_int(out, (long)stats->call_saves);
+    outbuf_putc(out, '\n');
+}
+
+// Print what register allocation did
+void regalloc_print_stats(const RegAllocStats *stats, FILE *out) {
+    fprintf(out, "Register allocation (%d registers): %zu intervals, %zu spilled, "
+            "%zu spill stores, %zu reloads, %zu call saves\n",
+            stats->num_regs, stats->num_intervals, stats->num_spilled,
+            stats->spill_stores, stats->reloads, stats->call_saves);
+}
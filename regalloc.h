@@ -0,0 +1,29 @@
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include "common.h"
+#include "ir.h"
+#include "outbuf.h"
+#include "target.h"
+
+// Register file sizes --regs accepts. R0 carries return values and R0 and
+// R1 carry spilled operands, so the allocator hands out R2 and up.
+#define REGALLOC_MIN_REGS 3
+#define REGALLOC_MAX_REGS 64
+
+// What register allocation did over a whole program
+typedef struct {
+    int num_regs;
+    size_t num_intervals;   // Live intervals (one per location per function)
+    size_t num_spilled;     // Intervals left in memory
+    size_t spill_stores;    // Stores of spilled results
+    size_t reloads;         // Loads of spilled operands
+    size_t call_saves;      // Registers saved and restored around calls
+} RegAllocStats;
+
+// Register allocation functions
+bool regalloc_lower(TargetCode *out, IRProgram *ir, int num_regs, RegAllocStats *stats);
+void regalloc_write_summary(OutBuf *out, const RegAllocStats *stats);
+void regalloc_print_stats(const RegAllocStats *stats, FILE *out);
+
+#endif // REGALLOC_H
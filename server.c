@@ -0,0 +1,372 @@
+#include "server.h"
+#include "driver.h"
+#include "session.h"
+#include "arena.h"
+#include "opt.h"
+#include "regalloc.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Read exactly length bytes. *eof is set if the stream ended before the
+// first byte.
+static bool read_full(int fd, void *data, size_t length, bool *eof) {
+    char *bytes = (char*)data;
+    size_t done = 0;
+    *eof = false;
+
+    while (done < length) {
+        ssize_t n = read(fd, bytes + done, length - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            *eof = n == 0 && done == 0;
+            return false;
+        }
+        done += (size_t)n;
+    }
+    return true;
+}
+
+// Write all of a buffer
+static bool write_full(int fd, const void *data, size_t length) {
+    const char *bytes = (const char*)data;
+    size_t done = 0;
+
+    while (done < length) {
+        ssize_t n = write(fd, bytes + done, length - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += (size_t)n;
+    }
+    return true;
+}
+
+// Read one message into a new NUL-terminated buffer
+static bool read_message(int fd, char **data, size_t *length, bool *eof) {
+    unsigned char prefix[4];
+    *data = NULL;
+    if (!read_full(fd, prefix, sizeof(prefix), eof)) return false;
+
+    uint32_t size = (uint32_t)prefix[0] | (uint32_t)prefix[1] << 8 |
+                    (uint32_t)prefix[2] << 16 | (uint32_t)prefix[3] << 24;
+    if (size > SERVER_MAX_MESSAGE) {
+        fprintf(stderr, "Error: Request message of %u bytes is too large\n", size);
+        return false;
+    }
+
+    *data = (char*)malloc((size_t)size + 1);
+    if (!*data) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+
+    bool ended;
+    if (!read_full(fd, *data, size, &ended)) {
+        free(*data);
+        *data = NULL;
+        return false;
+    }
+
+    (*data)[size] = '\0';
+    *length = size;
+    return true;
+}
+
+// Write one message
+static bool write_message(int fd, const char *data, size_t length) {
+    unsigned char prefix[4] = {
+        (unsigned char)length, (unsigned char)(length >> 8),
+        (unsigned char)(length >> 16), (unsigned char)(length >> 24)
+    };
+    return write_full(fd, prefix, sizeof(prefix)) && write_full(fd, data, length);
+}
+
+// Parse a number in [min, max]
+static bool parse_int(const char *text, long min, long max, long *value) {
+    char *end;
+    *value = strtol(text, &end, 10);
+    return *text != '\0' && *end == '\0' && *value >= min && *value <= max;
+}
+
+// What a request asks for besides the compiler settings
+typedef struct {
+    char *emit;             // Artifacts to return, or NULL for the defaults
+    bool edit;              // The source is an edit of the previous program
+    size_t offset;          // Where the edit starts
+    size_t removed;         // Bytes it replaces
+} Request;
+
+// Parse an edit: "<offset>,<removed>"
+static bool parse_edit(const char *text, Request *request) {
+    char *end;
+    if (*text < '0' || *text > '9') return false;
+    request->offset = (size_t)strtoull(text, &end, 10);
+    if (*end != ',' || end[1] < '0' || end[1] > '9') return false;
+    request->removed = (size_t)strtoull(end + 1, &end, 10);
+    request->edit = true;
+    return *end == '\0';
+}
+
+// Apply one "key=value" line of a request header to the configuration
+static bool apply_option(CompilerConfig *config, char *line, Request *request, FILE *err) {
+    char *value = strchr(line, '=');
+    if (!value) {
+        fprintf(err, "Error: Malformed request line '%s'\n", line);
+        return false;
+    }
+    *value++ = '\0';
+
+    long number;
+    if (strcmp(line, "name") == 0) {
+        config->input_file = value;
+    } else if (strcmp(line, "parser") == 0 && strcmp(value, "rd") == 0) {
+        config->parser_type = PARSER_RD;
+    } else if (strcmp(line, "parser") == 0 && strcmp(value, "lalr") == 0) {
+        config->parser_type = PARSER_LALR;
+    } else if (strcmp(line, "format") == 0 && strcmp(value, "text") == 0) {
+        config->format = FORMAT_TEXT;
+    } else if (strcmp(line, "format") == 0 && strcmp(value, "bin") == 0) {
+        config->format = FORMAT_BIN;
+    } else if (strcmp(line, "compact-json") == 0 && parse_int(value, 0, 1, &number)) {
+        config->compact_json = number != 0;
+    } else if (strcmp(line, "opt") == 0 && parse_int(value, 0, OPT_MAX_LEVEL, &number)) {
+        config->opt_level = (int)number;
+    } else if (strcmp(line, "regs") == 0 && parse_int(value, 0, REGALLOC_MAX_REGS, &number) &&
+               (number == 0 || number >= REGALLOC_MIN_REGS)) {
+        config->num_regs = (int)number;
+    } else if (strcmp(line, "max-errors") == 0 && parse_int(value, 0, 1L << 30, &number)) {
+        config->max_errors = (size_t)number;
+    } else if (strcmp(line, "emit") == 0) {
+        request->emit = value;
+    } else if (strcmp(line, "edit") == 0 && parse_edit(value, request)) {
+        // The source message holds the inserted text
+    } else {
+        fprintf(err, "Error: Invalid request option %s=%s\n", line, value);
+        return false;
+    }
+    return true;
+}
+
+// Compile one request and send the reply. Each request's program is kept
+// in the connection's session, so the next request may edit it. Returns
+// false if the reply could not be sent.
+static bool serve_request(const CompilerConfig *defaults, Arena *arena, CompileSession *session, int fd,
+                          char *header, const char *source, size_t source_length) {
+    CompilerConfig config = *defaults;
+    config.input_file = "<source>";
+    config.run = false;
+    config.jit = false;
+    config.verbose = false;
+
+    char *messages = NULL;
+    size_t messages_size = 0;
+    FILE *err = open_memstream(&messages, &messages_size);
+    if (!err) return false;
+
+    // Options, one per line
+    Request request = { NULL, false, 0, 0 };
+    bool ok = true;
+    for (char *line = strtok(header, "\n"); line && ok; line = strtok(NULL, "\n")) {
+        size_t length = strlen(line);
+        if (length > 0 && line[length - 1] == '\r') line[--length] = '\0';
+        if (length > 0) ok = apply_option(&config, line, &request, err);
+    }
+
+    bool wanted[ARTIFACT_COUNT];
+    if (request.emit || config.emit) {
+        ok = ok && driver_parse_artifacts(request.emit ? request.emit : config.emit, wanted, err);
+    } else {
+        driver_default_artifacts(config.format, wanted);
+    }
+
+    // Each wanted artifact is written to memory
+    char *data[ARTIFACT_COUNT] = { NULL };
+    size_t sizes[ARTIFACT_COUNT] = { 0 };
+    FILE *streams[ARTIFACT_COUNT] = { NULL };
+    OutBuf *outs[ARTIFACT_COUNT] = { NULL };
+    for (int kind = 0; ok && kind < ARTIFACT_COUNT; kind++) {
+        if (!wanted[kind]) continue;
+        streams[kind] = open_memstream(&data[kind], &sizes[kind]);
+        outs[kind] = outbuf_wrap(streams[kind]);
+        if (!outs[kind]) {
+            fprintf(err, "Error: Memory allocation failed\n");
+            ok = false;
+        }
+    }
+
+    // A whole program is compiled from the request itself, in the warm
+    // arena; an edit is compiled from the session
+    memset(&session->stats, 0, sizeof(session->stats));
+    session->cache.hits = 0;
+    session->cache.misses = 0;
+    if (ok && request.edit) {
+        ok = session_edit(session, request.offset, request.removed, source, source_length, err);
+    } else if (ok && !session_open(session, source, source_length)) {
+        fprintf(err, "Error: Memory allocation failed\n");
+        ok = false;
+    }
+
+    if (ok) {
+        DriverJob job;
+        driver_job_init(&job);
+        if (request.edit) {
+            job.session = session;
+        } else {
+            job.source = source;
+            job.source_length = source_length;
+        }
+        job.arena = arena;
+        job.out = err;
+        job.err = err;
+        job.artifacts = outs;
+        ok = driver_compile(&config, &job);
+    }
+
+    // Reply header, listing every wanted artifact; the ones a failed
+    // compilation did not reach are empty
+    char reply[512];
+    int length = snprintf(reply, sizeof(reply), "status=%s\nartifacts=", ok ? "ok" : "error");
+    bool first = true;
+    for (int kind = 0; kind < ARTIFACT_COUNT; kind++) {
+        if (!outs[kind]) continue;
+        length += snprintf(reply + length, sizeof(reply) - (size_t)length, "%s%s",
+                           first ? "" : ",", driver_artifact_name((ArtifactKind)kind));
+        first = false;
+    }
+    length += snprintf(reply + length, sizeof(reply) - (size_t)length, "\n");
+    if (request.edit) {
+        length += snprintf(reply + length, sizeof(reply) - (size_t)length,
+                           "lexed=%zu\nparsed=%zu\nreused=%zu\ngenerated=%zu\n",
+                           session->stats.tokens_lexed, session->stats.functions_parsed,
+                           session->cache.hits, session->cache.misses);
+    }
+
+    for (int kind = 0; kind < ARTIFACT_COUNT; kind++) {
+        if (outs[kind]) outbuf_close(outs[kind]);
+        if (streams[kind]) fclose(streams[kind]);
+    }
+    fclose(err);
+
+    bool sent = write_message(fd, reply, (size_t)length);
+    for (int kind = 0; kind < ARTIFACT_COUNT; kind++) {
+        if (outs[kind]) sent = sent && write_message(fd, data[kind], sizes[kind]);
+        free(data[kind]);
+    }
+    sent = sent && write_message(fd, messages, messages_size);
+    free(messages);
+    return sent;
+}
+
+// Answer requests on a connection until it is closed
+static bool serve_connection(const CompilerConfig *config, Arena *arena, int in, int out) {
+    CompileSession *session = session_create();
+    if (!session) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+
+    bool ok = true;
+    for (;;) {
+        char *header;
+        char *source;
+        size_t header_length;
+        size_t source_length;
+        bool eof;
+
+        if (!read_message(in, &header, &header_length, &eof)) {
+            ok = eof;
+            break;
+        }
+        if (!read_message(in, &source, &source_length, &eof)) {
+            fprintf(stderr, "Error: Request without source\n");
+            free(header);
+            ok = false;
+            break;
+        }
+
+        bool sent = serve_request(config, arena, session, out, header, source, source_length);
+        free(header);
+        free(source);
+        if (!sent) {
+            ok = false;
+            break;
+        }
+    }
+
+    session_free(session);
+    return ok;
+}
+
+// Listen on a Unix socket, replacing any stale socket file
+static int listen_on(const char *path) {
+    struct sockaddr_un address;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error: Socket path '%s' is too long\n", path);
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Could not create a socket\n");
+        return -1;
+    }
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 16) != 0) {
+        fprintf(stderr, "Error: Could not listen on '%s'\n", path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Answer compile requests on stdin and stdout until stdin ends, or on a
+// Unix socket, one connection after another, until the process is
+// stopped. The process stays up between requests, and so does the AST
+// arena, which is reset rather than freed after each one.
+bool server_run(const CompilerConfig *config) {
+    // A client that goes away mid-reply must not end the server
+    signal(SIGPIPE, SIG_IGN);
+
+    Arena *arena = arena_create(ARENA_DEFAULT_CHUNK_SIZE);
+    if (!arena) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+
+    bool ok;
+    if (!config->socket_path) {
+        ok = serve_connection(config, arena, STDIN_FILENO, STDOUT_FILENO);
+    } else {
+        int listener = listen_on(config->socket_path);
+        ok = listener >= 0;
+
+        while (ok) {
+            int fd = accept(listener, NULL, NULL);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                fprintf(stderr, "Error: Could not accept a connection\n");
+                ok = false;
+                break;
+            }
+
+            // A broken connection only ends that client's session
+            serve_connection(config, arena, fd, fd);
+            close(fd);
+        }
+
+        if (listener >= 0) close(listener);
+    }
+
+    arena_destroy(arena);
+    return ok;
+}
@@ -0,0 +1,26 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "common.h"
+#include <stdint.h>
+
+// Largest message a request may contain
+#define SERVER_MAX_MESSAGE ((uint32_t)1 << 30)
+
+// Compile server protocol. Every message is a 4-byte little-endian length
+// followed by that many bytes.
+//
+// A request is two messages: a header of "key=value" lines and the source
+// text. The keys are name (used in error messages), parser, opt, regs,
+// format, compact-json, max-errors and emit, a comma-separated list of
+// artifacts such as "tokens,ast-json,tac"; missing keys keep the server's
+// command-line settings.
+//
+// The reply is a header message holding "status=ok" or "status=error" and
+// "artifacts=<list>", then one message per listed artifact in that order,
+// then one message with the compiler's diagnostics.
+
+// Server functions
+bool server_run(const CompilerConfig *config);
+
+#endif // SERVER_H
@@ -0,0 +1,432 @@
+#include "session.h"
+#include "parser_rd.h"
+#include "ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Create a session with an empty program
+CompileSession* session_create(void) {
+    CompileSession *session = (CompileSession*)calloc(1, sizeof(CompileSession));
+    if (!session) return NULL;
+
+    // The lexer needs a buffer even for an empty program
+    session->capacity = 64;
+    session->text = (char*)malloc(session->capacity);
+    if (!session->text) {
+        free(session);
+        return NULL;
+    }
+
+    codegen_cache_init(&session->cache);
+    return session;
+}
+
+// Free the AST and everything derived from it
+static void drop_ast(CompileSession *session) {
+    ast_free_node(session->ast);
+    session->ast = NULL;
+    free(session->items);
+    session->items = NULL;
+    session->num_items = 0;
+    session->dirty = false;
+
+    // The nodes the cache knew are gone, and their addresses may come back
+    codegen_cache_clear(&session->cache);
+}
+
+// Free the session
+void session_free(CompileSession *session) {
+    if (!session) return;
+
+    drop_ast(session);
+    lexer_free(session->lexer);
+    free(session->text);
+    free(session);
+}
+
+// Make room for a text of a given length
+static bool reserve_text(CompileSession *session, size_t length) {
+    if (length < session->capacity) return true;
+
+    size_t capacity = session->capacity;
+    while (capacity <= length) capacity *= 2;
+
+    char *text = (char*)realloc(session->text, capacity);
+    if (!text) return false;
+
+    session->text = text;
+    session->capacity = capacity;
+    return true;
+}
+
+// Start over with a whole new program. It is lexed and parsed when it is
+// first compiled.
+bool session_open(CompileSession *session, const char *text, size_t length) {
+    drop_ast(session);
+    lexer_free(session->lexer);
+    session->lexer = NULL;
+
+    if (!reserve_text(session, length)) {
+        session->length = 0;
+        return false;
+    }
+
+    memcpy(session->text, text, length);
+    session->length = length;
+    return true;
+}
+
+// Where a token index before an edit is afterwards: a range start inside
+// the changed tokens moves to their start, a range end to their end
+static size_t map_start(size_t index, const TokenEdit *edit) {
+    if (index <= edit->first) return index;
+    if (index >= edit->first + edit->removed) return index - edit->removed + edit->inserted;
+    return edit->first;
+}
+
+static size_t map_end(size_t index, const TokenEdit *edit) {
+    if (index <= edit->first) return index;
+    if (index >= edit->first + edit->removed) return index - edit->removed + edit->inserted;
+    return edit->first + edit->inserted;
+}
+
+// Check if a function has to be parsed again: an edit changed its tokens,
+// or it overlaps the changed range or lies within it
+static bool item_is_dirty(const SessionItem *item, size_t dirty_first, size_t dirty_end) {
+    return item->changed || (item->first < dirty_end && item->end > dirty_first) ||
+           (item->first >= dirty_first && item->end <= dirty_end);
+}
+
+// Replace functions [first, stop) of the AST with count new ones
+static bool replace_items(CompileSession *session, size_t first, size_t stop, ASTNode **nodes,
+                          const SessionItem *items, size_t count) {
+    ASTNode *program = session->ast;
+    size_t old_count = stop - first;
+    size_t num_children = (size_t)program->num_children - old_count + count;
+    size_t num_items = session->num_items - old_count + count;
+
+    if (num_children > (size_t)program->capacity) {
+        ASTNode **children = (ASTNode**)realloc(program->children, sizeof(ASTNode*) * num_children);
+        if (!children) return false;
+        program->children = children;
+        program->capacity = (int)num_children;
+    }
+
+    SessionItem *grown = (SessionItem*)realloc(session->items, sizeof(SessionItem) * (num_items + 1));
+    if (!grown) return false;
+    session->items = grown;
+
+    for (size_t i = first; i < stop; i++) {
+        codegen_cache_forget(&session->cache, program->children[i]);
+        ast_free_node(program->children[i]);
+    }
+
+    size_t tail = session->num_items - (first + old_count);
+    if (tail > 0) {
+        memmove(&program->children[first + count], &program->children[first + old_count], sizeof(ASTNode*) * tail);
+        memmove(&session->items[first + count], &session->items[first + old_count], sizeof(SessionItem) * tail);
+    }
+    if (count > 0) {
+        memcpy(&program->children[first], nodes, sizeof(ASTNode*) * count);
+        memcpy(&session->items[first], items, sizeof(SessionItem) * count);
+    }
+
+    program->num_children = (int)num_children;
+    session->num_items = num_items;
+    return true;
+}
+
+// Parse the functions covering the changed tokens again. The functions
+// they touch are parsed from the first one's start; when the last new
+// function ends inside an old one, that one is parsed again as well.
+// Returns false, changing nothing, on a syntax error.
+static bool reparse(CompileSession *session) {
+    size_t num_tokens;
+    Token *tokens = lexer_get_tokens(session->lexer, &num_tokens);
+    size_t eof = num_tokens - 1;
+    size_t dirty_first = session->dirty_first < eof ? session->dirty_first : eof;
+    size_t dirty_end = session->dirty_end < eof ? session->dirty_end : eof;
+
+    // The functions the change touches, [first, stop), and their tokens.
+    // The ones between two touched functions lie within the changed range.
+    size_t first = 0;
+    while (first < session->num_items && session->items[first].end <= dirty_first &&
+           !item_is_dirty(&session->items[first], dirty_first, dirty_end)) {
+        first++;
+    }
+    size_t stop = first;
+    for (size_t i = first; i < session->num_items; i++) {
+        if (item_is_dirty(&session->items[i], dirty_first, dirty_end)) stop = i + 1;
+    }
+
+    size_t start = dirty_first;
+    size_t end = dirty_end;
+    if (stop > first) {
+        if (session->items[first].first < start) start = session->items[first].first;
+        if (session->items[stop - 1].end > end) end = session->items[stop - 1].end;
+    }
+
+    ASTNode **nodes = NULL;
+    SessionItem *items = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    bool ok = true;
+
+    Arena *saved = ast_get_arena();
+    ast_set_arena(NULL);
+
+    RDParser *parser = start < end ? parser_rd_init(tokens + start, num_tokens - start) : NULL;
+    if (start < end && !parser) ok = false;
+
+    size_t position = start;
+    while (ok && position < end) {
+        if (count >= capacity) {
+            capacity = capacity ? capacity * 2 : 4;
+            ASTNode **grown_nodes = (ASTNode**)realloc(nodes, sizeof(ASTNode*) * capacity);
+            if (grown_nodes) nodes = grown_nodes;
+            SessionItem *grown_items = (SessionItem*)realloc(items, sizeof(SessionItem) * capacity);
+            if (grown_items) items = grown_items;
+            if (!grown_nodes || !grown_items) {
+                ok = false;
+                break;
+            }
+        }
+
+        ASTNode *function = parser_rd_parse_function(parser);
+        if (!function) {
+            ok = false;
+            break;
+        }
+
+        nodes[count] = function;
+        items[count].first = position;
+        position = start + token_stream_position(&parser->stream);
+        items[count].end = position;
+        items[count].changed = false;
+        count++;
+
+        // A function that now runs into the next one takes it along
+        while (position > end && stop < session->num_items) {
+            if (session->items[stop].end > end) end = session->items[stop].end;
+            stop++;
+        }
+    }
+
+    parser_rd_free(parser);
+    ast_set_arena(saved);
+
+    ok = ok && position == end && replace_items(session, first, stop, nodes, items, count);
+    if (ok) {
+        session->stats.functions_parsed += count;
+        session->dirty = false;
+    } else {
+        for (size_t i = 0; i < count; i++) ast_free_node(nodes[i]);
+    }
+
+    free(nodes);
+    free(items);
+    return ok;
+}
+
+// Replace the bytes [offset, offset + removed) of the program with text.
+// The tokens are updated around the change and, if the program has been
+// parsed, the functions it touched are parsed again; those that no longer
+// parse are tried again after the next edit.
+bool session_edit(CompileSession *session, size_t offset, size_t removed, const char *text,
+                  size_t length, FILE *err) {
+    if (offset > session->length || removed > session->length - offset) {
+        fprintf(err, "Error: Edit of bytes %zu to %zu is outside the %zu-byte source\n",
+                offset, offset + removed, session->length);
+        return false;
+    }
+
+    size_t new_length = session->length - removed + length;
+    if (!reserve_text(session, new_length)) {
+        fprintf(err, "Error: Memory allocation failed\n");
+        return false;
+    }
+
+    memmove(session->text + offset + length, session->text + offset + removed,
+            session->length - offset - removed);
+    memcpy(session->text + offset, text, length);
+    session->length = new_length;
+
+    if (!session->lexer) return true;
+
+    TokenEdit edit;
+    if (!lexer_relex(session->lexer, session->text, session->length, offset, removed, length, &edit)) {
+        drop_ast(session);
+        lexer_free(session->lexer);
+        session->lexer = NULL;
+        fprintf(err, "Error: Tokenization failed\n");
+        return false;
+    }
+    session->stats.tokens_lexed += edit.inserted;
+
+    if (!session->ast || (edit.removed == 0 && edit.inserted == 0)) return true;
+
+    // Mark the functions whose tokens changed and move every function's
+    // token range, and the changed range, past the edit
+    for (size_t i = 0; i < session->num_items; i++) {
+        SessionItem *item = &session->items[i];
+        if ((item->first < edit.first + edit.removed && item->end > edit.first) ||
+            (item->first < edit.first && edit.first < item->end)) {
+            item->changed = true;
+        }
+        session->items[i].first = map_start(session->items[i].first, &edit);
+        session->items[i].end = map_end(session->items[i].end, &edit);
+    }
+
+    size_t dirty_first = edit.first;
+    size_t dirty_end = edit.first + edit.inserted;
+    if (session->dirty) {
+        size_t first = map_start(session->dirty_first, &edit);
+        size_t end = map_end(session->dirty_end, &edit);
+        if (first < dirty_first) dirty_first = first;
+        if (end > dirty_end) dirty_end = end;
+    }
+    session->dirty = true;
+    session->dirty_first = dirty_first;
+    session->dirty_end = dirty_end;
+
+    // Only ASTs from the recursive descent parser are patched; the others
+    // are parsed again in full, keeping the nodes of untouched functions
+    if (session->parser_type == PARSER_RD) reparse(session);
+    return true;
+}
+
+// The program's tokens, lexing it if it has not been yet
+Lexer* session_lexer(CompileSession *session) {
+    if (session->lexer) return session->lexer;
+
+    session->lexer = lexer_init_borrowed(session->text, session->length);
+    if (!session->lexer) return NULL;
+
+    if (!lexer_tokenize(session->lexer)) {
+        lexer_free(session->lexer);
+        session->lexer = NULL;
+        return NULL;
+    }
+
+    session->stats.tokens_lexed += session->lexer->num_tokens;
+    return session->lexer;
+}
+
+// The program's AST if it is up to date and was built by the given parser,
+// otherwise NULL
+ASTNode* session_ast(CompileSession *session, ParserType parser_type) {
+    if (!session->ast || session->dirty || session->parser_type != parser_type) return NULL;
+    return session->ast;
+}
+
+// Find the tokens of each function: from its first token to the brace
+// that closes its body. Returns false if they do not make up count
+// functions.
+static bool find_items(const Token *tokens, size_t num_tokens, size_t count, SessionItem **items) {
+    *items = (SessionItem*)malloc(sizeof(SessionItem) * (count + 1));
+    if (!*items) return false;
+
+    size_t position = 0;
+    size_t found = 0;
+    while (found < count) {
+        size_t first = position;
+        int depth = 0;
+
+        while (position < num_tokens && tokens[position].type != TOKEN_EOF) {
+            TokenKind kind = tokens[position++].kind;
+            if (kind == PUNCT_LBRACE) {
+                depth++;
+            } else if (kind == PUNCT_RBRACE && --depth == 0) {
+                break;
+            }
+        }
+
+        if (depth != 0 || position == first) break;
+        (*items)[found].first = first;
+        (*items)[found].end = position;
+        (*items)[found].changed = false;
+        found++;
+    }
+
+    // Nothing but the end of input may follow the last function
+    if (found == count && position < num_tokens && tokens[position].type == TOKEN_EOF) return true;
+
+    free(*items);
+    *items = NULL;
+    return false;
+}
+
+// Check if an old function and a new one cover the same tokens
+static bool same_item(const SessionItem *a, const SessionItem *b) {
+    return !a->changed && a->first == b->first && a->end == b->end;
+}
+
+// Take over an AST parsed from the program's current tokens, whose nodes
+// must be on the heap. Functions whose tokens lie outside the changed
+// range keep their old nodes instead of the new ones, and so their code.
+// Returns false, leaving the AST to the caller, if its functions cannot
+// be matched to their tokens.
+bool session_adopt_ast(CompileSession *session, ASTNode *ast, ParserType parser_type) {
+    size_t num_tokens;
+    Token *tokens = lexer_get_tokens(session->lexer, &num_tokens);
+    size_t count = (size_t)ast->num_children;
+
+    SessionItem *items = NULL;
+    if (ast->type != NODE_PROGRAM || !find_items(tokens, num_tokens, count, &items)) {
+        drop_ast(session);
+        return false;
+    }
+
+    ASTNode *old = session->ast;
+    if (old && session->parser_type != parser_type) {
+        drop_ast(session);
+        old = NULL;
+    }
+
+    size_t reused = 0;
+    if (old) {
+        size_t dirty_first = session->dirty ? session->dirty_first : num_tokens;
+        size_t dirty_end = session->dirty ? session->dirty_end : 0;
+        size_t old_count = session->num_items;
+
+        // Functions before the change, then functions after it
+        size_t prefix = 0;
+        while (prefix < count && prefix < old_count && session->items[prefix].end <= dirty_first &&
+               same_item(&session->items[prefix], &items[prefix])) {
+            prefix++;
+        }
+        size_t suffix = 0;
+        while (suffix < count - prefix && suffix < old_count - prefix &&
+               session->items[old_count - 1 - suffix].first >= dirty_end &&
+               same_item(&session->items[old_count - 1 - suffix], &items[count - 1 - suffix])) {
+            suffix++;
+        }
+
+        for (size_t i = 0; i < prefix + suffix; i++) {
+            size_t new_index = i < prefix ? i : count - 1 - (i - prefix);
+            size_t old_index = i < prefix ? i : old_count - 1 - (i - prefix);
+            ast_free_node(ast->children[new_index]);
+            ast->children[new_index] = old->children[old_index];
+            old->children[old_index] = NULL;
+        }
+        reused = prefix + suffix;
+
+        for (size_t i = 0; i < old_count; i++) {
+            if (!old->children[i]) continue;
+            codegen_cache_forget(&session->cache, old->children[i]);
+            ast_free_node(old->children[i]);
+        }
+        old->num_children = 0;
+        ast_free_node(old);
+        free(session->items);
+    }
+
+    session->ast = ast;
+    session->parser_type = parser_type;
+    session->items = items;
+    session->num_items = count;
+    session->dirty = false;
+    session->stats.functions_parsed += count - reused;
+    return true;
+}
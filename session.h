@@ -0,0 +1,52 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "common.h"
+#include "lexer.h"
+#include "codegen.h"
+
+// Tokens of one function at the top level of a session's program
+typedef struct {
+    size_t first;         // Its first token
+    size_t end;           // Just past its closing brace
+    bool changed;         // An edit changed its tokens since it was parsed
+} SessionItem;
+
+// Work done since the counters were last cleared
+typedef struct {
+    size_t tokens_lexed;      // Tokens lexed, again or for the first time
+    size_t functions_parsed;  // Functions parsed into new nodes
+} SessionStats;
+
+// A program kept between compilations while it is being edited. An edit
+// re-lexes only the tokens around it and reparses only the functions it
+// touched; the other functions keep their nodes, and with them their code
+// in the code cache. The AST is on the heap rather than in an arena so
+// that single functions can be replaced.
+typedef struct {
+    char *text;
+    size_t length;
+    size_t capacity;
+    Lexer *lexer;         // Tokens of text, or NULL until they are needed
+    ASTNode *ast;         // The program, or NULL until it is parsed
+    ParserType parser_type; // Parser that built ast
+    SessionItem *items;   // Tokens of each function in ast, in order
+    size_t num_items;
+    bool dirty;           // Tokens [dirty_first, dirty_end) changed since
+    size_t dirty_first;   // ast was parsed, and could not be parsed again
+    size_t dirty_end;
+    CodegenCache cache;
+    SessionStats stats;
+} CompileSession;
+
+// Session functions
+CompileSession* session_create(void);
+void session_free(CompileSession *session);
+bool session_open(CompileSession *session, const char *text, size_t length);
+bool session_edit(CompileSession *session, size_t offset, size_t removed, const char *text,
+                  size_t length, FILE *err);
+Lexer* session_lexer(CompileSession *session);
+ASTNode* session_ast(CompileSession *session, ParserType parser_type);
+bool session_adopt_ast(CompileSession *session, ASTNode *ast, ParserType parser_type);
+
+#endif // SESSION_H
@@ -0,0 +1,135 @@
+#include "source.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Initial buffer size for inputs that cannot be mapped
+#define SOURCE_READ_CHUNK 65536
+
+// Reset a source buffer to the empty state
+static void source_reset(SourceBuffer *source) {
+    source->data = "";
+    source->length = 0;
+    source->mapped = false;
+    source->map_length = 0;
+}
+
+// Read a whole stream into a heap buffer (used for pipes and stdin)
+bool source_from_stream(FILE *stream, SourceBuffer *source) {
+    source_reset(source);
+
+    size_t capacity = SOURCE_READ_CHUNK;
+    size_t length = 0;
+    char *buffer = (char*)malloc(capacity);
+    if (!buffer) return false;
+
+    size_t bytes;
+    while ((bytes = fread(buffer + length, 1, capacity - length, stream)) > 0) {
+        length += bytes;
+
+        // Grow the buffer geometrically when it fills up
+        if (length == capacity) {
+            capacity *= 2;
+            char *new_buffer = (char*)realloc(buffer, capacity);
+            if (!new_buffer) {
+                free(buffer);
+                return false;
+            }
+            buffer = new_buffer;
+        }
+    }
+
+    if (ferror(stream)) {
+        free(buffer);
+        return false;
+    }
+
+    // Keep the static empty buffer for empty input
+    if (length == 0) {
+        free(buffer);
+        return true;
+    }
+
+    source->data = buffer;
+    source->length = length;
+    return true;
+}
+
+// Open a source file, mapping it into memory when possible
+bool source_open(const char *filename, SourceBuffer *source) {
+    source_reset(source);
+
+    // "-" reads the source from standard input
+    if (strcmp(filename, "-") == 0) {
+        return source_from_stream(stdin, source);
+    }
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+
+    // Pipes, FIFOs and character devices have no size to map
+    if (!S_ISREG(st.st_mode)) {
+        FILE *stream = fdopen(fd, "r");
+        if (!stream) {
+            close(fd);
+            return false;
+        }
+        bool ok = source_from_stream(stream, source);
+        fclose(stream);
+        return ok;
+    }
+
+    // Empty files cannot be mapped; the static empty buffer is enough
+    if (st.st_size == 0) {
+        close(fd);
+        return true;
+    }
+
+    size_t length = (size_t)st.st_size;
+    void *data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        // Fall back to a buffered read (e.g. filesystems without mmap)
+        FILE *stream = fopen(filename, "r");
+        if (!stream) return false;
+        bool ok = source_from_stream(stream, source);
+        fclose(stream);
+        return ok;
+    }
+
+#ifdef MADV_SEQUENTIAL
+    // The lexer reads front to back exactly once
+    madvise(data, length, MADV_SEQUENTIAL);
+#endif
+
+    source->data = (const char*)data;
+    source->length = length;
+    source->mapped = true;
+    source->map_length = length;
+    return true;
+}
+
+// Release a source buffer
+void source_close(SourceBuffer *source) {
+    if (!source) return;
+
+    if (source->mapped) {
+        munmap((void*)source->data, source->map_length);
+    } else if (source->length > 0) {
+        // Heap buffers come from source_from_stream
+        free((void*)source->data);
+    }
+
+    source_reset(source);
+}
@@ -0,0 +1,19 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include "common.h"
+
+// Read-only view of an input source file
+typedef struct {
+    const char *data;     // Source bytes (not necessarily NUL-terminated)
+    size_t length;        // Number of bytes in data
+    bool mapped;          // data is an mmap'd view of the file
+    size_t map_length;    // Length of the mapping (when mapped)
+} SourceBuffer;
+
+// Source input functions
+bool source_open(const char *filename, SourceBuffer *source);
+bool source_from_stream(FILE *stream, SourceBuffer *source);
+void source_close(SourceBuffer *source);
+
+#endif // SOURCE_H
@@ -0,0 +1,393 @@
+#include "ssa.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Scratch state for building one function's SSA form
+typedef struct {
+    SSAForm *ssa;
+    IRProgram *ir;
+    int *local_of;
+    int *current;           // Value each local holds on the current path, or -1
+    int *entry_value;       // ENTRY value of each local, made on first read
+    int *saved;             // (local, previous value) pairs to undo on block exit
+    int num_saved;
+} SSABuilder;
+
+// Function-local number of a location, numbering it on first sight
+static int local_number(SSABuilder *builder, long loc) {
+    if (builder->local_of[loc] < 0) {
+        builder->local_of[loc] = builder->ssa->num_locals;
+        builder->ssa->location[builder->ssa->num_locals++] = loc;
+    }
+    return builder->local_of[loc];
+}
+
+// Add a value
+static int new_value(SSAForm *ssa, SSAValueKind kind, int block, size_t index, int local) {
+    SSAValue *value = &ssa->values[ssa->num_values];
+    value->kind = kind;
+    value->block = block;
+    value->index = index;
+    value->local = local;
+    return ssa->num_values++;
+}
+
+// Value a local holds on the current path
+static int current_value(SSABuilder *builder, int local) {
+    if (builder->current[local] >= 0) return builder->current[local];
+
+    if (builder->entry_value[local] < 0) {
+        builder->entry_value[local] = new_value(builder->ssa, SSA_ENTRY, 0, 0, local);
+    }
+    return builder->entry_value[local];
+}
+
+// Make value the local's current one until the defining block is left
+static void push_def(SSABuilder *builder, int local, int value) {
+    builder->saved[builder->num_saved * 2] = local;
+    builder->saved[builder->num_saved * 2 + 1] = builder->current[local];
+    builder->num_saved++;
+    builder->current[local] = value;
+}
+
+// Number the locations the function touches, and find the ones read in a
+// block that does not set them first (the only ones that can need phis)
+// along with the blocks that set each one
+static bool scan_locals(SSABuilder *builder, bool **global, int **def_blocks, int **def_start) {
+    SSAForm *ssa = builder->ssa;
+    const CFG *cfg = ssa->cfg;
+    IRInsn *code = builder->ir->code;
+
+    for (size_t i = ssa->first; i < cfg->func_end; i++) {
+        IROperand *operands[2];
+        int n = ir_insn_uses(&code[i], operands);
+        for (int k = 0; k < n; k++) {
+            long loc = ir_location(builder->ir, *operands[k]);
+            if (loc >= 0) local_number(builder, loc);
+        }
+        if (ir_insn_defines(&code[i])) {
+            long loc = ir_location(builder->ir, code[i].dst);
+            if (loc >= 0) local_number(builder, loc);
+        }
+    }
+
+    int num_locals = ssa->num_locals;
+    int *set_in = (int*)malloc(sizeof(int) * (size_t)(num_locals + 1));
+    *global = (bool*)calloc((size_t)num_locals + 1, sizeof(bool));
+    *def_start = (int*)calloc((size_t)num_locals + 2, sizeof(int));
+    if (!set_in || !*global || !*def_start) {
+        free(set_in);
+        return false;
+    }
+
+    // Count, then fill, the distinct blocks that set each local
+    for (int fill = 0; fill < 2; fill++) {
+        for (int l = 0; l < num_locals; l++) set_in[l] = -1;
+
+        if (fill) {
+            for (int l = 0; l < num_locals; l++) (*def_start)[l + 1] += (*def_start)[l];
+            *def_blocks = (int*)malloc(sizeof(int) * (size_t)((*def_start)[num_locals] + 1));
+            if (!*def_blocks) {
+                free(set_in);
+                return false;
+            }
+        }
+
+        int *filled = fill ? (int*)calloc((size_t)num_locals + 1, sizeof(int)) : NULL;
+        if (fill && !filled) {
+            free(set_in);
+            return false;
+        }
+
+        for (int b = 0; b < cfg->num_blocks; b++) {
+            const CFGBlock *block = &cfg->blocks[b];
+            if (block->rpo < 0) continue;
+
+            for (size_t i = block->start; i < block->end; i++) {
+                IROperand *operands[2];
+                int n = ir_insn_uses(&code[i], operands);
+                for (int k = 0; k < n; k++) {
+                    long loc = ir_location(builder->ir, *operands[k]);
+                    if (loc >= 0 && set_in[builder->local_of[loc]] != b) {
+                        (*global)[builder->local_of[loc]] = true;
+                    }
+                }
+
+                if (!ir_insn_defines(&code[i])) continue;
+                long loc = ir_location(builder->ir, code[i].dst);
+                if (loc < 0) continue;
+
+                int local = builder->local_of[loc];
+                if (set_in[local] == b) continue;
+                set_in[local] = b;
+
+                if (fill) {
+                    (*def_blocks)[(*def_start)[local] + filled[local]++] = b;
+                } else {
+                    (*def_start)[local + 1]++;
+                }
+            }
+        }
+
+        free(filled);
+    }
+
+    free(set_in);
+    return true;
+}
+
+// Place phis at the iterated dominance frontier of each global local's
+// defining blocks, then group them by block
+static bool place_phis(SSABuilder *builder, const bool *global, const int *def_blocks,
+                       const int *def_start) {
+    SSAForm *ssa = builder->ssa;
+    const CFG *cfg = ssa->cfg;
+    int n = cfg->num_blocks;
+
+    int *has_phi = (int*)malloc(sizeof(int) * (size_t)n);
+    int *queued = (int*)malloc(sizeof(int) * (size_t)n);
+    int *worklist = (int*)malloc(sizeof(int) * (size_t)n);
+    int *pairs = NULL;
+    size_t num_pairs = 0;
+    size_t capacity = 0;
+    bool ok = has_phi && queued && worklist;
+
+    for (int b = 0; ok && b < n; b++) has_phi[b] = queued[b] = -1;
+
+    for (int local = 0; ok && local < ssa->num_locals; local++) {
+        if (!global[local]) continue;
+
+        int count = 0;
+        for (int d = def_start[local]; d < def_start[local + 1]; d++) {
+            worklist[count++] = def_blocks[d];
+            queued[def_blocks[d]] = local;
+        }
+
+        while (ok && count > 0) {
+            const CFGBlock *block = &cfg->blocks[worklist[--count]];
+
+            for (int f = 0; f < block->num_df; f++) {
+                int join = cfg->frontier[block->df_start + f];
+                if (has_phi[join] == local) continue;
+                has_phi[join] = local;
+
+                if (num_pairs == capacity) {
+                    size_t new_capacity = capacity ? capacity * 2 : 64;
+                    int *grown = (int*)realloc(pairs, sizeof(int) * 2 * new_capacity);
+                    if (!grown) {
+                        ok = false;
+                        break;
+                    }
+                    pairs = grown;
+                    capacity = new_capacity;
+                }
+                pairs[num_pairs * 2] = join;
+                pairs[num_pairs * 2 + 1] = local;
+                num_pairs++;
+
+                if (queued[join] != local) {
+                    queued[join] = local;
+                    worklist[count++] = join;
+                }
+            }
+        }
+    }
+
+    ssa->block_phis = ok ? (int*)calloc((size_t)n + 1, sizeof(int)) : NULL;
+    ssa->phis = ok ? (SSAPhi*)malloc(sizeof(SSAPhi) * (num_pairs + 1)) : NULL;
+    ok = ok && ssa->block_phis && ssa->phis;
+
+    if (ok) {
+        for (size_t p = 0; p < num_pairs; p++) ssa->block_phis[pairs[p * 2] + 1]++;
+        for (int b = 0; b < n; b++) ssa->block_phis[b + 1] += ssa->block_phis[b];
+
+        // has_phi becomes the fill position of each block
+        for (int b = 0; b < n; b++) has_phi[b] = ssa->block_phis[b];
+
+        size_t num_args = 0;
+        for (size_t p = 0; p < num_pairs; p++) {
+            SSAPhi *phi = &ssa->phis[has_phi[pairs[p * 2]]++];
+            phi->block = pairs[p * 2];
+            phi->local = pairs[p * 2 + 1];
+            phi->value = SSA_NO_VALUE;
+            phi->first_arg = 0;
+        }
+
+        ssa->num_phis = (int)num_pairs;
+        for (int p = 0; p < ssa->num_phis; p++) {
+            ssa->phis[p].first_arg = num_args;
+            num_args += (size_t)cfg->blocks[ssa->phis[p].block].num_preds;
+        }
+
+        ssa->phi_args = (int*)malloc(sizeof(int) * (num_args + 1));
+        ok = ssa->phi_args != NULL;
+        for (size_t a = 0; ok && a < num_args; a++) ssa->phi_args[a] = SSA_NO_VALUE;
+    }
+
+    free(has_phi);
+    free(queued);
+    free(worklist);
+    free(pairs);
+    return ok;
+}
+
+// Give every phi, instruction result and operand read its value, walking
+// the dominator tree so that each block sees the definitions above it
+static bool rename_values(SSABuilder *builder) {
+    SSAForm *ssa = builder->ssa;
+    const CFG *cfg = ssa->cfg;
+    IRInsn *code = builder->ir->code;
+
+    // Frames of (block, next child or -1 before entering, saved height)
+    int *stack = (int*)malloc(sizeof(int) * (size_t)cfg->num_blocks * 3);
+    if (!stack) return false;
+
+    int depth = 1;
+    stack[0] = 0;
+    stack[1] = -1;
+    stack[2] = 0;
+
+    while (depth > 0) {
+        int *frame = &stack[(depth - 1) * 3];
+        int b = frame[0];
+        const CFGBlock *block = &cfg->blocks[b];
+
+        if (frame[1] < 0) {
+            frame[1] = 0;
+            frame[2] = builder->num_saved;
+
+            for (int p = ssa->block_phis[b]; p < ssa->block_phis[b + 1]; p++) {
+                SSAPhi *phi = &ssa->phis[p];
+                phi->value = new_value(ssa, SSA_PHI, b, (size_t)p, phi->local);
+                push_def(builder, phi->local, phi->value);
+            }
+
+            for (size_t i = block->start; i < block->end; i++) {
+                size_t offset = i - ssa->first;
+                IROperand *operands[2];
+                int n = ir_insn_uses(&code[i], operands);
+                for (int k = 0; k < n; k++) {
+                    long loc = ir_location(builder->ir, *operands[k]);
+                    if (loc >= 0) {
+                        ssa->use_value[offset * 2 + k] = current_value(builder, builder->local_of[loc]);
+                    }
+                }
+
+                if (!ir_insn_defines(&code[i])) continue;
+                long loc = ir_location(builder->ir, code[i].dst);
+                if (loc < 0) continue;
+
+                int local = builder->local_of[loc];
+                ssa->def_value[offset] = new_value(ssa, SSA_INSN, b, i, local);
+                push_def(builder, local, ssa->def_value[offset]);
+            }
+
+            for (int s = 0; s < block->num_succ; s++) {
+                int succ = block->succ[s];
+                int j = cfg_pred_index(cfg, succ, b);
+                for (int p = ssa->block_phis[succ]; p < ssa->block_phis[succ + 1]; p++) {
+                    SSAPhi *phi = &ssa->phis[p];
+                    ssa->phi_args[phi->first_arg + (size_t)j] = current_value(builder, phi->local);
+                }
+            }
+        }
+
+        if (frame[1] < block->num_dom_children) {
+            int child = cfg->dom_children[block->dom_start + frame[1]++];
+            int *next = &stack[depth * 3];
+            next[0] = child;
+            next[1] = -1;
+            next[2] = 0;
+            depth++;
+            continue;
+        }
+
+        // Leaving the block: its definitions go out of scope
+        while (builder->num_saved > frame[2]) {
+            builder->num_saved--;
+            builder->current[builder->saved[builder->num_saved * 2]] =
+                builder->saved[builder->num_saved * 2 + 1];
+        }
+        depth--;
+    }
+
+    free(stack);
+    return true;
+}
+
+// Build the SSA form of the function a CFG describes. local_of maps
+// program locations to function-local numbers while building; it must be
+// all -1 on entry (sized for ir_num_locations) and is left that way.
+SSAForm* ssa_build(IRProgram *ir, const CFG *cfg, int *local_of) {
+    SSAForm *ssa = (SSAForm*)calloc(1, sizeof(SSAForm));
+    if (!ssa) return NULL;
+
+    ssa->cfg = cfg;
+    ssa->first = cfg->func_start + 1;
+    size_t length = cfg->func_end - ssa->first;
+
+    SSABuilder builder;
+    memset(&builder, 0, sizeof(builder));
+    builder.ssa = ssa;
+    builder.ir = ir;
+    builder.local_of = local_of;
+
+    bool *global = NULL;
+    int *def_blocks = NULL;
+    int *def_start = NULL;
+
+    ssa->location = (long*)malloc(sizeof(long) * (length * 3 + 1));
+    ssa->use_value = (int*)malloc(sizeof(int) * (length * 2 + 1));
+    ssa->def_value = (int*)malloc(sizeof(int) * (length + 1));
+    bool ok = ssa->location && ssa->use_value && ssa->def_value &&
+              scan_locals(&builder, &global, &def_blocks, &def_start) &&
+              place_phis(&builder, global, def_blocks, def_start);
+
+    if (ok) {
+        // Every phi and result defines a value, plus one ENTRY per local
+        size_t max_values = (size_t)ssa->num_phis + length + (size_t)ssa->num_locals;
+        size_t max_saved = (size_t)ssa->num_phis + length;
+
+        ssa->values = (SSAValue*)malloc(sizeof(SSAValue) * (max_values + 1));
+        builder.current = (int*)malloc(sizeof(int) * ((size_t)ssa->num_locals + 1));
+        builder.entry_value = (int*)malloc(sizeof(int) * ((size_t)ssa->num_locals + 1));
+        builder.saved = (int*)malloc(sizeof(int) * (max_saved * 2 + 1));
+        ok = ssa->values && builder.current && builder.entry_value && builder.saved;
+    }
+
+    if (ok) {
+        for (int l = 0; l < ssa->num_locals; l++) builder.current[l] = builder.entry_value[l] = -1;
+        for (size_t i = 0; i < length * 2; i++) ssa->use_value[i] = SSA_NO_VALUE;
+        for (size_t i = 0; i < length; i++) ssa->def_value[i] = SSA_NO_VALUE;
+        ok = rename_values(&builder);
+    }
+
+    for (int l = 0; l < ssa->num_locals; l++) local_of[ssa->location[l]] = -1;
+    free(global);
+    free(def_blocks);
+    free(def_start);
+    free(builder.current);
+    free(builder.entry_value);
+    free(builder.saved);
+
+    if (!ok) {
+        ssa_free(ssa);
+        return NULL;
+    }
+    return ssa;
+}
+
+// Free an SSA form
+void ssa_free(SSAForm *ssa) {
+    if (!ssa) return;
+
+    free(ssa->location);
+    free(ssa->values);
+    free(ssa->phis);
+    free(ssa->block_phis);
+    free(ssa->phi_args);
+    free(ssa->use_value);
+    free(ssa->def_value);
+    free(ssa);
+}
@@ -0,0 +1,59 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include "common.h"
+#include "cfg.h"
+
+// Marks an operand that reads no SSA value (a constant, or unreachable code)
+#define SSA_NO_VALUE (-1)
+
+// Where an SSA value is defined
+typedef enum {
+    SSA_ENTRY,      // Whatever the location holds when the function starts
+    SSA_INSN,       // The dst of an instruction
+    SSA_PHI         // A phi at the start of a block
+} SSAValueKind;
+
+typedef struct {
+    SSAValueKind kind;
+    int block;
+    size_t index;           // Instruction index, or phi index
+    int local;              // Function-local number of the location
+} SSAValue;
+
+// Phi: picks one value per predecessor of its block, in CFG pred order
+typedef struct {
+    int block;
+    int local;
+    int value;              // The value the phi defines
+    size_t first_arg;       // Arguments, in SSAForm.phi_args
+} SSAPhi;
+
+// SSA form of one function, kept beside its TAC rather than rewriting it:
+// every operand read and every instruction result is tied to a value, and
+// phis say where values from different paths merge. Semi-pruned: phis are
+// only placed for locations read in a block other than where they are set.
+typedef struct {
+    const CFG *cfg;
+    size_t first;           // Index of the function's first body instruction
+
+    int num_locals;
+    long *location;         // Location of each local
+
+    SSAValue *values;
+    int num_values;
+
+    SSAPhi *phis;           // Grouped by block
+    int num_phis;
+    int *block_phis;        // Phis of block b: block_phis[b] up to block_phis[b + 1]
+    int *phi_args;
+
+    int *use_value;         // Value read by operand k of instruction i, at (i - first) * 2 + k
+    int *def_value;         // Value defined by instruction i, at i - first
+} SSAForm;
+
+// SSA functions
+SSAForm* ssa_build(IRProgram *ir, const CFG *cfg, int *local_of);
+void ssa_free(SSAForm *ssa);
+
+#endif // SSA_H
@@ -0,0 +1,234 @@
+#include "stats.h"
+#include "outbuf.h"
+#include "token_stream.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+// Counts of the allocation wrappers, shared by every thread
+static atomic_uint_fast64_t alloc_calls;
+static atomic_uint_fast64_t alloc_bytes;
+
+// Count one allocation of size bytes
+static void count_alloc(size_t size) {
+    atomic_fetch_add_explicit(&alloc_calls, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&alloc_bytes, size, memory_order_relaxed);
+}
+
+// malloc, counted
+void* stats_malloc(size_t size) {
+    count_alloc(size);
+    return malloc(size);
+}
+
+// calloc, counted
+void* stats_calloc(size_t count, size_t size) {
+    count_alloc(count * size);
+    return calloc(count, size);
+}
+
+// realloc, counted as an allocation of the new size
+void* stats_realloc(void *ptr, size_t size) {
+    count_alloc(size);
+    return realloc(ptr, size);
+}
+
+// strdup, counted
+char* stats_strdup(const char *str) {
+    count_alloc(strlen(str) + 1);
+    return strdup(str);
+}
+
+// Allocations counted so far
+void stats_alloc_counts(AllocCounts *counts) {
+    counts->calls = atomic_load_explicit(&alloc_calls, memory_order_relaxed);
+    counts->bytes = atomic_load_explicit(&alloc_bytes, memory_order_relaxed);
+}
+
+// Seconds on a clock
+static double clock_seconds(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Peak resident size of the process so far, in bytes
+static uint64_t peak_rss(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return (uint64_t)usage.ru_maxrss;
+#else
+    return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+// Start measuring a compilation
+void stats_init(CompileStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats_mark(stats, &stats->start);
+}
+
+// Note where a phase starts; without stats, nothing is measured
+void stats_mark(const CompileStats *stats, StatsMark *mark) {
+    if (!stats) return;
+
+    mark->wall = clock_seconds(CLOCK_MONOTONIC);
+    mark->cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+    stats_alloc_counts(&mark->allocs);
+}
+
+// Record a phase that started at start and ends now. The name and unit
+// must outlive the stats.
+void stats_phase(CompileStats *stats, const StatsMark *start, const char *name, uint64_t bytes_in,
+                 uint64_t bytes_out, uint64_t items, const char *unit) {
+    if (!stats || stats->num_phases >= STATS_MAX_PHASES) return;
+
+    StatsMark end;
+    stats_mark(stats, &end);
+
+    PhaseStats *phase = &stats->phases[stats->num_phases++];
+    phase->name = name;
+    phase->wall_seconds = end.wall - start->wall;
+    phase->cpu_seconds = end.cpu - start->cpu;
+    phase->bytes_in = bytes_in;
+    phase->bytes_out = bytes_out;
+    phase->items = items;
+    phase->unit = unit;
+    phase->allocs.calls = end.allocs.calls - start->allocs.calls;
+    phase->allocs.bytes = end.allocs.bytes - start->allocs.bytes;
+    phase->peak_rss = peak_rss();
+}
+
+// Bytes a phase read or wrote per second, in MB
+static double phase_mb_per_second(const PhaseStats *phase) {
+    uint64_t bytes = phase->bytes_in ? phase->bytes_in : phase->bytes_out;
+    return phase->wall_seconds > 0 ? (double)bytes / (1024.0 * 1024.0) / phase->wall_seconds : 0;
+}
+
+// Things a phase produced per second
+static double phase_items_per_second(const PhaseStats *phase) {
+    return phase->wall_seconds > 0 ? (double)phase->items / phase->wall_seconds : 0;
+}
+
+// Print the phases as a table
+static void print_text(const CompileStats *stats, const char *input_name, double wall, double cpu, FILE *out) {
+    fprintf(out, "Statistics for %s:\n", input_name);
+    fprintf(out, "  %-18s %10s %10s %10s %9s %18s %12s %8s %10s %9s\n", "phase", "wall ms", "cpu ms",
+            "bytes", "MB/s", "items", "items/s", "allocs", "alloc KB", "peak MB");
+
+    for (int i = 0; i < stats->num_phases; i++) {
+        const PhaseStats *phase = &stats->phases[i];
+        char items[32] = "";
+        char rate[32] = "";
+        if (phase->unit) {
+            snprintf(items, sizeof(items), "%llu %s", (unsigned long long)phase->items, phase->unit);
+            snprintf(rate, sizeof(rate), "%.0f", phase_items_per_second(phase));
+        }
+
+        fprintf(out, "  %-18s %10.3f %10.3f %10llu %9.1f %18s %12s %8llu %10.1f %9.1f\n",
+                phase->name, phase->wall_seconds * 1e3, phase->cpu_seconds * 1e3,
+                (unsigned long long)(phase->bytes_in ? phase->bytes_in : phase->bytes_out),
+                phase_mb_per_second(phase), items, rate,
+                (unsigned long long)phase->allocs.calls, (double)phase->allocs.bytes / 1024.0,
+                (double)phase->peak_rss / (1024.0 * 1024.0));
+    }
+    fprintf(out, "  %-18s %10.3f %10.3f\n", "total", wall * 1e3, cpu * 1e3);
+    fprintf(out, "  AST arena: %.1f KB used of %.1f KB reserved\n",
+            (double)stats->arena_used / 1024.0, (double)stats->arena_reserved / 1024.0);
+    if (stats->tokens_streamed) {
+        fprintf(out, "  Tokens: %llu streamed, at most %d held at once\n",
+                (unsigned long long)stats->tokens_streamed, TOKEN_STREAM_WINDOW);
+    }
+
+    if (stats->has_opt && stats->opt.num_passes > 0) {
+        fprintf(out, "  %-18s %10s %10s %10s %10s\n", "pass", "runs", "changes", "removed", "cpu ms");
+        for (int i = 0; i < stats->opt.num_passes; i++) {
+            const OptPassStats *pass = &stats->opt.passes[i];
+            fprintf(out, "  %-18s %10d %10zu %10zu %10.3f\n",
+                    pass->name, pass->runs, pass->changes, pass->removed, pass->seconds * 1e3);
+        }
+    }
+}
+
+// Write "key": value for a JSON number, after a comma unless first
+static void json_number(OutBuf *out, const char *key, double value, bool first) {
+    char text[64];
+    snprintf(text, sizeof(text), "%s\"%s\": %.17g", first ? "" : ", ", key, value);
+    outbuf_puts(out, text);
+}
+
+// Print the phases as one JSON object
+static void print_json(const CompileStats *stats, const char *input_name, double wall, double cpu, FILE *file) {
+    OutBuf *out = outbuf_wrap(file);
+    if (!out) return;
+
+    outbuf_puts(out, "{\"input\": ");
+    outbuf_json_string(out, input_name);
+    json_number(out, "wall_seconds", wall, false);
+    json_number(out, "cpu_seconds", cpu, false);
+    json_number(out, "peak_rss_bytes", (double)peak_rss(), false);
+    outbuf_puts(out, ", \"arena\": {");
+    json_number(out, "used_bytes", (double)stats->arena_used, true);
+    json_number(out, "reserved_bytes", (double)stats->arena_reserved, false);
+    outbuf_puts(out, "}");
+    json_number(out, "tokens_streamed", (double)stats->tokens_streamed, false);
+    json_number(out, "token_window", stats->tokens_streamed ? TOKEN_STREAM_WINDOW : 0, false);
+    outbuf_puts(out, ",\n \"phases\": [");
+
+    for (int i = 0; i < stats->num_phases; i++) {
+        const PhaseStats *phase = &stats->phases[i];
+        outbuf_puts(out, i == 0 ? "\n  {\"name\": " : ",\n  {\"name\": ");
+        outbuf_json_string(out, phase->name);
+        json_number(out, "wall_seconds", phase->wall_seconds, false);
+        json_number(out, "cpu_seconds", phase->cpu_seconds, false);
+        json_number(out, "bytes_in", (double)phase->bytes_in, false);
+        json_number(out, "bytes_out", (double)phase->bytes_out, false);
+        json_number(out, "mb_per_second", phase_mb_per_second(phase), false);
+        json_number(out, "items", (double)phase->items, false);
+        outbuf_puts(out, ", \"unit\": ");
+        if (phase->unit) {
+            outbuf_json_string(out, phase->unit);
+        } else {
+            outbuf_puts(out, "null");
+        }
+        json_number(out, "items_per_second", phase_items_per_second(phase), false);
+        json_number(out, "allocations", (double)phase->allocs.calls, false);
+        json_number(out, "allocated_bytes", (double)phase->allocs.bytes, false);
+        json_number(out, "peak_rss_bytes", (double)phase->peak_rss, false);
+        outbuf_putc(out, '}');
+    }
+
+    outbuf_puts(out, "],\n \"passes\": [");
+    int num_passes = stats->has_opt ? stats->opt.num_passes : 0;
+    for (int i = 0; i < num_passes; i++) {
+        const OptPassStats *pass = &stats->opt.passes[i];
+        outbuf_puts(out, i == 0 ? "\n  {\"name\": " : ",\n  {\"name\": ");
+        outbuf_json_string(out, pass->name);
+        json_number(out, "runs", pass->runs, false);
+        json_number(out, "changes", (double)pass->changes, false);
+        json_number(out, "removed", (double)pass->removed, false);
+        json_number(out, "cpu_seconds", pass->seconds, false);
+        outbuf_putc(out, '}');
+    }
+    outbuf_puts(out, "]}\n");
+    outbuf_close(out);
+    fflush(file);
+}
+
+// Print a compilation's statistics as a table or as JSON
+void stats_print(const CompileStats *stats, const char *input_name, StatsMode mode, FILE *out) {
+    StatsMark now;
+    stats_mark(stats, &now);
+    double wall = now.wall - stats->start.wall;
+    double cpu = now.cpu - stats->start.cpu;
+
+    if (mode == STATS_JSON) {
+        print_json(stats, input_name, wall, cpu, out);
+    } else {
+        print_text(stats, input_name, wall, cpu, out);
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "common.h"
+#include "opt.h"
+#include <stdint.h>
+
+// Most phases one compilation records
+#define STATS_MAX_PHASES 32
+
+// Allocations made through the counting wrappers since the process
+// started: the lexer's, the AST's and the code generator's
+typedef struct {
+    uint64_t calls;       // malloc, calloc, realloc and strdup calls
+    uint64_t bytes;       // Bytes they asked for
+} AllocCounts;
+
+// Clocks and counters when a phase started
+typedef struct {
+    double wall;
+    double cpu;
+    AllocCounts allocs;
+} StatsMark;
+
+// What one phase took and did
+typedef struct {
+    const char *name;
+    double wall_seconds;
+    double cpu_seconds;     // Of every thread in the process
+    uint64_t bytes_in;      // Source bytes read
+    uint64_t bytes_out;     // Artifact bytes written
+    uint64_t items;         // Things the phase produced, counted in unit
+    const char *unit;       // "tokens", "nodes", ..., or NULL
+    AllocCounts allocs;
+    uint64_t peak_rss;      // Process peak resident bytes when it ended
+} PhaseStats;
+
+// Measurements of one compilation, phase by phase
+typedef struct {
+    PhaseStats phases[STATS_MAX_PHASES];
+    int num_phases;
+    StatsMark start;
+    uint64_t arena_used;    // AST arena bytes handed out
+    uint64_t arena_reserved; // and obtained for its chunks
+    uint64_t tokens_streamed; // Tokens the parser pulled through its window, or 0
+    OptReport opt;          // Optimization passes, when there were any
+    bool has_opt;
+} CompileStats;
+
+// Statistics functions
+void stats_init(CompileStats *stats);
+void stats_mark(const CompileStats *stats, StatsMark *mark);
+void stats_phase(CompileStats *stats, const StatsMark *start, const char *name, uint64_t bytes_in,
+                 uint64_t bytes_out, uint64_t items, const char *unit);
+void stats_print(const CompileStats *stats, const char *input_name, StatsMode mode, FILE *out);
+void stats_alloc_counts(AllocCounts *counts);
+void* stats_malloc(size_t size);
+void* stats_calloc(size_t count, size_t size);
+void* stats_realloc(void *ptr, size_t size);
+char* stats_strdup(const char *str);
+
+#endif // STATS_H
@@ -0,0 +1,186 @@
+#include "strtab.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Default pool chunk size; larger strings get a chunk of their own
+#define STRTAB_CHUNK_SIZE 65536
+
+// FNV-1a hash of a byte range
+static uint32_t hash_bytes(const char *str, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Create an empty string table
+StringTable* strtab_create(void) {
+    StringTable *table = (StringTable*)malloc(sizeof(StringTable));
+    if (!table) return NULL;
+
+    table->chunks = NULL;
+    table->num_entries = 0;
+    table->entries_capacity = 256;
+    table->entries = (StringEntry*)malloc(sizeof(StringEntry) * table->entries_capacity);
+    table->num_slots = 512;
+    table->slots = (int32_t*)malloc(sizeof(int32_t) * table->num_slots);
+
+    if (!table->entries || !table->slots) {
+        strtab_free(table);
+        return NULL;
+    }
+
+    memset(table->slots, 0xff, sizeof(int32_t) * table->num_slots);
+    return table;
+}
+
+// Free the table, its pool and all strings in one pass over the chunks
+void strtab_free(StringTable *table) {
+    if (!table) return;
+
+    StringChunk *chunk = table->chunks;
+    while (chunk) {
+        StringChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    free(table->entries);
+    free(table->slots);
+    free(table);
+}
+
+// Copy a byte range into the pool and NUL-terminate it
+static char* pool_copy(StringTable *table, const char *str, size_t length) {
+    StringChunk *chunk = table->chunks;
+
+    if (!chunk || chunk->size - chunk->used < length + 1) {
+        size_t size = STRTAB_CHUNK_SIZE;
+        if (length + 1 > size) size = length + 1;
+
+        chunk = (StringChunk*)malloc(sizeof(StringChunk) + size);
+        if (!chunk) return NULL;
+        chunk->size = size;
+        chunk->used = 0;
+
+        // Oversized chunks go behind the current one so it keeps filling up
+        if (table->chunks && size > STRTAB_CHUNK_SIZE) {
+            chunk->next = table->chunks->next;
+            table->chunks->next = chunk;
+        } else {
+            chunk->next = table->chunks;
+            table->chunks = chunk;
+        }
+    }
+
+    char *copy = chunk->data + chunk->used;
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    chunk->used += length + 1;
+    return copy;
+}
+
+// Find the slot for a string: either its ID or an empty slot
+static size_t find_slot(const StringTable *table, const char *str, size_t length, uint32_t hash) {
+    size_t mask = table->num_slots - 1;
+    size_t slot = hash & mask;
+
+    while (table->slots[slot] >= 0) {
+        const StringEntry *entry = &table->entries[table->slots[slot]];
+        if (entry->hash == hash && entry->length == length &&
+            memcmp(entry->str, str, length) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+// Double the hash slots and reinsert every entry
+static bool grow_slots(StringTable *table) {
+    size_t num_slots = table->num_slots * 2;
+    int32_t *slots = (int32_t*)malloc(sizeof(int32_t) * num_slots);
+    if (!slots) return false;
+    memset(slots, 0xff, sizeof(int32_t) * num_slots);
+
+    size_t mask = num_slots - 1;
+    for (size_t i = 0; i < table->num_entries; i++) {
+        size_t slot = table->entries[i].hash & mask;
+        while (slots[slot] >= 0) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = (int32_t)i;
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->num_slots = num_slots;
+    return true;
+}
+
+// Intern a byte range, returning the ID shared by all equal strings
+int strtab_intern(StringTable *table, const char *str, size_t length) {
+    uint32_t hash = hash_bytes(str, length);
+    size_t slot = find_slot(table, str, length, hash);
+
+    if (table->slots[slot] >= 0) {
+        return table->slots[slot];
+    }
+
+    // Keep the load factor at or below one half
+    if ((table->num_entries + 1) * 2 > table->num_slots) {
+        if (!grow_slots(table)) return -1;
+        slot = find_slot(table, str, length, hash);
+    }
+
+    if (table->num_entries >= table->entries_capacity) {
+        size_t capacity = table->entries_capacity * 2;
+        StringEntry *entries = (StringEntry*)realloc(table->entries, sizeof(StringEntry) * capacity);
+        if (!entries) return -1;
+        table->entries = entries;
+        table->entries_capacity = capacity;
+    }
+
+    const char *copy = pool_copy(table, str, length);
+    if (!copy) return -1;
+
+    int id = (int)table->num_entries++;
+    table->entries[id].str = copy;
+    table->entries[id].length = (uint32_t)length;
+    table->entries[id].hash = hash;
+    table->slots[slot] = id;
+
+    return id;
+}
+
+// Look up a string without inserting it; returns -1 if absent
+int strtab_lookup(const StringTable *table, const char *str, size_t length) {
+    size_t slot = find_slot(table, str, length, hash_bytes(str, length));
+    return table->slots[slot];
+}
+
+// Store a string in the pool without interning it (e.g. string literals)
+const char* strtab_store(StringTable *table, const char *str, size_t length) {
+    return pool_copy(table, str, length);
+}
+
+// Get an interned string by ID
+const char* strtab_get(const StringTable *table, int id) {
+    if (id < 0 || (size_t)id >= table->num_entries) return NULL;
+    return table->entries[id].str;
+}
+
+// Get the length of an interned string by ID
+size_t strtab_length(const StringTable *table, int id) {
+    if (id < 0 || (size_t)id >= table->num_entries) return 0;
+    return table->entries[id].length;
+}
+
+// Number of interned strings
+size_t strtab_count(const StringTable *table) {
+    return table->num_entries;
+}
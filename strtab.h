@@ -0,0 +1,42 @@
+#ifndef STRTAB_H
+#define STRTAB_H
+
+#include "common.h"
+#include <stdint.h>
+
+// Interned string entry
+typedef struct {
+    const char *str;      // NUL-terminated copy in the table's pool
+    uint32_t length;
+    uint32_t hash;
+} StringEntry;
+
+// Pool chunk holding string bytes; chunks never move once allocated
+typedef struct StringChunk {
+    struct StringChunk *next;
+    size_t used;
+    size_t size;
+    char data[];
+} StringChunk;
+
+// String table: a chunked byte pool plus an open-addressing hash of IDs
+typedef struct {
+    StringChunk *chunks;
+    StringEntry *entries;
+    size_t num_entries;
+    size_t entries_capacity;
+    int32_t *slots;       // Hash slots holding entry IDs, -1 when empty
+    size_t num_slots;     // Always a power of two
+} StringTable;
+
+// String table functions
+StringTable* strtab_create(void);
+void strtab_free(StringTable *table);
+int strtab_intern(StringTable *table, const char *str, size_t length);
+int strtab_lookup(const StringTable *table, const char *str, size_t length);
+const char* strtab_store(StringTable *table, const char *str, size_t length);
+const char* strtab_get(const StringTable *table, int id);
+size_t strtab_length(const StringTable *table, int id);
+size_t strtab_count(const StringTable *table);
+
+#endif // STRTAB_H
@@ -0,0 +1,315 @@
+#include "symtab.h"
+#include "ast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Grow an array to hold at least count + 1 items
+static bool grow(void **items, size_t *capacity, size_t count, size_t item_size) {
+    if (count < *capacity) return true;
+
+    size_t new_capacity = *capacity ? *capacity * 2 : 64;
+    void *new_items = realloc(*items, item_size * new_capacity);
+    if (!new_items) return false;
+
+    *items = new_items;
+    *capacity = new_capacity;
+    return true;
+}
+
+// Create an empty symbol table
+SymbolTable* symtab_create(void) {
+    SymbolTable *table = (SymbolTable*)calloc(1, sizeof(SymbolTable));
+    if (!table) return NULL;
+
+    table->names = strtab_create();
+    if (!table->names) {
+        free(table);
+        return NULL;
+    }
+
+    table->function = -1;
+    return table;
+}
+
+// Free a symbol table
+void symtab_free(SymbolTable *table) {
+    if (!table) return;
+
+    strtab_free(table->names);
+    free(table->binding);
+    free(table->function_of);
+    free(table->symbols);
+    free(table->active);
+    free(table->scope_start);
+    free(table->implicit);
+    free(table);
+}
+
+// Intern a name, making room for it in the by-name arrays; -1 on failure
+static int intern_name(SymbolTable *table, const char *name) {
+    int id = strtab_intern(table->names, name, strlen(name));
+    if (id < 0) return -1;
+
+    if ((size_t)id >= table->names_capacity) {
+        size_t capacity = table->names_capacity ? table->names_capacity * 2 : 64;
+        while (capacity <= (size_t)id) capacity *= 2;
+
+        int *binding = (int*)realloc(table->binding, sizeof(int) * capacity);
+        if (binding) table->binding = binding;
+        int *function_of = (int*)realloc(table->function_of, sizeof(int) * capacity);
+        if (function_of) table->function_of = function_of;
+        if (!binding || !function_of) return -1;
+
+        for (size_t i = table->names_capacity; i < capacity; i++) {
+            table->binding[i] = -1;
+            table->function_of[i] = -1;
+        }
+        table->names_capacity = capacity;
+    }
+
+    return id;
+}
+
+// Open a scope
+bool symtab_push_scope(SymbolTable *table) {
+    if (table->num_scopes >= table->scopes_capacity) {
+        int capacity = table->scopes_capacity ? table->scopes_capacity * 2 : 16;
+        size_t *scope_start = (size_t*)realloc(table->scope_start, sizeof(size_t) * capacity);
+        if (!scope_start) {
+            table->failed = true;
+            return false;
+        }
+        table->scope_start = scope_start;
+        table->scopes_capacity = capacity;
+    }
+
+    table->scope_start[table->num_scopes++] = table->num_active;
+    return true;
+}
+
+// Close the innermost scope: its variables go out of sight and the ones
+// they hid are visible again
+void symtab_pop_scope(SymbolTable *table) {
+    if (table->num_scopes == 0) return;
+
+    size_t start = table->scope_start[--table->num_scopes];
+    while (table->num_active > start) {
+        const Symbol *symbol = &table->symbols[table->active[--table->num_active]];
+        table->binding[symbol->name_id] = symbol->shadowed;
+    }
+}
+
+// Name in generated code of a symbol hiding depth others: "name.depth"
+static const char* make_ir_name(SymbolTable *table, const char *name, int depth) {
+    char buffer[256];
+    int length = snprintf(buffer, sizeof(buffer), "%s.%d", name, depth);
+    if (length < 0 || (size_t)length >= sizeof(buffer)) return NULL;
+    return strtab_store(table->names, buffer, (size_t)length);
+}
+
+// Append a symbol; returns its ID, or -1 on failure
+static int add_symbol(SymbolTable *table, int name_id, SymbolKind kind, int shadowed) {
+    if (!grow((void**)&table->symbols, &table->symbols_capacity, table->num_symbols, sizeof(Symbol))) {
+        return -1;
+    }
+
+    Symbol *symbol = &table->symbols[table->num_symbols];
+    bool function = kind == SYMBOL_FUNCTION || kind == SYMBOL_EXTERNAL;
+
+    symbol->name = strtab_get(table->names, name_id);
+    symbol->kind = kind;
+    symbol->name_id = name_id;
+    symbol->scope = function ? 0 : table->num_scopes;
+    symbol->function = function ? -1 : table->function;
+    symbol->shadowed = shadowed;
+    symbol->depth = shadowed >= 0 ? table->symbols[shadowed].depth + 1 : 0;
+    symbol->ir_name = symbol->depth > 0 ? make_ir_name(table, symbol->name, symbol->depth) : symbol->name;
+    if (!symbol->ir_name) return -1;
+    symbol->first_param = -1;
+    symbol->num_params = 0;
+
+    // A function's parameters are declared one after another
+    if (kind == SYMBOL_PARAM && table->function >= 0) {
+        Symbol *owner = &table->symbols[table->function];
+        if (owner->num_params == 0) owner->first_param = (int)table->num_symbols;
+        if (owner->first_param + owner->num_params == (int)table->num_symbols) owner->num_params++;
+    }
+
+    return (int)table->num_symbols++;
+}
+
+// Declare a name in the innermost scope and return its symbol. Declaring
+// a name again in the same scope returns the first symbol. Functions go in
+// the program-wide function namespace, and implicit variables in the
+// scope of their function.
+int symtab_define(SymbolTable *table, const char *name, SymbolKind kind) {
+    int name_id = intern_name(table, name);
+    if (name_id < 0) {
+        table->failed = true;
+        return -1;
+    }
+
+    if (kind == SYMBOL_FUNCTION || kind == SYMBOL_EXTERNAL) {
+        if (table->function_of[name_id] >= 0) return table->function_of[name_id];
+
+        int id = add_symbol(table, name_id, kind, -1);
+        if (id < 0) {
+            table->failed = true;
+            return -1;
+        }
+        table->function_of[name_id] = id;
+        return id;
+    }
+
+    int visible = table->binding[name_id];
+    if (visible >= 0 && table->symbols[visible].scope == table->num_scopes &&
+        table->symbols[visible].function == table->function) {
+        return visible;
+    }
+
+    bool implicit = kind == SYMBOL_IMPLICIT;
+    int id = -1;
+    if (implicit) {
+        if (grow((void**)&table->implicit, &table->implicit_capacity, table->num_implicit, sizeof(int))) {
+            id = add_symbol(table, name_id, kind, visible);
+        }
+        if (id >= 0) {
+            table->symbols[id].scope = table->num_scopes > 0 ? 1 : 0;
+            table->implicit[table->num_implicit++] = id;
+        }
+    } else if (grow((void**)&table->active, &table->active_capacity, table->num_active, sizeof(int))) {
+        id = add_symbol(table, name_id, kind, visible);
+        if (id >= 0) table->active[table->num_active++] = id;
+    }
+
+    if (id < 0) {
+        table->failed = true;
+        return -1;
+    }
+    table->binding[name_id] = id;
+    return id;
+}
+
+// Innermost visible variable with a name, or -1
+int symtab_lookup(const SymbolTable *table, const char *name) {
+    int name_id = strtab_lookup(table->names, name, strlen(name));
+    return name_id >= 0 && (size_t)name_id < table->names_capacity ? table->binding[name_id] : -1;
+}
+
+// Function with a name, or -1
+int symtab_function(const SymbolTable *table, const char *name) {
+    int name_id = strtab_lookup(table->names, name, strlen(name));
+    return name_id >= 0 && (size_t)name_id < table->names_capacity ? table->function_of[name_id] : -1;
+}
+
+// Get a symbol by ID
+const Symbol* symtab_get(const SymbolTable *table, int id) {
+    return id >= 0 && (size_t)id < table->num_symbols ? &table->symbols[id] : NULL;
+}
+
+// Number of symbols
+size_t symtab_count(const SymbolTable *table) {
+    return table->num_symbols;
+}
+
+// Walk frame slot: set when the node opened a scope
+#define SLOT_SCOPE 0
+
+// Open a scope for blocks and for loops. A function's parameters and the
+// outermost block of its body share the function's scope, and argument
+// lists have no scope of their own.
+static ASTWalkAction resolve_enter(ASTWalkFrame *frame, void *ctx) {
+    SymbolTable *table = (SymbolTable*)ctx;
+    ASTNode *node = frame->node;
+    NodeType parent = frame->parent ? frame->parent->node->type : NODE_PROGRAM;
+
+    switch (node->type) {
+        case NODE_FUNCTION_DECL:
+            node->symbol = symtab_function(table, node->value);
+            table->function = node->symbol;
+            frame->slots[SLOT_SCOPE] = symtab_push_scope(table);
+            break;
+
+        case NODE_BLOCK:
+            if (parent != NODE_FUNCTION_DECL && parent != NODE_CALL) {
+                frame->slots[SLOT_SCOPE] = symtab_push_scope(table);
+            }
+            break;
+
+        case NODE_FOR:
+            // Declarations in the init clause are local to the loop
+            frame->slots[SLOT_SCOPE] = symtab_push_scope(table);
+            break;
+
+        case NODE_IDENTIFIER:
+        case NODE_ASSIGNMENT:
+            if (!node->value || table->function < 0) break;
+            node->symbol = symtab_lookup(table, node->value);
+            if (node->symbol < 0) node->symbol = symtab_define(table, node->value, SYMBOL_IMPLICIT);
+            break;
+
+        case NODE_CALL:
+            if (!node->value) break;
+            node->symbol = symtab_function(table, node->value);
+            if (node->symbol < 0) node->symbol = symtab_define(table, node->value, SYMBOL_EXTERNAL);
+            break;
+
+        default:
+            break;
+    }
+
+    return AST_WALK_CHILDREN;
+}
+
+// Declare variables once their initializer has been resolved, so the
+// initializer still sees what the name meant before; close scopes
+static void resolve_leave(ASTWalkFrame *frame, void *ctx) {
+    SymbolTable *table = (SymbolTable*)ctx;
+    ASTNode *node = frame->node;
+
+    if (node->type == NODE_VARIABLE_DECL && node->value && table->function >= 0) {
+        bool param = frame->parent && frame->parent->parent &&
+                     frame->parent->parent->node->type == NODE_FUNCTION_DECL && frame->parent->index == 0;
+        node->symbol = symtab_define(table, ast_decl_name(node), param ? SYMBOL_PARAM : SYMBOL_VARIABLE);
+    }
+
+    if (frame->slots[SLOT_SCOPE]) symtab_pop_scope(table);
+
+    if (node->type == NODE_FUNCTION_DECL) {
+        // Implicit variables live until the end of their function
+        while (table->num_implicit > 0) {
+            const Symbol *symbol = &table->symbols[table->implicit[--table->num_implicit]];
+            table->binding[symbol->name_id] = symbol->shadowed;
+        }
+        table->function = -1;
+    }
+}
+
+// Resolve every name in a program to a symbol and record it on its node.
+// Functions are declared first so calls can come before the callee.
+bool symtab_resolve(SymbolTable *table, ASTNode *root) {
+    static const ASTVisitor visitor = { resolve_enter, NULL, resolve_leave };
+
+    if (!table || !root) return false;
+
+    for (int i = 0; i < root->num_children; i++) {
+        ASTNode *child = root->children[i];
+        if (child && child->type == NODE_FUNCTION_DECL && child->value) {
+            symtab_define(table, child->value, SYMBOL_FUNCTION);
+        }
+    }
+
+    bool ok = ast_walk(root, &visitor, table);
+    return ok && !table->failed;
+}
+
+// Print how many symbols of each kind there are
+void symtab_print_summary(const SymbolTable *table, FILE *out) {
+    size_t counts[SYMBOL_IMPLICIT + 1] = { 0 };
+    for (size_t i = 0; i < table->num_symbols; i++) counts[table->symbols[i].kind]++;
+
+    fprintf(out, "Symbols: %zu (%zu functions, %zu external, %zu parameters, %zu variables, %zu undeclared)\n",
+            table->num_symbols, counts[SYMBOL_FUNCTION], counts[SYMBOL_EXTERNAL],
+            counts[SYMBOL_PARAM], counts[SYMBOL_VARIABLE], counts[SYMBOL_IMPLICIT]);
+}
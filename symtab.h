@@ -0,0 +1,75 @@
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include "common.h"
+#include "strtab.h"
+
+// What a symbol names
+typedef enum {
+    SYMBOL_FUNCTION,    // Function declared in the program
+    SYMBOL_EXTERNAL,    // Function called but not declared
+    SYMBOL_PARAM,
+    SYMBOL_VARIABLE,
+    SYMBOL_IMPLICIT     // Variable used without a declaration, local to its function
+} SymbolKind;
+
+typedef struct {
+    const char *name;       // As written in the source
+    const char *ir_name;    // In generated code: the name, or "name.N" when it
+                            // hides N enclosing declarations of the same name
+    SymbolKind kind;
+    int name_id;            // ID of the name in SymbolTable.names
+    int scope;              // Depth of the declaring scope, 0 for functions
+    int function;           // Function the symbol belongs to, -1 for functions
+    int shadowed;           // Symbol of the same name it hides, or -1
+    int depth;              // Enclosing declarations of the same name it hides
+    int first_param;        // Functions: symbols first_param.. are the
+    int num_params;         // parameters, in declaration order
+} Symbol;
+
+// Symbol table. Names are interned in an open-addressing hash, and each
+// name ID indexes its innermost visible variable and its function, so
+// looking a name up is one hash probe. Variables declared in a scope
+// sit on the active stack until the scope is popped, which makes the
+// variables they hid visible again. Functions share one program-wide
+// namespace of their own.
+typedef struct {
+    StringTable *names;
+    int *binding;           // Innermost visible variable by name ID, or -1
+    int *function_of;       // Function by name ID, or -1
+    size_t names_capacity;
+
+    Symbol *symbols;        // By symbol ID
+    size_t num_symbols;
+    size_t symbols_capacity;
+
+    int *active;            // Variables of the open scopes, innermost last
+    size_t num_active;
+    size_t active_capacity;
+
+    size_t *scope_start;    // Where each open scope begins in active
+    int num_scopes;
+    int scopes_capacity;
+
+    int *implicit;          // Implicit variables of the current function
+    size_t num_implicit;
+    size_t implicit_capacity;
+
+    int function;           // Function being resolved, -1 outside one
+    bool failed;            // An allocation failed
+} SymbolTable;
+
+// Symbol table functions
+SymbolTable* symtab_create(void);
+void symtab_free(SymbolTable *table);
+bool symtab_push_scope(SymbolTable *table);
+void symtab_pop_scope(SymbolTable *table);
+int symtab_define(SymbolTable *table, const char *name, SymbolKind kind);
+int symtab_lookup(const SymbolTable *table, const char *name);
+int symtab_function(const SymbolTable *table, const char *name);
+const Symbol* symtab_get(const SymbolTable *table, int id);
+size_t symtab_count(const SymbolTable *table);
+bool symtab_resolve(SymbolTable *table, ASTNode *root);
+void symtab_print_summary(const SymbolTable *table, FILE *out);
+
+#endif // SYMTAB_H
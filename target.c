@@ -0,0 +1,221 @@
+#include "target.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Target instruction mnemonics, indexed by TargetOp
+static const char *const target_names[TARGET_OPCODE_COUNT] = {
+    "", "MOV", "LOAD", "STORE", "PUSH", "POP",
+    "ADD", "SUB", "MUL", "DIV", "MOD", "EQ", "NEQ", "LT", "LTE", "GT", "GTE",
+    "AND", "OR", "BAND", "BOR", "BXOR",
+    "NEG", "NOT", "BNOT",
+    "CMP", "JE", "JMP", "CALL", "RET", ""
+};
+
+// Start empty target code
+void target_init(TargetCode *target) {
+    memset(target, 0, sizeof(*target));
+}
+
+// Free target code
+void target_free(TargetCode *target) {
+    if (!target) return;
+    free(target->code);
+    target_init(target);
+}
+
+// Missing operand
+TargetArg target_none(void) {
+    TargetArg arg = { TARGET_ARG_NONE, { IR_NONE, 0 } };
+    return arg;
+}
+
+// Register operand
+TargetArg target_reg(int reg) {
+    TargetArg arg = { TARGET_ARG_REG, { IR_NONE, reg } };
+    return arg;
+}
+
+// Immediate operand: a constant, literal, label or function
+TargetArg target_imm(IROperand value) {
+    TargetArg arg = { TARGET_ARG_IMM, value };
+    return arg;
+}
+
+// Memory operand of a variable or temporary
+TargetArg target_mem(IROperand var) {
+    TargetArg arg = { TARGET_ARG_MEM, var };
+    return arg;
+}
+
+// Frame slot operand
+TargetArg target_frame(int slot) {
+    TargetArg arg = { TARGET_ARG_FRAME, { IR_NONE, slot } };
+    return arg;
+}
+
+// Check if two operands are the same register, immediate or memory
+bool target_same_arg(TargetArg a, TargetArg b) {
+    return a.kind == b.kind && ir_same_operand(a.value, b.value);
+}
+
+// Append a target instruction
+void target_emit(TargetCode *target, TargetOp op, TargetArg a, TargetArg b, TargetArg c) {
+    if (target->num_code == target->capacity) {
+        size_t capacity = target->capacity ? target->capacity * 2 : 256;
+        TargetInsn *code = (TargetInsn*)realloc(target->code, sizeof(TargetInsn) * capacity);
+        if (!code) {
+            target->failed = true;
+            return;
+        }
+        target->code = code;
+        target->capacity = capacity;
+    }
+
+    TargetInsn *insn = &target->code[target->num_code++];
+    insn->op = op;
+    insn->args[0] = a;
+    insn->args[1] = b;
+    insn->args[2] = c;
+}
+
+// Append an instruction with one operand
+static void emit1(TargetCode *target, TargetOp op, TargetArg a) {
+    target_emit(target, op, a, target_none(), target_none());
+}
+
+// Append an instruction with two operands
+static void emit2(TargetCode *target, TargetOp op, TargetArg a, TargetArg b) {
+    target_emit(target, op, a, b, target_none());
+}
+
+// Lower the stack code of a program one instruction at a time, with R1
+// carrying each value to or from the stack
+bool target_lower_stack(TargetCode *target, const IRProgram *ir) {
+    TargetArg r1 = target_reg(1);
+    TargetArg sp = target_reg(TARGET_SP);
+    TargetArg fp = target_reg(TARGET_FP);
+
+    for (size_t i = 0; i < ir->num_stack; i++) {
+        const StackInsn *insn = &ir->stack[i];
+
+        switch (insn->op) {
+            case STACK_ADD:
+            case STACK_SUB:
+            case STACK_MUL:
+            case STACK_DIV:
+                target_emit(target, (TargetOp)(TARGET_ADD + (insn->op - STACK_ADD)),
+                            r1, target_reg(2), target_reg(3));
+                break;
+            case STACK_PUSH:
+                emit2(target, TARGET_MOV, r1, target_imm(insn->arg));
+                emit1(target, TARGET_PUSH, r1);
+                break;
+            case STACK_LOAD:
+                emit2(target, TARGET_LOAD, r1, target_mem(insn->arg));
+                emit1(target, TARGET_PUSH, r1);
+                break;
+            case STACK_STORE:
+                emit1(target, TARGET_POP, r1);
+                emit2(target, TARGET_STORE, target_mem(insn->arg), r1);
+                break;
+            case STACK_POP:
+                emit1(target, TARGET_POP, target_none());
+                break;
+            case STACK_JZ:
+                emit1(target, TARGET_POP, r1);
+                emit2(target, TARGET_CMP, r1, target_imm(ir_const(0)));
+                emit1(target, TARGET_JE, target_imm(insn->arg));
+                break;
+            case STACK_JMP:
+                emit1(target, TARGET_JMP, target_imm(insn->arg));
+                break;
+            case STACK_CALL:
+                emit1(target, TARGET_CALL, target_imm(insn->arg));
+                break;
+            case STACK_RET:
+                emit1(target, TARGET_POP, r1);
+                emit1(target, TARGET_RET, target_none());
+                break;
+            case STACK_RET0:
+                emit1(target, TARGET_RET, target_none());
+                break;
+            case STACK_FUNC:
+                emit1(target, TARGET_LABEL, target_imm(insn->arg));
+                emit1(target, TARGET_PUSH, fp);
+                emit2(target, TARGET_MOV, fp, sp);
+                break;
+            case STACK_END_FUNC:
+                emit2(target, TARGET_MOV, sp, fp);
+                emit1(target, TARGET_POP, fp);
+                emit1(target, TARGET_RET, target_none());
+                break;
+            case STACK_LABEL:
+                emit1(target, TARGET_LABEL, target_imm(insn->arg));
+                break;
+            case STACK_OPCODE_COUNT:
+                break;
+            default:
+                // The other operators work on the stack and take no operands
+                emit1(target, (TargetOp)(TARGET_ADD + (insn->op - STACK_ADD)), target_none());
+                break;
+        }
+    }
+
+    return !target->failed;
+}
+
+// Write one operand as text
+static void write_arg(OutBuf *out, const IRProgram *ir, TargetArg arg) {
+    switch (arg.kind) {
+        case TARGET_ARG_NONE:
+            break;
+        case TARGET_ARG_REG:
+            if (arg.value.value == TARGET_SP) {
+                outbuf_puts(out, "SP");
+            } else if (arg.value.value == TARGET_FP) {
+                outbuf_puts(out, "FP");
+            } else {
+                outbuf_putc(out, 'R');
+                outbuf_int(out, (long)arg.value.value);
+            }
+            break;
+        case TARGET_ARG_IMM:
+            ir_write_operand(out, ir, arg.value);
+            break;
+        case TARGET_ARG_MEM:
+            outbuf_putc(out, '[');
+            ir_write_operand(out, ir, arg.value);
+            outbuf_putc(out, ']');
+            break;
+        case TARGET_ARG_FRAME:
+            outbuf_puts(out, "[FP-");
+            outbuf_int(out, (long)arg.value.value);
+            outbuf_putc(out, ']');
+            break;
+    }
+}
+
+// Write target code as text
+void target_write(OutBuf *out, const IRProgram *ir, const TargetCode *target) {
+    for (size_t i = 0; i < target->num_code; i++) {
+        const TargetInsn *insn = &target->code[i];
+
+        if (insn->op == TARGET_LABEL) {
+            write_arg(out, ir, insn->args[0]);
+            outbuf_puts(out, ":\n");
+            continue;
+        }
+        if (insn->op == TARGET_END_FUNC) {
+            outbuf_putc(out, '\n');
+            continue;
+        }
+
+        outbuf_puts(out, "    ");
+        outbuf_puts(out, target_names[insn->op]);
+        for (int k = 0; k < 3 && insn->args[k].kind != TARGET_ARG_NONE; k++) {
+            outbuf_puts(out, k == 0 ? " " : ", ");
+            write_arg(out, ir, insn->args[k]);
+        }
+        outbuf_putc(out, '\n');
+    }
+}
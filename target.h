@@ -0,0 +1,92 @@
+#ifndef TARGET_H
+#define TARGET_H
+
+#include "common.h"
+#include "ir.h"
+#include "outbuf.h"
+
+// Register numbers of the stack and frame pointers; R0 and up are
+// numbered from 0
+#define TARGET_SP 1000
+#define TARGET_FP 1001
+
+// What a target instruction operand refers to
+typedef enum {
+    TARGET_ARG_NONE,
+    TARGET_ARG_REG,     // Register; value.value is its number
+    TARGET_ARG_IMM,     // Constant, literal, label or function, printed as is
+    TARGET_ARG_MEM,     // [name]: memory of a variable or temporary
+    TARGET_ARG_FRAME    // [FP-k]: frame slot k; value.value is k
+} TargetArgKind;
+
+typedef struct {
+    TargetArgKind kind;
+    IROperand value;
+} TargetArg;
+
+// Target machine instructions. The ALU opcodes are in the same order as
+// IR_ADD..IR_BNOT.
+typedef enum {
+    TARGET_LABEL,       // a:
+    TARGET_MOV,         // MOV a, b
+    TARGET_LOAD,        // LOAD a, [b]
+    TARGET_STORE,       // STORE [a], b
+    TARGET_PUSH,
+    TARGET_POP,
+    TARGET_ADD,         // ADD a, b, c, through TARGET_BXOR
+    TARGET_SUB,
+    TARGET_MUL,
+    TARGET_DIV,
+    TARGET_MOD,
+    TARGET_EQ,
+    TARGET_NEQ,
+    TARGET_LT,
+    TARGET_LTE,
+    TARGET_GT,
+    TARGET_GTE,
+    TARGET_AND,
+    TARGET_OR,
+    TARGET_BAND,
+    TARGET_BOR,
+    TARGET_BXOR,
+    TARGET_NEG,         // NEG a, b, through TARGET_BNOT
+    TARGET_NOT,
+    TARGET_BNOT,
+    TARGET_CMP,
+    TARGET_JE,
+    TARGET_JMP,
+    TARGET_CALL,
+    TARGET_RET,
+    TARGET_END_FUNC,    // Marks the end of a function; printed as a blank line
+    TARGET_OPCODE_COUNT
+} TargetOp;
+
+// Target instruction; unused operands are TARGET_ARG_NONE
+typedef struct {
+    TargetOp op;
+    TargetArg args[3];
+} TargetInsn;
+
+// Target code for a whole program, kept as instructions until it is
+// written so it can still be rewritten
+typedef struct {
+    TargetInsn *code;
+    size_t num_code;
+    size_t capacity;
+    bool failed;        // An allocation failed while appending
+} TargetCode;
+
+// Target code functions
+void target_init(TargetCode *target);
+void target_free(TargetCode *target);
+TargetArg target_none(void);
+TargetArg target_reg(int reg);
+TargetArg target_imm(IROperand value);
+TargetArg target_mem(IROperand var);
+TargetArg target_frame(int slot);
+bool target_same_arg(TargetArg a, TargetArg b);
+void target_emit(TargetCode *target, TargetOp op, TargetArg a, TargetArg b, TargetArg c);
+bool target_lower_stack(TargetCode *target, const IRProgram *ir);
+void target_write(OutBuf *out, const IRProgram *ir, const TargetCode *target);
+
+#endif // TARGET_H
@@ -0,0 +1,111 @@
+#include "token_stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WINDOW_MASK (TOKEN_STREAM_WINDOW - 1)
+
+// Stream over a complete token array
+void token_stream_init_array(TokenStream *stream, Token *tokens, size_t num_tokens) {
+    stream->lexer = NULL;
+    stream->tokens = tokens;
+    stream->num_tokens = num_tokens;
+    stream->position = 0;
+    stream->pulled = 0;
+    stream->failed = false;
+}
+
+// Stream that pulls tokens from a lexer on demand
+void token_stream_init_lexer(TokenStream *stream, Lexer *lexer) {
+    stream->lexer = lexer;
+    stream->tokens = NULL;
+    stream->num_tokens = 0;
+    stream->position = 0;
+    stream->pulled = 0;
+    stream->failed = false;
+}
+
+// Check if the most recently pulled token ends the stream
+static bool pulled_eof(TokenStream *stream) {
+    return stream->pulled > 0 &&
+           stream->window[(stream->pulled - 1) & WINDOW_MASK].type == TOKEN_EOF;
+}
+
+// Pull tokens until index is in the window (or the stream has ended)
+static Token* pull_until(TokenStream *stream, size_t index) {
+    while (stream->pulled <= index && !pulled_eof(stream)) {
+        Token *slot = &stream->window[stream->pulled & WINDOW_MASK];
+
+        if (!lexer_next_token(stream->lexer, slot)) {
+            // Turn a lexer failure into EOF so parsers stop cleanly
+            stream->failed = true;
+            slot->type = TOKEN_EOF;
+            slot->kind = KIND_NONE;
+            slot->value = "";
+            slot->id = -1;
+            slot->length = 0;
+        }
+        stream->pulled++;
+    }
+
+    // Past the end every index reads as the EOF token
+    if (index >= stream->pulled) {
+        index = stream->pulled - 1;
+    }
+    return &stream->window[index & WINDOW_MASK];
+}
+
+// Get the token `ahead` positions after the current one (0 = current)
+Token* token_stream_peek(TokenStream *stream, size_t ahead) {
+    if (ahead >= TOKEN_STREAM_LOOKAHEAD) {
+        ahead = TOKEN_STREAM_LOOKAHEAD - 1;
+    }
+
+    size_t index = stream->position + ahead;
+
+    if (!stream->lexer) {
+        if (stream->num_tokens == 0) return NULL;
+        if (index >= stream->num_tokens) index = stream->num_tokens - 1;
+        return &stream->tokens[index];
+    }
+
+    return pull_until(stream, index);
+}
+
+// Get the most recently consumed token (the current one at the start)
+Token* token_stream_previous(TokenStream *stream) {
+    if (stream->position == 0) {
+        return token_stream_peek(stream, 0);
+    }
+
+    if (!stream->lexer) {
+        size_t index = stream->position - 1;
+        if (index >= stream->num_tokens) index = stream->num_tokens - 1;
+        return &stream->tokens[index];
+    }
+
+    return pull_until(stream, stream->position - 1);
+}
+
+// Move to the next token
+void token_stream_advance(TokenStream *stream) {
+    stream->position++;
+}
+
+// Get the index of the current token
+size_t token_stream_position(TokenStream *stream) {
+    return stream->position;
+}
+
+// Move back to an earlier position. In pull mode only the last
+// TOKEN_STREAM_HISTORY consumed tokens can be revisited.
+bool token_stream_rewind(TokenStream *stream, size_t position) {
+    if (position > stream->position) return false;
+
+    if (stream->lexer && stream->position - position > TOKEN_STREAM_HISTORY) {
+        return false;
+    }
+
+    stream->position = position;
+    return true;
+}
@@ -0,0 +1,36 @@
+#ifndef TOKEN_STREAM_H
+#define TOKEN_STREAM_H
+
+#include "common.h"
+#include "lexer.h"
+
+// Window sizes for pull mode. The window is a ring buffer that holds the
+// tokens a parser may still look at: up to TOKEN_STREAM_LOOKAHEAD tokens
+// ahead of the cursor and TOKEN_STREAM_HISTORY already consumed ones.
+#define TOKEN_STREAM_LOOKAHEAD 4
+#define TOKEN_STREAM_HISTORY 4
+#define TOKEN_STREAM_WINDOW 8   // Power of two >= LOOKAHEAD + HISTORY
+
+// Token source for the parsers: either a complete token array (as produced
+// by lexer_tokenize) or a lexer pulled one token at a time, in which case
+// memory is bounded by the window instead of by the input size.
+typedef struct {
+    Lexer *lexer;         // Pull mode: lexer feeding the window (NULL in array mode)
+    Token *tokens;        // Array mode: all tokens, ending with TOKEN_EOF
+    size_t num_tokens;
+    Token window[TOKEN_STREAM_WINDOW];
+    size_t position;      // Index of the current token in the stream
+    size_t pulled;        // Pull mode: number of tokens read from the lexer
+    bool failed;          // Pull mode: the lexer could not produce a token
+} TokenStream;
+
+// Token stream functions
+void token_stream_init_array(TokenStream *stream, Token *tokens, size_t num_tokens);
+void token_stream_init_lexer(TokenStream *stream, Lexer *lexer);
+Token* token_stream_peek(TokenStream *stream, size_t ahead);
+Token* token_stream_previous(TokenStream *stream);
+void token_stream_advance(TokenStream *stream);
+size_t token_stream_position(TokenStream *stream);
+bool token_stream_rewind(TokenStream *stream, size_t position);
+
+#endif // TOKEN_STREAM_H
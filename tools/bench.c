@@ -0,0 +1,509 @@
+// Phase benchmarks for the compiler
+//
+// Runs each phase of the compiler many times over the given programs and
+// reports the median and 99th percentile time of a run, with the phase's
+// throughput. Built against the compiler's sources and run by hand, it is
+// not part of the compiler:
+//
+//   gcc -O2 -I. -o bench tools/bench.c $(ls *.c | grep -v '^main.c$') -lpthread
+//   gcc -O2 -o benchgen tools/benchgen.c
+//   ./benchgen --size 4M > big.c
+//   ./bench --runs 20 --save baseline.txt big.c
+//   ./bench --runs 20 --baseline baseline.txt big.c
+//
+// The phases are lex, parse-rd, parse-lalr, resolve and generate, then
+// one per artifact writer, named as in --emit. Lexing, parsing, resolving
+// and generating are timed from scratch each run and their MB/s is of
+// source bytes. The writers share one generated program and write to
+// /dev/null; their MB/s is of bytes written. Stack and target code are
+// lowered by their writers, so those include the lowering.
+//
+// A baseline file holds one "file phase median-ms p99-ms" line per
+// result. With --baseline, a median more than --threshold percent above
+// the baseline's is reported as a regression and the exit status is 1.
+
+#include "arena.h"
+#include "ast.h"
+#include "ast_flat.h"
+#include "codegen.h"
+#include "lexer.h"
+#include "outbuf.h"
+#include "parser_lalr.h"
+#include "parser_rd.h"
+#include "source.h"
+#include "symtab.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_BASELINE_NAME 512
+
+// One program and the products shared by its benchmarks
+typedef struct {
+    SourceBuffer source;
+    Lexer *lexer;         // Tokens of the source
+    Arena *arena;         // Holds ast
+    ASTNode *ast;         // Parsed by the recursive descent parser
+    SymbolTable *symbols; // Resolved over ast
+    CodeGenerator *codegen; // Generated from ast, for the writers
+    Arena *scratch;       // For the parse benchmarks, reset after each run
+    FILE *devnull;
+    int opt_level;
+    int num_regs;
+} BenchInput;
+
+// Runs a phase once; returns false on failure and sets *bytes to the
+// bytes its MB/s is of
+typedef bool (*BenchFn)(BenchInput *input, uint64_t *bytes);
+
+typedef struct {
+    const char *name;
+    BenchFn run;
+} Benchmark;
+
+// A phase's times over all runs of it
+typedef struct {
+    const char *file;
+    const char *phase;
+    double median_ms;
+    double p99_ms;
+    double mb_per_second;
+} BenchResult;
+
+// Baseline results, read from a file
+typedef struct {
+    char file[MAX_BASELINE_NAME];
+    char phase[64];
+    double median_ms;
+    double p99_ms;
+} BaselineEntry;
+
+typedef struct {
+    BaselineEntry *entries;
+    size_t count;
+} Baseline;
+
+// Seconds on the monotonic clock
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static bool bench_lex(BenchInput *input, uint64_t *bytes) {
+    Lexer *lexer = lexer_init_borrowed(input->source.data, input->source.length);
+    bool ok = lexer && lexer_tokenize(lexer);
+    lexer_free(lexer);
+    *bytes = input->source.length;
+    return ok;
+}
+
+static bool bench_parse_rd(BenchInput *input, uint64_t *bytes) {
+    size_t num_tokens;
+    Token *tokens = lexer_get_tokens(input->lexer, &num_tokens);
+
+    ast_set_arena(input->scratch);
+    RDParser *parser = parser_rd_init(tokens, num_tokens);
+    bool ok = parser && parser_rd_parse(parser) && !parser_rd_had_error(parser);
+    parser_rd_free(parser);
+    ast_set_arena(NULL);
+    arena_reset(input->scratch);
+
+    *bytes = input->source.length;
+    return ok;
+}
+
+static bool bench_parse_lalr(BenchInput *input, uint64_t *bytes) {
+    size_t num_tokens;
+    Token *tokens = lexer_get_tokens(input->lexer, &num_tokens);
+
+    ast_set_arena(input->scratch);
+    LALRParser *parser = parser_lalr_init(tokens, num_tokens);
+    bool ok = parser && parser_lalr_parse(parser) && !parser_lalr_had_error(parser);
+    parser_lalr_free(parser);
+    ast_set_arena(NULL);
+    arena_reset(input->scratch);
+
+    *bytes = input->source.length;
+    return ok;
+}
+
+// Resolving again sets the same symbol IDs, so the shared AST is unchanged
+static bool bench_resolve(BenchInput *input, uint64_t *bytes) {
+    SymbolTable *symbols = symtab_create();
+    bool ok = symbols && symtab_resolve(symbols, input->ast);
+    symtab_free(symbols);
+    *bytes = input->source.length;
+    return ok;
+}
+
+// Set up a code generator over the input's AST as the driver does
+static CodeGenerator* new_codegen(BenchInput *input) {
+    CodeGenerator *codegen = codegen_init(input->ast);
+    if (!codegen) return NULL;
+
+    codegen_set_symbols(codegen, input->symbols);
+    codegen_set_optimization(codegen, input->opt_level);
+    codegen_set_jobs(codegen, 1);
+    codegen_set_registers(codegen, input->num_regs);
+    codegen_set_peephole(codegen, input->opt_level > 0);
+    return codegen;
+}
+
+static bool bench_generate(BenchInput *input, uint64_t *bytes) {
+    CodeGenerator *codegen = new_codegen(input);
+    bool ok = codegen && codegen_generate(codegen);
+    codegen_free(codegen);
+    *bytes = input->source.length;
+    return ok;
+}
+
+// Run one writer into /dev/null through an output buffer, as the save
+// functions do into their files
+#define WRITER_BENCH(fn_name, call)                                  \
+    static bool fn_name(BenchInput *input, uint64_t *bytes) {        \
+        OutBuf *out = outbuf_wrap(input->devnull);                   \
+        if (!out) return false;                                      \
+        bool ok = (call);                                            \
+        ok = outbuf_flush(out) && ok;                                \
+        *bytes = outbuf_bytes(out);                                  \
+        outbuf_close(out);                                           \
+        return ok;                                                   \
+    }
+
+WRITER_BENCH(bench_tokens, lexer_write_tokens(input->lexer, out))
+WRITER_BENCH(bench_tokens_json, lexer_write_tokens_json(input->lexer, out, JSON_PRETTY))
+WRITER_BENCH(bench_tokens_bin, lexer_write_tokens_bin(input->lexer, out))
+WRITER_BENCH(bench_ast, ast_write_text(input->ast, out))
+WRITER_BENCH(bench_ast_dot, ast_write_dot(input->ast, out))
+WRITER_BENCH(bench_ast_json, ast_write_json(input->ast, out, JSON_PRETTY))
+WRITER_BENCH(bench_ast_bin, ast_write_bin(input->ast, out))
+WRITER_BENCH(bench_tac, codegen_write_tac(input->codegen, out))
+WRITER_BENCH(bench_stack, codegen_write_stack_code(input->codegen, out))
+WRITER_BENCH(bench_target, codegen_write_target_code(input->codegen, out))
+
+static const Benchmark benchmarks[] = {
+    { "lex", bench_lex },
+    { "parse-rd", bench_parse_rd },
+    { "parse-lalr", bench_parse_lalr },
+    { "resolve", bench_resolve },
+    { "generate", bench_generate },
+    { "tokens", bench_tokens },
+    { "tokens-json", bench_tokens_json },
+    { "tokens-bin", bench_tokens_bin },
+    { "ast", bench_ast },
+    { "ast-dot", bench_ast_dot },
+    { "ast-json", bench_ast_json },
+    { "ast-bin", bench_ast_bin },
+    { "tac", bench_tac },
+    { "stack", bench_stack },
+    { "target", bench_target },
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+// Read a program and build the products its benchmarks share
+static bool input_open(BenchInput *input, const char *filename) {
+    if (!source_open(filename, &input->source)) {
+        fprintf(stderr, "Error: Could not read %s\n", filename);
+        return false;
+    }
+
+    input->lexer = lexer_init_borrowed(input->source.data, input->source.length);
+    if (!input->lexer || !lexer_tokenize(input->lexer)) {
+        fprintf(stderr, "Error: Tokenization of %s failed\n", filename);
+        return false;
+    }
+
+    input->arena = arena_create(ARENA_DEFAULT_CHUNK_SIZE);
+    input->scratch = arena_create(ARENA_DEFAULT_CHUNK_SIZE);
+    if (!input->arena || !input->scratch) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return false;
+    }
+
+    size_t num_tokens;
+    Token *tokens = lexer_get_tokens(input->lexer, &num_tokens);
+    ast_set_arena(input->arena);
+    RDParser *parser = parser_rd_init(tokens, num_tokens);
+    if (parser) {
+        input->ast = parser_rd_parse(parser);
+        if (parser_rd_had_error(parser)) input->ast = NULL;
+    }
+    parser_rd_free(parser);
+    ast_set_arena(NULL);
+    if (!input->ast) {
+        fprintf(stderr, "Error: Parsing %s failed\n", filename);
+        return false;
+    }
+
+    input->symbols = symtab_create();
+    if (!input->symbols || !symtab_resolve(input->symbols, input->ast)) {
+        fprintf(stderr, "Error: Could not resolve symbols of %s\n", filename);
+        return false;
+    }
+
+    input->codegen = new_codegen(input);
+    if (!input->codegen || !codegen_generate(input->codegen)) {
+        fprintf(stderr, "Error: Code generation for %s failed\n", filename);
+        return false;
+    }
+    return true;
+}
+
+// Free a program's products; safe after a failed input_open
+static void input_close(BenchInput *input) {
+    codegen_free(input->codegen);
+    symtab_free(input->symbols);
+    if (input->arena) arena_destroy(input->arena);
+    if (input->scratch) arena_destroy(input->scratch);
+    lexer_free(input->lexer);
+    if (input->source.data) source_close(&input->source);
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Time runs of a benchmark after one untimed warm-up run
+static bool run_benchmark(const Benchmark *bench, BenchInput *input, int runs, double *times,
+                          BenchResult *result) {
+    uint64_t bytes = 0;
+    if (!bench->run(input, &bytes)) return false;
+
+    for (int i = 0; i < runs; i++) {
+        double start = now_seconds();
+        if (!bench->run(input, &bytes)) return false;
+        times[i] = now_seconds() - start;
+    }
+
+    qsort(times, (size_t)runs, sizeof(double), compare_doubles);
+    double median = runs % 2 ? times[runs / 2] : (times[runs / 2 - 1] + times[runs / 2]) / 2;
+    int p99_index = (runs * 99 + 99) / 100 - 1;
+    result->median_ms = median * 1e3;
+    result->p99_ms = times[p99_index] * 1e3;
+    result->mb_per_second = median > 0 ? (double)bytes / (1024.0 * 1024.0) / median : 0;
+    return true;
+}
+
+// Read a baseline file; blank lines and lines starting with '#' are skipped
+static bool baseline_load(Baseline *baseline, const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "Error: Could not open baseline %s\n", filename);
+        return false;
+    }
+
+    size_t capacity = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+
+        if (baseline->count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            BaselineEntry *entries = (BaselineEntry*)realloc(baseline->entries, capacity * sizeof(BaselineEntry));
+            if (!entries) {
+                fclose(file);
+                fprintf(stderr, "Error: Memory allocation failed\n");
+                return false;
+            }
+            baseline->entries = entries;
+        }
+
+        BaselineEntry *entry = &baseline->entries[baseline->count];
+        if (sscanf(line, "%511s %63s %lf %lf", entry->file, entry->phase, &entry->median_ms,
+                   &entry->p99_ms) != 4) {
+            fclose(file);
+            fprintf(stderr, "Error: Malformed baseline line: %s", line);
+            return false;
+        }
+        baseline->count++;
+    }
+
+    fclose(file);
+    return true;
+}
+
+// Baseline entry for a file's phase, or NULL
+static const BaselineEntry* baseline_find(const Baseline *baseline, const char *file, const char *phase) {
+    for (size_t i = 0; i < baseline->count; i++) {
+        const BaselineEntry *entry = &baseline->entries[i];
+        if (strcmp(entry->file, file) == 0 && strcmp(entry->phase, phase) == 0) return entry;
+    }
+    return NULL;
+}
+
+// Write results as a baseline file
+static bool baseline_save(const BenchResult *results, size_t count, int runs, const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        fprintf(stderr, "Error: Could not create baseline %s\n", filename);
+        return false;
+    }
+
+    fprintf(file, "# file phase median-ms p99-ms (%d runs)\n", runs);
+    for (size_t i = 0; i < count; i++) {
+        fprintf(file, "%s %s %.6f %.6f\n", results[i].file, results[i].phase, results[i].median_ms,
+                results[i].p99_ms);
+    }
+
+    bool ok = fclose(file) == 0;
+    if (!ok) fprintf(stderr, "Error: Could not write baseline %s\n", filename);
+    return ok;
+}
+
+// Check if a phase is in a comma-separated list
+static bool phase_listed(const char *list, const char *phase) {
+    size_t length = strlen(phase);
+    for (const char *p = list; *p; ) {
+        const char *end = strchr(p, ',');
+        size_t item = end ? (size_t)(end - p) : strlen(p);
+        if (item == length && strncmp(p, phase, length) == 0) return true;
+        p += item + (end ? 1 : 0);
+    }
+    return false;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [options] <file>...\n"
+            "  --runs <n>          Timed runs of each phase (default: 10)\n"
+            "  --phases <list>     Only these phases, comma-separated (default: all)\n"
+            "  -O<level>           Optimization level of generate and the writers (default: 0)\n"
+            "  --regs <n>          Registers for target code, 0 for stack-based (default: 0)\n"
+            "  --baseline <file>   Compare medians against a saved baseline\n"
+            "  --threshold <pct>   Slowdown reported as a regression (default: 10)\n"
+            "  --save <file>       Save the results as a baseline\n",
+            program);
+}
+
+int main(int argc, char **argv) {
+    int runs = 10;
+    int opt_level = 0;
+    int num_regs = 0;
+    double threshold = 10;
+    const char *phases = NULL;
+    const char *baseline_file = NULL;
+    const char *save_file = NULL;
+    int first_file = argc;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strncmp(arg, "-O", 2) == 0 && arg[2] >= '0' && arg[2] <= '2' && arg[3] == '\0') {
+            opt_level = arg[2] - '0';
+            continue;
+        }
+        if (arg[0] != '-') {
+            first_file = i;
+            break;
+        }
+
+        bool ok = value != NULL;
+        if (ok && strcmp(arg, "--runs") == 0) {
+            runs = atoi(value);
+            ok = runs > 0;
+        } else if (ok && strcmp(arg, "--phases") == 0) {
+            phases = value;
+        } else if (ok && strcmp(arg, "--regs") == 0) {
+            num_regs = atoi(value);
+            ok = num_regs == 0 || (num_regs >= 3 && num_regs <= 64);
+        } else if (ok && strcmp(arg, "--baseline") == 0) {
+            baseline_file = value;
+        } else if (ok && strcmp(arg, "--threshold") == 0) {
+            threshold = atof(value);
+            ok = threshold >= 0;
+        } else if (ok && strcmp(arg, "--save") == 0) {
+            save_file = value;
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    if (first_file >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Baseline baseline = { NULL, 0 };
+    if (baseline_file && !baseline_load(&baseline, baseline_file)) return 1;
+
+    size_t max_results = (size_t)(argc - first_file) * NUM_BENCHMARKS;
+    BenchResult *results = (BenchResult*)malloc(max_results * sizeof(BenchResult));
+    double *times = (double*)malloc((size_t)runs * sizeof(double));
+    if (!results || !times) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 1;
+    }
+
+    size_t num_results = 0;
+    int regressions = 0;
+    bool failed = false;
+
+    printf("%-24s %-12s %6s %12s %12s %10s", "file", "phase", "runs", "median ms", "p99 ms", "MB/s");
+    printf(baseline_file ? " %10s\n" : "\n", "vs base");
+
+    for (int f = first_file; f < argc && !failed; f++) {
+        BenchInput input;
+        memset(&input, 0, sizeof(input));
+        input.opt_level = opt_level;
+        input.num_regs = num_regs;
+        input.devnull = fopen("/dev/null", "w");
+
+        if (!input.devnull || !input_open(&input, argv[f])) {
+            failed = true;
+        }
+
+        for (size_t b = 0; b < NUM_BENCHMARKS && !failed; b++) {
+            const Benchmark *bench = &benchmarks[b];
+            if (phases && !phase_listed(phases, bench->name)) continue;
+
+            BenchResult *result = &results[num_results];
+            result->file = argv[f];
+            result->phase = bench->name;
+            if (!run_benchmark(bench, &input, runs, times, result)) {
+                fprintf(stderr, "Error: Phase %s failed on %s\n", bench->name, argv[f]);
+                failed = true;
+                break;
+            }
+            num_results++;
+
+            printf("%-24s %-12s %6d %12.3f %12.3f %10.1f", result->file, result->phase, runs,
+                   result->median_ms, result->p99_ms, result->mb_per_second);
+
+            const BaselineEntry *base = baseline_file ? baseline_find(&baseline, result->file, result->phase) : NULL;
+            if (base && base->median_ms > 0) {
+                double change = (result->median_ms - base->median_ms) / base->median_ms * 100;
+                bool regressed = change > threshold;
+                if (regressed) regressions++;
+                printf(" %+9.1f%%%s\n", change, regressed ? "  REGRESSION" : "");
+            } else {
+                printf(baseline_file ? " %10s\n" : "\n", "-");
+            }
+            fflush(stdout);
+        }
+
+        input_close(&input);
+        if (input.devnull) fclose(input.devnull);
+    }
+
+    if (!failed && save_file && !baseline_save(results, num_results, runs, save_file)) failed = true;
+    if (!failed && baseline_file) {
+        printf("%d of %zu phases regressed by more than %.1f%%\n", regressions, num_results, threshold);
+    }
+
+    free(times);
+    free(results);
+    free(baseline.entries);
+    return failed || regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,360 @@
+// Synthetic program generator for the benchmarks
+//
+// Writes a random program in the compiler's C subset to stdout. The shape
+// is set by the options, and the same seed always gives the same program.
+// Built and run by hand, it is not part of the compiler:
+//
+//   gcc -O2 -o benchgen tools/benchgen.c
+//   ./benchgen --functions 32 --depth 4 --loops 2 --reuse 70 --size 16M > big.c
+//
+// Functions come in rounds of --functions, each function calling earlier
+// ones of its round, until the output reaches --size. Without --size, one
+// round is written. A main function calling the last round ends the
+// program. Division and remainder only ever have a nonzero constant on
+// their right, so the programs can also be run.
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LOCALS 64
+#define MAX_PARAMS 3
+
+// Generator settings
+typedef struct {
+    int functions;        // Functions per round
+    int statements;       // Statements per block, at most
+    int depth;            // Expression depth, at most
+    int loops;            // Loop nesting, at most
+    int reuse;            // Percent of names that reuse a variable in scope
+    uint64_t size;        // Bytes to write at least, 0 for one round
+    uint64_t seed;
+} GenOptions;
+
+// Generator state
+typedef struct {
+    const GenOptions *options;
+    FILE *out;
+    uint64_t written;     // Bytes written so far
+    uint64_t rng;
+    int round;
+    int function;         // Index of the function being written in its round
+    int *num_params;      // Parameters of each function of the round
+    char locals[MAX_LOCALS][16]; // Variables in scope, innermost last
+    int num_locals;
+    int next_name;        // Suffix of the next fresh variable
+} Gen;
+
+// Next pseudo-random number (xorshift64*)
+static uint64_t next_random(Gen *gen) {
+    gen->rng ^= gen->rng >> 12;
+    gen->rng ^= gen->rng << 25;
+    gen->rng ^= gen->rng >> 27;
+    return gen->rng * 0x2545F4914F6CDD1DULL;
+}
+
+// Random number in [0, bound)
+static int below(Gen *gen, int bound) {
+    return (int)(next_random(gen) % (uint64_t)bound);
+}
+
+// True with the given percent chance
+static bool chance(Gen *gen, int percent) {
+    return below(gen, 100) < percent;
+}
+
+// Write formatted text, counting its bytes
+static void emit(Gen *gen, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vfprintf(gen->out, format, args);
+    va_end(args);
+    if (length > 0) gen->written += (uint64_t)length;
+}
+
+// Write indentation for a nesting level
+static void indent(Gen *gen, int level) {
+    for (int i = 0; i < level; i++) emit(gen, "    ");
+}
+
+// Bring a declared variable into scope
+static void add_local(Gen *gen, const char *name) {
+    int slot = gen->num_locals < MAX_LOCALS ? gen->num_locals++ : below(gen, MAX_LOCALS);
+    snprintf(gen->locals[slot], sizeof(gen->locals[slot]), "%s", name);
+}
+
+// A variable in scope, or NULL if there is none
+static const char* some_local(Gen *gen) {
+    return gen->num_locals > 0 ? gen->locals[below(gen, gen->num_locals)] : NULL;
+}
+
+static void write_expr(Gen *gen, int depth);
+
+// Write a call to an earlier function of the round
+static void write_call(Gen *gen, int depth) {
+    int callee = below(gen, gen->function);
+    emit(gen, "f%d_%d(", gen->round, callee);
+    for (int i = 0; i < gen->num_params[callee]; i++) {
+        if (i > 0) emit(gen, ", ");
+        write_expr(gen, depth - 1);
+    }
+    emit(gen, ")");
+}
+
+// Write an operand: a variable (as often as --reuse says), a call or a
+// constant
+static void write_leaf(Gen *gen, int depth) {
+    const char *name = some_local(gen);
+    if (name && chance(gen, gen->options->reuse)) {
+        emit(gen, "%s", name);
+    } else if (gen->function > 0 && depth > 0 && chance(gen, 10)) {
+        write_call(gen, depth);
+    } else {
+        emit(gen, "%d", below(gen, 100));
+    }
+}
+
+// Write an expression at most depth operators deep
+static void write_expr(Gen *gen, int depth) {
+    static const char *binary[] = { "+", "-", "*", "<", "<=", ">", ">=", "==", "!=", "&&", "||", "&", "|", "^" };
+    static const char *unary[] = { "-", "!", "~" };
+
+    if (depth <= 0 || chance(gen, 25)) {
+        write_leaf(gen, depth);
+        return;
+    }
+
+    int kind = below(gen, 10);
+    if (kind == 0) {
+        emit(gen, "%s(", unary[below(gen, 3)]);
+        write_expr(gen, depth - 1);
+        emit(gen, ")");
+    } else if (kind == 1) {
+        emit(gen, "(");
+        write_expr(gen, depth - 1);
+        emit(gen, " %s %d)", chance(gen, 50) ? "/" : "%", 1 + below(gen, 9));
+    } else {
+        emit(gen, "(");
+        write_expr(gen, depth - 1);
+        emit(gen, " %s ", binary[below(gen, (int)(sizeof(binary) / sizeof(binary[0])))]);
+        write_expr(gen, depth - 1);
+        emit(gen, ")");
+    }
+}
+
+// Write "int vN = expr;"; the variable is in scope only after it
+static void write_declaration(Gen *gen, int depth) {
+    char name[16];
+    snprintf(name, sizeof(name), "v%d", gen->next_name++);
+    emit(gen, "int %s = ", name);
+    write_expr(gen, depth);
+    emit(gen, ";\n");
+    add_local(gen, name);
+}
+
+static void write_block(Gen *gen, int level, int loop_depth);
+
+// Write one statement
+static void write_statement(Gen *gen, int level, int loop_depth) {
+    static const char *assign[] = { "=", "+=", "-=", "*=" };
+    int depth = gen->options->depth;
+    const char *name = some_local(gen);
+    int kind = below(gen, 10);
+
+    indent(gen, level);
+    if (kind < 4 && name && chance(gen, gen->options->reuse)) {
+        emit(gen, "%s %s ", name, assign[below(gen, 4)]);
+        write_expr(gen, depth);
+        emit(gen, ";\n");
+    } else if (kind < 6) {
+        write_declaration(gen, depth);
+    } else if (kind == 6 && level < 8) {
+        emit(gen, "if (");
+        write_expr(gen, depth);
+        emit(gen, ") {\n");
+        write_block(gen, level + 1, loop_depth);
+        if (chance(gen, 40)) {
+            indent(gen, level);
+            emit(gen, "} else {\n");
+            write_block(gen, level + 1, loop_depth);
+        }
+        indent(gen, level);
+        emit(gen, "}\n");
+    } else if (kind == 7 && loop_depth < gen->options->loops) {
+        // Counted loops, so generated programs finish when run
+        char counter[16];
+        snprintf(counter, sizeof(counter), "i%d", gen->next_name++);
+        int bound = 2 + below(gen, 7);
+        if (chance(gen, 50)) {
+            emit(gen, "for (int %s = 0; %s < %d; %s += 1) {\n", counter, counter, bound, counter);
+            write_block(gen, level + 1, loop_depth + 1);
+        } else {
+            emit(gen, "int %s = 0;\n", counter);
+            indent(gen, level);
+            emit(gen, "while (%s < %d) {\n", counter, bound);
+            write_block(gen, level + 1, loop_depth + 1);
+            indent(gen, level + 1);
+            emit(gen, "%s += 1;\n", counter);
+        }
+        indent(gen, level);
+        emit(gen, "}\n");
+    } else if (kind == 8 && gen->function > 0) {
+        write_call(gen, depth);
+        emit(gen, ";\n");
+    } else {
+        write_declaration(gen, 0);
+    }
+}
+
+// Write the statements of a block; its variables go out of scope after it
+static void write_block(Gen *gen, int level, int loop_depth) {
+    int scope = gen->num_locals;
+    int count = 1 + below(gen, gen->options->statements);
+    for (int i = 0; i < count; i++) write_statement(gen, level, loop_depth);
+    gen->num_locals = scope;
+}
+
+// Write function index of the current round
+static void write_function(Gen *gen, int index) {
+    gen->function = index;
+    gen->num_locals = 0;
+    gen->next_name = 0;
+
+    int params = gen->num_params[index];
+    emit(gen, "int f%d_%d(", gen->round, index);
+    if (params == 0) emit(gen, "void");
+    for (int i = 0; i < params; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "p%d", i);
+        add_local(gen, name);
+        emit(gen, "%sint p%d", i > 0 ? ", " : "", i);
+    }
+    emit(gen, ") {\n");
+
+    write_block(gen, 1, 0);
+    indent(gen, 1);
+    emit(gen, "return ");
+    write_expr(gen, gen->options->depth);
+    emit(gen, ";\n}\n\n");
+}
+
+// Write main, calling every function of the last round
+static void write_main(Gen *gen, int functions) {
+    emit(gen, "int main() {\n    int total = 0;\n");
+    for (int i = 0; i < functions; i++) {
+        emit(gen, "    total += f%d_%d(", gen->round, i);
+        for (int p = 0; p < gen->num_params[i]; p++) emit(gen, "%s%d", p > 0 ? ", " : "", p + 1);
+        emit(gen, ");\n");
+    }
+    emit(gen, "    return total;\n}\n");
+}
+
+// Parse a size such as 4096, 64K, 16M or 1G
+static bool parse_size(const char *text, uint64_t *size) {
+    char *end;
+    unsigned long long value = strtoull(text, &end, 10);
+    if (end == text) return false;
+
+    switch (*end) {
+        case 'K': case 'k': value <<= 10; end++; break;
+        case 'M': case 'm': value <<= 20; end++; break;
+        case 'G': case 'g': value <<= 30; end++; break;
+        default: break;
+    }
+    *size = value;
+    return *end == '\0';
+}
+
+// Parse a whole number option within [low, high]
+static bool parse_int(const char *text, int low, int high, int *value) {
+    char *end;
+    long parsed = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || parsed < low || parsed > high) return false;
+    *value = (int)parsed;
+    return true;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [options] > program.c\n"
+            "  --functions <n>   Functions per round (default: 16)\n"
+            "  --statements <n>  Statements per block, at most (default: 8)\n"
+            "  --depth <n>       Expression depth, at most (default: 3)\n"
+            "  --loops <n>       Loop nesting, at most (default: 2)\n"
+            "  --reuse <pct>     Percent of names that reuse a variable (default: 60)\n"
+            "  --size <bytes>    Write at least this much, e.g. 1K, 64M, 1G (default: one round)\n"
+            "  --seed <n>        Random seed (default: 1)\n",
+            program);
+}
+
+int main(int argc, char **argv) {
+    GenOptions options = { 16, 8, 3, 2, 60, 0, 1 };
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        bool ok = value != NULL;
+
+        if (ok && strcmp(arg, "--functions") == 0) {
+            ok = parse_int(value, 1, 1 << 20, &options.functions);
+        } else if (ok && strcmp(arg, "--statements") == 0) {
+            ok = parse_int(value, 1, 1000, &options.statements);
+        } else if (ok && strcmp(arg, "--depth") == 0) {
+            ok = parse_int(value, 0, 64, &options.depth);
+        } else if (ok && strcmp(arg, "--loops") == 0) {
+            ok = parse_int(value, 0, 16, &options.loops);
+        } else if (ok && strcmp(arg, "--reuse") == 0) {
+            ok = parse_int(value, 0, 100, &options.reuse);
+        } else if (ok && strcmp(arg, "--size") == 0) {
+            ok = parse_size(value, &options.size);
+        } else if (ok && strcmp(arg, "--seed") == 0) {
+            char *end;
+            options.seed = strtoull(value, &end, 10);
+            ok = *value != '\0' && *end == '\0';
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    Gen gen;
+    memset(&gen, 0, sizeof(gen));
+    gen.options = &options;
+    gen.out = stdout;
+    gen.rng = options.seed * 0x9E3779B97F4A7C15ULL + 1;
+    gen.num_params = (int*)malloc(sizeof(int) * (size_t)options.functions);
+    if (!gen.num_params) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        return 1;
+    }
+
+    // Rounds of functions until the size is reached; main calls the
+    // functions of the last one
+    int written = 0;
+    for (bool done = false; !done; gen.round++) {
+        for (int i = 0; i < options.functions; i++) gen.num_params[i] = below(&gen, MAX_PARAMS + 1);
+
+        written = 0;
+        while (written < options.functions && !(written > 0 && options.size && gen.written >= options.size)) {
+            write_function(&gen, written++);
+        }
+        done = !options.size || gen.written >= options.size;
+    }
+    gen.round--;
+    write_main(&gen, written);
+
+    free(gen.num_params);
+    if (fflush(stdout) != 0) {
+        fprintf(stderr, "Error: Could not write the program\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,847 @@
+// LALR(1) table generator for parser_lalr.c
+//
+// Reads a grammar description (see parser_lalr.grammar) and writes a header
+// holding the Symbol enum, the rule table and comb-compressed action and
+// goto tables. Built and run by hand, it is not part of the compiler:
+//
+//   gcc -O2 -o lalrgen tools/lalrgen.c
+//   ./lalrgen parser_lalr.grammar parser_lalr_tables.h
+//
+// The LR(0) automaton is built first, then LALR(1) lookaheads are
+// propagated over it until nothing changes. Shift/reduce conflicts are
+// resolved by shifting and must match the grammar's %expect count;
+// reduce/reduce conflicts are errors.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SYMBOLS 128
+#define MAX_TERMINALS 64    // Lookahead sets are 64-bit masks
+#define MAX_RULES 256
+#define MAX_RHS 16
+#define MAX_ACTIONS 64
+#define MAX_NAME 64
+
+// Lookahead set: bit t is terminal t
+typedef uint64_t TermSet;
+
+// Production rule
+typedef struct {
+    int lhs;
+    int rhs[MAX_RHS];
+    int length;
+    int action;
+    int first_item;       // Item ID of the rule with the dot at the start
+} Rule;
+
+// LR(0) state: its kernel items and transitions
+typedef struct {
+    int *kernel;          // Item IDs, sorted
+    TermSet *lookahead;   // Lookahead of each kernel item
+    int num_kernel;
+    int *next;            // Target state for each symbol, or -1
+} State;
+
+// Row or column of a parse table to be packed
+typedef struct {
+    int owner;            // Value stored in check for this vector's entries
+    int *keys;
+    int *values;
+    int count;
+    int base;
+} Vector;
+
+// Grammar
+static char symbol_names[MAX_SYMBOLS][MAX_NAME];
+static int num_symbols;
+static int num_terminals;
+static int start_symbol = -1;
+static Rule rules[MAX_RULES];
+static int num_rules;
+static char action_names[MAX_ACTIONS][MAX_NAME];
+static int num_actions;
+static int expected_conflicts;
+
+// Analysis
+static bool nullable[MAX_SYMBOLS];
+static TermSet first[MAX_SYMBOLS];
+static int num_items;
+static int *item_rule;
+static int *item_dot;
+
+// Automaton
+static State *states;
+static int num_states;
+static int states_capacity;
+
+// Print an error and exit
+static void fail(const char *message, const char *detail) {
+    if (detail) {
+        fprintf(stderr, "Error: %s '%s'\n", message, detail);
+    } else {
+        fprintf(stderr, "Error: %s\n", message);
+    }
+    exit(1);
+}
+
+// Allocate memory or exit
+static void* xcalloc(size_t count, size_t size) {
+    void *p = calloc(count ? count : 1, size);
+    if (!p) fail("Out of memory", NULL);
+    return p;
+}
+
+// Find a symbol by name, or -1
+static int find_symbol(const char *name) {
+    for (int i = 0; i < num_symbols; i++) {
+        if (strcmp(symbol_names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+// Add a symbol, returning its index
+static int add_symbol(const char *name) {
+    if (num_symbols >= MAX_SYMBOLS) fail("Too many symbols at", name);
+    if (strlen(name) >= MAX_NAME) fail("Symbol name too long:", name);
+    strcpy(symbol_names[num_symbols], name);
+    return num_symbols++;
+}
+
+// Find or add a semantic action by name; 0 is the implicit "pass"
+static int intern_action(const char *name) {
+    if (num_actions == 0) {
+        strcpy(action_names[num_actions++], "pass");
+    }
+    for (int i = 0; i < num_actions; i++) {
+        if (strcmp(action_names[i], name) == 0) return i;
+    }
+    if (num_actions >= MAX_ACTIONS) fail("Too many actions at", name);
+    if (strlen(name) >= MAX_NAME) fail("Action name too long:", name);
+    strcpy(action_names[num_actions], name);
+    return num_actions++;
+}
+
+// Read the whole grammar file into words. Comments run from '#' to the end
+// of the line.
+static char** read_words(const char *filename, int *num_words) {
+    FILE *file = fopen(filename, "r");
+    if (!file) fail("Could not open grammar file", filename);
+
+    int capacity = 1024;
+    char **words = (char**)xcalloc((size_t)capacity, sizeof(char*));
+    *num_words = 0;
+
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+
+        for (char *word = strtok(line, " \t\r\n"); word; word = strtok(NULL, " \t\r\n")) {
+            if (*num_words >= capacity) {
+                capacity *= 2;
+                words = (char**)realloc(words, sizeof(char*) * (size_t)capacity);
+                if (!words) fail("Out of memory", NULL);
+            }
+            words[(*num_words)++] = strdup(word);
+        }
+    }
+
+    fclose(file);
+    return words;
+}
+
+// Parse the grammar: %token and %expect directives, then rules of the form
+// "LHS : symbols @action | symbols @action ..."
+static void parse_grammar(const char *filename) {
+    int num_words;
+    char **words = read_words(filename, &num_words);
+    int i = 0;
+
+    // Directives
+    while (i < num_words && words[i][0] == '%') {
+        if (strcmp(words[i], "%token") == 0) {
+            for (i++; i < num_words && words[i][0] != '%' &&
+                      !(i + 1 < num_words && strcmp(words[i + 1], ":") == 0); i++) {
+                if (find_symbol(words[i]) >= 0) fail("Duplicate token", words[i]);
+                add_symbol(words[i]);
+            }
+        } else if (strcmp(words[i], "%expect") == 0 && i + 1 < num_words) {
+            expected_conflicts = atoi(words[i + 1]);
+            i += 2;
+        } else {
+            fail("Unknown directive", words[i]);
+        }
+    }
+
+    num_terminals = num_symbols;
+    if (num_terminals == 0 || strcmp(symbol_names[0], "EOF") != 0) {
+        fail("The first token must be EOF", NULL);
+    }
+    if (num_terminals > MAX_TERMINALS) fail("Too many terminals", NULL);
+
+    // Non-terminals are declared by their first rule
+    for (int j = 0; j + 1 < num_words; j++) {
+        if (strcmp(words[j + 1], ":") == 0 && find_symbol(words[j]) < 0) {
+            add_symbol(words[j]);
+        }
+    }
+    if (num_symbols == num_terminals) fail("Grammar has no rules", NULL);
+    start_symbol = num_terminals;
+
+    // Rule 0 is the augmented start rule, reduced only to accept
+    int accept_symbol = add_symbol("$accept");
+    rules[0].lhs = accept_symbol;
+    rules[0].rhs[0] = start_symbol;
+    rules[0].length = 1;
+    num_rules = 1;
+    intern_action("pass");
+
+    // Rules
+    int lhs = -1;
+    Rule *rule = NULL;
+    for (; i < num_words; i++) {
+        const char *word = words[i];
+
+        if (i + 1 < num_words && strcmp(words[i + 1], ":") == 0) {
+            lhs = find_symbol(word);
+            if (lhs < num_terminals) fail("Rule for a terminal", word);
+            i++;
+        } else if (strcmp(word, "|") != 0) {
+            if (!rule) fail("Symbol outside a rule:", word);
+            if (word[0] == '@') {
+                rule->action = intern_action(word + 1);
+                rule = NULL;
+                continue;
+            }
+
+            int symbol = find_symbol(word);
+            if (symbol < 0) fail("Unknown symbol", word);
+            if (rule->length >= MAX_RHS) fail("Rule too long at", word);
+            rule->rhs[rule->length++] = symbol;
+            continue;
+        } else if (lhs < 0) {
+            fail("'|' before the first rule", NULL);
+        }
+
+        // Start a new alternative
+        if (num_rules >= MAX_RULES) fail("Too many rules", NULL);
+        rule = &rules[num_rules++];
+        rule->lhs = lhs;
+        rule->length = 0;
+        rule->action = 0;
+    }
+
+    for (int j = 0; j < num_words; j++) {
+        free(words[j]);
+    }
+    free(words);
+
+    // Every non-terminal needs a rule
+    for (int s = num_terminals; s < num_symbols; s++) {
+        bool defined = false;
+        for (int r = 0; r < num_rules && !defined; r++) {
+            defined = rules[r].lhs == s;
+        }
+        if (!defined) fail("No rules for", symbol_names[s]);
+    }
+}
+
+// Compute nullable and FIRST sets by iterating to a fixed point
+static void compute_first(void) {
+    for (int t = 0; t < num_terminals; t++) {
+        first[t] = (TermSet)1 << t;
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int r = 0; r < num_rules; r++) {
+            Rule *rule = &rules[r];
+            TermSet set = first[rule->lhs];
+            bool all_nullable = true;
+
+            for (int k = 0; k < rule->length && all_nullable; k++) {
+                set |= first[rule->rhs[k]];
+                all_nullable = nullable[rule->rhs[k]];
+            }
+
+            if (set != first[rule->lhs]) {
+                first[rule->lhs] = set;
+                changed = true;
+            }
+            if (all_nullable && !nullable[rule->lhs]) {
+                nullable[rule->lhs] = true;
+                changed = true;
+            }
+        }
+    }
+}
+
+// FIRST of rhs[from..] of a rule; *all_nullable says whether it can be empty
+static TermSet first_of_suffix(const Rule *rule, int from, bool *all_nullable) {
+    TermSet set = 0;
+    *all_nullable = true;
+
+    for (int k = from; k < rule->length && *all_nullable; k++) {
+        set |= first[rule->rhs[k]];
+        *all_nullable = nullable[rule->rhs[k]];
+    }
+
+    return set;
+}
+
+// Number every (rule, dot) item
+static void number_items(void) {
+    num_items = 0;
+    for (int r = 0; r < num_rules; r++) {
+        rules[r].first_item = num_items;
+        num_items += rules[r].length + 1;
+    }
+
+    item_rule = (int*)xcalloc((size_t)num_items, sizeof(int));
+    item_dot = (int*)xcalloc((size_t)num_items, sizeof(int));
+    for (int r = 0; r < num_rules; r++) {
+        for (int d = 0; d <= rules[r].length; d++) {
+            item_rule[rules[r].first_item + d] = r;
+            item_dot[rules[r].first_item + d] = d;
+        }
+    }
+}
+
+// Symbol after the dot of an item, or -1 at the end
+static int item_next_symbol(int item) {
+    const Rule *rule = &rules[item_rule[item]];
+    int dot = item_dot[item];
+    return dot < rule->length ? rule->rhs[dot] : -1;
+}
+
+// Closure of a state's kernel with lookaheads. lookahead[item] receives
+// the set for every item in the closure and in_closure marks membership.
+// Returns the closure's items in *items.
+static int closure(const State *state, TermSet *lookahead, bool *in_closure, int *items) {
+    int count = 0;
+    memset(in_closure, 0, sizeof(bool) * (size_t)num_items);
+
+    for (int k = 0; k < state->num_kernel; k++) {
+        int item = state->kernel[k];
+        lookahead[item] = state->lookahead[k];
+        in_closure[item] = true;
+        items[count++] = item;
+    }
+
+    // Items are revisited whenever their lookahead grows
+    int *work = (int*)xcalloc((size_t)num_items, sizeof(int));
+    bool *queued = (bool*)xcalloc((size_t)num_items, sizeof(bool));
+    int work_size = 0;
+    for (int k = 0; k < count; k++) {
+        work[work_size++] = items[k];
+        queued[items[k]] = true;
+    }
+
+    while (work_size > 0) {
+        int item = work[--work_size];
+        queued[item] = false;
+
+        int symbol = item_next_symbol(item);
+        if (symbol < num_terminals) continue;
+
+        const Rule *rule = &rules[item_rule[item]];
+        bool rest_nullable;
+        TermSet set = first_of_suffix(rule, item_dot[item] + 1, &rest_nullable);
+        if (rest_nullable) set |= lookahead[item];
+
+        for (int r = 0; r < num_rules; r++) {
+            if (rules[r].lhs != symbol) continue;
+
+            int start = rules[r].first_item;
+            bool added = !in_closure[start];
+            if (added) {
+                in_closure[start] = true;
+                lookahead[start] = 0;
+                items[count++] = start;
+            }
+
+            TermSet merged = lookahead[start] | set;
+            if (added || merged != lookahead[start]) {
+                lookahead[start] = merged;
+                if (!queued[start]) {
+                    work[work_size++] = start;
+                    queued[start] = true;
+                }
+            }
+        }
+    }
+
+    free(work);
+    free(queued);
+    return count;
+}
+
+// Compare item IDs for qsort
+static int compare_ints(const void *a, const void *b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// Find the state with the given sorted kernel, adding it if it is new
+static int find_or_add_state(const int *kernel, int num_kernel) {
+    for (int s = 0; s < num_states; s++) {
+        if (states[s].num_kernel == num_kernel &&
+            memcmp(states[s].kernel, kernel, sizeof(int) * (size_t)num_kernel) == 0) {
+            return s;
+        }
+    }
+
+    if (num_states >= states_capacity) {
+        states_capacity = states_capacity ? states_capacity * 2 : 64;
+        states = (State*)realloc(states, sizeof(State) * (size_t)states_capacity);
+        if (!states) fail("Out of memory", NULL);
+    }
+
+    State *state = &states[num_states];
+    state->num_kernel = num_kernel;
+    state->kernel = (int*)xcalloc((size_t)num_kernel, sizeof(int));
+    memcpy(state->kernel, kernel, sizeof(int) * (size_t)num_kernel);
+    state->lookahead = (TermSet*)xcalloc((size_t)num_kernel, sizeof(TermSet));
+    state->next = (int*)xcalloc((size_t)num_symbols, sizeof(int));
+    for (int x = 0; x < num_symbols; x++) {
+        state->next[x] = -1;
+    }
+
+    return num_states++;
+}
+
+// Build the LR(0) automaton: states are discovered in breadth-first order
+static void build_states(void) {
+    TermSet *lookahead = (TermSet*)xcalloc((size_t)num_items, sizeof(TermSet));
+    bool *in_closure = (bool*)xcalloc((size_t)num_items, sizeof(bool));
+    int *items = (int*)xcalloc((size_t)num_items, sizeof(int));
+    int *kernel = (int*)xcalloc((size_t)num_items, sizeof(int));
+
+    int start = rules[0].first_item;
+    find_or_add_state(&start, 1);
+
+    for (int s = 0; s < num_states; s++) {
+        int count = closure(&states[s], lookahead, in_closure, items);
+
+        for (int x = 0; x < num_symbols; x++) {
+            int num_kernel = 0;
+            for (int k = 0; k < count; k++) {
+                if (item_next_symbol(items[k]) == x) {
+                    kernel[num_kernel++] = items[k] + 1;
+                }
+            }
+            if (num_kernel == 0) continue;
+
+            qsort(kernel, (size_t)num_kernel, sizeof(int), compare_ints);
+            int target = find_or_add_state(kernel, num_kernel);
+            states[s].next[x] = target;
+        }
+    }
+
+    free(lookahead);
+    free(in_closure);
+    free(items);
+    free(kernel);
+}
+
+// Index of an item in a state's kernel
+static int kernel_index(const State *state, int item) {
+    for (int k = 0; k < state->num_kernel; k++) {
+        if (state->kernel[k] == item) return k;
+    }
+    fail("Internal error: item missing from kernel", NULL);
+    return -1;
+}
+
+// Propagate lookaheads from each state's closure into its successors'
+// kernels until no set grows
+static void compute_lookaheads(void) {
+    TermSet *lookahead = (TermSet*)xcalloc((size_t)num_items, sizeof(TermSet));
+    bool *in_closure = (bool*)xcalloc((size_t)num_items, sizeof(bool));
+    int *items = (int*)xcalloc((size_t)num_items, sizeof(int));
+
+    states[0].lookahead[0] = (TermSet)1 << 0;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int s = 0; s < num_states; s++) {
+            int count = closure(&states[s], lookahead, in_closure, items);
+
+            for (int k = 0; k < count; k++) {
+                int symbol = item_next_symbol(items[k]);
+                if (symbol < 0) continue;
+
+                State *target = &states[states[s].next[symbol]];
+                int index = kernel_index(target, items[k] + 1);
+                TermSet merged = target->lookahead[index] | lookahead[items[k]];
+                if (merged != target->lookahead[index]) {
+                    target->lookahead[index] = merged;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    free(lookahead);
+    free(in_closure);
+    free(items);
+}
+
+// Action encoding in the tables: 0 is an error, a positive value shifts to
+// that state, a negative value reduces by rule -value and ACCEPT accepts.
+// State 0 is never the target of a shift and rule 0 is never reduced.
+#define ACCEPT INT16_MAX
+
+// Fill the full action and goto tables, resolving conflicts. A goto of 0
+// means none, since no transition leads back to the start state.
+static void build_tables(int *action, int *go_to) {
+    TermSet *lookahead = (TermSet*)xcalloc((size_t)num_items, sizeof(TermSet));
+    bool *in_closure = (bool*)xcalloc((size_t)num_items, sizeof(bool));
+    int *items = (int*)xcalloc((size_t)num_items, sizeof(int));
+    int num_nonterminals = num_symbols - num_terminals;
+    int shift_reduce = 0;
+    int reduce_reduce = 0;
+
+    for (int s = 0; s < num_states; s++) {
+        int *row = &action[s * num_terminals];
+
+        // Shifts
+        for (int t = 0; t < num_terminals; t++) {
+            row[t] = states[s].next[t] >= 0 ? states[s].next[t] : 0;
+        }
+        for (int n = 0; n < num_nonterminals; n++) {
+            int target = states[s].next[num_terminals + n];
+            go_to[s * num_nonterminals + n] = target >= 0 ? target : 0;
+        }
+
+        // Reductions
+        int count = closure(&states[s], lookahead, in_closure, items);
+        for (int k = 0; k < count; k++) {
+            if (item_next_symbol(items[k]) >= 0) continue;
+
+            int r = item_rule[items[k]];
+            for (int t = 0; t < num_terminals; t++) {
+                if (!(lookahead[items[k]] & ((TermSet)1 << t))) continue;
+
+                int value = r == 0 ? ACCEPT : -r;
+                if (row[t] == 0) {
+                    row[t] = value;
+                } else if (row[t] > 0 && row[t] != ACCEPT) {
+                    // Shift wins
+                    fprintf(stderr, "State %d: shift/reduce conflict on %s (rule %d), shifting\n",
+                            s, symbol_names[t], r);
+                    shift_reduce++;
+                } else {
+                    fprintf(stderr, "State %d: reduce/reduce conflict on %s (rules %d and %d)\n",
+                            s, symbol_names[t], -row[t], r);
+                    reduce_reduce++;
+                    if (-row[t] > r) row[t] = value;
+                }
+            }
+        }
+    }
+
+    free(lookahead);
+    free(in_closure);
+    free(items);
+
+    if (reduce_reduce > 0) fail("Grammar has reduce/reduce conflicts", NULL);
+    if (shift_reduce != expected_conflicts) {
+        fprintf(stderr, "Error: %d shift/reduce conflicts, expected %d\n",
+                shift_reduce, expected_conflicts);
+        exit(1);
+    }
+}
+
+// Most common non-zero value in a vector (the default entry), or zero.
+// With reductions_only only reductions are candidates.
+static int most_common(const int *values, int count, int stride, bool reductions_only) {
+    int best = 0;
+    int best_count = 0;
+
+    for (int i = 0; i < count; i++) {
+        int value = values[i * stride];
+        if (value == 0) continue;
+        if (reductions_only && (value > 0 || value == ACCEPT)) continue;
+
+        int n = 0;
+        for (int j = 0; j < count; j++) {
+            if (values[j * stride] == value) n++;
+        }
+        if (n > best_count) {
+            best = value;
+            best_count = n;
+        }
+    }
+
+    return best;
+}
+
+// Compare vectors by decreasing size, so dense ones are placed first
+static int compare_vectors(const void *a, const void *b) {
+    const Vector *x = *(const Vector* const*)a;
+    const Vector *y = *(const Vector* const*)b;
+    if (x->count != y->count) return y->count - x->count;
+    return x->owner - y->owner;
+}
+
+// Growable packed table
+static int *packed_value;
+static int *packed_check;
+static int packed_size;
+static int packed_capacity;
+
+// Make sure the packed table has at least size slots
+static void reserve_packed(int size) {
+    if (size <= packed_capacity) return;
+
+    int capacity = packed_capacity ? packed_capacity : 256;
+    while (capacity < size) capacity *= 2;
+
+    packed_value = (int*)realloc(packed_value, sizeof(int) * (size_t)capacity);
+    packed_check = (int*)realloc(packed_check, sizeof(int) * (size_t)capacity);
+    if (!packed_value || !packed_check) fail("Out of memory", NULL);
+
+    for (int i = packed_capacity; i < capacity; i++) {
+        packed_value[i] = 0;
+        packed_check[i] = -1;
+    }
+    packed_capacity = capacity;
+}
+
+// Place every vector at the lowest base where its entries land on free
+// slots (first-fit comb packing). Lookups then need no bounds check as
+// long as the table extends span slots past the highest base.
+static void pack_vectors(Vector **vectors, int count, int span) {
+    qsort(vectors, (size_t)count, sizeof(Vector*), compare_vectors);
+
+    for (int v = 0; v < count; v++) {
+        Vector *vector = vectors[v];
+        if (vector->count == 0) {
+            vector->base = 0;
+            continue;
+        }
+
+        for (int base = 0;; base++) {
+            reserve_packed(base + span);
+
+            bool fits = true;
+            for (int e = 0; e < vector->count && fits; e++) {
+                fits = packed_check[base + vector->keys[e]] == -1;
+            }
+            if (!fits) continue;
+
+            for (int e = 0; e < vector->count; e++) {
+                packed_value[base + vector->keys[e]] = vector->values[e];
+                packed_check[base + vector->keys[e]] = vector->owner;
+            }
+            vector->base = base;
+            break;
+        }
+    }
+
+    for (int v = 0; v < count; v++) {
+        if (vectors[v]->base + span > packed_size) {
+            packed_size = vectors[v]->base + span;
+        }
+    }
+}
+
+// Convert a name to upper case for an identifier
+static void upper(char *out, const char *name) {
+    for (; *name; name++) {
+        *out++ = (char)(*name >= 'a' && *name <= 'z' ? *name - 'a' + 'A' : *name);
+    }
+    *out = '\0';
+}
+
+// Write an int16 array in rows of twelve
+static void write_array(FILE *out, const char *type, const char *name, const int *values, int count) {
+    fprintf(out, "static const %s %s[%d] = {", type, name, count);
+    for (int i = 0; i < count; i++) {
+        if (i % 12 == 0) fprintf(out, "\n   ");
+        fprintf(out, " %d,", values[i]);
+    }
+    fprintf(out, "\n};\n\n");
+}
+
+// Write the generated header
+static void write_header(const char *grammar_file, const char *filename,
+                         const int *action_base, const int *action_default,
+                         const int *goto_base, const int *goto_default) {
+    FILE *out = fopen(filename, "w");
+    if (!out) fail("Could not create output file", filename);
+
+    int num_nonterminals = num_symbols - num_terminals - 1;  // Without $accept
+    int max_rhs = 0;
+    for (int r = 0; r < num_rules; r++) {
+        if (rules[r].length > max_rhs) max_rhs = rules[r].length;
+    }
+
+    fprintf(out, "// Generated by tools/lalrgen.c from %s. Do not edit.\n\n", grammar_file);
+    fprintf(out, "#ifndef PARSER_LALR_TABLES_H\n#define PARSER_LALR_TABLES_H\n\n");
+    fprintf(out, "#include <stdint.h>\n\n");
+
+    // Symbols
+    fprintf(out, "// Grammar symbols\ntypedef enum {\n    SYM_INVALID = -1,     // Token with no terminal\n");
+    for (int s = 0; s < num_symbols - 1; s++) {
+        if (s == 1) fprintf(out, "\n    // Terminals\n");
+        if (s == num_terminals) fprintf(out, "\n    // Non-terminals\n");
+        fprintf(out, "    SYM_%s%s,\n", symbol_names[s], s == 0 ? " = 0" : "");
+    }
+    fprintf(out, "} Symbol;\n\n");
+
+    // Actions
+    fprintf(out, "// Semantic action run when a rule is reduced\ntypedef enum {\n");
+    for (int a = 0; a < num_actions; a++) {
+        char name[MAX_NAME];
+        upper(name, action_names[a]);
+        fprintf(out, "    LALR_ACT_%s,\n", name);
+    }
+    fprintf(out, "} LALRActionKind;\n\n");
+
+    fprintf(out, "#define LALR_NUM_TERMINALS %d\n", num_terminals);
+    fprintf(out, "#define LALR_NUM_NONTERMINALS %d\n", num_nonterminals);
+    fprintf(out, "#define LALR_NUM_STATES %d\n", num_states);
+    fprintf(out, "#define LALR_NUM_RULES %d\n", num_rules);
+    fprintf(out, "#define LALR_MAX_RHS %d\n", max_rhs);
+    fprintf(out, "#define LALR_TABLE_SIZE %d\n\n", packed_size);
+
+    fprintf(out, "// Actions: 0 is an error, a positive value shifts to that state, a\n");
+    fprintf(out, "// negative value reduces by rule -value and LALR_ACCEPT accepts\n");
+    fprintf(out, "#define LALR_ACCEPT INT16_MAX\n\n");
+
+    // Rules
+    fprintf(out, "// Rules: left-hand side (SYM_x - LALR_NUM_TERMINALS), length and action.\n");
+    fprintf(out, "// Rule 0 is the augmented start rule and is never reduced.\n");
+    fprintf(out, "typedef struct {\n    uint8_t lhs;\n    uint8_t length;\n    uint8_t action;\n} LALRRule;\n\n");
+    fprintf(out, "static const LALRRule lalr_rules[LALR_NUM_RULES] = {\n");
+    for (int r = 0; r < num_rules; r++) {
+        char name[MAX_NAME];
+        upper(name, action_names[rules[r].action]);
+        int lhs = r == 0 ? 0 : rules[r].lhs - num_terminals;
+        fprintf(out, "    {%d, %d, LALR_ACT_%s}, //", lhs, rules[r].length, name);
+        fprintf(out, " %s ->", symbol_names[rules[r].lhs]);
+        for (int k = 0; k < rules[r].length; k++) {
+            fprintf(out, " %s", symbol_names[rules[r].rhs[k]]);
+        }
+        fprintf(out, "\n");
+    }
+    fprintf(out, "};\n\n");
+
+    // Tables
+    fprintf(out, "// Action for (state, terminal): lalr_table[base + terminal] when\n");
+    fprintf(out, "// lalr_check there is the state, otherwise the state's default\n");
+    write_array(out, "int16_t", "lalr_action_base", action_base, num_states);
+    write_array(out, "int16_t", "lalr_action_default", action_default, num_states);
+
+    fprintf(out, "// Goto for (state, non-terminal n): lalr_table[base + state] when\n");
+    fprintf(out, "// lalr_check there is LALR_NUM_STATES + n, otherwise n's default\n");
+    write_array(out, "int16_t", "lalr_goto_base", goto_base, num_nonterminals);
+    write_array(out, "int16_t", "lalr_goto_default", goto_default, num_nonterminals);
+
+    fprintf(out, "// Packed action and goto entries and the owner of each slot\n");
+    write_array(out, "int16_t", "lalr_table", packed_value, packed_size);
+    write_array(out, "int16_t", "lalr_check", packed_check, packed_size);
+
+    fprintf(out, "#endif // PARSER_LALR_TABLES_H\n");
+
+    if (fclose(out) != 0) fail("Could not write output file", filename);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <grammar> <output.h>\n", argv[0]);
+        return 1;
+    }
+
+    parse_grammar(argv[1]);
+    compute_first();
+    number_items();
+    build_states();
+    compute_lookaheads();
+
+    if (num_states >= INT16_MAX) fail("Too many states", NULL);
+
+    // Full tables; the augmented start symbol never needs a goto
+    int num_nonterminals = num_symbols - num_terminals - 1;
+    int *action = (int*)xcalloc((size_t)num_states * (size_t)num_terminals, sizeof(int));
+    int *go_to = (int*)xcalloc((size_t)num_states * (size_t)(num_nonterminals + 1), sizeof(int));
+    build_tables(action, go_to);
+
+    int *action_base = (int*)xcalloc((size_t)num_states, sizeof(int));
+    int *action_default = (int*)xcalloc((size_t)num_states, sizeof(int));
+    int *goto_base = (int*)xcalloc((size_t)num_nonterminals, sizeof(int));
+    int *goto_default = (int*)xcalloc((size_t)num_nonterminals, sizeof(int));
+
+    // Action rows: each state's most common reduction becomes its default,
+    // so only shifts and the other reductions are stored
+    int num_vectors = num_states + num_nonterminals;
+    Vector *vector_data = (Vector*)xcalloc((size_t)num_vectors, sizeof(Vector));
+    Vector **vectors = (Vector**)xcalloc((size_t)num_vectors, sizeof(Vector*));
+
+    for (int s = 0; s < num_states; s++) {
+        int *row = &action[s * num_terminals];
+        Vector *vector = &vector_data[s];
+        vector->owner = s;
+        vector->keys = (int*)xcalloc((size_t)num_terminals, sizeof(int));
+        vector->values = (int*)xcalloc((size_t)num_terminals, sizeof(int));
+
+        action_default[s] = most_common(row, num_terminals, 1, true);
+        for (int t = 0; t < num_terminals; t++) {
+            if (row[t] != 0 && row[t] != action_default[s]) {
+                vector->keys[vector->count] = t;
+                vector->values[vector->count++] = row[t];
+            }
+        }
+        vectors[s] = vector;
+    }
+    pack_vectors(vectors, num_states, num_terminals);
+
+    // Goto columns: each non-terminal's most common target is its default
+    int stride = num_nonterminals + 1;
+    for (int n = 0; n < num_nonterminals; n++) {
+        Vector *vector = &vector_data[num_states + n];
+        vector->owner = num_states + n;
+        vector->keys = (int*)xcalloc((size_t)num_states, sizeof(int));
+        vector->values = (int*)xcalloc((size_t)num_states, sizeof(int));
+
+        goto_default[n] = most_common(&go_to[n], num_states, stride, false);
+        for (int s = 0; s < num_states; s++) {
+            int target = go_to[s * stride + n];
+            if (target != 0 && target != goto_default[n]) {
+                vector->keys[vector->count] = s;
+                vector->values[vector->count++] = target;
+            }
+        }
+        vectors[n] = vector;
+    }
+    pack_vectors(vectors, num_nonterminals, num_states);
+
+    for (int s = 0; s < num_states; s++) {
+        action_base[s] = vector_data[s].base;
+    }
+    for (int n = 0; n < num_nonterminals; n++) {
+        goto_base[n] = vector_data[num_states + n].base;
+    }
+    if (packed_size >= INT16_MAX) fail("Packed table too large", NULL);
+
+    write_header(argv[1], argv[2], action_base, action_default, goto_base, goto_default);
+
+    int entries = 0;
+    for (int i = 0; i < packed_size; i++) {
+        if (packed_check[i] >= 0) entries++;
+    }
+    fprintf(stderr, "%d terminals, %d non-terminals, %d rules, %d states\n",
+            num_terminals, num_nonterminals, num_rules, num_states);
+    fprintf(stderr, "packed %d entries into %d slots (full tables: %d)\n",
+            entries, packed_size, num_states * (num_terminals + num_nonterminals));
+
+    return 0;
+}
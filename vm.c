@@ -0,0 +1,632 @@
+#include "vm.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Dispatch with computed gotos where the compiler has them; build with
+// -DVM_NO_COMPUTED_GOTO to force the switch loop
+#if defined(__GNUC__) && !defined(VM_NO_COMPUTED_GOTO)
+#define VM_THREADED 1
+#endif
+
+// State while encoding stack code
+typedef struct {
+    VMProgram *vm;
+    const IRProgram *ir;
+    const SymbolTable *symbols;
+    int *function_of;       // Function by name ID, -1 if none
+    int *slot;              // Slot of each location in slot_owner
+    int *slot_owner;        // Function a location's slot belongs to
+    long *label_at;         // Word each label is at, -1 until placed
+    size_t *fixups;         // Operand words holding a label number
+    size_t num_fixups;
+    size_t fixups_capacity;
+    bool failed;
+} VMLoader;
+
+// Grow an array to hold at least count + 1 items
+static bool grow(void **items, size_t *capacity, size_t count, size_t item_size) {
+    if (count < *capacity) return true;
+
+    size_t new_capacity = *capacity ? *capacity * 2 : 256;
+    void *new_items = realloc(*items, item_size * new_capacity);
+    if (!new_items) return false;
+
+    *items = new_items;
+    *capacity = new_capacity;
+    return true;
+}
+
+// Append one word
+static void emit_word(VMLoader *loader, int32_t word) {
+    VMProgram *vm = loader->vm;
+    if (!grow((void**)&vm->code, &vm->code_capacity, vm->num_code, sizeof(int32_t))) {
+        loader->failed = true;
+        return;
+    }
+    vm->code[vm->num_code++] = word;
+}
+
+// Append an instruction and its operand, if it has one
+static void emit(VMLoader *loader, VMOp op, long arg) {
+    emit_word(loader, (int32_t)op);
+    if (VM_HAS_ARG(op)) emit_word(loader, (int32_t)arg);
+}
+
+// Append a jump; its label is resolved once every label is placed
+static void emit_jump(VMLoader *loader, VMOp op, IROperand label) {
+    emit(loader, op, (long)label.value);
+    if (loader->failed) return;
+
+    if (!grow((void**)&loader->fixups, &loader->fixups_capacity, loader->num_fixups, sizeof(size_t))) {
+        loader->failed = true;
+        return;
+    }
+    loader->fixups[loader->num_fixups++] = loader->vm->num_code - 1;
+}
+
+// Append a push of an integer constant
+static void emit_constant(VMLoader *loader, int64_t value) {
+    VMProgram *vm = loader->vm;
+    if (!grow((void**)&vm->constants, &vm->constants_capacity, vm->num_constants, sizeof(int64_t))) {
+        loader->failed = true;
+        return;
+    }
+    vm->constants[vm->num_constants] = value;
+    emit(loader, VM_PUSH, (long)vm->num_constants++);
+}
+
+// Append a push of a constant or literal. Literals that are integers in
+// another base ("0x1F", "017") become constants; the rest can't be run.
+static void emit_push(VMLoader *loader, IROperand arg) {
+    if (arg.kind == IR_CONST) {
+        emit_constant(loader, arg.value);
+        return;
+    }
+
+    const char *text = ir_operand_name(loader->ir, arg);
+    char *end;
+    errno = 0;
+    long long value = text ? strtoll(text, &end, 0) : 0;
+    if (text && *text && *end == '\0' && errno == 0) {
+        emit_constant(loader, (int64_t)value);
+    } else {
+        emit(loader, VM_LITERAL, (long)arg.value);
+    }
+}
+
+// Add a function, defined once its FUNC is seen
+static int add_function(VMLoader *loader, IROperand name) {
+    VMProgram *vm = loader->vm;
+    size_t capacity = (size_t)vm->functions_capacity;
+    if (!grow((void**)&vm->functions, &capacity, (size_t)vm->num_functions, sizeof(VMFunction))) {
+        loader->failed = true;
+        return -1;
+    }
+    vm->functions_capacity = (int)capacity;
+
+    VMFunction *function = &vm->functions[vm->num_functions];
+    function->name = name;
+    function->entry = -1;
+    function->num_params = 0;
+    function->num_slots = 0;
+
+    loader->function_of[name.value] = vm->num_functions;
+    return vm->num_functions++;
+}
+
+// Frame slot of a variable or temporary in a function, or -1
+static int slot_for(VMLoader *loader, int function, IROperand operand) {
+    long loc = ir_location(loader->ir, operand);
+    if (loc < 0) return -1;
+
+    if (loader->slot_owner[loc] != function) {
+        loader->slot_owner[loc] = function;
+        loader->slot[loc] = loader->vm->functions[function].num_slots++;
+    }
+    return loader->slot[loc];
+}
+
+// Pop the arguments into the parameters at a function's entry. The first
+// argument is on top, as calls push them last to first.
+static void bind_params(VMLoader *loader, int function) {
+    VMFunction *vm_function = &loader->vm->functions[function];
+    if (!loader->symbols) return;
+
+    const char *name = ir_operand_name(loader->ir, vm_function->name);
+    const Symbol *symbol = symtab_get(loader->symbols, symtab_function(loader->symbols, name));
+    if (!symbol) return;
+
+    for (int i = 0; i < symbol->num_params; i++) {
+        const Symbol *param = symtab_get(loader->symbols, symbol->first_param + i);
+        int id = strtab_lookup(loader->ir->names, param->ir_name, strlen(param->ir_name));
+
+        // A parameter the code never uses has no name in the program
+        if (id < 0) {
+            emit(loader, VM_POP, 0);
+        } else {
+            IROperand var = { IR_VAR, id };
+            emit(loader, VM_STORE, slot_for(loader, function, var));
+        }
+    }
+    vm_function->num_params = symbol->num_params;
+}
+
+// Report a stack instruction that can't be encoded
+static bool load_error(VMLoader *loader, const char *message, IROperand arg) {
+    const char *name = ir_operand_name(loader->ir, arg);
+    fprintf(stderr, "Error: %s%s%s\n", message, name ? ": " : "", name ? name : "");
+    return false;
+}
+
+// Encode every stack instruction
+static bool encode(VMLoader *loader) {
+    const IRProgram *ir = loader->ir;
+    VMProgram *vm = loader->vm;
+
+    // Functions first, so calls can come before their callee
+    for (size_t i = 0; i < ir->num_stack; i++) {
+        const StackInsn *insn = &ir->stack[i];
+        if (insn->op == STACK_FUNC && insn->arg.kind == IR_FUNC &&
+            loader->function_of[insn->arg.value] < 0 && add_function(loader, insn->arg) < 0) {
+            return false;
+        }
+    }
+
+    int current = -1;
+    for (size_t i = 0; i < ir->num_stack && !loader->failed; i++) {
+        const StackInsn *insn = &ir->stack[i];
+        int slot;
+
+        if (current < 0 && insn->op != STACK_FUNC) {
+            return load_error(loader, "Stack code outside a function", ir_none());
+        }
+
+        switch (insn->op) {
+            case STACK_FUNC:
+                if (insn->arg.kind != IR_FUNC) return load_error(loader, "Bad function", insn->arg);
+                current = loader->function_of[insn->arg.value];
+                if (vm->functions[current].entry >= 0) {
+                    return load_error(loader, "Function defined twice", insn->arg);
+                }
+                vm->functions[current].entry = (long)vm->num_code;
+                bind_params(loader, current);
+                break;
+            case STACK_END_FUNC:
+                emit(loader, VM_RET0, 0);
+                current = -1;
+                break;
+            case STACK_LABEL:
+                if (insn->arg.kind != IR_LABEL || insn->arg.value >= ir->num_labels) {
+                    return load_error(loader, "Bad label", insn->arg);
+                }
+                loader->label_at[insn->arg.value] = (long)vm->num_code;
+                break;
+            case STACK_PUSH:
+                emit_push(loader, insn->arg);
+                break;
+            case STACK_LOAD:
+            case STACK_STORE:
+                slot = slot_for(loader, current, insn->arg);
+                if (slot < 0) return load_error(loader, "Bad variable", insn->arg);
+                emit(loader, insn->op == STACK_LOAD ? VM_LOAD : VM_STORE, slot);
+                break;
+            case STACK_JZ:
+            case STACK_JMP:
+                if (insn->arg.kind != IR_LABEL || insn->arg.value >= ir->num_labels) {
+                    return load_error(loader, "Bad label", insn->arg);
+                }
+                emit_jump(loader, insn->op == STACK_JZ ? VM_JZ : VM_JMP, insn->arg);
+                break;
+            case STACK_CALL:
+                if (insn->arg.kind != IR_FUNC) return load_error(loader, "Bad function", insn->arg);
+                if (loader->function_of[insn->arg.value] < 0 && add_function(loader, insn->arg) < 0) {
+                    return false;
+                }
+                emit(loader, VM_CALL, loader->function_of[insn->arg.value]);
+                break;
+            case STACK_POP:
+                emit(loader, VM_POP, 0);
+                break;
+            case STACK_RET:
+                emit(loader, VM_RET, 0);
+                break;
+            case STACK_RET0:
+                emit(loader, VM_RET0, 0);
+                break;
+            case STACK_OPCODE_COUNT:
+                break;
+            default:
+                // Operators map one to one
+                emit(loader, (VMOp)(VM_ADD + (insn->op - STACK_ADD)), 0);
+                break;
+        }
+    }
+
+    if (current >= 0) emit(loader, VM_RET0, 0);
+    if (loader->failed) return false;
+
+    for (size_t i = 0; i < loader->num_fixups; i++) {
+        int32_t *word = &vm->code[loader->fixups[i]];
+        if (loader->label_at[*word] < 0) {
+            return load_error(loader, "Jump to a missing label", ir_label(*word));
+        }
+        *word = (int32_t)loader->label_at[*word];
+    }
+
+    return true;
+}
+
+// Encode the stack code of a program. Parameters are taken from the
+// symbol table, since the stack code does not list them.
+VMProgram* vm_load(const IRProgram *ir, const SymbolTable *symbols) {
+    VMProgram *vm = (VMProgram*)calloc(1, sizeof(VMProgram));
+    if (!vm) return NULL;
+    vm->ir = ir;
+
+    size_t num_names = strtab_count(ir->names);
+    size_t num_locations = ir_num_locations(ir);
+    VMLoader loader = { vm, ir, symbols, NULL, NULL, NULL, NULL, NULL, 0, 0, false };
+    loader.function_of = (int*)malloc(sizeof(int) * (num_names + 1));
+    loader.slot = (int*)malloc(sizeof(int) * (num_locations + 1));
+    loader.slot_owner = (int*)malloc(sizeof(int) * (num_locations + 1));
+    loader.label_at = (long*)malloc(sizeof(long) * ((size_t)ir->num_labels + 1));
+
+    bool ok = loader.function_of && loader.slot && loader.slot_owner && loader.label_at;
+    if (ok) {
+        for (size_t i = 0; i < num_names; i++) loader.function_of[i] = -1;
+        for (size_t i = 0; i < num_locations; i++) loader.slot_owner[i] = -1;
+        for (int i = 0; i < ir->num_labels; i++) loader.label_at[i] = -1;
+        ok = encode(&loader);
+    }
+
+    free(loader.function_of);
+    free(loader.slot);
+    free(loader.slot_owner);
+    free(loader.label_at);
+    free(loader.fixups);
+
+    if (!ok) {
+        vm_free(vm);
+        return NULL;
+    }
+    return vm;
+}
+
+// Free encoded bytecode
+void vm_free(VMProgram *vm) {
+    if (!vm) return;
+    free(vm->code);
+    free(vm->constants);
+    free(vm->functions);
+    free(vm);
+}
+
+// Seconds on a monotonic clock
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Call frame
+typedef struct {
+    size_t return_pc;       // Word to continue at in the caller
+    size_t base;            // Operand stack height below the arguments
+    int64_t *locals;
+    int function;
+} VMFrame;
+
+// Memory of one run
+typedef struct {
+    int64_t *stack;
+    VMFrame *frames;
+    int64_t *locals;
+} VMMemory;
+
+#ifdef VM_THREADED
+// Directly threaded code: each opcode word is replaced by the address
+// of its handler
+typedef union {
+    const void *handler;
+    intptr_t arg;
+} VMCell;
+#define VM_CASE(op) do_##op
+#define VM_ARG ((long)ip[1].arg)
+#define VM_DISPATCH() do { executed++; goto *ip->handler; } while (0)
+#else
+typedef int32_t VMCell;
+#define VM_CASE(op) case op
+#define VM_ARG ((long)ip[1])
+#define VM_DISPATCH() continue
+#endif
+
+// Pop b, replace a with the result
+#define VM_BINARY(op, expr) \
+    VM_CASE(op): { \
+        int64_t b = *--sp; \
+        int64_t a = sp[-1]; \
+        sp[-1] = (expr); \
+        ip++; \
+        VM_DISPATCH(); \
+    }
+
+// Replace the top value
+#define VM_UNARY(op, expr) \
+    VM_CASE(op): { \
+        int64_t a = sp[-1]; \
+        sp[-1] = (expr); \
+        ip++; \
+        VM_DISPATCH(); \
+    }
+
+// Run a function to completion. Arithmetic wraps around like the
+// constant folder's; the one division it leaves alone, INT64_MIN / -1,
+// gives INT64_MIN (remainder 0), and dividing by zero stops the run.
+static bool execute(const VMProgram *vm, int entry, VMMemory *memory, VMResult *result) {
+    const VMCell *cells;
+    const char *error = NULL;
+    const VMFunction *error_function = &vm->functions[entry];
+    uint64_t executed = 0;
+
+#ifdef VM_THREADED
+    static const void *const handlers[VM_OPCODE_COUNT] = {
+        [VM_PUSH] = &&do_VM_PUSH, [VM_LOAD] = &&do_VM_LOAD, [VM_STORE] = &&do_VM_STORE,
+        [VM_JZ] = &&do_VM_JZ, [VM_JMP] = &&do_VM_JMP, [VM_LITERAL] = &&do_VM_LITERAL,
+        [VM_CALL] = &&do_VM_CALL, [VM_POP] = &&do_VM_POP,
+        [VM_ADD] = &&do_VM_ADD, [VM_SUB] = &&do_VM_SUB, [VM_MUL] = &&do_VM_MUL,
+        [VM_DIV] = &&do_VM_DIV, [VM_MOD] = &&do_VM_MOD,
+        [VM_EQ] = &&do_VM_EQ, [VM_NEQ] = &&do_VM_NEQ, [VM_LT] = &&do_VM_LT,
+        [VM_LTE] = &&do_VM_LTE, [VM_GT] = &&do_VM_GT, [VM_GTE] = &&do_VM_GTE,
+        [VM_AND] = &&do_VM_AND, [VM_OR] = &&do_VM_OR,
+        [VM_BAND] = &&do_VM_BAND, [VM_BOR] = &&do_VM_BOR, [VM_BXOR] = &&do_VM_BXOR,
+        [VM_NEG] = &&do_VM_NEG, [VM_NOT] = &&do_VM_NOT, [VM_BNOT] = &&do_VM_BNOT,
+        [VM_RET] = &&do_VM_RET, [VM_RET0] = &&do_VM_RET0
+    };
+
+    VMCell *threaded = (VMCell*)malloc(sizeof(VMCell) * (vm->num_code + 1));
+    if (!threaded) {
+        fprintf(stderr, "Error: Could not allocate threaded code\n");
+        return false;
+    }
+    for (size_t i = 0; i < vm->num_code; i++) {
+        VMOp op = (VMOp)vm->code[i];
+        threaded[i].handler = handlers[op];
+        if (VM_HAS_ARG(op)) {
+            i++;
+            threaded[i].arg = vm->code[i];
+        }
+    }
+    cells = threaded;
+#else
+    cells = vm->code;
+#endif
+
+    int64_t *const stack = memory->stack;
+    int64_t *const stack_end = stack + VM_STACK_SIZE;
+    int64_t *const locals_end = memory->locals + VM_MAX_LOCALS;
+    VMFrame *frame = memory->frames;
+    int64_t value = 0;
+
+    // The entry function's parameters start out as 0
+    const VMFunction *function = &vm->functions[entry];
+    int64_t *sp = stack;
+    for (int i = 0; i < function->num_params; i++) *sp++ = 0;
+
+    frame->return_pc = 0;
+    frame->base = 0;
+    frame->locals = memory->locals;
+    frame->function = entry;
+    memset(frame->locals, 0, sizeof(int64_t) * (size_t)function->num_slots);
+
+    int64_t *locals = frame->locals;
+    int64_t *locals_top = locals + function->num_slots;
+    const VMCell *ip = cells + function->entry;
+
+    double start = now_seconds();
+
+#ifdef VM_THREADED
+    VM_DISPATCH();
+#else
+    for (;;) {
+        executed++;
+        switch ((VMOp)*ip) {
+#endif
+
+    VM_CASE(VM_PUSH):
+        if (sp == stack_end) goto overflow;
+        *sp++ = vm->constants[VM_ARG];
+        ip += 2;
+        VM_DISPATCH();
+
+    VM_CASE(VM_LOAD):
+        if (sp == stack_end) goto overflow;
+        *sp++ = locals[VM_ARG];
+        ip += 2;
+        VM_DISPATCH();
+
+    VM_CASE(VM_STORE):
+        locals[VM_ARG] = *--sp;
+        ip += 2;
+        VM_DISPATCH();
+
+    VM_CASE(VM_JZ):
+        ip = *--sp == 0 ? cells + VM_ARG : ip + 2;
+        VM_DISPATCH();
+
+    VM_CASE(VM_JMP):
+        ip = cells + VM_ARG;
+        VM_DISPATCH();
+
+    VM_CASE(VM_LITERAL):
+        error_function = &vm->functions[frame->function];
+        error = "Value that is not an integer in";
+        goto fail;
+
+    VM_CASE(VM_CALL): {
+        const VMFunction *callee = &vm->functions[VM_ARG];
+        if (callee->entry < 0) {
+            error_function = callee;
+            error = "Call to undefined function";
+            goto fail;
+        }
+        if (frame + 1 == memory->frames + VM_MAX_FRAMES || locals_top + callee->num_slots > locals_end) {
+            goto overflow;
+        }
+        if ((size_t)(sp - stack) - frame->base < (size_t)callee->num_params) {
+            error_function = callee;
+            error = "Too few arguments in call to";
+            goto fail;
+        }
+
+        frame[1].return_pc = (size_t)(ip + 2 - cells);
+        frame++;
+        frame->base = (size_t)(sp - stack) - (size_t)callee->num_params;
+        frame->locals = locals = locals_top;
+        frame->function = (int)(callee - vm->functions);
+        memset(locals, 0, sizeof(int64_t) * (size_t)callee->num_slots);
+        locals_top += callee->num_slots;
+        ip = cells + callee->entry;
+        VM_DISPATCH();
+    }
+
+    VM_CASE(VM_POP):
+        sp--;
+        ip++;
+        VM_DISPATCH();
+
+    VM_BINARY(VM_ADD, (int64_t)((uint64_t)a + (uint64_t)b))
+    VM_BINARY(VM_SUB, (int64_t)((uint64_t)a - (uint64_t)b))
+    VM_BINARY(VM_MUL, (int64_t)((uint64_t)a * (uint64_t)b))
+
+    VM_CASE(VM_DIV):
+    VM_CASE(VM_MOD): {
+        int64_t b = *--sp;
+        int64_t a = sp[-1];
+        bool div = vm->code[ip - cells] == VM_DIV;
+        if (b == 0) {
+            error_function = &vm->functions[frame->function];
+            error = "Division by zero in";
+            goto fail;
+        }
+        if (a == INT64_MIN && b == -1) {
+            sp[-1] = div ? INT64_MIN : 0;
+        } else {
+            sp[-1] = div ? a / b : a % b;
+        }
+        ip++;
+        VM_DISPATCH();
+    }
+
+    VM_BINARY(VM_EQ, a == b)
+    VM_BINARY(VM_NEQ, a != b)
+    VM_BINARY(VM_LT, a < b)
+    VM_BINARY(VM_LTE, a <= b)
+    VM_BINARY(VM_GT, a > b)
+    VM_BINARY(VM_GTE, a >= b)
+    VM_BINARY(VM_AND, a != 0 && b != 0)
+    VM_BINARY(VM_OR, a != 0 || b != 0)
+    VM_BINARY(VM_BAND, a & b)
+    VM_BINARY(VM_BOR, a | b)
+    VM_BINARY(VM_BXOR, a ^ b)
+
+    VM_UNARY(VM_NEG, (int64_t)(0 - (uint64_t)a))
+    VM_UNARY(VM_NOT, a == 0)
+    VM_UNARY(VM_BNOT, ~a)
+
+    VM_CASE(VM_RET):
+        value = *--sp;
+        goto leave;
+
+    VM_CASE(VM_RET0):
+        value = 0;
+        goto leave;
+
+    leave:
+        // Drop what the callee left, then push its result for the caller
+        sp = stack + frame->base;
+        locals_top = frame->locals;
+        if (frame == memory->frames) goto done;
+        ip = cells + frame->return_pc;
+        frame--;
+        locals = frame->locals;
+        *sp++ = value;
+        VM_DISPATCH();
+
+#ifndef VM_THREADED
+        default:
+            error = "Invalid bytecode in";
+            goto fail;
+        }
+    }
+#endif
+
+overflow:
+    error_function = &vm->functions[frame->function];
+    error = "Stack overflow in";
+
+fail:
+    fprintf(stderr, "Error: %s %s\n", error, ir_operand_name(vm->ir, error_function->name));
+#ifdef VM_THREADED
+    free(threaded);
+#endif
+    return false;
+
+done:
+    result->seconds = now_seconds() - start;
+    result->value = value;
+    result->insns = executed;
+#ifdef VM_THREADED
+    result->threaded = true;
+    free(threaded);
+#else
+    result->threaded = false;
+#endif
+    return true;
+}
+
+// Run a program from its entry function
+bool vm_run(const VMProgram *vm, const char *entry, VMResult *result) {
+    int id = strtab_lookup(vm->ir->names, entry, strlen(entry));
+    int function = -1;
+    for (int i = 0; i < vm->num_functions && id >= 0; i++) {
+        if (vm->functions[i].name.value == id && vm->functions[i].entry >= 0) function = i;
+    }
+    if (function < 0) {
+        fprintf(stderr, "Error: No function %s to run\n", entry);
+        return false;
+    }
+    if (vm->functions[function].num_slots > VM_MAX_LOCALS) {
+        fprintf(stderr, "Error: Stack overflow in %s\n", entry);
+        return false;
+    }
+
+    VMMemory memory;
+    memory.stack = (int64_t*)malloc(sizeof(int64_t) * VM_STACK_SIZE);
+    memory.frames = (VMFrame*)malloc(sizeof(VMFrame) * VM_MAX_FRAMES);
+    memory.locals = (int64_t*)malloc(sizeof(int64_t) * VM_MAX_LOCALS);
+
+    bool ok = memory.stack && memory.frames && memory.locals;
+    if (!ok) {
+        fprintf(stderr, "Error: Could not allocate VM memory\n");
+    } else {
+        ok = execute(vm, function, &memory, result);
+    }
+
+    free(memory.stack);
+    free(memory.frames);
+    free(memory.locals);
+    return ok;
+}
+
+// Print what a run returned and how fast it went
+void vm_print_result(const VMProgram *vm, const VMResult *result, FILE *out) {
+    double rate = result->seconds > 0 ? (double)result->insns / result->seconds : 0;
+
+    fprintf(out, "Program returned %lld\n", (long long)result->value);
+    fprintf(out, "Executed %llu instructions in %.3f ms (%.1f million/s, %s dispatch, %zu bytecode words)\n",
+            (unsigned long long)result->insns, result->seconds * 1e3, rate / 1e6,
+            result->threaded ? "threaded" : "switch", vm->num_code);
+}
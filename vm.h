@@ -0,0 +1,92 @@
+#ifndef VM_H
+#define VM_H
+
+#include "common.h"
+#include "ir.h"
+#include "symtab.h"
+#include <stdint.h>
+
+// Limits of one run
+#define VM_STACK_SIZE   (1 << 16)   // Operand stack values
+#define VM_MAX_FRAMES   (1 << 16)   // Call depth
+#define VM_MAX_LOCALS   (1 << 20)   // Variable slots of all active frames
+
+// Bytecode instructions. The operators are in the same order as
+// STACK_ADD..STACK_BNOT. Instructions with an operand word are listed
+// up to VM_CALL.
+typedef enum {
+    VM_PUSH,        // Push constants[arg]
+    VM_LOAD,        // Push slot arg of the frame
+    VM_STORE,       // Pop into slot arg
+    VM_JZ,          // Pop and jump to word arg if zero
+    VM_JMP,         // Jump to word arg
+    VM_LITERAL,     // Push literal arg: a runtime error, it is not an integer
+    VM_CALL,        // Call functions[arg]
+    VM_POP,
+    VM_ADD,
+    VM_SUB,
+    VM_MUL,
+    VM_DIV,
+    VM_MOD,
+    VM_EQ,
+    VM_NEQ,
+    VM_LT,
+    VM_LTE,
+    VM_GT,
+    VM_GTE,
+    VM_AND,
+    VM_OR,
+    VM_BAND,
+    VM_BOR,
+    VM_BXOR,
+    VM_NEG,
+    VM_NOT,
+    VM_BNOT,
+    VM_RET,         // Return the top value
+    VM_RET0,        // Return 0
+    VM_OPCODE_COUNT
+} VMOp;
+
+#define VM_HAS_ARG(op) ((op) <= VM_CALL)
+
+// Function in the bytecode
+typedef struct {
+    IROperand name;
+    long entry;             // Word the body starts at, -1 if not defined
+    int num_params;
+    int num_slots;          // Parameters, variables and temporaries
+} VMFunction;
+
+// Stack code encoded as 32-bit words: an opcode, then its operand if it
+// has one. Labels are resolved to word offsets and each function's
+// variables and temporaries to frame slots.
+typedef struct {
+    const IRProgram *ir;    // Names for messages
+    int32_t *code;
+    size_t num_code;
+    size_t code_capacity;
+
+    int64_t *constants;
+    size_t num_constants;
+    size_t constants_capacity;
+
+    VMFunction *functions;
+    int num_functions;
+    int functions_capacity;
+} VMProgram;
+
+// Outcome of a run
+typedef struct {
+    int64_t value;          // What the entry function returned
+    uint64_t insns;         // Instructions executed
+    double seconds;
+    bool threaded;          // Dispatched with computed gotos
+} VMResult;
+
+// VM functions
+VMProgram* vm_load(const IRProgram *ir, const SymbolTable *symbols);
+void vm_free(VMProgram *vm);
+bool vm_run(const VMProgram *vm, const char *entry, VMResult *result);
+void vm_print_result(const VMProgram *vm, const VMResult *result, FILE *out);
+
+#endif // VM_H